@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <memory>
 #include <string>
@@ -15,23 +16,45 @@
 using std::string;
 using std::unique_ptr;
 
-bool ACPCServer::HandleRequest(NBSocketIO *socket_io) {
-  string request;
-  // I think it suffices to wait for only 1 second; since select() has fired data should be
-  // soon available on the socket.
-  if (! socket_io->ReadMessage(&request, 1)) {
-    // We don't want to spit out warning messages every time someone connects and then
-    // doesn't send data in the format we expect.  Monitoring services will do that,
-    // people will telnet, etc.
-    // Warning("Couldn't read string from socket\n");
-    // Use "null" as a generic failure response
-    socket_io->WriteMessage("null");
-    return false;
-  }
+class ACPCConnectionState : public ConnectionState {
+public:
+  ACPCConnectionState(void) {}
+  ~ACPCConnectionState(void) {}
+  HandSession *GetSession(void) {return &session_;}
+private:
+  HandSession session_;
+};
+
+ConnectionState *ACPCServer::CreateConnectionState(void) {
+  return new ACPCConnectionState;
+}
+
+void ACPCServer::HandleRequest(Connection *conn, const string &request, string *response) {
+  // Use "null" as a generic failure response
+  *response = "null";
   unique_ptr<MatchState> match_state(ParseACPCRequest(request, agent_.BigBlind(),
 						      agent_.StackSize()));
-  if (! match_state.get()) return false;
-  return true;
+  if (! match_state.get()) return;
+  HandSession *session = ((ACPCConnectionState *)conn->GetState())->GetSession();
+  if (match_state->Terminal()) {
+    // The hand is over
+    session->active = false;
+    return;
+  }
+  bool call, fold;
+  int bet_size;
+  if (! agent_.ProcessMatchStateInSession(*match_state, session, &call, &fold, &bet_size)) {
+    return;
+  }
+  char buf[100];
+  if (call) {
+    strcpy(buf, "c");
+  } else if (fold) {
+    strcpy(buf, "f");
+  } else {
+    sprintf(buf, "r%i", bet_size);
+  }
+  *response = request + ':' + buf;
 }
 
 ACPCServer::ACPCServer(int num_workers, int port, const Agent &agent):
@@ -2,17 +2,24 @@
 #define _ACPC_SERVER_H_
 
 #include <memory>
+#include <string>
 
 #include "agent.h"
 #include "server.h"
 
-class NBSocketIO;
+class Connection;
+class ConnectionState;
 
+// Serves ACPC match states.  Each request is a match state; the response is the match state
+// with our action appended (as a bot would send it to the dealer), or "null" if we have no
+// action to take.  Each connection gets its own HandSession, so a connection should carry one
+// match at a time; many matches can be played at once over separate connections.
 class ACPCServer : public Server {
  public:
   ACPCServer(int num_workers, int port, const Agent &agent);
   ~ACPCServer(void) {}
-  bool HandleRequest(NBSocketIO *socket_io);
+  void HandleRequest(Connection *conn, const std::string &request, std::string *response);
+  ConnectionState *CreateConnectionState(void);
  private:
   const Agent &agent_;
 };
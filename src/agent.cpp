@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "agent.h"
 #include "betting_abstraction.h"
@@ -12,67 +14,300 @@
 #include "buckets.h"
 #include "canonical.h"
 #include "card_abstraction.h"
+#include "canonical_cards.h"
 #include "cards.h"
+#include "cfr_config.h"
 #include "cfr_street_values.h"
 #include "cfr_values.h"
+#include "cfrd_eg_cfr.h"
+#include "combined_eg_cfr.h"
+#include "compiled_strategy.h"
 #include "constants.h"
 #include "disk_probs.h"
 #include "dynamic_cbr.h"
 #include "eg_cfr.h"
+#include "files.h"
 #include "game.h"
 #include "hand_tree.h"
+#include "hand_value_tree.h"
+#include "io.h"
+#include "latency_stats.h"
+#include "reach_probs.h"
+#include "subgame_store.h"
 #include "subgame_utils.h"
 #include "unsafe_eg_cfr.h"
 
+using std::pair;
+using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
+using std::vector;
+
+// The warm start gives the base strategy the weight of this many iterations of resolving
+static const double kWarmStartIts = 10.0;
+// Memory budget for the subgame store's cache of recently used resolves
+static const long long int kSubgameStoreCacheBytes = 1LL << 30;
 
 void Agent::Initialize(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
-		       int it, int big_blind, int seed) {
+		       int it, int big_blind, int seed, long long int disk_probs_cache_bytes) {
+  base_ca_ = &ca;
+  base_ba_ = &ba;
+  base_cc_ = &cc;
+  subgame_ca_ = nullptr;
   subgame_ba_ = nullptr;
-  srand48_r(seed, &rand_buf_);
+  subgame_cc_ = nullptr;
+  method_ = ResolvingMethod::UNSAFE;
+  // The RNG is reseeded with the hand number at the start of each hand (see StartSession()), so
+  // seed is unused.
   big_blind_ = big_blind;
   small_blind_ = big_blind / 2;
   // The stack size in the actual game
   stack_size_ = big_blind_ * ba.StackSize();
   translation_method_ = 0;
   resolve_st_ = -1;
-  int max_street = Game::MaxStreet();
-  boards_.reset(new int[max_street + 1]);
+  resolve_its_ = 0;
+  resolve_secs_ = 0;
+  num_resolve_threads_ = 1;
   buckets_.reset(new Buckets(ca, false));
   betting_trees_.reset(new BettingTrees(ba));
-  disk_probs_.reset(new DiskProbs(ca, ba, cc, *buckets_, betting_trees_->GetBettingTree(), it));
+  string compiled_filename = CompiledStrategy::Filename(ca, ba, cc, it);
+  if (FileExists(compiled_filename.c_str())) {
+    compiled_strategy_.reset(new CompiledStrategy(ca, ba, cc, *buckets_,
+						  betting_trees_->GetBettingTree(), it));
+  } else {
+    disk_probs_.reset(new DiskProbs(ca, ba, cc, *buckets_, betting_trees_->GetBettingTree(), it,
+				    disk_probs_cache_bytes));
+  }
+  session_.reset(new HandSession);
 }
 
 Agent::Agent(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
-	     int it, int big_blind, int seed) {
-  Initialize(ca, ba, cc, it, big_blind, seed);
+	     int it, int big_blind, int seed, long long int disk_probs_cache_bytes) {
+  Initialize(ca, ba, cc, it, big_blind, seed, disk_probs_cache_bytes);
 }
 
 Agent::Agent(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
 	     const CardAbstraction *subgame_ca, const BettingAbstraction *subgame_ba,
-	     const CFRConfig *subgame_cc, int it, int big_blind, int resolve_st, int seed) {
-  Initialize(ca, ba, cc, it, big_blind, seed);
+	     const CFRConfig *subgame_cc, ResolvingMethod method, int it, int big_blind,
+	     int resolve_st, int resolve_its, double resolve_secs, int num_resolve_threads,
+	     int seed, long long int disk_probs_cache_bytes) {
+  Initialize(ca, ba, cc, it, big_blind, seed, disk_probs_cache_bytes);
+  subgame_ca_ = subgame_ca;
   subgame_ba_ = subgame_ba;
+  subgame_cc_ = subgame_cc;
+  method_ = method;
   resolve_st_ = resolve_st;
-  if (resolve_st_ >= 0) {
-    dynamic_cbr_.reset(new DynamicCBR(ca, cc, *buckets_, 1));
-    subgame_buckets.reset(new Buckets(*subgame_ca, false));
-    // 1 thread
-    eg_cfr.reset(new UnsafeEGCFR(*subgame_ca, ca, ba, *subgame_cc, cc, *subgame_buckets, 1));
+  resolve_its_ = resolve_its;
+  resolve_secs_ = resolve_secs;
+  num_resolve_threads_ = num_resolve_threads;
+  if (resolve_st_ < 0) return;
+  if (resolve_st_ == 0 || resolve_st_ > Game::MaxStreet()) {
+    fprintf(stderr, "Can't resolve street %i\n", resolve_st_);
+    exit(-1);
+  }
+  if (method_ != ResolvingMethod::UNSAFE && method_ != ResolvingMethod::CFRD &&
+      method_ != ResolvingMethod::COMBINED) {
+    fprintf(stderr, "Agent doesn't support resolving method %s\n", ResolvingMethodName(method_));
+    exit(-1);
+  }
+  if (ba.Asymmetric()) {
+    fprintf(stderr, "Agent can't resolve with an asymmetric base betting abstraction\n");
+    exit(-1);
+  }
+  subgame_buckets_.reset(new Buckets(*subgame_ca, false));
+  for (int st = resolve_st_; st <= Game::MaxStreet(); ++st) {
+    if (! subgame_buckets_->None(st)) {
+      fprintf(stderr, "Resolving requires an unbucketed subgame card abstraction\n");
+      exit(-1);
+    }
+  }
+  // For the showdown values of the hand trees we resolve with
+  HandValueTree::Create();
+  // Mapping is nearly instantaneous and only touches the pages for the boards we resolve on.
+  base_sumprobs_.reset(new CFRValues(nullptr, nullptr, 0, 0, *buckets_,
+				     betting_trees_->GetBettingTree()));
+  char dir[500];
+  sprintf(dir, "%s/%s.%u.%s.%i.%i.%i.%s.%s", Files::OldCFRBase(), Game::GameName().c_str(),
+	  Game::NumPlayers(), ca.CardAbstractionName().c_str(), Game::NumRanks(),
+	  Game::NumSuits(), Game::MaxStreet(), ba.BettingAbstractionName().c_str(),
+	  cc.CFRConfigName().c_str());
+  base_sumprobs_->Map(dir, it, betting_trees_->GetBettingTree(), "x", -1, true);
+  subgame_store_.reset(new SubgameStore(ca, *subgame_ca, ba, *subgame_ba, cc, *subgame_cc,
+					method, 0, kSubgameStoreCacheBytes));
+}
+
+void Agent::StartSession(int hand_no, int we_p, HandSession *session) const {
+  session->active = true;
+  session->hand_no = hand_no;
+  session->we_p = we_p;
+  session->action = "";
+  session->node = betting_trees_->GetBettingTree()->Root();
+  session->raise_node = nullptr;
+  session->mapped_bet_to_closing_call = false;
+  session->actual_bet_to = big_blind_;
+  session->st = 0;
+  session->pa = 1;
+  session->call_ends_street = false;
+  session->hand_over = false;
+  // In our reconstruction of the action (inside ProcessAction()) we choose our actions
+  // randomly.  We need to be able to reconstruct the action of the hand and make the same
+  // choices each time.  For this to work, I need to seed the RNG here consistently.
+  srand48_r(hand_no, &session->rand_buf);
+  session->buckets_st = -1;
+  session->path.clear();
+  session->path_valid = true;
+  session->resolved.reset();
+  if (! session->buckets) {
+    int max_street = Game::MaxStreet();
+    session->boards.reset(new int[max_street + 1]);
+    session->buckets.reset(new int[max_street + 1]);
+  }
+}
+
+// Finds the board of street st that the resolved subgame uses for the actual cards, and our hole
+// cards in the same suit frame.  The resolved subgame's boards extend the canonical board we
+// resolved on, which isn't necessarily the canonical form of the later streets' actual cards,
+// so we search for a suit permutation mapping the actual board onto one of them.
+void Agent::FindResolvedHand(const HandSession *session, int st, int *gbd,
+			     Card *hole_cards) const {
+  int root_bd = session->resolved->root_bd;
+  const Card *root_board = BoardTree::Board(resolve_st_, root_bd);
+  int num_suits = Game::NumSuits();
+  int num_board_cards = Game::NumBoardCards(st);
+  int start_gbd = st == resolve_st_ ? root_bd : BoardTree::SuccBoardBegin(resolve_st_, root_bd, st);
+  int end_gbd = st == resolve_st_ ? root_bd + 1 : BoardTree::SuccBoardEnd(resolve_st_, root_bd, st);
+  int perm[4] = {0, 1, 2, 3};
+  Card mapped[5], sorted_mapped[5], sorted_board[5];
+  do {
+    for (int i = 0; i < num_board_cards; ++i) {
+      Card c = session->raw_board[i];
+      mapped[i] = MakeCard(Rank(c), perm[Suit(c)]);
+    }
+    // The board tree doesn't order the cards within a street, so compare each street as a set
+    for (int i = 0; i < num_board_cards; ++i) sorted_mapped[i] = mapped[i];
+    for (int st1 = 1; st1 <= st; ++st1) {
+      std::sort(sorted_mapped + Game::NumBoardCards(st1 - 1),
+		sorted_mapped + Game::NumBoardCards(st1));
+    }
+    bool prefix_matches = true;
+    for (int st1 = 1; st1 <= resolve_st_ && prefix_matches; ++st1) {
+      for (int i = Game::NumBoardCards(st1 - 1); i < Game::NumBoardCards(st1); ++i) {
+	sorted_board[i] = root_board[i];
+      }
+      std::sort(sorted_board + Game::NumBoardCards(st1 - 1),
+		sorted_board + Game::NumBoardCards(st1));
+      for (int i = Game::NumBoardCards(st1 - 1); i < Game::NumBoardCards(st1); ++i) {
+	if (sorted_board[i] != sorted_mapped[i]) prefix_matches = false;
+      }
+    }
+    if (! prefix_matches) continue;
+    for (int bd = start_gbd; bd < end_gbd; ++bd) {
+      const Card *board = BoardTree::Board(st, bd);
+      for (int i = 0; i < num_board_cards; ++i) sorted_board[i] = board[i];
+      bool matches = true;
+      for (int st1 = resolve_st_ + 1; st1 <= st && matches; ++st1) {
+	int begin = Game::NumBoardCards(st1 - 1), end = Game::NumBoardCards(st1);
+	std::sort(sorted_board + begin, sorted_board + end);
+	for (int i = begin; i < end; ++i) {
+	  if (sorted_board[i] != sorted_mapped[i]) matches = false;
+	}
+      }
+      if (! matches) continue;
+      *gbd = bd;
+      Card c0 = MakeCard(Rank(session->raw_hole_cards[0]), perm[Suit(session->raw_hole_cards[0])]);
+      Card c1 = MakeCard(Rank(session->raw_hole_cards[1]), perm[Suit(session->raw_hole_cards[1])]);
+      hole_cards[0] = c0 > c1 ? c0 : c1;
+      hole_cards[1] = c0 > c1 ? c1 : c0;
+      return;
+    }
+  } while (std::next_permutation(perm, perm + num_suits));
+  fprintf(stderr, "Couldn't find the resolved board for street %i\n", st);
+  exit(-1);
+}
+
+void Agent::ResolvedProbs(Node *node, const HandSession *session, double *probs) const {
+  int num_succs = node->NumSuccs();
+  if (num_succs == 1) {
+    probs[0] = 1.0;
+    return;
+  }
+  int st = node->Street();
+  int gbd;
+  Card hole_cards[2];
+  FindResolvedHand(session, st, &gbd, hole_cards);
+  const ResolvedSubgame *resolved = session->resolved.get();
+  int num_hole_card_pairs = Game::NumHoleCardPairs(st);
+  // On the final street the hand tree orders the hands by strength, so look ours up
+  const CanonicalCards *hands = resolved->hand_tree->Hands(st, gbd);
+  int i;
+  for (i = 0; i < num_hole_card_pairs; ++i) {
+    const Card *cards = hands->Cards(i);
+    if (cards[0] == hole_cards[0] && cards[1] == hole_cards[1]) break;
+  }
+  if (i == num_hole_card_pairs) {
+    fprintf(stderr, "Hole cards not found in resolved hand tree\n");
+    exit(-1);
+  }
+  int lbd = BoardTree::LocalIndex(resolve_st_, resolved->root_bd, st, gbd);
+  int offset = lbd * num_hole_card_pairs * num_succs + i * num_succs;
+  resolved->sumprobs->RMProbs(st, node->PlayerActing(), node->NonterminalID(), offset,
+			      num_succs, node->DefaultSuccIndex(), probs);
+}
+
+void Agent::Probs(Node *node, const HandSession *session, double *probs) const {
+  if (session->resolved) {
+    ResolvedProbs(node, session, probs);
+    return;
+  }
+  int p = node->PlayerActing();
+  int st = node->Street();
+  int nt = node->NonterminalID();
+  int b = session->buckets[st];
+  if (compiled_strategy_) {
+    compiled_strategy_->Probs(p, st, nt, b, node->NumSuccs(), probs);
+  } else {
+    disk_probs_->Probs(p, st, nt, b, node->NumSuccs(), probs);
+  }
+}
+
+// Returns the succ chosen by the random number r.  With a compiled strategy this is a single
+// lookup in a table of cumulative probabilities.
+int Agent::SampleSucc(Node *node, const HandSession *session, double r) const {
+  int num_succs = node->NumSuccs();
+  if (compiled_strategy_ && ! session->resolved) {
+    return compiled_strategy_->Sample(node->PlayerActing(), node->Street(),
+				      node->NonterminalID(), session->buckets[node->Street()],
+				      num_succs, r);
+  }
+  unique_ptr<double []> probs(new double[num_succs]);
+  Probs(node, session, probs.get());
+  double cum = 0;
+  int s;
+  for (s = 0; s < num_succs - 1; ++s) {
+    cum += probs[s];
+    if (r < cum) break;
   }
+  return s;
+}
+
+void Agent::EndHand(int hand_no) {
+  if (session_->active && session_->hand_no == hand_no) session_->active = false;
 }
 
+// Only computes the buckets for streets the session hasn't reached yet.
 void Agent::SetBuckets(int st, const Card *raw_board, const Card *raw_hole_cards,
-		       int *buckets) {
+		       HandSession *session) const {
   int num_hole_cards = Game::NumCardsForStreet(0);
   int num_board_cards = Game::NumBoardCards(st);
+  for (int i = 0; i < num_board_cards; ++i) session->raw_board[i] = raw_board[i];
+  for (int i = 0; i < num_hole_cards; ++i) session->raw_hole_cards[i] = raw_hole_cards[i];
+  if (st <= session->buckets_st) return;
   Card canon_board[5];
   Card canon_hole_cards[2];
   CanonicalizeCards(raw_board, raw_hole_cards, st, canon_board, canon_hole_cards);
-  for (int st1 = 0; st1 <= st; ++st1) {
+  for (int st1 = session->buckets_st + 1; st1 <= st; ++st1) {
     int bd = BoardTree::LookupBoard(canon_board, st1);
-    boards_[st1] = bd;
+    session->boards[st1] = bd;
     Card canon_cards[7];
     for (int i = 0; i < num_board_cards; ++i) {
       canon_cards[num_hole_cards + i] = canon_board[i];
@@ -84,30 +319,21 @@ void Agent::SetBuckets(int st, const Card *raw_board, const Card *raw_hole_cards
     int num_hole_card_pairs = Game::NumHoleCardPairs(st1);
     // What about final street?
     unsigned int h = ((unsigned int)bd) * ((unsigned int)num_hole_card_pairs) + raw_hcp;
-    buckets[st1] = buckets_->Bucket(st1, h);
+    session->buckets[st1] = buckets_->Bucket(st1, h);
   }
+  session->buckets_st = st;
 }
 
-Node *Agent::ChooseOurActionWithRaiseNode(Node *node, Node *raise_node, const int *buckets,
-					  bool mapped_bet_to_closing_call) {
+Node *Agent::ChooseOurActionWithRaiseNode(Node *node, Node *raise_node, const HandSession *session,
+					  bool mapped_bet_to_closing_call,
+					  struct drand48_data *rand_buf) const {
   fprintf(stderr, "ChooseOurActionWithRaiseNode\n");
-  int raise_nt = raise_node->NonterminalID();
-  int pa = raise_node->PlayerActing();
   double r;
-  drand48_r(&rand_buf_, &r);
+  drand48_r(rand_buf, &r);
   int num_raise_node_succs = raise_node->NumSuccs();
   if (num_raise_node_succs > 0) {
     // Choose a response from the raise node's
-    int st = raise_node->Street();
-    int b = buckets[st];
-    unique_ptr<double []> raise_node_probs(new double[num_raise_node_succs]);
-    disk_probs_->Probs(pa, st, raise_nt, b, num_raise_node_succs, raise_node_probs.get());
-    double cum = 0;
-    int s;
-    for (s = 0; s < num_raise_node_succs - 1; ++s) {
-      cum += raise_node_probs[s];
-      if (r < cum) break;
-    }
+    int s = SampleSucc(raise_node, session, r);
     if (s != raise_node->CallSuccIndex() && s != raise_node->FoldSuccIndex()) {
       return raise_node->IthSucc(s);
     }
@@ -124,18 +350,15 @@ Node *Agent::ChooseOurActionWithRaiseNode(Node *node, Node *raise_node, const in
   if (fsi == -1) {
     return node->IthSucc(csi);
   }
-  int st = node->Street();
-  int b = buckets[st];
-  int nt = node->NonterminalID();
   int num_succs = node->NumSuccs();
   unique_ptr<double []> probs(new double[num_succs]);
-  disk_probs_->Probs(pa, st, nt, b, num_succs, probs.get());
+  Probs(node, session, probs.get());
   double call_prob = probs[csi];
   double fold_prob = probs[fsi];
   // How much to scale up the call and fold probs so that the scaled-up versions sum to 1.0.
   double scaling = 1.0 / (call_prob + fold_prob);
   // Do I need to draw a new random number?
-  drand48_r(&rand_buf_, &r);
+  drand48_r(rand_buf, &r);
   if (r < call_prob * scaling) {
     return node->IthSucc(csi);
   } else {
@@ -143,7 +366,8 @@ Node *Agent::ChooseOurActionWithRaiseNode(Node *node, Node *raise_node, const in
   }
 }
 
-Node *Agent::ChooseOurAction(Node *node, const int *buckets, bool mapped_bet_to_closing_call) {
+Node *Agent::ChooseOurAction(Node *node, const HandSession *session,
+			     bool mapped_bet_to_closing_call, struct drand48_data *rand_buf) const {
   fprintf(stderr, "ChooseOurAction simple\n");
   if (mapped_bet_to_closing_call) {
     fprintf(stderr, "ChooseOurAction simple mbtcc\n");
@@ -154,22 +378,10 @@ Node *Agent::ChooseOurAction(Node *node, const int *buckets, bool mapped_bet_to_
     // This is the case where we mapped an opponent's bet to a call.
     return node;
   }
-  int st = node->Street();
-  int b = buckets[st];
-  int nt = node->NonterminalID();
-  int pa = node->PlayerActing();
-  int num_succs = node->NumSuccs();
-  unique_ptr<double []> probs(new double[num_succs]);
-  disk_probs_->Probs(pa, st, nt, b, num_succs, probs.get());
   double r;
-  drand48_r(&rand_buf_, &r);
-  double cum = 0;
-  int s = 0;
-  for (s = 0; s < num_succs - 1; ++s) {
-    cum += probs[s];
-    if (r < cum) break;
-  }
-  fprintf(stderr, "ChooseOurAction: chose succ %i r %f cum %f\n", s, r, cum);
+  drand48_r(rand_buf, &r);
+  int s = SampleSucc(node, session, r);
+  fprintf(stderr, "ChooseOurAction: chose succ %i r %f\n", s, r);
   Node *ret = node->IthSucc(s);
   fprintf(stderr, "  ret st %i pa %i nt %i\n", ret->Street(), ret->PlayerActing(),
 	  ret->NonterminalID());
@@ -177,19 +389,20 @@ Node *Agent::ChooseOurAction(Node *node, const int *buckets, bool mapped_bet_to_
 }
 
 // Assume SetBuckets() has been called.
-Node *Agent::ChooseOurAction(Node *node, Node *raise_node, const int *buckets,
-			     bool mapped_bet_to_closing_call) {
+Node *Agent::ChooseOurAction(Node *node, Node *raise_node, const HandSession *session,
+			     bool mapped_bet_to_closing_call, struct drand48_data *rand_buf) const {
   if (raise_node) {
-    return ChooseOurActionWithRaiseNode(node, raise_node, buckets, mapped_bet_to_closing_call);
+    return ChooseOurActionWithRaiseNode(node, raise_node, session, mapped_bet_to_closing_call,
+					rand_buf);
   } else {
-    return ChooseOurAction(node, buckets, mapped_bet_to_closing_call);
+    return ChooseOurAction(node, session, mapped_bet_to_closing_call, rand_buf);
   }
 }
 
 // In order to do translation, find the two succs that most closely match
 // the current action.
 void Agent::GetTwoClosestSuccs(Node *node, int actual_bet_to, int *below_succ, int *below_bet_to,
-			       int *above_succ, int *above_bet_to) {
+			       int *above_succ, int *above_bet_to) const {
   int num_succs = node->NumSuccs();
   // Want to find closest bet below and closest bet above
   int fsi = node->FoldSuccIndex();
@@ -220,7 +433,7 @@ void Agent::GetTwoClosestSuccs(Node *node, int actual_bet_to, int *below_succ, i
 }
 
 double Agent::BelowProb(int actual_bet_to, int below_bet_to, int above_bet_to,
-			int actual_pot_size) {
+			int actual_pot_size) const {
   double below_prob;
   if (translation_method_ == 0 || translation_method_ == 1) {
     // Express bet sizes as fraction of pot
@@ -257,7 +470,8 @@ double Agent::BelowProb(int actual_bet_to, int below_bet_to, int above_bet_to,
 
 // At least one of below_succ and above_succ is not -1.
 int Agent::ChooseBetweenBetAndCall(Node *node, int below_succ, int above_succ, int actual_bet_to,
-				   int actual_pot_size, Node **raise_node) {
+				   int actual_pot_size, Node **raise_node,
+				   struct drand48_data *rand_buf) const {
   int selected_succ = -1;
   *raise_node = nullptr;
 
@@ -294,7 +508,7 @@ int Agent::ChooseBetweenBetAndCall(Node *node, int below_succ, int above_succ, i
     double below_prob = BelowProb(actual_bet_to, below_bet_to, above_bet_to, actual_pot_size);
     double r;
     // drand48_r(&rand_bufs_[node->PlayerActing()], &r);
-    drand48_r(&rand_buf_, &r);
+    drand48_r(rand_buf, &r);
     if (r < below_prob) {
       selected_succ = below_succ;
     } else {
@@ -309,7 +523,7 @@ int Agent::ChooseBetweenBetAndCall(Node *node, int below_succ, int above_succ, i
 }
 
 int Agent::ChooseBetweenTwoBets(Node *node, int below_succ, int above_succ, int actual_bet_to,
-				int actual_pot_size) {
+				int actual_pot_size, struct drand48_data *rand_buf) const {
   if (above_succ == -1) {
     // Can happen if we do not have all-ins in our betting abstraction
     return below_succ;
@@ -326,7 +540,7 @@ int Agent::ChooseBetweenTwoBets(Node *node, int below_succ, int above_succ, int
     double r;
     // Do I need a separate rand_buf_ for each player?
     // drand48_r(&rand_bufs_[node->PlayerActing()], &r);
-    drand48_r(&rand_buf_, &r);
+    drand48_r(rand_buf, &r);
     if (r < below_prob) {
       return below_succ;
     } else {
@@ -338,28 +552,34 @@ int Agent::ChooseBetweenTwoBets(Node *node, int below_succ, int above_succ, int
 // Map the opponent's actual bet to an action in our abstraction.  We may map a bet to a
 // check/call.
 int Agent::ChooseOppAction(Node *node, int below_succ, int above_succ, int actual_bet_to,
-			   int actual_pot_size, Node **raise_node) {
+			   int actual_pot_size, Node **raise_node,
+			   struct drand48_data *rand_buf) const {
   int call_succ = node->CallSuccIndex();
   if (below_succ == call_succ || above_succ == call_succ) {
     return ChooseBetweenBetAndCall(node, below_succ, above_succ, actual_bet_to, actual_pot_size,
-				   raise_node);
+				   raise_node, rand_buf);
   } else {
     *raise_node = nullptr;
-    return ChooseBetweenTwoBets(node, below_succ, above_succ, actual_bet_to, actual_pot_size);
+    return ChooseBetweenTwoBets(node, below_succ, above_succ, actual_bet_to, actual_pot_size,
+				rand_buf);
   }
 }
 
-Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, Node **raise_node,
-			   bool *mapped_bet_to_closing_call) {
-  Node *node = betting_trees_->GetBettingTree()->Root();
+// Processes the actions in action beyond the prefix that the session has already processed.
+// The session holds the parse state (and RNG state) that processing the prefix left behind, so
+// the result is the same as processing the whole action string from the root.
+Node *Agent::ProcessAction(const string &action, HandSession *session,
+			   struct drand48_data *rand_buf) const {
+  int we_p = session->we_p;
+  Node *&node = session->node;
+  Node **raise_node = &session->raise_node;
+  bool *mapped_bet_to_closing_call = &session->mapped_bet_to_closing_call;
+  int &actual_bet_to = session->actual_bet_to;
+  int &st = session->st;
+  int &pa = session->pa;
+  bool &call_ends_street = session->call_ends_street;
   int len = action.size();
-  int actual_bet_to = big_blind_;
-  int st = 0;
-  int pa = 1;
-  bool call_ends_street = false;
-  *raise_node = nullptr;
-  *mapped_bet_to_closing_call = false;
-  int i = 0;
+  int i = session->action.size();
   fprintf(stderr, "ProcessAction %s\n", action.c_str());
   while (i < len) {
     fprintf(stderr, "aaa1 %s %i %s\n", action.c_str(), i, action.c_str() + i);
@@ -379,6 +599,7 @@ Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, N
       // consume the "c" and move on.
       if (! *mapped_bet_to_closing_call) {
 	int csi = node->CallSuccIndex();
+	RecordTransition(node, node->IthSucc(csi), session);
 	node = node->IthSucc(csi);
       }
       ++i;
@@ -387,7 +608,11 @@ Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, N
 	fprintf(stderr, "i %i st advancing\n", i);
 	pa = 0;
 	call_ends_street = false;
-	if (st == 4) break;
+	if (st == 4) {
+	  session->hand_over = true;
+	  break;
+	}
+	if (st == resolve_st_ && node->Street() == st) node = Resolve(node, session);
       } else {
 	call_ends_street = true;
 	pa = pa^1;
@@ -400,6 +625,7 @@ Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, N
       ++i;
       *raise_node = nullptr;
       *mapped_bet_to_closing_call = false;
+      session->hand_over = true;
       break;
     } else if (c == 'r') {
       ++i;
@@ -415,7 +641,10 @@ Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, N
 
       if (pa == we_p) {
 	fprintf(stderr, "Our action\n");
-	node = ChooseOurAction(node, *raise_node, buckets, *mapped_bet_to_closing_call);
+	Node *succ = ChooseOurAction(node, *raise_node, session, *mapped_bet_to_closing_call,
+				     rand_buf);
+	RecordTransition(node, succ, session);
+	node = succ;
 	*raise_node = nullptr;
 	*mapped_bet_to_closing_call = false;
       } else {
@@ -444,7 +673,7 @@ Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, N
 	
 	int actual_pot_size = 2 * actual_bet_to;
 	int succ = ChooseOppAction(node, below_succ, above_succ, new_actual_bet_to, actual_pot_size,
-				   raise_node);
+				   raise_node, rand_buf);
 	if (call_ends_street && succ == node->CallSuccIndex()) {
 	  // If 1) we mapped an opponent's bet to a call, and 2) that call ends the current
 	  // street, then set *mapped_bet_to_closing_call to true
@@ -453,6 +682,7 @@ Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, N
 	  *mapped_bet_to_closing_call = false;
 	}
 	fprintf(stderr, "Translated to opp succ %i\n", succ);
+	RecordTransition(node, node->IthSucc(succ), session);
 	node = node->IthSucc(succ);
 #if 0
 	Node *prior_node = node;
@@ -476,116 +706,284 @@ Node *Agent::ProcessAction(const string &action, int we_p, const int *buckets, N
     fprintf(stderr, "i %i len %i action %s\n", i, len, action.c_str());
     exit(-1);
   }
+  session->action = action;
   return node;
 }
 
-// Pass in root_bd.  Turn root_bd for turn and river, or switch to river root_bd for river?
-// Probably need to pass around global board and map to local board.
-void Agent::ReadSumprobsFromDisk(Node *node, int p, const Card *board, CFRValues *values) {
-  if (node->Terminal()) return;
+// Records that the hand went from node to succ in the base betting tree.  succ is a grandchild of
+// node when we respond at a raise node (the opponent's bet was translated to a call).
+void Agent::RecordTransition(Node *node, Node *succ, HandSession *session) const {
+  if (resolve_st_ < 0 || session->resolved || node->Street() >= resolve_st_) return;
+  if (succ == node) return;
   int num_succs = node->NumSuccs();
-  if (num_succs > 1 && node->PlayerActing() == p) {
-    int nt = node->NonterminalID();
+  for (int s = 0; s < num_succs; ++s) {
+    if (node->IthSucc(s) == succ) {
+      session->path.push_back(pair<Node *, int>(node, s));
+      return;
+    }
+  }
+  for (int s = 0; s < num_succs; ++s) {
+    Node *bet_node = node->IthSucc(s);
+    if (bet_node->Terminal()) continue;
+    int num_bet_node_succs = bet_node->NumSuccs();
+    for (int s1 = 0; s1 < num_bet_node_succs; ++s1) {
+      if (bet_node->IthSucc(s1) == succ) {
+	session->path.push_back(pair<Node *, int>(node, s));
+	session->path.push_back(pair<Node *, int>(bet_node, s1));
+	return;
+      }
+    }
+  }
+  session->path_valid = false;
+}
+
+// The reach probs of both players' hands at the resolve root given the base strategy and the
+// path the hand took.  The boards of the earlier streets are taken from the canonical board we
+// resolve on so that all the hands are in the same suit frame.
+unique_ptr<ReachProbs> Agent::ResolveReachProbs(const HandSession *session, int root_bd) const {
+  const Card *root_board = BoardTree::Board(resolve_st_, root_bd);
+  unique_ptr<ReachProbs> root_reach_probs(ReachProbs::CreateRoot());
+  const ReachProbs *reach_probs = root_reach_probs.get();
+  shared_ptr<ReachProbs []> succ_reach_probs;
+  unique_ptr<HandTree> hand_tree;
+  int hand_tree_st = -1;
+  int num_path = session->path.size();
+  for (int i = 0; i < num_path; ++i) {
+    Node *node = session->path[i].first;
     int st = node->Street();
-    int num_buckets = buckets_->NumBuckets(st);
-    int num = num_buckets * num_succs;
-    unique_ptr<double []> bucket_probs(new double[num]);
-    for (int b = 0; b < num_buckets; ++b) {
-      disk_probs_->Probs(p, st, nt, b, num_succs, bucket_probs.get());
+    int gbd = BoardTree::LookupBoard(root_board, st);
+    if (st != hand_tree_st) {
+      hand_tree.reset(new HandTree(st, gbd, st));
+      hand_tree_st = st;
     }
+    succ_reach_probs = ReachProbs::CreateSuccReachProbs(node, gbd, gbd, hand_tree->Hands(st, gbd),
+							*buckets_, base_sumprobs_.get(),
+							*reach_probs, false);
+    reach_probs = &succ_reach_probs[session->path[i].second];
+  }
+  unique_ptr<ReachProbs> ret(ReachProbs::CreateRoot());
+  int num_players = Game::NumPlayers();
+  for (int p = 0; p < num_players; ++p) ret->Set(p, reach_probs->Get(p));
+  return ret;
+}
+
+static bool SameShape(Node *node1, Node *node2) {
+  if (node1->Terminal() != node2->Terminal() || node1->Street() != node2->Street() ||
+      node1->LastBetTo() != node2->LastBetTo()) {
+    return false;
+  }
+  if (node1->Terminal()) return true;
+  int num_succs = node1->NumSuccs();
+  if (node1->PlayerActing() != node2->PlayerActing() || node2->NumSuccs() != num_succs) {
+    return false;
+  }
+  for (int s = 0; s < num_succs; ++s) {
+    if (! SameShape(node1->IthSucc(s), node2->IthSucc(s))) return false;
+  }
+  return true;
+}
+
+// Each hand gets the base strategy for its base bucket (or itself, where the base is
+// unbucketed), weighted by its reach prob at the resolve root.
+void Agent::WarmStartNode(Node *base_node, Node *subtree_node, const HandTree *hand_tree,
+			  const ReachProbs &reach_probs, CFRValues *sumprobs) const {
+  if (base_node->Terminal()) return;
+  int num_succs = base_node->NumSuccs();
+  int st = base_node->Street();
+  int pa = base_node->PlayerActing();
+  if (num_succs > 1 && sumprobs->Player(pa)) {
     CFRStreetValues<double> *street_values =
-      dynamic_cast<CFRStreetValues<double> *>(values->StreetValues(st));
-    double *probs = street_values->AllValues(p, nt);
-    int root_gbd = boards_[st];
-    int start_gbd, end_gbd;
-    if (st == resolve_st_) {
-      start_gbd = root_gbd;
-      end_gbd = root_gbd + 1;
-    } else {
-      start_gbd = BoardTree::SuccBoardBegin(resolve_st_, root_gbd, st);
-      end_gbd = BoardTree::SuccBoardEnd(resolve_st_, root_gbd, st);
-    }
-    int max_card = Game::MaxCard();
+      dynamic_cast<CFRStreetValues<double> *>(sumprobs->StreetValues(st));
+    double *values = street_values->AllValues(pa, subtree_node->NonterminalID());
+    int base_nt = base_node->NonterminalID();
+    int dsi = base_node->DefaultSuccIndex();
+    unique_ptr<double []> probs(new double[num_succs]);
+    int root_bd = hand_tree->RootBd();
     int num_hole_card_pairs = Game::NumHoleCardPairs(st);
-    for (int gbd = start_gbd; gbd < end_gbd; ++gbd) {
-      int lbd = BoardTree::LocalIndex(resolve_st_, root_gbd, st, gbd);
-      Card hole_cards[2];
-      for (Card hi = 1; hi <= max_card; ++hi) {
-	// Check for board conflicts
-	hole_cards[0] = hi;
-	for (Card lo = 0; lo < hi; ++lo) {
-	  // Check for board conflicts
-	  hole_cards[1] = lo;
-	  // Get board
-	  int raw_hcp = HCPIndex(st, board, hole_cards);
-	  unsigned int h = ((unsigned int)gbd) * ((unsigned int)num_hole_card_pairs) + raw_hcp;
-	  int b = buckets_->Bucket(st, h);
-	  // Is this correct on the river?  Probably not.
-	  int card_offset = lbd * num_hole_card_pairs + raw_hcp;
-	  int bucket_offset = b * num_succs;
-	  for (int s = 0; s < num_succs; ++s) {
-	    probs[card_offset + s] = bucket_probs[bucket_offset + s];
-	  }
+    int max_card1 = Game::MaxCard() + 1;
+    int num_local_boards = BoardTree::NumLocalBoards(resolve_st_, root_bd, st);
+    for (int lbd = 0; lbd < num_local_boards; ++lbd) {
+      int gbd = BoardTree::GlobalIndex(resolve_st_, root_bd, st, lbd);
+      const Card *board = BoardTree::Board(st, gbd);
+      const CanonicalCards *hands = hand_tree->Hands(st, gbd);
+      for (int i = 0; i < num_hole_card_pairs; ++i) {
+	const Card *cards = hands->Cards(i);
+	int offset;
+	if (buckets_->None(st)) {
+	  offset = gbd * num_hole_card_pairs * num_succs + i * num_succs;
+	} else {
+	  unsigned int h = ((unsigned int)gbd) * ((unsigned int)num_hole_card_pairs) +
+	    HCPIndex(st, board, cards);
+	  offset = buckets_->Bucket(st, h) * num_succs;
 	}
+	base_sumprobs_->RMProbs(st, pa, base_nt, offset, num_succs, dsi, probs.get());
+	double w = kWarmStartIts * reach_probs.Get(pa, cards[0] * max_card1 + cards[1]);
+	double *hand_values = values + (lbd * num_hole_card_pairs + i) * num_succs;
+	for (int s = 0; s < num_succs; ++s) hand_values[s] = w * probs[s];
       }
     }
   }
   for (int s = 0; s < num_succs; ++s) {
-    ReadSumprobsFromDisk(node->IthSucc(s), p, board, values);
+    WarmStartNode(base_node->IthSucc(s), subtree_node->IthSucc(s), hand_tree, reach_probs,
+		  sumprobs);
   }
 }
 
-// What to do if node is on a later street than resolve_st_?
-// We don't back up and solve the whole turn game, do we?
-CFRValues *Agent::ReadSumprobs(Node *node, int p, const Card *board) {
-  int num_players = Game::NumPlayers();
-  unique_ptr<bool []> players(new bool[num_players]);
-  for (int p1 = 0; p1 < num_players; ++p1) players[p1] = (p1 == p);
-  int st = node->Street();
+// Sumprobs for the resolved subgame that start out as the base strategy, so that resolving
+// refines the base strategy rather than starting from scratch, and a resolve cut short by the
+// deadline falls back on it where it has seen few iterations.  Requires the subgame betting
+// tree to have the same shape as the base tree; returns null otherwise.
+shared_ptr<CFRValues> Agent::WarmStart(Node *base_node, BettingTrees *subtrees,
+				       const bool *players, const HandTree *hand_tree,
+				       const ReachProbs &reach_probs) const {
+  if (! SameShape(base_node, subtrees->Root())) return nullptr;
   int max_street = Game::MaxStreet();
   unique_ptr<bool []> streets(new bool[max_street + 1]);
-  for (int st1 = 0; st1 <= max_street; ++st1) streets[st1] = (st1 >= st);
-  int root_bd = boards_[st];
-  CFRValues *values = new CFRValues(players.get(), streets.get(), root_bd, st,
-				    *buckets_, betting_trees_->GetBettingTree());
-  // Need to create CFRStreetValues
-  ReadSumprobsFromDisk(node, p, board, values);
-  return values;
+  for (int st = 0; st <= max_street; ++st) streets[st] = st >= resolve_st_;
+  shared_ptr<CFRValues> sumprobs(new CFRValues(players, streets.get(), hand_tree->RootBd(),
+					       resolve_st_, *subgame_buckets_,
+					       subtrees->GetBettingTree()));
+  sumprobs->AllocateAndClear(subtrees->GetBettingTree(), CFRValueType::CFR_DOUBLE, false, -1);
+  WarmStartNode(base_node, subtrees->Root(), hand_tree, reach_probs, sumprobs.get());
+  return sumprobs;
 }
 
-// dynamic_cbr needs:
-// a) our probs for the resolve streets
-// b) opp reach probs
-// Can't load the entire flop into memory
-CFRValues *Agent::Resolve(const Card *board, int we_p, Node *node) {
-  unique_ptr<BettingTrees> betting_trees;
-  int pa = node->PlayerActing();
-  betting_trees.reset(CreateSubtrees(resolve_st_, pa, node->LastBetTo(), we_p,
-				     *subgame_ba_));
-  return nullptr;
+// Resolves the rest of the hand from node, the base betting tree's node at the start of the
+// resolve street.  Returns the root of the resolved subtree, or node if we didn't resolve (in
+// which case we play the base strategy for the rest of the hand).
+Node *Agent::Resolve(Node *node, HandSession *session) const {
+  if (! session->path_valid) {
+    fprintf(stderr, "Couldn't follow the action in the base tree; not resolving\n");
+    return node;
+  }
+  // No point resolving if we are already all-in
+  if (node->Terminal() || node->LastBetTo() == base_ba_->StackSize()) return node;
+  long long int start = LatencyStats::Now();
+  int root_bd = session->boards[resolve_st_];
+  int we_p = session->we_p;
+  unique_ptr<ResolvedSubgame> resolved(new ResolvedSubgame);
+  resolved->root_bd = root_bd;
+  resolved->subtrees.reset(CreateSubtrees(resolve_st_, node->PlayerActing(), node->LastBetTo(),
+					  we_p, *subgame_ba_));
+  resolved->hand_tree.reset(new HandTree(resolve_st_, root_bd, Game::MaxStreet()));
+  BettingTrees *subtrees = resolved->subtrees.get();
+  const HandTree *hand_tree = resolved->hand_tree.get();
+
+  string action_sequence;
+  int num_path = session->path.size();
+  for (int i = 0; i < num_path; ++i) {
+    action_sequence += session->path[i].first->ActionName(session->path[i].second);
+  }
+  int num_players = Game::NumPlayers();
+  unique_ptr<bool []> players(new bool[num_players]);
+  for (int p = 0; p < num_players; ++p) players[p] = p == we_p;
+  resolved->sumprobs = ReadSubgame(action_sequence, subtrees, root_bd, *subgame_buckets_,
+				   players.get(), resolve_st_, root_bd, subgame_store_.get());
+  if (resolved->sumprobs) {
+    fprintf(stderr, "Stored resolve for st %i bd %i %s\n", resolve_st_, root_bd,
+	    action_sequence.c_str());
+    Node *root = subtrees->Root();
+    session->resolved = std::move(resolved);
+    return root;
+  }
+
+  unique_ptr<ReachProbs> reach_probs = ResolveReachProbs(session, root_bd);
+  unique_ptr<EGCFR> eg_cfr;
+  shared_ptr<double []> t_vals;
+  if (method_ == ResolvingMethod::UNSAFE) {
+    eg_cfr.reset(new UnsafeEGCFR(*subgame_ca_, *base_ca_, *base_ba_, *subgame_cc_, *base_cc_,
+				 *subgame_buckets_, num_resolve_threads_));
+    for (int p = 0; p < num_players; ++p) players[p] = true;
+  } else {
+    // The safe methods solve for one player at a time given the opponent's counterfactual
+    // best-response values against the base strategy.  We only need our own strategy.
+    DynamicCBR dynamic_cbr(*base_ca_, *base_cc_, *buckets_, 1);
+    shared_ptr<CFRValues> base_sumprobs = base_sumprobs_;
+    dynamic_cbr.SetSumprobs(base_sumprobs);
+    t_vals = dynamic_cbr.Compute(node, *reach_probs, root_bd, hand_tree, we_p^1, false, true,
+				 false, false);
+    if (method_ == ResolvingMethod::CFRD) {
+      eg_cfr.reset(new CFRDEGCFR(*subgame_ca_, *base_ca_, *base_ba_, *subgame_cc_, *base_cc_,
+				 *subgame_buckets_, false, true, num_resolve_threads_));
+    } else {
+      eg_cfr.reset(new CombinedEGCFR(*subgame_ca_, *base_ca_, *base_ba_, *subgame_cc_,
+				     *base_cc_, *subgame_buckets_, false, true,
+				     num_resolve_threads_));
+    }
+  }
+  if (num_resolve_threads_ > 1 && resolve_st_ < Game::MaxStreet()) {
+    eg_cfr->SetSplitStreet(resolve_st_ + 1);
+  }
+  shared_ptr<CFRValues> warm_start = WarmStart(node, subtrees, players.get(), hand_tree,
+					       *reach_probs);
+  if (warm_start) eg_cfr->SetWarmStart(warm_start);
+  double secs = (session->resolve_deadline - LatencyStats::Now()) / 1000000.0;
+  if (secs <= 0) {
+    fprintf(stderr, "No time left to resolve; using the base strategy\n");
+    return node;
+  }
+  eg_cfr->SetTimeLimit(secs);
+  bool unsafe = method_ == ResolvingMethod::UNSAFE;
+  eg_cfr->SolveSubgame(subtrees, root_bd, *reach_probs, "x", hand_tree, t_vals.get(),
+		       unsafe ? -1 : we_p, unsafe, resolve_its_);
+  resolved->sumprobs = eg_cfr->Sumprobs();
+  fprintf(stderr, "Resolved st %i bd %i: %i its%s in %.3f secs\n", resolve_st_, root_bd,
+	  eg_cfr->NumItsDone(), warm_start ? " (warm start)" : "",
+	  (LatencyStats::Now() - start) / 1000000.0);
+  // Resolves cut short by the deadline aren't worth keeping
+  if (eg_cfr->NumItsDone() == resolve_its_) {
+    for (int p = 0; p < num_players; ++p) {
+      if (! players[p]) continue;
+      WriteSubgame(subtrees->Root(), action_sequence, action_sequence, root_bd,
+		   resolved->sumprobs.get(), resolve_st_, root_bd, p, resolve_st_,
+		   subgame_store_.get());
+    }
+  }
+  Node *root = subtrees->Root();
+  session->resolved = std::move(resolved);
+  return root;
 }
 
 // Return true if we take an action.
 bool Agent::ProcessMatchState(const MatchState &match_state, CFRValues **resolved_strategy,
 			      bool *call, bool *fold, int *bet_size) {
-  // In our reconstruction of the action (inside ProcessAction()) we choose our actions
-  // randomly.  We need to be able to reconstruct the action of the hand and make the same
-  // choices each time.  For this to work, I need to seed the RNG here consistently.
+  return ProcessMatchStateInSession(match_state, session_.get(), call, fold, bet_size);
+}
+
+bool Agent::ProcessMatchStateInSession(const MatchState &match_state, HandSession *session,
+				       bool *call, bool *fold, int *bet_size) const {
   int hand_no = match_state.HandNo();
-  srand48_r(hand_no, &rand_buf_);
   bool we_p1 = match_state.P1();
   int we_p = we_p1 ? 1 : 0;
   const string &action = match_state.Action();
+  // Continue the current session if this match state extends the action we have already
+  // processed.  Otherwise (a new hand, or a match state we can't resume from) start over from
+  // the root.
+  int prefix_len = session->action.size();
+  if (! session->active || session->hand_no != hand_no || session->we_p != we_p ||
+      session->hand_over || action.compare(0, prefix_len, session->action) != 0 ||
+      ((int)action.size() > prefix_len && action[prefix_len] >= '0' &&
+       action[prefix_len] <= '9')) {
+    StartSession(hand_no, we_p, session);
+  }
+  struct drand48_data rand_buf = session->rand_buf;
   Card hole_cards[2];
   hole_cards[0] = match_state.OurHi();
   hole_cards[1] = match_state.OurLo();
   const Card *board = match_state.Board();
   int st = match_state.Street();
-  unique_ptr<int []> buckets(new int[st + 1]);
-  SetBuckets(st, board, hole_cards, buckets.get());
-  Node *raise_node;
-  bool mapped_bet_to_closing_call;
-  Node *node = ProcessAction(action, we_p, buckets.get(), &raise_node, &mapped_bet_to_closing_call);
+  SetBuckets(st, board, hole_cards, session);
+  session->resolve_deadline = LatencyStats::Now() + (long long int)(resolve_secs_ * 1000000.0);
+  Node *node = ProcessAction(action, session, &rand_buf);
+  if (node == nullptr) {
+    session->active = false;
+    return false;
+  }
+  // Save the RNG state before we choose our action.  The next decision will see that action in
+  // the action string and, resuming from here, choose it again.
+  session->rand_buf = rand_buf;
+  Node *raise_node = session->raise_node;
+  bool mapped_bet_to_closing_call = session->mapped_bet_to_closing_call;
   fprintf(stderr, "Back from ProcessAction\n");
   *call = false;
   *fold = false;
@@ -623,7 +1021,9 @@ bool Agent::ProcessMatchState(const MatchState &match_state, CFRValues **resolve
     exit(-1);
   }
 #endif
-  Node *next_node = ChooseOurAction(node, raise_node, buckets.get(), mapped_bet_to_closing_call);
+  Node *next_node = ChooseOurAction(node, raise_node, session, mapped_bet_to_closing_call,
+				    &rand_buf);
+  if (next_node->Terminal()) session->active = false;
   int csi = node->CallSuccIndex();
   int fsi = node->FoldSuccIndex();
   if (next_node == node) {
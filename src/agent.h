@@ -1,72 +1,174 @@
 #ifndef _AGENT_H_
 #define _AGENT_H_
 
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "betting_trees.h"
 #include "buckets.h"
 #include "cards.h"
+#include "cfr_values.h"
+#include "compiled_strategy.h"
 #include "disk_probs.h"
-#include "dynamic_cbr.h"
-#include "eg_cfr.h"
+#include "hand_tree.h"
 #include "match_state.h"
+#include "resolving_method.h"
+#include "subgame_store.h"
 
 class BettingAbstraction;
 class Buckets;
 class CardAbstraction;
 class CFRConfig;
-class CFRValues;
-class EGCFR;
 class Node;
+class ReachProbs;
+
+// The strategy we computed for the rest of a hand when it reached the resolve street
+struct ResolvedSubgame {
+  std::unique_ptr<BettingTrees> subtrees;
+  std::unique_ptr<HandTree> hand_tree;
+  std::shared_ptr<CFRValues> sumprobs;
+  int root_bd;
+};
+
+// Our reconstruction of the hand in progress.  Each decision extends it by the actions taken
+// since the previous decision instead of replaying the hand from the root.  All the state that
+// changes from decision to decision lives here, so one Agent can serve several matches at once
+// as long as each match has its own session.
+struct HandSession {
+  HandSession(void) : active(false) {}
+  // False until the first decision of a hand and after the hand is over
+  bool active;
+  int hand_no;
+  int we_p;
+  // The action string processed so far
+  std::string action;
+  // Parse state after processing action
+  Node *node;
+  Node *raise_node;
+  bool mapped_bet_to_closing_call;
+  int actual_bet_to;
+  int st;
+  int pa;
+  bool call_ends_street;
+  bool hand_over;
+  // RNG state after processing action.  Resuming from it makes the same random choices that a
+  // replay of the whole hand would.
+  struct drand48_data rand_buf;
+  // Boards and buckets for streets 0...buckets_st
+  int buckets_st;
+  std::unique_ptr<int []> boards;
+  std::unique_ptr<int []> buckets;
+  // The cards in the latest match state
+  Card raw_board[5];
+  Card raw_hole_cards[2];
+  // The nodes of the base betting tree before the resolve street and the succ taken at each.
+  // Gives the reach probs when we resolve.  Not valid if we couldn't follow the action.
+  std::vector< std::pair<Node *, int> > path;
+  bool path_valid;
+  // Once the hand reaches the resolve street, node and raise_node are nodes of
+  // resolved->subtrees.  Null before then, or if we didn't resolve.
+  std::unique_ptr<ResolvedSubgame> resolved;
+  // When we must have finished resolving for the current decision (see LatencyStats::Now())
+  long long int resolve_deadline;
+};
 
 class Agent {
 public:
+  // disk_probs_cache_bytes bounds the cache of sumprobs blocks read from disk when there is no
+  // compiled strategy (see DiskProbs).
   Agent(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc, int it,
-	int big_blind, int seed);
+	int big_blind, int seed, long long int disk_probs_cache_bytes);
+  // Resolves the rest of the hand with the given method when it reaches resolve_st.  Each
+  // resolve runs for at most resolve_its iterations and ends before resolve_secs have passed
+  // since the match state arrived.
   Agent(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
 	const CardAbstraction *subgame_ca, const BettingAbstraction *subgame_ba,
-	const CFRConfig *subgame_cc, int it, int big_blind, int resolve_st, int seed);
+	const CFRConfig *subgame_cc, ResolvingMethod method, int it, int big_blind,
+	int resolve_st, int resolve_its, double resolve_secs, int num_resolve_threads, int seed,
+	long long int disk_probs_cache_bytes);
   ~Agent(void) {}
   bool ProcessMatchState(const MatchState &match_state, CFRValues **resolved_strategy, bool *call,
 			 bool *fold, int *bet_size);
+  // Like ProcessMatchState(), but keeps the state of the hand in the caller's session rather
+  // than the Agent's own.  Thread-safe as long as concurrent calls pass different sessions.
+  bool ProcessMatchStateInSession(const MatchState &match_state, HandSession *session,
+				  bool *call, bool *fold, int *bet_size) const;
+  // Discards our reconstruction of the given hand.  Call when the hand is over.
+  void EndHand(int hand_no);
   int BigBlind(void) const {return big_blind_;}
   int StackSize(void) const {return stack_size_;}
 private:
   void Initialize(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
-		  int it, int big_blind, int seed);
-  void SetBuckets(int st, const Card *raw_board, const Card *raw_hole_cards, int *buckets);
-  Node *ChooseOurActionWithRaiseNode(Node *node, Node *raise_node, const int *buckets,
-				     bool mapped_bet_to_closing_call);
-  Node *ChooseOurAction(Node *node, const int *buckets, bool mapped_bet_to_closing_call);
-  Node *ChooseOurAction(Node *node, Node *raise_node, const int *buckets,
-			bool mapped_bet_to_closing_call);
+		  int it, int big_blind, int seed, long long int disk_probs_cache_bytes);
+  void StartSession(int hand_no, int we_p, HandSession *session) const;
+  void Probs(Node *node, const HandSession *session, double *probs) const;
+  int SampleSucc(Node *node, const HandSession *session, double r) const;
+  void FindResolvedHand(const HandSession *session, int st, int *gbd, Card *hole_cards) const;
+  void ResolvedProbs(Node *node, const HandSession *session, double *probs) const;
+  void SetBuckets(int st, const Card *raw_board, const Card *raw_hole_cards,
+		  HandSession *session) const;
+  Node *ChooseOurActionWithRaiseNode(Node *node, Node *raise_node, const HandSession *session,
+				     bool mapped_bet_to_closing_call,
+				     struct drand48_data *rand_buf) const;
+  Node *ChooseOurAction(Node *node, const HandSession *session, bool mapped_bet_to_closing_call,
+			struct drand48_data *rand_buf) const;
+  Node *ChooseOurAction(Node *node, Node *raise_node, const HandSession *session,
+			bool mapped_bet_to_closing_call, struct drand48_data *rand_buf) const;
   void GetTwoClosestSuccs(Node *node, int actual_bet_to, int *below_succ, int *below_bet_to,
-			  int *above_succ, int *above_bet_to);
-  double BelowProb(int actual_bet_to, int below_bet_to, int above_bet_to, int actual_pot_size);
+			  int *above_succ, int *above_bet_to) const;
+  double BelowProb(int actual_bet_to, int below_bet_to, int above_bet_to,
+		   int actual_pot_size) const;
   int ChooseBetweenBetAndCall(Node *node, int below_succ, int above_succ, int actual_bet_to,
-			      int actual_pot_size, Node **raise_node);
+			      int actual_pot_size, Node **raise_node,
+			      struct drand48_data *rand_buf) const;
   int ChooseBetweenTwoBets(Node *node, int below_succ, int above_succ, int actual_bet_to,
-			   int actual_pot_size);
+			   int actual_pot_size, struct drand48_data *rand_buf) const;
   int ChooseOppAction(Node *node, int below_succ, int above_succ, int actual_bet_to,
-		      int actual_pot_size, Node **raise_node);
-  Node *ProcessAction(const std::string &action, int we_p, const int *buckets, Node **raise_node,
-		      bool *mapped_bet_to_closing_call);
-  void ReadSumprobsFromDisk(Node *node, int p, const Card *board, CFRValues *values);
-  CFRValues *ReadSumprobs(Node *node, int p, const Card *board);
-  CFRValues *Resolve(const Card *board, int we_p, Node *node);
+		      int actual_pot_size, Node **raise_node, struct drand48_data *rand_buf) const;
+  Node *ProcessAction(const std::string &action, HandSession *session,
+		      struct drand48_data *rand_buf) const;
+  void RecordTransition(Node *node, Node *succ, HandSession *session) const;
+  std::unique_ptr<ReachProbs> ResolveReachProbs(const HandSession *session, int root_bd) const;
+  void WarmStartNode(Node *base_node, Node *subtree_node, const HandTree *hand_tree,
+		     const ReachProbs &reach_probs, CFRValues *sumprobs) const;
+  std::shared_ptr<CFRValues> WarmStart(Node *base_node, BettingTrees *subtrees,
+				       const bool *players, const HandTree *hand_tree,
+				       const ReachProbs &reach_probs) const;
+  Node *Resolve(Node *node, HandSession *session) const;
 
+  const CardAbstraction *base_ca_;
+  const BettingAbstraction *base_ba_;
+  const CFRConfig *base_cc_;
+  const CardAbstraction *subgame_ca_;
   const BettingAbstraction *subgame_ba_;
-  struct drand48_data rand_buf_;
+  const CFRConfig *subgame_cc_;
+  ResolvingMethod method_;
   int small_blind_;
   int big_blind_;
   int stack_size_;
   int resolve_st_;
+  int resolve_its_;
+  double resolve_secs_;
+  int num_resolve_threads_;
   int translation_method_;
-  std::unique_ptr<int []> boards_;
   std::unique_ptr<Buckets> buckets_;
   std::unique_ptr<BettingTrees> betting_trees_;
+  // If the strategy has been compiled we use the compiled strategy; otherwise we read the
+  // sumprobs with disk_probs_.
+  std::unique_ptr<CompiledStrategy> compiled_strategy_;
   std::unique_ptr<DiskProbs> disk_probs_;
-  std::unique_ptr<DynamicCBR> dynamic_cbr_;
-  std::unique_ptr<Buckets> subgame_buckets;
-  std::unique_ptr<EGCFR> eg_cfr;
+  // When resolving: the base sumprobs for all streets, mapped read-only, for the reach probs at
+  // the resolve street, the warm start and the safe methods' counterfactual values.
+  std::shared_ptr<CFRValues> base_sumprobs_;
+  std::unique_ptr<Buckets> subgame_buckets_;
+  // Resolves from earlier hands, runs and processes (e.g., solve_all_subgames), looked up before
+  // resolving
+  std::unique_ptr<SubgameStore> subgame_store_;
+  std::unique_ptr<HandSession> session_;
 };
 
 #endif
@@ -28,6 +28,7 @@
 #include "params.h"
 #include "resolving_method.h"
 #include "split.h"
+#include "subgame_store.h"
 #include "subgame_utils.h" // ReadSubgame()
 
 using std::string;
@@ -66,6 +67,7 @@ private:
   unique_ptr<CFRValues> base_sumprobs_;
   unique_ptr<CFRValues> merged_sumprobs_;
   unique_ptr<Buckets> subgame_buckets_;
+  unique_ptr<SubgameStore> store_;
 };
 
 Assembler::Assembler(const BettingTrees &base_betting_trees,
@@ -87,6 +89,9 @@ Assembler::Assembler(const BettingTrees &base_betting_trees,
   DeleteOldFiles(merged_ca_, subgame_ba_.BettingAbstractionName(), merged_cc_, subgame_it_);
 
   subgame_buckets_.reset(new Buckets(subgame_ca_, true));
+  // Each subgame is read once
+  store_.reset(new SubgameStore(base_ca_, subgame_ca_, base_ba_, subgame_ba_, base_cc_,
+				subgame_cc_, method_, 0, 0));
   
   int max_street = Game::MaxStreet();
   unique_ptr<bool []> base_streets(new bool[max_street + 1]);
@@ -173,9 +178,12 @@ void Assembler::WalkTrunk(Node *base_node, Node *subgame_node, const string &act
 #endif
     for (int gbd = 0; gbd < num_boards; ++gbd) {
       unique_ptr<CFRValues> subgame_sumprobs =
-	ReadSubgame(action_sequence, subtrees.get(), gbd, base_ca_, subgame_ca_, base_ba_,
-		    subgame_ba_, base_cc_, subgame_cc_, *subgame_buckets_.get(), method_, st, gbd,
-		    -1);
+	ReadSubgame(action_sequence, subtrees.get(), gbd, *subgame_buckets_.get(), nullptr, st,
+		    gbd, store_.get());
+      if (! subgame_sumprobs) {
+	fprintf(stderr, "Subgame %s gbd %i is missing\n", action_sequence.c_str(), gbd);
+	exit(-1);
+      }
       merged_sumprobs_->MergeInto(*subgame_sumprobs.get(), gbd, subgame_node, subtrees->Root(),
 				  *subgame_buckets_, Game::MaxStreet());
     }
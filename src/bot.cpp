@@ -40,7 +40,10 @@ void Bot::MainLoop(void) {
       fprintf(stderr, "Couldn't parse match state\n");
       exit(-1);
     }
-    if (match_state->Terminal()) continue;
+    if (match_state->Terminal()) {
+      agent_.EndHand(match_state->HandNo());
+      continue;
+    }
     bool call, fold;
     int bet_size;
     if (agent_.ProcessMatchState(*match_state, nullptr, &call, &fold, &bet_size)) {
@@ -8,12 +8,15 @@
 #include "game.h"
 #include "io.h"
 
+using std::unique_ptr;
+
 Buckets::Buckets(const CardAbstraction &ca, bool numb_only) {
   BoardTree::Create();
   int max_street = Game::MaxStreet();
   none_.reset(new bool[max_street + 1]);
-  short_buckets_ = new unsigned short *[max_street + 1];
-  int_buckets_ = new int *[max_street + 1];
+  short_buckets_.reset(new const unsigned short *[max_street + 1]);
+  int_buckets_.reset(new const int *[max_street + 1]);
+  files_.reset(new unique_ptr<MappedFile>[max_street + 1]);
   for (int st = 0; st <= max_street; ++st) {
     short_buckets_[st] = nullptr;
     int_buckets_[st] = nullptr;
@@ -38,26 +41,18 @@ Buckets::Buckets(const CardAbstraction &ca, bool numb_only) {
       if (none_[st]) continue;
       int num_boards = BoardTree::NumBoards(st);
       int num_hole_card_pairs = Game::NumHoleCardPairs(st);
-      // Need to use an unsigned int for this
-      unsigned int num_hands = (unsigned int)num_boards * (unsigned int)num_hole_card_pairs;
-      long long int lli_num_hands = num_hands;
+      long long int num_hands = (long long int)num_boards * (long long int)num_hole_card_pairs;
   
       sprintf(buf, "%s/buckets.%s.%i.%i.%i.%s.%i", Files::StaticBase(), Game::GameName().c_str(),
 	      Game::NumRanks(), Game::NumSuits(), max_street, ca.Bucketing(st).c_str(), st);
-      Reader reader(buf);
-      long long int file_size = reader.FileSize();
-      if (file_size == lli_num_hands * 2) {
-	short_buckets_[st] = new unsigned short[num_hands];
-	for (unsigned int h = 0; h < num_hands; ++h) {
-	  short_buckets_[st][h] = reader.ReadUnsignedShortOrDie();
-	}
-      } else if (file_size == lli_num_hands * 4) {
-	int_buckets_[st] = new int[num_hands];
-	for (unsigned int h = 0; h < num_hands; ++h) {
-	  int_buckets_[st][h] = reader.ReadIntOrDie();
-	}
+      files_[st].reset(new MappedFile(buf));
+      long long int file_size = files_[st]->Size();
+      if (file_size == num_hands * 2) {
+	short_buckets_[st] = (const unsigned short *)files_[st]->Data();
+      } else if (file_size == num_hands * 4) {
+	int_buckets_[st] = (const int *)files_[st]->Data();
       } else {
-	fprintf(stderr, "BucketsInstance::Initialize: Unexpected file size %lli\n", file_size);
+	fprintf(stderr, "Buckets: Unexpected file size %lli for %s\n", file_size, buf);
 	exit(-1);
       }
     }
@@ -66,22 +61,7 @@ Buckets::Buckets(const CardAbstraction &ca, bool numb_only) {
 
 // Allow a dummy empty buckets object to be created
 Buckets::Buckets(void) {
-  short_buckets_ = nullptr;
-  int_buckets_ = nullptr;
 }
 
 Buckets::~Buckets(void) {
-  int max_street = Game::MaxStreet();
-  if (short_buckets_) {
-    for (int st = 0; st <= max_street; ++st) {
-      if (short_buckets_[st]) delete [] short_buckets_[st];
-    }
-    delete [] short_buckets_;
-  }
-  if (int_buckets_) {
-    for (int st = 0; st <= max_street; ++st) {
-      if (int_buckets_[st]) delete [] int_buckets_[st];
-    }
-    delete [] int_buckets_;
-  }
 }
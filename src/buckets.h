@@ -4,7 +4,12 @@
 #include <memory>
 
 class CardAbstraction;
+class MappedFile;
 
+// The bucket tables are mapped read-only from the bucket files rather than read into private
+// arrays.  Constructing a Buckets object therefore reads nothing; pages of a street's table are
+// faulted in from the page cache the first time they are touched, and every process using the
+// same card abstraction shares one copy.
 class Buckets {
 public:
   Buckets(const CardAbstraction &ca, bool numb_only);
@@ -23,9 +28,11 @@ public:
   int NumBuckets(int st) const {return num_buckets_[st];}
 private:
   std::unique_ptr<bool []> none_;
-  // Should make these unique pointers, no?
-  unsigned short **short_buckets_;
-  int **int_buckets_;
+  // Each street's table points into files_[st].  At most one of short_buckets_[st] and
+  // int_buckets_[st] is non-null.
+  std::unique_ptr<const unsigned short * []> short_buckets_;
+  std::unique_ptr<const int * []> int_buckets_;
+  std::unique_ptr<std::unique_ptr<MappedFile> []> files_;
   std::unique_ptr<int []> num_buckets_;
 };
 
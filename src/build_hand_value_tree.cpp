@@ -1,3 +1,18 @@
+// Builds the hand value file read by HandValueTree: the value of every set of num-cards cards
+// (hole cards plus full board) in colex order.  Sets are ordered by their highest card, so the
+// file divides naturally into one shard per highest card.  Threads build the shards independently
+// and the shards are then concatenated.
+//
+// Each shard is written under a temporary name, followed by a checksum of its values, and renamed
+// into place when complete.  If the program is killed, rerunning it reuses the shards that were
+// finished.  The concatenation checks each shard's checksum, and the finished file is reread and
+// checked against a checksum of the whole, which is also written to <file>.checksum.  The shards
+// are removed once the file has been verified.
+//
+// Example:
+//   ../bin/build_hand_value_tree holdem_params 8
+
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -15,391 +30,260 @@
 using std::string;
 using std::unique_ptr;
 
-static void DealOneCard(void) {
-  Card max_card = Game::MaxCard();
-  Card c1;
-  int *tree = new int[max_card + 1];
-  for (c1 = 0; c1 <= max_card; ++c1) {
-    OutputCard(c1);
-    printf("\n");
-    fflush(stdout);
-    int i1 = c1;
-    tree[i1] = Rank(c1);
-  }
-  char buf[500];
-  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.1", Files::StaticBase(),
-	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
-  Writer writer(buf);
-  for (int i1 = 0; i1 <= max_card; ++i1) {
-    writer.WriteInt(tree[i1]);
+// Number of hands evaluated per call to EvaluateBatch()
+static const int kChunkSize = 65536;
+
+// 64-bit FNV-1a over the bytes of the values
+static const unsigned long long int kFNVOffsetBasis = 14695981039346656037ULL;
+static const unsigned long long int kFNVPrime = 1099511628211ULL;
+
+static unsigned long long int Checksum(unsigned long long int h, int val) {
+  unsigned int u = val;
+  for (int i = 0; i < 4; ++i) {
+    h ^= (u >> (8 * i)) & 0xff;
+    h *= kFNVPrime;
   }
+  return h;
 }
 
-static void DealTwoCards(HandEvaluator *he) {
-  Card max_card = Game::MaxCard();
-  Card cards[2];
-  Card c1, c2;
-  int **tree = new int *[max_card + 1];
-  for (c1 = 1; c1 <= max_card; ++c1) {
-    OutputCard(c1);
-    printf("\n");
-    fflush(stdout);
-    cards[0] = c1;
-    int i1 = c1;
-    int *tree1 = new int[i1];
-    tree[i1] = tree1;
-    for (c2 = 0; c2 < c1; ++c2) {
-      printf("  ");
-      OutputCard(c2);
-      printf("\n");
-      fflush(stdout);
-      cards[1] = c2;
-      tree1[c2] = he->Evaluate(cards, 2);
-    }
-  }
-  char buf[500];
-  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.2", Files::StaticBase(),
-	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
-  Writer writer(buf);
-  for (int i1 = 1; i1 <= max_card; ++i1) {
-    int *tree1 = tree[i1];
-    for (int i2 = 0; i2 < i1; ++i2) {
-      writer.WriteInt(tree1[i2]);
-    }
-  }
+static long long int Binomial(int n, int k) {
+  if (k < 0 || k > n) return 0;
+  long long int b = 1;
+  for (int i = 1; i <= k; ++i) b = b * (n - k + i) / i;
+  return b;
 }
 
-static void DealThreeCards(HandEvaluator *he) {
-  Card max_card = Game::MaxCard();
-  Card cards[3];
-  Card c1, c2, c3;
-  int ***tree = new int **[max_card + 1];
-  for (c1 = 2; c1 <= max_card; ++c1) {
-    OutputCard(c1);
-    printf("\n");
-    fflush(stdout);
-    cards[0] = c1;
-    int i1 = c1;
-    int **tree1 = new int *[i1];
-    tree[i1] = tree1;
-    for (c2 = 1; c2 < c1; ++c2) {
-      cards[1] = c2;
-      int i2 = c2;
-      int *tree2 = new int[i2];
-      tree1[i2] = tree2;
-      for (c3 = 0; c3 < c2; ++c3) {
-	cards[2] = c3;
-	int i3 = c3;
-	tree2[i3] = he->Evaluate(cards, 3);
-      }
-    }
-  }
+static string Filename(int num_cards) {
   char buf[500];
-  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.3", Files::StaticBase(),
-	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
-  Writer writer(buf);
-  for (int i1 = 2; i1 <= max_card; ++i1) {
-    int **tree1 = tree[i1];
-    for (int i2 = 1; i2 < i1; ++i2) {
-      int *tree2 = tree1[i2];
-      for (int i3 = 0; i3 < i2; ++i3) {
-	writer.WriteInt(tree2[i3]);
-      }
-    }
-  }
+  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.%i", Files::StaticBase(),
+	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits(), num_cards);
+  return buf;
 }
 
-static void DealFourCards(HandEvaluator *he) {
-  Card max_card = Game::MaxCard();
-  Card cards[4];
-  Card c1, c2, c3, c4;
-  int ****tree = new int ***[max_card + 1];
-  for (c1 = 3; c1 <= max_card; ++c1) {
-    OutputCard(c1);
-    printf("\n");
-    fflush(stdout);
-    cards[0] = c1;
-    int i1 = c1;
-    int ***tree1 = new int **[i1];
-    tree[i1] = tree1;
-    for (c2 = 2; c2 < c1; ++c2) {
-      cards[1] = c2;
-      int i2 = c2;
-      int **tree2 = new int *[i2];
-      tree1[i2] = tree2;
-      for (c3 = 1; c3 < c2; ++c3) {
-	cards[2] = c3;
-	int i3 = c3;
-	int *tree3 = new int[i3];
-	tree2[i3] = tree3;
-	for (c4 = 0; c4 < c3; ++c4) {
-	  cards[3] = c4;
-	  int i4 = c4;
-	  tree3[i4] = he->Evaluate(cards, 4);
+static string ShardFilename(int num_cards, int hi_card) {
+  char buf[50];
+  sprintf(buf, ".shard%i", hi_card);
+  return Filename(num_cards) + buf;
+}
+
+// Values and checksum trailer
+static long long int ShardSize(int num_cards, int hi_card) {
+  return Binomial(hi_card, num_cards - 1) * sizeof(int) + sizeof(unsigned long long int);
+}
+
+class Builder {
+public:
+  Builder(const HandEvaluator &he, int num_cards, int num_threads);
+  ~Builder(void);
+  void Build(void);
+  void BuildShards(void);
+private:
+  void BuildShard(int hi_card, Card *cards, int *vals);
+  void Concatenate(void);
+  void Verify(void);
+
+  const HandEvaluator &he_;
+  int num_cards_;
+  int num_threads_;
+  pthread_mutex_t mutex_;
+  // Shards are handed out from the highest card down because those are the biggest
+  int next_hi_card_;
+  unsigned long long int checksum_;
+};
+
+Builder::Builder(const HandEvaluator &he, int num_cards, int num_threads) :
+  he_(he), num_cards_(num_cards), num_threads_(num_threads) {
+  pthread_mutex_init(&mutex_, NULL);
+  checksum_ = kFNVOffsetBasis;
+}
+
+Builder::~Builder(void) {
+  pthread_mutex_destroy(&mutex_);
+}
+
+// Enumerates the sets whose highest card is hi_card in colex order: the remaining cards, kept in
+// ascending order in rest, advance like an odometer whose lowest card moves fastest.
+void Builder::BuildShard(int hi_card, Card *cards, int *vals) {
+  string final_filename = ShardFilename(num_cards_, hi_card);
+  string tmp_filename = final_filename + ".tmp";
+  int num_rest = num_cards_ - 1;
+  long long int num_sets = Binomial(hi_card, num_rest);
+  unsigned long long int checksum = kFNVOffsetBasis;
+  {
+    Writer writer(tmp_filename.c_str());
+    Card rest[HandEvaluator::kMaxNumCards];
+    for (int i = 0; i < num_rest; ++i) rest[i] = i;
+    long long int num_done = 0;
+    while (num_done < num_sets) {
+      int n = num_sets - num_done < kChunkSize ? num_sets - num_done : kChunkSize;
+      for (int h = 0; h < n; ++h) {
+	cards[h] = hi_card;
+	for (int i = 0; i < num_rest; ++i) cards[(i + 1) * n + h] = rest[i];
+	// Advance to the next set
+	for (int i = 0; i < num_rest; ++i) {
+	  int limit = i == num_rest - 1 ? hi_card : rest[i+1];
+	  if (rest[i] + 1 < limit) {
+	    ++rest[i];
+	    break;
+	  }
+	  rest[i] = i;
 	}
       }
-    }
-  }
-  char buf[500];
-  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.4", Files::StaticBase(),
-	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
-  Writer writer(buf);
-  for (int i1 = 3; i1 <= max_card; ++i1) {
-    int ***tree1 = tree[i1];
-    for (int i2 = 2; i2 < i1; ++i2) {
-      int **tree2 = tree1[i2];
-      for (int i3 = 1; i3 < i2; ++i3) {
-	int *tree3 = tree2[i3];
-	for (int i4 = 0; i4 < i3; ++i4) {
-	  writer.WriteInt(tree3[i4]);
-	}
+      if (num_cards_ == 1) {
+	// No evaluator needed for a single card
+	for (int h = 0; h < n; ++h) vals[h] = Rank(cards[h]);
+      } else {
+	he_.EvaluateBatch(cards, num_cards_, n, vals);
+      }
+      for (int h = 0; h < n; ++h) {
+	writer.WriteInt(vals[h]);
+	checksum = Checksum(checksum, vals[h]);
       }
+      num_done += n;
     }
+    writer.WriteUnsignedLong(checksum);
   }
+  // A leftover shard of the wrong size
+  if (FileExists(final_filename.c_str())) RemoveFile(final_filename.c_str());
+  MoveFile(tmp_filename.c_str(), final_filename.c_str());
+}
+
+static void *thread_run(void *v_b) {
+  Builder *b = (Builder *)v_b;
+  b->BuildShards();
+  return NULL;
 }
 
-// Is this Holdem specific?
-static void DealFiveCards(HandEvaluator *he) {
-  Card max_card = Game::MaxCard();
-  Card cards[7];
-  Card c1, c2, c3, c4, c5;
-  int *****tree = new int ****[max_card + 1];
-  for (c1 = 4; c1 <= max_card; ++c1) {
-    OutputCard(c1);
+void Builder::BuildShards(void) {
+  unique_ptr<Card []> cards(new Card[num_cards_ * kChunkSize]);
+  unique_ptr<int []> vals(new int[kChunkSize]);
+  while (true) {
+    pthread_mutex_lock(&mutex_);
+    int hi_card = next_hi_card_--;
+    pthread_mutex_unlock(&mutex_);
+    if (hi_card < num_cards_ - 1) break;
+    string filename = ShardFilename(num_cards_, hi_card);
+    if (FileExists(filename.c_str()) &&
+	FileSize(filename.c_str()) == ShardSize(num_cards_, hi_card)) {
+      continue;
+    }
+    BuildShard(hi_card, cards.get(), vals.get());
+    pthread_mutex_lock(&mutex_);
+    printf("Built shard ");
+    OutputCard(hi_card);
     printf("\n");
     fflush(stdout);
-    cards[0] = c1;
-    int i1 = c1;
-    int ****tree1 = new int ***[i1];
-    tree[i1] = tree1;
-    for (c2 = 3; c2 < c1; ++c2) {
-      fflush(stdout);
-      cards[1] = c2;
-      int i2 = c2;
-      int ***tree2 = new int **[i2];
-      tree1[i2] = tree2;
-      for (c3 = 2; c3 < c2; ++c3) {
-	cards[2] = c3;
-	int i3 = c3;
-	int **tree3 = new int *[i3];
-	tree2[i3] = tree3;
-	for (c4 = 1; c4 < c3; ++c4) {
-	  cards[3] = c4;
-	  int i4 = c4;
-	  int *tree4 = new int[i4];
-	  tree3[i4] = tree4;
-	  for (c5 = 0; c5 < c4; ++c5) {
-	    cards[4] = c5;
-	    int i5 = c5;
-	    tree4[i5] = he->Evaluate(cards, 5);
-	  }
-	}
-      }
-    }
+    pthread_mutex_unlock(&mutex_);
   }
-  char buf[500];
-  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.5", Files::StaticBase(),
-	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
-  Writer writer(buf);
-  for (int i1 = 4; i1 <= max_card; ++i1) {
-    int ****tree1 = tree[i1];
-    for (int i2 = 3; i2 < i1; ++i2) {
-      int ***tree2 = tree1[i2];
-      for (int i3 = 2; i3 < i2; ++i3) {
-	int **tree3 = tree2[i3];
-	for (int i4 = 1; i4 < i3; ++i4) {
-	  int *tree4 = tree3[i4];
-	  for (int i5 = 0; i5 < i4; ++i5) {
-	    writer.WriteInt(tree4[i5]);
-	  }
-	}
+}
+
+// Checks each shard against its trailer while copying its values to the final file.
+void Builder::Concatenate(void) {
+  string filename = Filename(num_cards_);
+  string tmp_filename = filename + ".tmp";
+  checksum_ = kFNVOffsetBasis;
+  {
+    Writer writer(tmp_filename.c_str());
+    for (int hi_card = num_cards_ - 1; hi_card <= Game::MaxCard(); ++hi_card) {
+      string shard_filename = ShardFilename(num_cards_, hi_card);
+      Reader reader(shard_filename.c_str());
+      if (reader.FileSize() != ShardSize(num_cards_, hi_card)) {
+	fprintf(stderr, "Shard %s has size %lli; expected %lli\n", shard_filename.c_str(),
+		reader.FileSize(), ShardSize(num_cards_, hi_card));
+	exit(-1);
+      }
+      long long int num_sets = Binomial(hi_card, num_cards_ - 1);
+      unsigned long long int shard_checksum = kFNVOffsetBasis;
+      for (long long int i = 0; i < num_sets; ++i) {
+	int val = reader.ReadIntOrDie();
+	writer.WriteInt(val);
+	shard_checksum = Checksum(shard_checksum, val);
+	checksum_ = Checksum(checksum_, val);
+      }
+      if (reader.ReadUnsignedLongOrDie() != shard_checksum) {
+	fprintf(stderr, "Checksum mismatch in shard %s; delete it and rerun\n",
+		shard_filename.c_str());
+	exit(-1);
       }
     }
   }
+  if (FileExists(filename.c_str())) RemoveFile(filename.c_str());
+  MoveFile(tmp_filename.c_str(), filename.c_str());
 }
 
-static void DealSixCards(HandEvaluator *he) {
-  Card max_card = Game::MaxCard();
-  Card cards[7];
-  Card c1, c2, c3, c4, c5, c6;
-  int ******tree = new int *****[max_card + 1];
-  for (c1 = 5; c1 <= max_card; ++c1) {
-    OutputCard(c1);
-    printf("\n");
-    fflush(stdout);
-    cards[0] = c1;
-    int i1 = c1;
-    int *****tree1 = new int ****[i1];
-    tree[i1] = tree1;
-    for (c2 = 4; c2 < c1; ++c2) {
-      cards[1] = c2;
-      int i2 = c2;
-      int ****tree2 = new int ***[i2];
-      tree1[i2] = tree2;
-      for (c3 = 3; c3 < c2; ++c3) {
-	cards[2] = c3;
-	int i3 = c3;
-	int ***tree3 = new int **[i3];
-	tree2[i3] = tree3;
-	for (c4 = 2; c4 < c3; ++c4) {
-	  cards[3] = c4;
-	  int i4 = c4;
-	  int **tree4 = new int *[i4];
-	  tree3[i4] = tree4;
-	  for (c5 = 1; c5 < c4; ++c5) {
-	    cards[4] = c5;
-	    int i5 = c5;
-	    int *tree5 = new int[i5];
-	    tree4[i5] = tree5;
-	    for (c6 = 0; c6 < c5; ++c6) {
-	      cards[5] = c6;
-	      int i6 = c6;
-	      tree5[i6] = he->Evaluate(cards, 6);
-	    }
-	  }
-	}
-      }
-    }
+void Builder::Verify(void) {
+  string filename = Filename(num_cards_);
+  Reader reader(filename.c_str());
+  long long int num_sets = Binomial(Game::MaxCard() + 1, num_cards_);
+  if (reader.FileSize() != num_sets * (long long int)sizeof(int)) {
+    fprintf(stderr, "%s has size %lli; expected %lli\n", filename.c_str(), reader.FileSize(),
+	    num_sets * (long long int)sizeof(int));
+    exit(-1);
   }
-  char buf[500];
-  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.6", Files::StaticBase(),
-	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
-  Writer writer(buf);
-  for (int i1 = 5; i1 <= max_card; ++i1) {
-    int *****tree1 = tree[i1];
-    for (int i2 = 4; i2 < i1; ++i2) {
-      int ****tree2 = tree1[i2];
-      for (int i3 = 3; i3 < i2; ++i3) {
-	int ***tree3 = tree2[i3];
-	for (int i4 = 2; i4 < i3; ++i4) {
-	  int **tree4 = tree3[i4];
-	  for (int i5 = 1; i5 < i4; ++i5) {
-	    int *tree5 = tree4[i5];
-	    for (int i6 = 0; i6 < i5; ++i6) {
-	      writer.WriteInt(tree5[i6]);
-	    }
-	  }
-	}
-      }
-    }
+  unsigned long long int checksum = kFNVOffsetBasis;
+  for (long long int i = 0; i < num_sets; ++i) {
+    checksum = Checksum(checksum, reader.ReadIntOrDie());
   }
+  if (checksum != checksum_) {
+    fprintf(stderr, "Checksum mismatch in %s\n", filename.c_str());
+    exit(-1);
+  }
+  string checksum_filename = filename + ".checksum";
+  FILE *fp = fopen(checksum_filename.c_str(), "w");
+  if (fp == NULL) {
+    fprintf(stderr, "Couldn't open %s for writing\n", checksum_filename.c_str());
+    exit(-1);
+  }
+  fprintf(fp, "%016llx\n", checksum);
+  fclose(fp);
+  printf("Wrote %s; %lli values; checksum %016llx\n", filename.c_str(), num_sets, checksum);
 }
 
-// This is not as general as it could be.  Holdem specific.
-static void DealSevenCards(HandEvaluator *he) {
-  Card max_card = Game::MaxCard();
-  Card cards[7];
-  Card c1, c2, c3, c4, c5, c6, c7;
-  int *******tree = new int ******[max_card + 1];
-  for (c1 = 6; c1 <= max_card; ++c1) {
-    OutputCard(c1);
-    printf("\n");
-    fflush(stdout);
-    cards[0] = c1;
-    int i1 = c1;
-    int ******tree1 = new int *****[i1];
-    tree[i1] = tree1;
-    for (c2 = 5; c2 < c1; ++c2) {
-      printf("  ");
-      OutputCard(c2);
-      printf("\n");
-      fflush(stdout);
-      cards[1] = c2;
-      int i2 = c2;
-      int *****tree2 = new int ****[i2];
-      tree1[i2] = tree2;
-      for (c3 = 4; c3 < c2; ++c3) {
-	cards[2] = c3;
-	int i3 = c3;
-	int ****tree3 = new int ***[i3];
-	tree2[i3] = tree3;
-	for (c4 = 3; c4 < c3; ++c4) {
-	  cards[3] = c4;
-	  int i4 = c4;
-	  int ***tree4 = new int **[i4];
-	  tree3[i4] = tree4;
-	  for (c5 = 2; c5 < c4; ++c5) {
-	    cards[4] = c5;
-	    int i5 = c5;
-	    int **tree5 = new int *[i5];
-	    tree4[i5] = tree5;
-	    for (c6 = 1; c6 < c5; ++c6) {
-	      cards[5] = c6;
-	      int i6 = c6;
-	      int *tree6 = new int[i6];
-	      tree5[i6] = tree6;
-	      for (c7 = 0; c7 < c6; ++c7) {
-		cards[6] = c7;
-		int i7 = c7;
-		tree6[i7] = he->Evaluate(cards, 7);
-	      }
-	    }
-	  }
-	}
-      }
+void Builder::Build(void) {
+  next_hi_card_ = Game::MaxCard();
+  if (num_threads_ == 1) {
+    BuildShards();
+  } else {
+    unique_ptr<pthread_t []> pthread_ids(new pthread_t[num_threads_]);
+    for (int t = 0; t < num_threads_; ++t) {
+      pthread_create(&pthread_ids[t], NULL, thread_run, this);
     }
-  }
-  char buf[500];
-  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.7", Files::StaticBase(),
-	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
-  Writer writer(buf);
-  for (int i1 = 6; i1 <= max_card; ++i1) {
-    int ******tree1 = tree[i1];
-    for (int i2 = 5; i2 < i1; ++i2) {
-      int *****tree2 = tree1[i2];
-      for (int i3 = 4; i3 < i2; ++i3) {
-	int ****tree3 = tree2[i3];
-	for (int i4 = 3; i4 < i3; ++i4) {
-	  int ***tree4 = tree3[i4];
-	  for (int i5 = 2; i5 < i4; ++i5) {
-	    int **tree5 = tree4[i5];
-	    for (int i6 = 1; i6 < i5; ++i6) {
-	      int *tree6 = tree5[i6];
-	      for (int i7 = 0; i7 < i6; ++i7) {
-		writer.WriteInt(tree6[i7]);
-	      }
-	    }
-	  }
-	}
-      }
+    for (int t = 0; t < num_threads_; ++t) {
+      pthread_join(pthread_ids[t], NULL);
     }
   }
+  Concatenate();
+  Verify();
+  for (int hi_card = num_cards_ - 1; hi_card <= Game::MaxCard(); ++hi_card) {
+    RemoveFile(ShardFilename(num_cards_, hi_card).c_str());
+  }
 }
 
 static void Usage(const char *prog_name) {
-  fprintf(stderr, "USAGE: %s <config file>\n", prog_name);
+  fprintf(stderr, "USAGE: %s <config file> (<num threads>)\n", prog_name);
   exit(-1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) Usage(argv[0]);
+  if (argc != 2 && argc != 3) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
   Game::Initialize(*game_params);
+  int num_threads = 1;
+  if (argc == 3 && (sscanf(argv[2], "%i", &num_threads) != 1 || num_threads < 1)) {
+    Usage(argv[0]);
+  }
 
-  HandEvaluator *he = HandEvaluator::Create(Game::GameName());
+  unique_ptr<HandEvaluator> he(HandEvaluator::Create(Game::GameName()));
   int num_cards = 0;
   for (int s = 0; s <= Game::MaxStreet(); ++s) {
     num_cards += Game::NumCardsForStreet(s);
   }
-  if (num_cards == 1) {
-    DealOneCard();
-  } else if (num_cards == 2) {
-    DealTwoCards(he);
-  } else if (num_cards == 3) {
-    DealThreeCards(he);
-  } else if (num_cards == 4) {
-    DealFourCards(he);
-  } else if (num_cards == 5) {
-    DealFiveCards(he);
-  } else if (num_cards == 6) {
-    DealSixCards(he);
-  } else if (num_cards == 7) {
-    DealSevenCards(he);
-  } else {
-    fprintf(stderr, "Unsupported number of cards: %u\n", num_cards);
+  if (num_cards < 1 || num_cards > HandEvaluator::kMaxNumCards) {
+    fprintf(stderr, "Unexpected number of cards: %i\n", num_cards);
     exit(-1);
   }
-  delete he;
+  Builder builder(*he, num_cards, num_threads);
+  builder.Build();
 }
@@ -48,7 +48,7 @@ static void Write(int st, const string &bucketing, KMeans *kmeans, int *indices,
 
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <street> <num clusters> <bucketing> <features> "
-	  "<neighbor thresh> <num iterations> <num threads>\n", prog_name);
+	  "<batch size> <num iterations> <num threads>\n", prog_name);
   exit(-1);
 }
 
@@ -64,8 +64,9 @@ int main(int argc, char *argv[]) {
   if (sscanf(argv[3], "%i", &num_clusters) != 1) Usage(argv[0]);
   string bucketing = argv[4];
   string features = argv[5];
-  double neighbor_thresh;
-  if (sscanf(argv[6], "%lf", &neighbor_thresh) != 1) Usage(argv[0]);
+  // Zero means full Lloyd iterations; positive means mini-batch k-means
+  int batch_size;
+  if (sscanf(argv[6], "%i", &batch_size) != 1 || batch_size < 0) Usage(argv[0]);
   int num_iterations, num_threads;
   if (sscanf(argv[7], "%i", &num_iterations) != 1)  Usage(argv[0]);
   if (sscanf(argv[8], "%i", &num_threads) != 1)     Usage(argv[0]);
@@ -129,24 +130,21 @@ int main(int argc, char *argv[]) {
   fprintf(stderr, "%i unique objects\n", num_unique);
   delete sad;
 
-  float **objects = new float *[num_unique];
+  float *objects = new float[(long long int)num_unique * num_features];
   for (int i = 0; i < num_unique; ++i) {
-    objects[i] = new float[num_features];
+    float *object = objects + (long long int)i * num_features;
     for (int f = 0; f < num_features; ++f) {
-      objects[i][f] = (*unique_objects)[i][f];
+      object[f] = (*unique_objects)[i][f];
     }
     delete [] (*unique_objects)[i];
   }
   delete unique_objects;
 
-  KMeans kmeans(num_clusters, num_features, num_unique, objects, neighbor_thresh, num_threads);
+  KMeans kmeans(num_clusters, num_features, num_unique, objects, batch_size, num_threads);
   kmeans.Cluster(num_iterations);
   int num_actual = kmeans.NumClusters();
   fprintf(stderr, "Num actual buckets: %i\n", num_actual);
 
-  for (int i = 0; i < num_unique; ++i) {
-    delete [] objects[i];
-  }
   delete [] objects;
 
   Write(st, bucketing, &kmeans, indices, num_actual);
@@ -1,6 +1,18 @@
+// Builds rollout features for one or more streets.  With several streets, the table of river
+// strengths is built once and shared by all of them.
+//
+// Features are written as they are computed.  Squashing needs the largest value over all the
+// hands, so with squashing the raw features are written to a temporary file first and then
+// squashed into the features file.
+
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "board_tree.h"
 #include "constants.h"
 #include "files.h"
@@ -10,24 +22,44 @@
 #include "io.h"
 #include "params.h"
 #include "rollout.h"
+#include "split.h"
 
 using namespace std;
 
 static void Usage(const char *prog_name) {
-  fprintf(stderr, "USAGE: %s <game params> <street> <features name> "
-	  "<squashing> [wins|wmls] <pct 0> <pct 1>... <pct n>\n", prog_name);
-  fprintf(stderr, "\nSquashing of 1.0 means no squashing\n");
+  fprintf(stderr, "USAGE: %s <game params> <streets> <features name> "
+	  "<squashing> [wins|wmls] <num threads> <pct 0> <pct 1>... <pct n>\n", prog_name);
+  fprintf(stderr, "\nStreets is a comma-separated list like \"1,2\"\n");
+  fprintf(stderr, "Squashing of 1.0 means no squashing\n");
   exit(-1);
 }
 
+// Renormalize vals so that worse hands have higher values and the lowest
+// value is zero.  Then squash by raising to the given power.
+static void Squash(const string &raw_filename, const string &filename, short max_val,
+		   double squashing) {
+  Reader reader(raw_filename.c_str());
+  Writer writer(filename.c_str());
+  writer.WriteInt(reader.ReadIntOrDie());
+  while (! reader.AtEnd()) {
+    short val = reader.ReadShortOrDie();
+    short norm_val = -(val - max_val);
+    writer.WriteShort((short)pow(norm_val, squashing));
+  }
+}
+
 int main(int argc, char *argv[]) {
-  if (argc < 7) Usage(argv[0]);
+  if (argc < 8) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
   Game::Initialize(*game_params);
-  int street;
-  if (sscanf(argv[2], "%i", &street) != 1) Usage(argv[0]);
+  vector<int> streets;
+  ParseInts(argv[2], &streets);
+  int max_street = Game::MaxStreet();
+  for (int st : streets) {
+    if (st < 0 || st > max_street) Usage(argv[0]);
+  }
   string features_name = argv[3];
   double squashing;
   if (sscanf(argv[4], "%lf", &squashing) != 1) Usage(argv[0]);
@@ -36,32 +68,42 @@ int main(int argc, char *argv[]) {
   if (warg == "wins")      wins = true;
   else if (warg == "wmls") wins = false;
   else                     Usage(argv[0]);
-  
-  int num_percentiles = argc - 6;
-  double *percentiles = new double[num_percentiles];
+  int num_threads;
+  if (sscanf(argv[6], "%i", &num_threads) != 1 || num_threads < 1) Usage(argv[0]);
+
+  int num_percentiles = argc - 7;
+  unique_ptr<double []> percentiles(new double[num_percentiles]);
   for (int i = 0; i < num_percentiles; ++i) {
-    if (sscanf(argv[6 + i], "%lf", &percentiles[i]) != 1) Usage(argv[0]);
+    if (sscanf(argv[7 + i], "%lf", &percentiles[i]) != 1) Usage(argv[0]);
+    if (percentiles[i] < 0 || percentiles[i] > 1.0) Usage(argv[0]);
   }
 
   HandValueTree::Create();
-  // Need this for ComputeRollout()
+  // Need this for Rollout
   BoardTree::Create();
-  short *pct_vals = ComputeRollout(street, percentiles, num_percentiles, squashing, wins);
+  Rollout rollout(wins, num_threads);
+  if (streets.size() > 1) rollout.BuildRiverTable();
 
-  unsigned int num_boards = BoardTree::NumBoards(street);
-  unsigned int num_hole_card_pairs = Game::NumHoleCardPairs(street);
-  unsigned int num_hands = num_boards * num_hole_card_pairs;
-  fprintf(stderr, "%u hands\n", num_hands);
+  for (int st : streets) {
+    unsigned int num_boards = BoardTree::NumBoards(st);
+    unsigned int num_hole_card_pairs = Game::NumHoleCardPairs(st);
+    unsigned int num_hands = num_boards * num_hole_card_pairs;
+    fprintf(stderr, "%u hands\n", num_hands);
 
-  char buf[500];
-  sprintf(buf, "%s/features.%s.%u.%s.%u", Files::StaticBase(), Game::GameName().c_str(),
-	  Game::NumRanks(), features_name.c_str(), street);
-  Writer writer(buf);
-  writer.WriteInt(num_percentiles);
-
-  for (unsigned int h = 0; h < num_hands; ++h) {
-    for (int p = 0; p < num_percentiles; ++p) {
-      writer.WriteShort(pct_vals[h * num_percentiles + p]);
+    char buf[500];
+    sprintf(buf, "%s/features.%s.%u.%s.%u", Files::StaticBase(), Game::GameName().c_str(),
+	    Game::NumRanks(), features_name.c_str(), st);
+    string filename = buf;
+    string raw_filename = squashing == 1.0 ? filename : filename + ".raw";
+    short max_val;
+    {
+      Writer writer(raw_filename.c_str());
+      writer.WriteInt(num_percentiles);
+      max_val = rollout.Write(st, percentiles.get(), num_percentiles, &writer);
+    }
+    if (squashing != 1.0) {
+      Squash(raw_filename, filename, max_val, squashing);
+      remove(raw_filename.c_str());
     }
   }
 }
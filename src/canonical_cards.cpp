@@ -36,6 +36,7 @@ CanonicalCards::CanonicalCards(int n, const Card *previous, int num_previous,
   n_ = n;
   suit_groups_.reset(nullptr);
   hand_values_.reset(nullptr);
+  num_ranges_ = 0;
   int max_card = Game::MaxCard();
   int index = 0;
   int num_remaining = Game::NumCardsInDeck() - num_previous;
@@ -167,6 +168,29 @@ CanonicalCards::CanonicalCards(int n, const Card *previous, int num_previous,
     exit(-1);
   }
   num_raw_ = index;
+  if (n_ == 2) SetHiLoCards();
+}
+
+// Copies the (interleaved) cards into separate hi and lo arrays so that the terminal evaluators
+// can load several hands' cards at once.
+void CanonicalCards::SetHiLoCards(void) {
+  hi_cards_.reset(new unsigned char[num_raw_]);
+  lo_cards_.reset(new unsigned char[num_raw_]);
+  for (int i = 0; i < num_raw_; ++i) {
+    hi_cards_[i] = cards_[i * 2];
+    lo_cards_[i] = cards_[i * 2 + 1];
+  }
+}
+
+// Approximate memory held by these hands; HandCache charges it against its LRU budget.
+long long int CanonicalCards::NumBytes(void) const {
+  long long int bytes_per_hand = n_ * sizeof(Card) + sizeof(unsigned char) + sizeof(int);
+  if (suit_groups_) bytes_per_hand += sizeof(int);
+  if (hand_values_) bytes_per_hand += sizeof(int);
+  if (hi_cards_) bytes_per_hand += 2 * sizeof(unsigned char);
+  long long int bytes = num_raw_ * bytes_per_hand;
+  if (range_begins_) bytes += (num_ranges_ + 1) * sizeof(int);
+  return bytes;
 }
 
 CanonicalCards::~CanonicalCards(void) {
@@ -388,6 +412,19 @@ void CanonicalCards::SortByHandStrength(const Card *board) {
   cards_.reset(new_cards);
   num_variants_.reset(new_num_variants);
   canon_.reset(new_canon);
+  SetHiLoCards();
+
+  // Find the boundaries of the ranges of equally strong hands
+  num_ranges_ = 0;
+  for (int i = 0; i < num_raw_; ++i) {
+    if (i == 0 || hand_values_[i] != hand_values_[i - 1]) ++num_ranges_;
+  }
+  range_begins_.reset(new int[num_ranges_ + 1]);
+  int r = 0;
+  for (int i = 0; i < num_raw_; ++i) {
+    if (i == 0 || hand_values_[i] != hand_values_[i - 1]) range_begins_[r++] = i;
+  }
+  range_begins_[num_ranges_] = num_raw_;
 }
 
 int NChooseK(int n, int k) {
@@ -7,7 +7,7 @@
 
 class CanonicalCards {
  public:
-  CanonicalCards(void) {}
+  CanonicalCards(void) : num_ranges_(0) {}
   CanonicalCards(int n, const Card *previous, int num_previous, int previous_suit_groups,
 		 bool maintain_suit_groups);
   virtual ~CanonicalCards(void);
@@ -24,8 +24,19 @@ class CanonicalCards {
   const Card *Cards(int i) const {return &cards_[i * n_];}
   int HandValue(int i) const {return hand_values_[i];}
   int SuitGroups(int i) const {return suit_groups_[i];}
+  // Approximate memory used by the hands
+  long long int NumBytes(void) const;
+  // Structure-of-arrays view of two-card hands used by the vectorized terminal evaluators in
+  // cfr_utils.cpp.  HiCards() and LoCards() are only available when n is 2.  RangeBegins() is
+  // only available after SortByHandStrength() and has NumRanges() + 1 entries; range r holds the
+  // equally strong hands RangeBegins()[r]...RangeBegins()[r+1]-1.
+  const unsigned char *HiCards(void) const {return hi_cards_.get();}
+  const unsigned char *LoCards(void) const {return lo_cards_.get();}
+  int NumRanges(void) const {return num_ranges_;}
+  const int *RangeBegins(void) const {return range_begins_.get();}
  protected:
   int NumMappings(const Card *cards, int n, int old_suit_groups);
+  void SetHiLoCards(void);
 
   int n_;
   std::unique_ptr<Card []> cards_;
@@ -35,6 +46,10 @@ class CanonicalCards {
   int num_raw_;
   int num_canon_;
   std::unique_ptr<int []> suit_groups_;
+  std::unique_ptr<unsigned char []> hi_cards_;
+  std::unique_ptr<unsigned char []> lo_cards_;
+  int num_ranges_;
+  std::unique_ptr<int []> range_begins_;
 };
 
 void UpdateSuitGroups(const Card *cards, int num_cards, const int old_suit_groups,
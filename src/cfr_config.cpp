@@ -33,6 +33,14 @@ CFRConfig::CFRConfig(const Params &params) {
   } else {
     subgame_street_ = -1;
   }
+  // Streets on which VCFR farms out boards to worker threads.  Default (empty) is the flop.
+  ParseInts(params.GetStringValue("SplitStreets"), &split_streets_);
+  // Street whose boards run_dist_cfrp farms out to worker processes.  Default is the flop.
+  if (params.IsSet("DistributedStreet")) {
+    distributed_street_ = params.GetIntValue("DistributedStreet");
+  } else {
+    distributed_street_ = 1;
+  }
   if (params.IsSet("SamplingRate")) {
     sampling_rate_ = params.GetIntValue("SamplingRate");
   }
@@ -68,12 +76,14 @@ CFRConfig::CFRConfig(const Params &params) {
   char_quantized_streets_.reset(new bool[max_street + 1]);
   short_quantized_streets_.reset(new bool[max_street + 1]);
   scaled_streets_.reset(new bool[max_street + 1]);
+  delta_streets_.reset(new bool[max_street + 1]);
   for (int st = 0; st <= max_street; ++st) {
     char_quantized_streets_[st] = false;
     short_quantized_streets_[st] = false;
     scaled_streets_[st] = false;
+    delta_streets_[st] = false;
   }
-  vector<int> cqsv, sqsv, ssv;
+  vector<int> cqsv, sqsv, ssv, dsv;
   ParseInts(params.GetStringValue("CharQuantizedStreets"), &cqsv);
   int num_cqsv = cqsv.size();
   for (int i = 0; i < num_cqsv; ++i) {
@@ -89,6 +99,18 @@ CFRConfig::CFRConfig(const Params &params) {
   for (int i = 0; i < num_ssv; ++i) {
     scaled_streets_[ssv[i]] = true;
   }
+  // TCFR streets whose updates are accumulated in per-thread buffers and merged periodically
+  ParseInts(params.GetStringValue("DeltaStreets"), &dsv);
+  int num_dsv = dsv.size();
+  for (int i = 0; i < num_dsv; ++i) {
+    delta_streets_[dsv[i]] = true;
+  }
+  if (params.IsSet("DeltaMergeInterval")) {
+    delta_merge_interval_ = params.GetIntValue("DeltaMergeInterval");
+  } else {
+    delta_merge_interval_ = 10000;
+  }
+  profile_contention_ = params.GetBooleanValue("ProfileContention");
   double_regrets_ = params.GetBooleanValue("DoubleRegrets");
   double_sumprobs_ = params.GetBooleanValue("DoubleSumprobs");
   ParseInts(params.GetStringValue("CompressedStreets"), &compressed_streets_);
@@ -24,6 +24,8 @@ public:
   int SoftWarmup(void) const {return soft_warmup_;}
   int HardWarmup(void) const {return hard_warmup_;}
   int SubgameStreet(void) const {return subgame_street_;}
+  const std::vector<int> &SplitStreets(void) const {return split_streets_;}
+  int DistributedStreet(void) const {return distributed_street_;}
   int SamplingRate(void) const {return sampling_rate_;}
   const std::vector<int> &SumprobStreets(void) const {
     return sumprob_streets_;
@@ -42,6 +44,9 @@ public:
   }
   bool ShortQuantizedStreet(int st) const {return short_quantized_streets_[st];}
   bool ScaledStreet(int st) const {return scaled_streets_[st];}
+  bool DeltaStreet(int st) const {return delta_streets_[st];}
+  int DeltaMergeInterval(void) const {return delta_merge_interval_;}
+  bool ProfileContention(void) const {return profile_contention_;}
   int ActiveMod(void) const {return active_mod_;}
   int NumActiveConditions(void) const {return num_active_conditions_;}
   int NumActiveStreets(int c) const {return active_streets_[c].size();}
@@ -71,6 +76,8 @@ public:
   int soft_warmup_;
   int hard_warmup_;
   int subgame_street_;
+  std::vector<int> split_streets_;
+  int distributed_street_;
   int sampling_rate_;
   std::vector<int> sumprob_streets_;
   std::vector<unsigned int> pruning_thresholds_;
@@ -83,6 +90,9 @@ public:
   std::unique_ptr<bool []> char_quantized_streets_;
   std::unique_ptr<bool []> short_quantized_streets_;
   std::unique_ptr<bool []> scaled_streets_;
+  std::unique_ptr<bool []> delta_streets_;
+  int delta_merge_interval_;
+  bool profile_contention_;
   int active_mod_;
   int num_active_conditions_;
   std::unique_ptr<std::vector<int> []> active_streets_;
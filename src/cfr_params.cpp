@@ -23,6 +23,8 @@ unique_ptr<Params> CreateCFRParams(void) {
   params->AddParam("SoftWarmup", P_INT);
   params->AddParam("HardWarmup", P_INT);
   params->AddParam("SubgameStreet", P_INT);
+  params->AddParam("SplitStreets", P_STRING);
+  params->AddParam("DistributedStreet", P_INT);
   params->AddParam("OverweightingFactor", P_INT);
   params->AddParam("SamplingRate", P_INT);
   params->AddParam("SumprobStreets", P_STRING);
@@ -42,6 +44,9 @@ unique_ptr<Params> CreateCFRParams(void) {
   params->AddParam("CharQuantizedStreets", P_STRING);
   params->AddParam("ShortQuantizedStreets", P_STRING);
   params->AddParam("ScaledStreets", P_STRING);
+  params->AddParam("DeltaStreets", P_STRING);
+  params->AddParam("DeltaMergeInterval", P_INT);
+  params->AddParam("ProfileContention", P_BOOLEAN);
   params->AddParam("DealTwice", P_BOOLEAN);
   params->AddParam("BoostThresholds", P_STRING);
   params->AddParam("Freeze", P_STRING);
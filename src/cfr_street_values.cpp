@@ -11,6 +11,7 @@
 #include "cfr_value_type.h"
 #include "game.h"
 #include "io.h"
+#include "value_compression.h"
 
 using std::shared_ptr;
 using std::unique_ptr;
@@ -72,6 +73,8 @@ CFRStreetValues<T>::CFRStreetValues(int st, const bool *players, int num_holding
     }
   }
   data_ = nullptr;
+  mapped_.reset(new bool[num_players]);
+  for (int p = 0; p < num_players; ++p) mapped_[p] = false;
 }
 
 template <typename T>
@@ -89,6 +92,9 @@ CFRStreetValues<T>::CFRStreetValues(CFRStreetValues<T> *p0_values, CFRStreetValu
   p0_values->data_[0] = nullptr;
   data_[1] = p1_values->data_[1];
   p1_values->data_[1] = nullptr;
+  mapped_.reset(new bool[2]);
+  mapped_[0] = p0_values->mapped_[0];
+  mapped_[1] = p1_values->mapped_[1];
 }
 
 template <typename T>
@@ -98,9 +104,11 @@ CFRStreetValues<T>::~CFRStreetValues(void) {
   int num_players = Game::NumPlayers();
   for (int p = 0; p < num_players; ++p) {
     if (data_[p] == nullptr) continue;
-    int num_nt = num_nonterminals_[p];
-    for (int i = 0; i < num_nt; ++i) {
-      delete [] data_[p][i];
+    if (! mapped_[p]) {
+      int num_nt = num_nonterminals_[p];
+      for (int i = 0; i < num_nt; ++i) {
+	delete [] data_[p][i];
+      }
     }
     delete [] data_[p];
   }
@@ -230,14 +238,15 @@ void CFRStreetValues<T>::PureProbs(int p, int nt, int offset, int num_succs,
 // Uses the current strategy (from regrets or sumprobs) to compute the weighted average of
 // the successor values.  This version for systems employing card abstraction.
 template <typename T>
-void CFRStreetValues<T>::ComputeOurValsBucketed(int pa, int nt, int num_hole_card_pairs,
-						int num_succs, int dsi,
+void CFRStreetValues<T>::ComputeOurValsBucketed(int pa, int nt, int num_succs, int dsi,
 						shared_ptr<double []> *succ_vals,
-						int *street_buckets, shared_ptr<double []> vals)
-  const {
+						const int *street_buckets,
+						const int *bucket_order, const int *run_begins,
+						int num_runs, double *probs,
+						shared_ptr<double []> vals) const {
   const T *all_cs_vals = data_[pa][nt];
-  ::ComputeOurValsBucketed(all_cs_vals, num_hole_card_pairs, num_succs, dsi, succ_vals,
-			   street_buckets, vals);
+  ::ComputeOurValsBucketed(all_cs_vals, num_succs, dsi, succ_vals, street_buckets, bucket_order,
+			   run_begins, num_runs, probs, vals);
 }
 
 // Uses the current strategy (from regrets or sumprobs) to compute the weighted average of
@@ -282,10 +291,8 @@ void CFRStreetValues<T>::WriteNode(Node *node, Writer *writer, void *compressor)
   int nt = node->NonterminalID();
   int num_succs = node->NumSuccs();
   if (num_succs <= 1) return;
-  // if (compressed_streets_[st]) {}
   if (compressor) {
-    fprintf(stderr, "Compression not supported yet\n");
-    exit(-1);
+    ((ValueCompressor *)compressor)->Write(data_[p][nt], num_holdings_, num_succs);
   } else {
     int num_actions = num_holdings_ * num_succs;
     for (int a = 0; a < num_actions; ++a) {
@@ -302,10 +309,9 @@ void CFRStreetValues<T>::WriteBoardValuesForNode(Node *node, Writer *writer, voi
   int nt = node->NonterminalID();
   int num_succs = node->NumSuccs();
   if (num_succs <= 1) return;
-  // if (compressed_streets_[st]) {}
   if (compressor) {
-    fprintf(stderr, "Compression not supported yet\n");
-    exit(-1);
+    int offset = lbd * num_hole_card_pairs * num_succs;
+    ((ValueCompressor *)compressor)->Write(data_[p][nt] + offset, num_hole_card_pairs, num_succs);
   } else {
     int offset = lbd * num_hole_card_pairs * num_succs;
     int num_actions = num_hole_card_pairs * num_succs;
@@ -409,11 +415,24 @@ void CFRStreetValues<T>::ReadNode(Node *node, Reader *reader, void *decompressor
     return;
   }
   InitializeValuesForReading(p, nt, num_succs);
+  int num_actions = num_holdings_ * num_succs;
   if (decompressor) {
-    fprintf(stderr, "Decompression not supported yet\n");
-    exit(-1);
+    ValueDecompressor *vd = (ValueDecompressor *)decompressor;
+    if (sizeof(T) == 1 && file_value_type_ != CFRValueType::CFR_CHAR) {
+      // Quantizing
+      unique_ptr<long long int []> vals(new long long int[num_actions]);
+      vd->Read(vals.get(), num_holdings_, num_succs);
+      unique_ptr<double []> succ_probs(new double[num_succs]);
+      unsigned char ***data = GetUnsignedCharData();
+      for (int h = 0; h < num_holdings_; ++h) {
+	for (int s = 0; s < num_succs; ++s) succ_probs[s] = vals[h * num_succs + s];
+	Quantize(succ_probs.get(), num_succs, &data[p][nt][h * num_succs]);
+      }
+    } else {
+      vd->Read(data_[p][nt], num_holdings_, num_succs);
+    }
+    return;
   }
-  int num_actions = num_holdings_ * num_succs;
   if (file_value_type_ == CFRValueType::CFR_CHAR) {
     for (int a = 0; a < num_actions; ++a) {
       reader->ReadOrDie(&data_[p][nt][a]);
@@ -477,6 +496,35 @@ void CFRStreetValues<T>::ReadNode(Node *node, Reader *reader, void *decompressor
   }
 }
 
+// Points the node's values into a mapped file at *offset and advances *offset past them.
+template <typename T>
+void CFRStreetValues<T>::MapNode(Node *node, const unsigned char *base, long long int *offset) {
+  int num_succs = node->NumSuccs();
+  if (num_succs <= 1) return;
+  int p = node->PlayerActing();
+  int nt = node->NonterminalID();
+  // Assume this is because this node is reentrant.
+  if (data_ && data_[p] && data_[p][nt]) {
+    return;
+  }
+  if (data_ == nullptr) {
+    int num_players = Game::NumPlayers();
+    data_ = new T **[num_players];
+    for (int p = 0; p < num_players; ++p) data_[p] = nullptr;
+  }
+  if (data_[p] == nullptr) {
+    int num_nt = num_nonterminals_[p];
+    data_[p] = new T *[num_nt];
+    for (int i = 0; i < num_nt; ++i) data_[p][i] = nullptr;
+    mapped_[p] = true;
+  } else if (! mapped_[p]) {
+    fprintf(stderr, "MapNode: can't mix mapped and allocated values for one player\n");
+    exit(-1);
+  }
+  data_[p][nt] = (T *)(base + *offset);
+  *offset += ((long long int)num_holdings_) * num_succs * sizeof(T);
+}
+
 // Doesn't support abstraction.
 // Doesn't support reentrancy.
 // Normally used for resolved subgames.  Read just one board's data from disk.
@@ -488,11 +536,12 @@ void CFRStreetValues<T>::ReadBoardValuesForNode(Node *node, Reader *reader, void
   int p = node->PlayerActing();
   int nt = node->NonterminalID();
   InitializeValuesForReading(p, nt, num_succs);
+  int offset = lbd * num_hole_card_pairs * num_succs;
   if (decompressor) {
-    fprintf(stderr, "Decompression not supported yet\n");
-    exit(-1);
+    ((ValueDecompressor *)decompressor)->Read(data_[p][nt] + offset, num_hole_card_pairs,
+					      num_succs);
+    return;
   }
-  int offset = lbd * num_hole_card_pairs * num_succs;
   int num_actions = num_hole_card_pairs * num_succs;
   for (int a = 0; a < num_actions; ++a) {
     reader->ReadOrDie(&data_[p][nt][a + offset]);
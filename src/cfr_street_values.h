@@ -16,9 +16,12 @@ class AbstractCFRStreetValues {
   virtual void AllocateAndClear(Node *node, int p) = 0;
   virtual void RMProbs(int p, int nt, int offset,  int num_succs, int dsi, double *probs) const = 0;
   virtual void PureProbs(int p, int nt, int offset, int num_succs, double *probs) const = 0;
-  virtual void ComputeOurValsBucketed(int pa, int nt, int num_hole_card_pairs, int num_succs,
-				      int dsi, std::shared_ptr<double []> *succ_vals,
-				      int *street_buckets,
+  // The hands are visited one bucket at a time (see VCFRState::StreetBucketOrder()) so that the
+  // current strategy is computed once per bucket.  probs is scratch space for num_succs doubles.
+  virtual void ComputeOurValsBucketed(int pa, int nt, int num_succs, int dsi,
+				      std::shared_ptr<double []> *succ_vals,
+				      const int *street_buckets, const int *bucket_order,
+				      const int *run_begins, int num_runs, double *probs,
 				      std::shared_ptr<double []> vals) const = 0;
   virtual void ComputeOurVals(int pa, int nt, int num_hole_card_pairs, int num_succs, int dsi,
 			      std::shared_ptr<double []> *succ_vals, int lbd,
@@ -28,6 +31,7 @@ class AbstractCFRStreetValues {
   virtual void Floor(int p, int nt, int num_succs, int floor) = 0;
   virtual bool Players(int p) const = 0;
   virtual void ReadNode(Node *node, Reader *reader, void *decompressor) = 0;
+  virtual void MapNode(Node *node, const unsigned char *base, long long int *offset) = 0;
   virtual void ReadBoardValuesForNode(Node *node, Reader *reader, void *decompressor, int lbd,
 				      int num_hole_card_pairs) = 0;
   virtual void WriteNode(Node *node, Writer *writer, void *compressor) const = 0;
@@ -56,9 +60,10 @@ public:
   void RMProbs(int p, int nt, int offset, int num_succs, int dsi, double *probs) const;
   // Note: doesn't handle nodes with one succ
   void PureProbs(int p, int nt, int offset, int num_succs, double *probs) const;
-  void ComputeOurValsBucketed(int pa, int nt, int num_hole_card_pairs, int num_succs, int dsi,
-			      std::shared_ptr<double []> *succ_vals, int *street_buckets,
-			      std::shared_ptr<double []> vals) const;
+  void ComputeOurValsBucketed(int pa, int nt, int num_succs, int dsi,
+			      std::shared_ptr<double []> *succ_vals, const int *street_buckets,
+			      const int *bucket_order, const int *run_begins, int num_runs,
+			      double *probs, std::shared_ptr<double []> vals) const;
   void ComputeOurVals(int pa, int nt, int num_hole_card_pairs, int num_succs, int dsi,
 		      std::shared_ptr<double []> *succ_vals, int lbd,
 		      std::shared_ptr<double []> vals) const;
@@ -68,6 +73,9 @@ public:
   void Set(int p, int nt, int h, int num_succs, T *vals);
   void InitializeValuesForReading(int p, int nt, int num_succs);
   void ReadNode(Node *node, Reader *reader, void *decompressor);
+  // Points the node's values at base + *offset (the node's values in a mapped file of the same
+  // type as T) and advances *offset past them.  The values are read-only.
+  void MapNode(Node *node, const unsigned char *base, long long int *offset);
   void ReadBoardValuesForNode(Node *node, Reader *reader, void *decompressor, int lbd,
 			      int num_hole_card_pairs);
   void WriteNode(Node *node, Writer *writer, void *compressor) const;
@@ -85,6 +93,9 @@ protected:
   std::unique_ptr<int []> num_nonterminals_;
   T ***data_;
   CFRValueType file_value_type_;
+  // mapped_[p] is true if player p's per-node arrays point into a mapped file rather than being
+  // owned by us.
+  std::unique_ptr<bool []> mapped_;
 };
 
 template <typename T> void CopyUnabstractedValues(T *from_values, T *to_values, int st,
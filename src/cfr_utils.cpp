@@ -1,7 +1,10 @@
 #include <math.h> // lrint()
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h> // strncmp()
+#include <string.h> // memcpy(), strncmp()
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include <memory>
 #include <string>
@@ -57,39 +60,59 @@ template void RMProbs<unsigned char>(const unsigned char *vals, int num_succs, i
 				     double *probs);
 
 // Uses the current strategy (from regrets or sumprobs) to compute the weighted average of
-// the successor values.  This version for systems employing card abstraction.
-template <typename T> void ComputeOurValsBucketed(const T *all_cs_vals, int num_hole_card_pairs,
-						  int num_succs, int dsi,
+// the successor values.  This version for systems employing card abstraction.  The hands are
+// visited a bucket at a time, so regret matching is done once per bucket rather than once per
+// hand.  If bucket_order is null, the hands are not grouped, and num_runs is the number of hands.
+template <typename T> void ComputeOurValsBucketed(const T *all_cs_vals, int num_succs, int dsi,
 						  shared_ptr<double []> *succ_vals,
-						  int *street_buckets, shared_ptr<double []> vals) {
-  unique_ptr<double []> current_probs(new double[num_succs]);
-  for (int i = 0; i < num_hole_card_pairs; ++i) {
-    int b = street_buckets[i];
-    RMProbs(all_cs_vals + b * num_succs, num_succs, dsi, current_probs.get());
-    for (int s = 0; s < num_succs; ++s) {
-      vals[i] += succ_vals[s][i] * current_probs[s];
+						  const int *street_buckets,
+						  const int *bucket_order, const int *run_begins,
+						  int num_runs, double *probs,
+						  shared_ptr<double []> vals) {
+  if (bucket_order == nullptr) {
+    for (int i = 0; i < num_runs; ++i) {
+      int b = street_buckets[i];
+      RMProbs(all_cs_vals + b * num_succs, num_succs, dsi, probs);
+      for (int s = 0; s < num_succs; ++s) {
+	vals[i] += succ_vals[s][i] * probs[s];
+      }
+    }
+    return;
+  }
+  for (int r = 0; r < num_runs; ++r) {
+    int begin = run_begins[r];
+    int end = run_begins[r + 1];
+    int b = street_buckets[bucket_order[begin]];
+    RMProbs(all_cs_vals + b * num_succs, num_succs, dsi, probs);
+    for (int j = begin; j < end; ++j) {
+      int i = bucket_order[j];
+      for (int s = 0; s < num_succs; ++s) {
+	vals[i] += succ_vals[s][i] * probs[s];
+      }
     }
   }
 }
 
-template void ComputeOurValsBucketed<double>(const double *all_cs_vals, int num_hole_card_pairs,
-					     int num_succs, int dsi,
-					     shared_ptr<double []> *succ_vals,
-					     int *street_buckets, shared_ptr<double []> vals);
-template void ComputeOurValsBucketed<int>(const int *all_cs_vals, int num_hole_card_pairs,
-					  int num_succs, int dsi, shared_ptr<double []> *succ_vals,
-					  int *street_buckets, shared_ptr<double []> vals);
-template void ComputeOurValsBucketed<unsigned short>(const unsigned short *all_cs_vals, 
-						     int num_hole_card_pairs, int num_succs,
-						     int dsi, shared_ptr<double []> *succ_vals,
-						     int *street_buckets,
-						     shared_ptr<double []> vals);
-template void ComputeOurValsBucketed<unsigned char>(const unsigned char *all_cs_vals,
-						    int num_hole_card_pairs,
-						    int num_succs, int dsi,
-						    shared_ptr<double []> *succ_vals,
-						    int *street_buckets,
-						    shared_ptr<double []> vals);
+template void
+ComputeOurValsBucketed<double>(const double *all_cs_vals, int num_succs, int dsi,
+			       shared_ptr<double []> *succ_vals, const int *street_buckets,
+			       const int *bucket_order, const int *run_begins, int num_runs,
+			       double *probs, shared_ptr<double []> vals);
+template void
+ComputeOurValsBucketed<int>(const int *all_cs_vals, int num_succs, int dsi,
+			    shared_ptr<double []> *succ_vals, const int *street_buckets,
+			    const int *bucket_order, const int *run_begins, int num_runs,
+			    double *probs, shared_ptr<double []> vals);
+template void
+ComputeOurValsBucketed<unsigned short>(const unsigned short *all_cs_vals, int num_succs, int dsi,
+				       shared_ptr<double []> *succ_vals, const int *street_buckets,
+				       const int *bucket_order, const int *run_begins, int num_runs,
+				       double *probs, shared_ptr<double []> vals);
+template void
+ComputeOurValsBucketed<unsigned char>(const unsigned char *all_cs_vals, int num_succs, int dsi,
+				      shared_ptr<double []> *succ_vals, const int *street_buckets,
+				      const int *bucket_order, const int *run_begins, int num_runs,
+				      double *probs, shared_ptr<double []> vals);
 
 // Uses the current strategy (from regrets or sumprobs) to compute the weighted average of
 // the successor values.  This version for unabstracted systems.
@@ -146,6 +169,121 @@ template void SetCurrentAbstractedStrategy<unsigned char>(const unsigned char *a
 							  int num_buckets, int num_succs, int dsi,
 							  double *all_cs_probs);
 
+// The terminal evaluators below operate on the structure-of-arrays view of the hands
+// (CanonicalCards::HiCards(), LoCards() and RangeBegins()).  Each kernel has an AVX-512 or AVX2
+// loop (selected at compile time by -march) followed by a scalar loop that handles the tail and
+// serves as the fallback on other targets.  Per hand, the vector and scalar loops perform the
+// same arithmetic in the same order.
+
+#if defined(__AVX512F__)
+static inline __m256i LoadCards8(const unsigned char *cards) {
+  return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)cards));
+}
+#elif defined(__AVX2__)
+static inline __m128i LoadCards4(const unsigned char *cards) {
+  int packed;
+  memcpy(&packed, cards, sizeof(packed));
+  return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+}
+
+// Equivalent to _mm256_i32gather_pd(); the masked form avoids a spurious -Wmaybe-uninitialized
+// from gcc's headers.
+static inline __m256d Gather4(const double *base, __m128i indices) {
+  return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, indices,
+				  _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+}
+#endif
+
+// Copies the opponent reach probability of each hand into probs[], in hand order.
+static void GatherOppProbs(const unsigned char *his, const unsigned char *los, int n,
+			   int max_card1, const double *opp_probs, double *probs) {
+  int i = 0;
+#if defined(__AVX512F__)
+  __m256i vmc1 = _mm256_set1_epi32(max_card1);
+  for (; i + 8 <= n; i += 8) {
+    __m256i enc = _mm256_add_epi32(_mm256_mullo_epi32(LoadCards8(his + i), vmc1),
+				   LoadCards8(los + i));
+    _mm512_storeu_pd(probs + i, _mm512_i32gather_pd(enc, opp_probs, 8));
+  }
+#elif defined(__AVX2__)
+  __m128i vmc1 = _mm_set1_epi32(max_card1);
+  for (; i + 4 <= n; i += 4) {
+    __m128i enc = _mm_add_epi32(_mm_mullo_epi32(LoadCards4(his + i), vmc1), LoadCards4(los + i));
+    _mm256_storeu_pd(probs + i, Gather4(opp_probs, enc));
+  }
+#endif
+  for (; i < n; ++i) {
+    probs[i] = opp_probs[his[i] * max_card1 + los[i]];
+  }
+}
+
+// Probability of the opponent holding a weaker hand: cum_prob minus the weaker hands that
+// conflict with our cards.
+static void WinProbs(const unsigned char *his, const unsigned char *los, int n, double cum_prob,
+		     const double *cum_card_probs, double *win_probs) {
+  int i = 0;
+#if defined(__AVX512F__)
+  __m512d vcp = _mm512_set1_pd(cum_prob);
+  for (; i + 8 <= n; i += 8) {
+    __m512d chi = _mm512_i32gather_pd(LoadCards8(his + i), cum_card_probs, 8);
+    __m512d clo = _mm512_i32gather_pd(LoadCards8(los + i), cum_card_probs, 8);
+    _mm512_storeu_pd(win_probs + i, _mm512_sub_pd(_mm512_sub_pd(vcp, chi), clo));
+  }
+#elif defined(__AVX2__)
+  __m256d vcp = _mm256_set1_pd(cum_prob);
+  for (; i + 4 <= n; i += 4) {
+    __m256d chi = Gather4(cum_card_probs, LoadCards4(his + i));
+    __m256d clo = Gather4(cum_card_probs, LoadCards4(los + i));
+    _mm256_storeu_pd(win_probs + i, _mm256_sub_pd(_mm256_sub_pd(vcp, chi), clo));
+  }
+#endif
+  for (; i < n; ++i) {
+    win_probs[i] = cum_prob - cum_card_probs[his[i]] - cum_card_probs[los[i]];
+  }
+}
+
+// On entry vals[] holds the win probs; on exit it holds the showdown values.  stronger_prob is
+// the total opponent probability of the stronger hands (sum_opp_probs - cum_prob).
+static void ShowdownVals(const unsigned char *his, const unsigned char *los, int n,
+			 double stronger_prob, const double *total_card_probs,
+			 const double *cum_card_probs, double half_pot, double *vals) {
+  int i = 0;
+#if defined(__AVX512F__)
+  __m512d vsp = _mm512_set1_pd(stronger_prob);
+  __m512d vhp = _mm512_set1_pd(half_pot);
+  for (; i + 8 <= n; i += 8) {
+    __m256i hi = LoadCards8(his + i);
+    __m256i lo = LoadCards8(los + i);
+    __m512d better_hi = _mm512_sub_pd(_mm512_i32gather_pd(hi, total_card_probs, 8),
+				      _mm512_i32gather_pd(hi, cum_card_probs, 8));
+    __m512d better_lo = _mm512_sub_pd(_mm512_i32gather_pd(lo, total_card_probs, 8),
+				      _mm512_i32gather_pd(lo, cum_card_probs, 8));
+    __m512d lose = _mm512_sub_pd(_mm512_sub_pd(vsp, better_hi), better_lo);
+    _mm512_storeu_pd(vals + i, _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(vals + i), lose), vhp));
+  }
+#elif defined(__AVX2__)
+  __m256d vsp = _mm256_set1_pd(stronger_prob);
+  __m256d vhp = _mm256_set1_pd(half_pot);
+  for (; i + 4 <= n; i += 4) {
+    __m128i hi = LoadCards4(his + i);
+    __m128i lo = LoadCards4(los + i);
+    __m256d better_hi = _mm256_sub_pd(Gather4(total_card_probs, hi),
+				      Gather4(cum_card_probs, hi));
+    __m256d better_lo = _mm256_sub_pd(Gather4(total_card_probs, lo),
+				      Gather4(cum_card_probs, lo));
+    __m256d lose = _mm256_sub_pd(_mm256_sub_pd(vsp, better_hi), better_lo);
+    _mm256_storeu_pd(vals + i, _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(vals + i), lose), vhp));
+  }
+#endif
+  for (; i < n; ++i) {
+    double better_hi_prob = total_card_probs[his[i]] - cum_card_probs[his[i]];
+    double better_lo_prob = total_card_probs[los[i]] - cum_card_probs[los[i]];
+    double lose_prob = stronger_prob - better_hi_prob - better_lo_prob;
+    vals[i] = (vals[i] - lose_prob) * half_pot;
+  }
+}
+
+// Assumes the hands have been sorted by SortByHandStrength().
 shared_ptr<double []> Showdown(Node *node, const CanonicalCards *hands, double *opp_probs,
 			       double sum_opp_probs, double *total_card_probs) {
   int max_card1 = Game::MaxCard() + 1;
@@ -153,51 +291,32 @@ shared_ptr<double []> Showdown(Node *node, const CanonicalCards *hands, double *
   double cum_card_probs[52];
   for (Card c = 0; c < max_card1; ++c) cum_card_probs[c] = 0;
   int num_hole_card_pairs = hands->NumRaw();
-  unique_ptr<double []> win_probs(new double[num_hole_card_pairs]);
+  const unsigned char *his = hands->HiCards();
+  const unsigned char *los = hands->LoCards();
+  const int *range_begins = hands->RangeBegins();
+  int num_ranges = hands->NumRanges();
   double half_pot = node->LastBetTo();
   shared_ptr<double []> vals(new double[num_hole_card_pairs]);
+  unique_ptr<double []> probs(new double[num_hole_card_pairs]);
+  GatherOppProbs(his, los, num_hole_card_pairs, max_card1, opp_probs, probs.get());
 
-  int j = 0;
-  while (j < num_hole_card_pairs) {
-    int last_hand_val = hands->HandValue(j);
-    int begin_range = j;
-    // Make three passes through the range of equally strong hands
-    // First pass computes win counts for each hand and finds end of range
-    // Second pass updates cumulative counters
-    // Third pass computes lose counts for each hand
-    while (j < num_hole_card_pairs) {
-      int hand_val = hands->HandValue(j);
-      if (hand_val != last_hand_val) break;
-      const Card *cards = hands->Cards(j);
-      Card hi = cards[0];
-      Card lo = cards[1];
-      win_probs[j] = cum_prob - cum_card_probs[hi] - cum_card_probs[lo];
-      ++j;
-    }
-    // Positions begin_range...j-1 (inclusive) all have the same hand value
-    for (int k = begin_range; k < j; ++k) {
-      const Card *cards = hands->Cards(k);
-      Card hi = cards[0];
-      Card lo = cards[1];
-      int code = hi * max_card1 + lo;
-      double prob = opp_probs[code];
-      cum_card_probs[hi] += prob;
-      cum_card_probs[lo] += prob;
+  // For each range of equally strong hands:
+  // 1) Compute the win probs for each hand (stored temporarily in vals)
+  // 2) Update cumulative counters
+  // 3) Compute the lose probs and the final value for each hand
+  for (int r = 0; r < num_ranges; ++r) {
+    int begin = range_begins[r];
+    int n = range_begins[r + 1] - begin;
+    WinProbs(his + begin, los + begin, n, cum_prob, cum_card_probs, vals.get() + begin);
+    for (int k = begin; k < begin + n; ++k) {
+      double prob = probs[k];
+      cum_card_probs[his[k]] += prob;
+      cum_card_probs[los[k]] += prob;
       cum_prob += prob;
     }
-    for (int k = begin_range; k < j; ++k) {
-      const Card *cards = hands->Cards(k);
-      Card hi = cards[0];
-      Card lo = cards[1];
-      double better_hi_prob = total_card_probs[hi] - cum_card_probs[hi];
-      double better_lo_prob = total_card_probs[lo] - cum_card_probs[lo];
-      double lose_prob = (sum_opp_probs - cum_prob) -
-	better_hi_prob - better_lo_prob;
-      vals[k] = (win_probs[k] - lose_prob) * half_pot;
-      // fprintf(stderr, "vals[%u] %f sop %f\n", k, vals[k], sum_opp_probs);
-    }
+    ShowdownVals(his + begin, los + begin, n, sum_opp_probs - cum_prob, total_card_probs,
+		 cum_card_probs, half_pot, vals.get() + begin);
   }
-  // fprintf(stderr, "showdown %i vals[0] %f\n", node->TerminalID(), vals[0]);
 
   return vals;
 }
@@ -215,14 +334,44 @@ shared_ptr<double []> Fold(Node *node, int p, const CanonicalCards *hands, doubl
     half_pot = -node->LastBetTo();
   }
   int num_hole_card_pairs = hands->NumRaw();
+  const unsigned char *his = hands->HiCards();
+  const unsigned char *los = hands->LoCards();
   shared_ptr<double []> vals(new double[num_hole_card_pairs]);
 
-  for (int i = 0; i < num_hole_card_pairs; ++i) {
-    const Card *cards = hands->Cards(i);
-    Card hi = cards[0];
-    Card lo = cards[1];
-    int enc = hi * max_card1 + lo;
-    double opp_prob = opp_probs[enc];
+  int i = 0;
+#if defined(__AVX512F__)
+  __m256i vmc1 = _mm256_set1_epi32(max_card1);
+  __m512d vsop = _mm512_set1_pd(sum_opp_probs);
+  __m512d vhp = _mm512_set1_pd(half_pot);
+  for (; i + 8 <= num_hole_card_pairs; i += 8) {
+    __m256i hi = LoadCards8(his + i);
+    __m256i lo = LoadCards8(los + i);
+    __m256i enc = _mm256_add_epi32(_mm256_mullo_epi32(hi, vmc1), lo);
+    __m512d opp_prob = _mm512_i32gather_pd(enc, opp_probs, 8);
+    __m512d card_probs = _mm512_add_pd(_mm512_i32gather_pd(hi, total_card_probs, 8),
+				       _mm512_i32gather_pd(lo, total_card_probs, 8));
+    _mm512_storeu_pd(vals.get() + i,
+		     _mm512_mul_pd(vhp, _mm512_sub_pd(_mm512_add_pd(vsop, opp_prob), card_probs)));
+  }
+#elif defined(__AVX2__)
+  __m128i vmc1 = _mm_set1_epi32(max_card1);
+  __m256d vsop = _mm256_set1_pd(sum_opp_probs);
+  __m256d vhp = _mm256_set1_pd(half_pot);
+  for (; i + 4 <= num_hole_card_pairs; i += 4) {
+    __m128i hi = LoadCards4(his + i);
+    __m128i lo = LoadCards4(los + i);
+    __m128i enc = _mm_add_epi32(_mm_mullo_epi32(hi, vmc1), lo);
+    __m256d opp_prob = Gather4(opp_probs, enc);
+    __m256d card_probs = _mm256_add_pd(Gather4(total_card_probs, hi),
+				       Gather4(total_card_probs, lo));
+    _mm256_storeu_pd(vals.get() + i,
+		     _mm256_mul_pd(vhp, _mm256_sub_pd(_mm256_add_pd(vsop, opp_prob), card_probs)));
+  }
+#endif
+  for (; i < num_hole_card_pairs; ++i) {
+    Card hi = his[i];
+    Card lo = los[i];
+    double opp_prob = opp_probs[hi * max_card1 + lo];
     vals[i] = half_pot *
       (sum_opp_probs + opp_prob - (total_card_probs[hi] + total_card_probs[lo]));
   }
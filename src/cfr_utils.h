@@ -11,10 +11,11 @@ class CFRConfig;
 class Node;
 
 template <typename T> void RMProbs(const T *vals, int num_succs, int dsi, double *probs);
-template <typename T> void ComputeOurValsBucketed(const T *all_cs_vals, int num_hole_card_pairs,
-						  int num_succs, int dsi,
+template <typename T> void ComputeOurValsBucketed(const T *all_cs_vals, int num_succs, int dsi,
 						  std::shared_ptr<double []> *succ_vals,
-						  int *street_buckets,
+						  const int *street_buckets,
+						  const int *bucket_order, const int *run_begins,
+						  int num_runs, double *probs,
 						  std::shared_ptr<double []> vals);
 template <typename T> void ComputeOurVals(const T *all_cs_vals, int num_hole_card_pairs,
 					  int num_succs, int dsi,
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <memory>
 #include <string>
@@ -14,9 +15,12 @@
 #include "game.h"
 #include "io.h"
 #include "nonterminal_ids.h"
+#include "value_compression.h"
 
+using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
+using std::vector;
 
 void CFRValues::Initialize(const bool *players, const bool *streets, int root_bd, int root_bd_st,
 			   const Buckets &buckets) {
@@ -50,6 +54,8 @@ void CFRValues::Initialize(const bool *players, const bool *streets, int root_bd
 
   street_values_.reset(new AbstractCFRStreetValues *[max_street + 1]);
   for (int st = 0; st <= max_street; ++st) street_values_[st] = nullptr;
+  compressed_streets_.reset(new bool[max_street + 1]);
+  for (int st = 0; st <= max_street; ++st) compressed_streets_[st] = false;
 }
 
 CFRValues::CFRValues(const bool *players, const bool *streets, int root_bd, int root_bd_st,
@@ -115,6 +121,10 @@ CFRValues::CFRValues(const CFRValues &p0_values, const CFRValues &p1_values) {
     }
     num_holdings_[st] = p0_values.NumHoldings(st);
   }
+  compressed_streets_.reset(new bool[max_street + 1]);
+  for (int st = 0; st <= max_street; ++st) {
+    compressed_streets_[st] = p0_values.CompressedStreet(st);
+  }
   street_values_.reset(new AbstractCFRStreetValues *[max_street + 1]);
   for (int st = 0; st <= max_street; ++st) {
     if (! streets_[st]) {
@@ -137,6 +147,9 @@ CFRValues::CFRValues(const CFRValues &p0_values, const CFRValues &p1_values) {
       exit(-1);
     }
   }
+  mapped_files_ = p0_values.mapped_files_;
+  mapped_files_.insert(mapped_files_.end(), p1_values.mapped_files_.begin(),
+		       p1_values.mapped_files_.end());
   // Don't need to fill out num_nonterminals_
 }
 
@@ -272,9 +285,24 @@ void CFRValues::Read(Node *node, Reader ***readers, void ***decompressors, int p
   }
 }
 
-Reader *CFRValues::InitializeReader(const char *dir, int p, int st, int it,
-				    const string &action_sequence, int root_bd_st, int root_bd,
-				    bool sumprobs, CFRValueType *value_type) {
+void CFRValues::SetCompressedStreets(const vector<int> &streets) {
+  int max_street = Game::MaxStreet();
+  for (int st = 0; st <= max_street; ++st) compressed_streets_[st] = false;
+  int num = streets.size();
+  for (int i = 0; i < num; ++i) {
+    int st = streets[i];
+    if (st < 0 || st > max_street) {
+      fprintf(stderr, "SetCompressedStreets: bad street %i\n", st);
+      exit(-1);
+    }
+    compressed_streets_[st] = true;
+  }
+}
+
+// A compressed file has the same name as the uncompressed file plus a trailing 'z'.
+string CFRValues::FindFile(const char *dir, int p, int st, int it, const string &action_sequence,
+			   int root_bd_st, int root_bd, bool sumprobs, CFRValueType *value_type,
+			   bool *compressed) {
   char buf[500];
 
   int t;
@@ -295,6 +323,10 @@ Reader *CFRValues::InitializeReader(const char *dir, int p, int st, int it,
     }
     sprintf(buf, "%s/%s.%s.%u.%u.%u.%u.p%u.%c", dir, sumprobs ? "sumprobs" : "regrets",
 	    action_sequence.c_str(), root_bd_st, root_bd, st, it, p, suffix);
+    *compressed = false;
+    if (FileExists(buf)) break;
+    strcat(buf, "z");
+    *compressed = true;
     if (FileExists(buf)) break;
   }
   if (t == 4) {
@@ -302,35 +334,71 @@ Reader *CFRValues::InitializeReader(const char *dir, int p, int st, int it,
     fprintf(stderr, "buf: %s\n", buf);
     exit(-1);
   }
-  Reader *reader = new Reader(buf);
+  return buf;
+}
+
+Reader *CFRValues::InitializeReader(const char *dir, int p, int st, int it,
+				    const string &action_sequence, int root_bd_st, int root_bd,
+				    bool sumprobs, CFRValueType *value_type,
+				    ValueDecompressor **decompressor) {
+  bool compressed;
+  string filename = FindFile(dir, p, st, it, action_sequence, root_bd_st, root_bd, sumprobs,
+			     value_type, &compressed);
+  Reader *reader = new Reader(filename.c_str());
+  *decompressor = compressed ? new ValueDecompressor(reader) : nullptr;
   return reader;
 }
 
+// Checks that every reader consumed its whole file and deletes the readers and decompressors.
+void CFRValues::DeleteReaders(Reader ***readers, void ***decompressors, int only_p) const {
+  int num_players = Game::NumPlayers();
+  int max_street = Game::MaxStreet();
+  for (int p = 0; p < num_players; ++p) {
+    if (only_p != -1 && p != only_p) continue;
+    if (! players_[p]) continue;
+    for (int st = 0; st <= max_street; ++st) {
+      if (! streets_[st]) continue;
+      ValueDecompressor *decompressor = (ValueDecompressor *)decompressors[p][st];
+      bool at_end = decompressor ? decompressor->AtEnd() : readers[p][st]->AtEnd();
+      if (! at_end) {
+	fprintf(stderr, "Reader p %u st %u didn't get to end\n", p, st);
+	fprintf(stderr, "Pos: %lli\n", readers[p][st]->BytePos());
+	fprintf(stderr, "File size: %lli\n", readers[p][st]->FileSize());
+	exit(-1);
+      }
+      delete decompressor;
+      delete readers[p][st];
+    }
+    delete [] readers[p];
+    delete [] decompressors[p];
+  }
+  delete [] readers;
+  delete [] decompressors;
+}
+
 void CFRValues::Read(const char *dir, int it, const BettingTree *betting_tree,
 		     const string &action_sequence, int only_p, bool sumprobs, bool quantize) {
   int num_players = Game::NumPlayers();
   Reader ***readers = new Reader **[num_players];
-  void ***decompressors = nullptr;
+  void ***decompressors = new void **[num_players];
   int max_street = Game::MaxStreet();
 
   for (int p = 0; p < num_players; ++p) {
-    if (only_p != -1 && p != only_p) {
-      readers[p] = nullptr;
-      continue;
-    }
-    if (! players_[p]) {
-      readers[p] = nullptr;
-      continue;
-    }
+    readers[p] = nullptr;
+    decompressors[p] = nullptr;
+    if (only_p != -1 && p != only_p) continue;
+    if (! players_[p]) continue;
     readers[p] = new Reader *[max_street + 1];
+    decompressors[p] = new void *[max_street + 1];
     for (int st = 0; st <= max_street; ++st) {
-      if (! streets_[st]) {
-	readers[p][st] = nullptr;
-	continue;
-      }
+      readers[p][st] = nullptr;
+      decompressors[p][st] = nullptr;
+      if (! streets_[st]) continue;
       CFRValueType value_type;
+      ValueDecompressor *decompressor;
       readers[p][st] = InitializeReader(dir, p, st, it, action_sequence, root_bd_st_, root_bd_,
-					sumprobs, &value_type);
+					sumprobs, &value_type, &decompressor);
+      decompressors[p][st] = decompressor;
       if (street_values_[st] == nullptr) {
 	CreateStreetValues(st, value_type, quantize);
       }
@@ -343,23 +411,82 @@ void CFRValues::Read(const char *dir, int it, const BettingTree *betting_tree,
     }    
   }
   
+  DeleteReaders(readers, decompressors, only_p);
+}
+
+void CFRValues::Map(Node *node, const unsigned char ***bases, long long int **offsets, int p) {
+  if (node->Terminal()) return;
+  int st = node->Street();
+  int num_succs = node->NumSuccs();
+  int pa = node->PlayerActing();
+  if (street_values_[st] && pa == p) {
+    street_values_[st]->MapNode(node, bases[p][st], &offsets[p][st]);
+  }
+  for (int s = 0; s < num_succs; ++s) {
+    Map(node->IthSucc(s), bases, offsets, p);
+  }
+}
+
+// The files are in the same format that Read() consumes: each node's values, in the order of a
+// depth-first traversal, with nothing in between.  So we can compute each node's offset in a
+// traversal up front without touching the data.
+void CFRValues::Map(const char *dir, int it, const BettingTree *betting_tree,
+		    const string &action_sequence, int only_p, bool sumprobs) {
+  int num_players = Game::NumPlayers();
+  int max_street = Game::MaxStreet();
+  unique_ptr<const unsigned char **[]> bases(new const unsigned char **[num_players]);
+  unique_ptr<long long int *[]> offsets(new long long int *[num_players]);
+  unique_ptr<MappedFile *[]> files(new MappedFile *[num_players * (max_street + 1)]);
   for (int p = 0; p < num_players; ++p) {
-    if (only_p != -1 && p != only_p) continue;
-    if (! players_[p]) continue;
+    bases[p] = new const unsigned char *[max_street + 1];
+    offsets[p] = new long long int[max_street + 1];
     for (int st = 0; st <= max_street; ++st) {
-      if (! streets_[st]) continue;
-      if (! readers[p][st]->AtEnd()) {
-	fprintf(stderr, "Reader p %u st %u didn't get to end\n", p, st);
-	fprintf(stderr, "Pos: %lli\n", readers[p][st]->BytePos());
-	fprintf(stderr, "File size: %lli\n", readers[p][st]->FileSize());
+      bases[p][st] = nullptr;
+      offsets[p][st] = 0;
+      files[p * (max_street + 1) + st] = nullptr;
+      if (only_p != -1 && p != only_p) continue;
+      if (! players_[p] || ! streets_[st]) continue;
+      CFRValueType value_type;
+      bool compressed;
+      string filename = FindFile(dir, p, st, it, action_sequence, root_bd_st_, root_bd_,
+				 sumprobs, &value_type, &compressed);
+      if (compressed) {
+	fprintf(stderr, "CFRValues::Map(): can't map compressed file %s\n", filename.c_str());
 	exit(-1);
       }
-      delete readers[p][st];
+      if (street_values_[st] == nullptr) {
+	CreateStreetValues(st, value_type, false);
+      } else if (street_values_[st]->MyType() != value_type) {
+	fprintf(stderr, "CFRValues::Map(): type of %s doesn't match existing values\n",
+		filename.c_str());
+	exit(-1);
+      }
+      shared_ptr<MappedFile> file(new MappedFile(filename.c_str()));
+      mapped_files_.push_back(file);
+      files[p * (max_street + 1) + st] = file.get();
+      bases[p][st] = file->Data();
     }
-    delete [] readers[p];
   }
-  delete [] readers;
-  delete [] decompressors;
+
+  for (int p = 0; p < num_players; ++p) {
+    if ((only_p == -1 || p == only_p) && players_[p]) {
+      Map(betting_tree->Root(), bases.get(), offsets.get(), p);
+    }
+  }
+
+  for (int p = 0; p < num_players; ++p) {
+    for (int st = 0; st <= max_street; ++st) {
+      MappedFile *file = files[p * (max_street + 1) + st];
+      if (file && offsets[p][st] != file->Size()) {
+	fprintf(stderr, "CFRValues::Map(): p %u st %u offset %lli doesn't match file size %lli\n",
+		p, st, offsets[p][st], file->Size());
+	fprintf(stderr, "File: %s\n", file->Filename().c_str());
+	exit(-1);
+      }
+    }
+    delete [] bases[p];
+    delete [] offsets[p];
+  }
 }
 
 // For asymmetric systems.  For when you want P0's values to be the values trained for a target
@@ -370,29 +497,27 @@ void CFRValues::ReadAsymmetric(const char *dir, int it, const BettingTrees &bett
 			       bool quantize) {
   int num_players = Game::NumPlayers();
   Reader ***readers = new Reader **[num_players];
-  void ***decompressors = nullptr;
+  void ***decompressors = new void **[num_players];
   int max_street = Game::MaxStreet();
   char asym_dir[500];
 
   for (int p = 0; p < num_players; ++p) {
-    if (only_p != -1 && p != only_p) {
-      readers[p] = nullptr;
-      continue;
-    }
-    if (! players_[p]) {
-      readers[p] = nullptr;
-      continue;
-    }
+    readers[p] = nullptr;
+    decompressors[p] = nullptr;
+    if (only_p != -1 && p != only_p) continue;
+    if (! players_[p]) continue;
     sprintf(asym_dir, "%s.p%i", dir, p);
     readers[p] = new Reader *[max_street + 1];
+    decompressors[p] = new void *[max_street + 1];
     for (int st = 0; st <= max_street; ++st) {
-      if (! streets_[st]) {
-	readers[p][st] = nullptr;
-	continue;
-      }
+      readers[p][st] = nullptr;
+      decompressors[p][st] = nullptr;
+      if (! streets_[st]) continue;
       CFRValueType value_type;
+      ValueDecompressor *decompressor;
       readers[p][st] = InitializeReader(asym_dir, p, st, it, action_sequence, root_bd_st_, root_bd_,
-					sumprobs, &value_type);
+					sumprobs, &value_type, &decompressor);
+      decompressors[p][st] = decompressor;
       if (street_values_[st] == nullptr) {
 	CreateStreetValues(st, value_type, quantize);
       }
@@ -405,23 +530,7 @@ void CFRValues::ReadAsymmetric(const char *dir, int it, const BettingTrees &bett
     }    
   }
   
-  for (int p = 0; p < num_players; ++p) {
-    if (only_p != -1 && p != only_p) continue;
-    if (! players_[p]) continue;
-    for (int st = 0; st <= max_street; ++st) {
-      if (! streets_[st]) continue;
-      if (! readers[p][st]->AtEnd()) {
-	fprintf(stderr, "Reader p %u st %u didn't get to end\n", p, st);
-	fprintf(stderr, "Pos: %lli\n", readers[p][st]->BytePos());
-	fprintf(stderr, "File size: %lli\n", readers[p][st]->FileSize());
-	exit(-1);
-      }
-      delete readers[p][st];
-    }
-    delete [] readers[p];
-  }
-  delete [] readers;
-  delete [] decompressors;
+  DeleteReaders(readers, decompressors, only_p);
 }
 
 // Prevent redundant writing with reentrant trees
@@ -452,9 +561,10 @@ static void DeleteWriters(Writer ***writers, void ***compressors) {
   for (int p = 0; p < num_players; ++p) {
     if (writers[p] == nullptr) continue;
     for (int st = 0; st <= max_street; ++st) {
-      if (compressors[p][st]) {
-	fprintf(stderr, "Didn't expect compressors\n");
-	exit(-1);
+      ValueCompressor *compressor = (ValueCompressor *)compressors[p][st];
+      if (compressor) {
+	compressor->Finish();
+	delete compressor;
       }
       delete writers[p][st];
     }
@@ -502,8 +612,19 @@ Writer ***CFRValues::InitializeWriters(const char *dir, int it, const string &ac
       sprintf(buf, "%s/%s.%s.%u.%u.%u.%u.p%u.%c", dir,
 	      sumprobs ? "sumprobs" : "regrets", action_sequence.c_str(),
 	      root_bd_st_, root_bd_, st, it, p, suffix);
+      if (compressed_streets_[st]) {
+	if (value_type == CFRValueType::CFR_DOUBLE) {
+	  fprintf(stderr, "Compression not supported for double values (street %i)\n", st);
+	  exit(-1);
+	}
+	strcat(buf, "z");
+      }
       writers[p][st] = new Writer(buf);
-      (*compressors)[p][st] = nullptr;
+      if (compressed_streets_[st]) {
+	(*compressors)[p][st] = new ValueCompressor(writers[p][st]);
+      } else {
+	(*compressors)[p][st] = nullptr;
+      }
     }
   }
   return writers;
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "betting_tree.h"
 #include "cfr_street_values.h"
@@ -11,7 +12,9 @@
 class BettingTree;
 class BettingTrees;
 class Buckets;
+class MappedFile;
 class Node;
+class ValueDecompressor;
 
 class CFRValues {
  public:
@@ -29,11 +32,21 @@ class CFRValues {
   void CreateStreetValues(int st, CFRValueType value_type, bool quantize);
   void Read(const char *dir, int it, const BettingTree *betting_tree,
 	    const std::string &action_sequence, int only_p, bool sumprobs, bool quantize);
+  // Like Read(), but maps the files into memory rather than copying them.  Each node's values point
+  // directly into the mapping, so loading is nearly instantaneous, pages are only brought in when
+  // touched, and processes mapping the same files share one copy in the page cache.  The values
+  // are read-only and keep the type they have on disk (no quantization).
+  void Map(const char *dir, int it, const BettingTree *betting_tree,
+	   const std::string &action_sequence, int only_p, bool sumprobs);
   void ReadAsymmetric(const char *dir, int it, const BettingTrees &betting_trees,
 		      const std::string &action_sequence, int only_p, bool sumprobs,
 		      bool quantize);
   void Write(const char *dir, int it, Node *root, const std::string &action_sequence, int only_p,
 	     bool sumprobs) const;
+  // Write() compresses the values for these streets (see value_compression.h).  Read() detects
+  // compressed files by name, so nothing needs to be set to read them.
+  void SetCompressedStreets(const std::vector<int> &streets);
+  bool CompressedStreet(int st) const {return compressed_streets_[st];}
   // Note: doesn't handle nodes with one succ
   void RMProbs(int st, int p, int nt, int offset, int num_succs, int dsi,
 	       double *probs) const {
@@ -65,9 +78,15 @@ class CFRValues {
   int RootBd(void) const {return root_bd_;}
  protected:
   void Read(Node *node, Reader ***readers, void ***decompressors, int p);
+  void Map(Node *node, const unsigned char ***bases, long long int **offsets, int p);
+  std::string FindFile(const char *dir, int p, int st, int it, const std::string &action_sequence,
+		       int root_bd_st, int root_bd, bool sumprobs, CFRValueType *value_type,
+		       bool *compressed);
   Reader *InitializeReader(const char *dir, int p, int st, int it,
 			   const std::string &action_sequence, int root_bd_st, int root_bd,
-			   bool sumprobs, CFRValueType *value_type);
+			   bool sumprobs, CFRValueType *value_type,
+			   ValueDecompressor **decompressor);
+  void DeleteReaders(Reader ***readers, void ***decompressors, int only_p) const;
   void Write(Node *node, Writer ***writers, void ***compressors, bool ***seen) const;
   Writer ***InitializeWriters(const char *dir, int it, const std::string &action_sequence,
 			      int only_p, bool sumprobs, void ****compressors) const;
@@ -83,6 +102,10 @@ class CFRValues {
   int root_bd_st_;
   std::unique_ptr<int []> num_holdings_;
   std::unique_ptr<int []> num_nonterminals_;
+  std::unique_ptr<bool []> compressed_streets_;
+  // Mappings backing any values loaded with Map().  Shared so that values combined from two
+  // CFRValues objects keep them alive.
+  std::vector< std::shared_ptr<MappedFile> > mapped_files_;
 };
 
 #endif
@@ -82,6 +82,8 @@ void CFRP::Initialize(const BettingAbstraction &ba, int target_p) {
     sumprobs_.reset(new CFRValues(nullptr, streets.get(), 0, 0, buckets_,
 				  betting_trees_->GetBettingTree()));
   }
+  regrets_->SetCompressedStreets(cfr_config_.CompressedStreets());
+  sumprobs_->SetCompressedStreets(cfr_config_.CompressedStreets());
 
   unique_ptr<bool []> bucketed_streets(new bool[max_street + 1]);
   bucketed_ = false;
@@ -317,9 +319,10 @@ void CFRP::HalfIteration(int p) {
   }
 }
 
-void CFRP::Checkpoint(int it) {
+// The directory for our regrets and sumprobs under the given base (the old or new CFR base)
+string CFRP::CheckpointDir(const char *base) const {
   char dir[500];
-  sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::NewCFRBase(),
+  sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", base,
 	  Game::GameName().c_str(), Game::NumPlayers(),
 	  card_abstraction_.CardAbstractionName().c_str(), Game::NumRanks(),
 	  Game::NumSuits(), Game::MaxStreet(), betting_abstraction_name_.c_str(),
@@ -329,34 +332,25 @@ void CFRP::Checkpoint(int it) {
     sprintf(buf, ".p%u", target_p_);
     strcat(dir, buf);
   }
-  Mkdir(dir);
-  regrets_->Write(dir, it, betting_trees_->Root(), "x", -1, false);
-  sumprobs_->Write(dir, it, betting_trees_->Root(), "x", -1, true);
+  return dir;
 }
 
-void CFRP::ReadFromCheckpoint(int it) {
-  char dir[500];
-  sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::OldCFRBase(),
-	  Game::GameName().c_str(), Game::NumPlayers(),
-	  card_abstraction_.CardAbstractionName().c_str(), Game::NumRanks(),
-	  Game::NumSuits(), Game::MaxStreet(), betting_abstraction_name_.c_str(),
-	  cfr_config_.CFRConfigName().c_str());
-  if (asymmetric_) {
-    char buf[100];
-    sprintf(buf, ".p%u", target_p_);
-    strcat(dir, buf);
-  }
-  regrets_->Read(dir, it, betting_trees_->GetBettingTree(), "x", -1, false, false);
-  sumprobs_->Read(dir, it, betting_trees_->GetBettingTree(), "x", -1, true, false);
+void CFRP::Checkpoint(int it) {
+  string dir = CheckpointDir(Files::NewCFRBase());
+  Mkdir(dir.c_str());
+  regrets_->Write(dir.c_str(), it, betting_trees_->Root(), "x", -1, false);
+  sumprobs_->Write(dir.c_str(), it, betting_trees_->Root(), "x", -1, true);
 }
 
-void CFRP::Run(int start_it, int end_it) {
-  if (start_it == 0) {
-    fprintf(stderr, "CFR starts from iteration 1\n");
-    exit(-1);
-  }
-  DeleteOldFiles(card_abstraction_, betting_abstraction_name_, cfr_config_, end_it);
+void CFRP::ReadFromCheckpoint(int it) {
+  string dir = CheckpointDir(Files::OldCFRBase());
+  regrets_->Read(dir.c_str(), it, betting_trees_->GetBettingTree(), "x", -1, false, false);
+  sumprobs_->Read(dir.c_str(), it, betting_trees_->GetBettingTree(), "x", -1, true, false);
+}
 
+// Reads the regrets and sumprobs from the previous checkpoint or, when starting from scratch,
+// allocates them.
+void CFRP::InitializeValues(int start_it) {
   if (start_it > 1) {
     ReadFromCheckpoint(start_it - 1);
     last_checkpoint_it_ = start_it - 1;
@@ -383,6 +377,15 @@ void CFRP::Run(int start_it, int end_it) {
     current_strategy_->AllocateAndClear(betting_trees_->GetBettingTree(), CFRValueType::CFR_DOUBLE,
 					false, -1);
   }
+}
+
+void CFRP::Run(int start_it, int end_it) {
+  if (start_it == 0) {
+    fprintf(stderr, "CFR starts from iteration 1\n");
+    exit(-1);
+  }
+  DeleteOldFiles(card_abstraction_, betting_abstraction_name_, cfr_config_, end_it);
+  InitializeValues(start_it);
 
   if (subgame_street_ >= 0 && subgame_street_ <= Game::MaxStreet()) {
     prune_ = false;
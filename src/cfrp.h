@@ -35,8 +35,10 @@ public:
 #endif
   void FloorRegrets(Node *node, int p);
   void HalfIteration(int p);
+  std::string CheckpointDir(const char *base) const;
   void Checkpoint(int it);
-  void ReadFromCheckpoint(int it);
+  virtual void ReadFromCheckpoint(int it);
+  void InitializeValues(int start_it);
 
   bool asymmetric_;
   std::string betting_abstraction_name_;
@@ -214,9 +214,7 @@ void CombinedEGCFR::SolveSubgame(BettingTrees *subtrees, int solve_bd,
   for (int p = 0; p < num_players; ++p) {
     players[p] = p == target_p;
   }
-  sumprobs_.reset(new CFRValues(players.get(), subtree_streets.get(), solve_bd, subtree_st,
-				buckets_, subtrees->GetBettingTree()));
-  sumprobs_->AllocateAndClear(subtrees->GetBettingTree(), CFRValueType::CFR_DOUBLE, false, -1);
+  InitializeSumprobs(players.get(), subtree_streets.get(), solve_bd, subtree_st, subtrees);
 
   int num_hole_card_pairs = Game::NumHoleCardPairs(subtree_st);
   combined_regrets_.reset(new double[num_hole_card_pairs * 2]);
@@ -225,7 +223,7 @@ void CombinedEGCFR::SolveSubgame(BettingTrees *subtrees, int solve_bd,
     combined_regrets_[i * 2 + 1] = 0;
   }
   
-  for (it_ = 1; it_ <= num_its; ++it_) {
+  for (it_ = 1; it_ <= num_its && TimeForIteration(); ++it_) {
     // Go from high to low to mimic slumbot2017 code
     for (int p = (int)num_players - 1; p >= 0; --p) {
       HalfIteration(subtrees, target_p, p, reach_probs, hand_tree, action_sequence, opp_cvs);
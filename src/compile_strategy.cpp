@@ -0,0 +1,81 @@
+// Compiles the sumprobs of the given iteration into the table read by CompiledStrategy.  Once
+// the table exists, Agent uses it in place of the sumprobs.  8 bits is usually enough to play
+// with; use 16 for strategies with many small probabilities.
+//
+// Example:
+//   ../bin/compile_strategy holdem_params nnnull_params mb1b1_params cfrps_params 200 8
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+
+#include "betting_abstraction.h"
+#include "betting_abstraction_params.h"
+#include "betting_trees.h"
+#include "buckets.h"
+#include "card_abstraction.h"
+#include "card_abstraction_params.h"
+#include "cfr_config.h"
+#include "cfr_params.h"
+#include "compiled_strategy.h"
+#include "disk_probs.h"
+#include "files.h"
+#include "game.h"
+#include "game_params.h"
+#include "io.h"
+#include "params.h"
+
+using std::string;
+using std::unique_ptr;
+
+// Compiling reads the sumprobs sequentially, so a small cache suffices
+static const long long int kDiskProbsCacheBytes = 1LL << 26;
+
+static void Usage(const char *prog_name) {
+  fprintf(stderr, "USAGE: %s <game params> <card params> <betting params> <CFR params> <it> "
+	  "<bits>\n", prog_name);
+  fprintf(stderr, "\n<bits> is 8 or 16\n");
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 7) Usage(argv[0]);
+  Files::Init();
+  unique_ptr<Params> game_params = CreateGameParams();
+  game_params->ReadFromFile(argv[1]);
+  Game::Initialize(*game_params);
+  unique_ptr<Params> card_params = CreateCardAbstractionParams();
+  card_params->ReadFromFile(argv[2]);
+  unique_ptr<CardAbstraction>
+    card_abstraction(new CardAbstraction(*card_params));
+  unique_ptr<Params> betting_params = CreateBettingAbstractionParams();
+  betting_params->ReadFromFile(argv[3]);
+  unique_ptr<BettingAbstraction>
+    betting_abstraction(new BettingAbstraction(*betting_params));
+  unique_ptr<Params> cfr_params = CreateCFRParams();
+  cfr_params->ReadFromFile(argv[4]);
+  unique_ptr<CFRConfig> cfr_config(new CFRConfig(*cfr_params));
+  int it, bits;
+  if (sscanf(argv[5], "%i", &it) != 1)   Usage(argv[0]);
+  if (sscanf(argv[6], "%i", &bits) != 1) Usage(argv[0]);
+  if (bits != 8 && bits != 16)           Usage(argv[0]);
+
+  Buckets buckets(*card_abstraction, false);
+  int max_street = Game::MaxStreet();
+  for (int st = 0; st <= max_street; ++st) {
+    if (buckets.None(st)) {
+      fprintf(stderr, "Only bucketed strategies can be compiled\n");
+      exit(-1);
+    }
+  }
+  BettingTrees betting_trees(*betting_abstraction);
+  const BettingTree *betting_tree = betting_trees.GetBettingTree();
+  DiskProbs disk_probs(*card_abstraction, *betting_abstraction, *cfr_config, buckets,
+		       betting_tree, it, kDiskProbsCacheBytes);
+  string filename = CompiledStrategy::Filename(*card_abstraction, *betting_abstraction,
+					       *cfr_config, it);
+  CompiledStrategy::Compile(buckets, betting_tree, &disk_probs, bits, filename);
+  printf("Wrote %s (%lli bytes)\n", filename.c_str(), FileSize(filename.c_str()));
+}
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "betting_abstraction.h"
+#include "betting_tree.h"
+#include "buckets.h"
+#include "card_abstraction.h"
+#include "cfr_config.h"
+#include "compiled_strategy.h"
+#include "disk_probs.h"
+#include "files.h"
+#include "game.h"
+#include "io.h"
+
+using std::string;
+using std::unique_ptr;
+
+string CompiledStrategy::Filename(const CardAbstraction &ca, const BettingAbstraction &ba,
+				  const CFRConfig &cc, int it) {
+  char buf[500];
+  sprintf(buf, "%s/%s.%u.%s.%i.%i.%i.%s.%s/compiled_strategy.x.0.0.%i", Files::OldCFRBase(),
+	  Game::GameName().c_str(), Game::NumPlayers(), ca.CardAbstractionName().c_str(),
+	  Game::NumRanks(), Game::NumSuits(), Game::MaxStreet(),
+	  ba.BettingAbstractionName().c_str(), cc.CFRConfigName().c_str(), it);
+  return buf;
+}
+
+static void GetNumSuccs(Node *node, unique_ptr<int []> *num_succs) {
+  if (node->Terminal()) return;
+  int max_street = Game::MaxStreet();
+  int pst = node->PlayerActing() * (max_street + 1) + node->Street();
+  num_succs[pst][node->NonterminalID()] = node->NumSuccs();
+  for (int s = 0; s < node->NumSuccs(); ++s) {
+    GetNumSuccs(node->IthSucc(s), num_succs);
+  }
+}
+
+CompiledStrategy::CompiledStrategy(const CardAbstraction &ca, const BettingAbstraction &ba,
+				   const CFRConfig &cc, const Buckets &buckets,
+				   const BettingTree *betting_tree, int it) {
+  string filename = Filename(ca, ba, cc, it);
+  file_.reset(new MappedFile(filename.c_str()));
+  const unsigned char *ptr = file_->Data();
+  const unsigned char *end = ptr + file_->Size();
+  int num_players = Game::NumPlayers();
+  int max_street = Game::MaxStreet();
+  long long int header_size = sizeof(int) * (1 + num_players * (max_street + 1));
+  if (file_->Size() < header_size) {
+    fprintf(stderr, "%s is truncated\n", filename.c_str());
+    exit(-1);
+  }
+  memcpy(&bits_, ptr, sizeof(int));
+  ptr += sizeof(int);
+  if (bits_ != 8 && bits_ != 16) {
+    fprintf(stderr, "%s: bad number of bits %i\n", filename.c_str(), bits_);
+    exit(-1);
+  }
+  max_value_ = (1U << bits_) - 1;
+  unique_ptr<int []> num_nts(new int[num_players * (max_street + 1)]);
+  for (int p = 0; p < num_players; ++p) {
+    for (int st = 0; st <= max_street; ++st) {
+      int num_nt;
+      memcpy(&num_nt, ptr, sizeof(int));
+      ptr += sizeof(int);
+      if (num_nt != betting_tree->NumNonterminals(p, st)) {
+	fprintf(stderr, "%s was compiled for a different betting tree\n", filename.c_str());
+	exit(-1);
+      }
+      num_nts[p * (max_street + 1) + st] = num_nt;
+    }
+  }
+  // The offsets aren't necessarily aligned in the file, so we copy them.
+  offsets_.reset(new unique_ptr<unique_ptr<long long int []> []>[num_players]);
+  for (int p = 0; p < num_players; ++p) {
+    offsets_[p].reset(new unique_ptr<long long int []>[max_street + 1]);
+    for (int st = 0; st <= max_street; ++st) {
+      int num_nt = num_nts[p * (max_street + 1) + st];
+      if (end - ptr < (long long int)(num_nt * sizeof(long long int))) {
+	fprintf(stderr, "%s is truncated\n", filename.c_str());
+	exit(-1);
+      }
+      offsets_[p][st].reset(new long long int[num_nt]);
+      memcpy(offsets_[p][st].get(), ptr, num_nt * sizeof(long long int));
+      ptr += num_nt * sizeof(long long int);
+    }
+  }
+  data_ = ptr;
+
+  // Check that the data is the size the betting tree and buckets call for
+  int num_pst = num_players * (max_street + 1);
+  unique_ptr<unique_ptr<int []> []> num_succs(new unique_ptr<int []>[num_pst]);
+  for (int pst = 0; pst < num_pst; ++pst) {
+    num_succs[pst].reset(new int[num_nts[pst]]);
+    for (int nt = 0; nt < num_nts[pst]; ++nt) num_succs[pst][nt] = 0;
+  }
+  GetNumSuccs(betting_tree->Root(), num_succs.get());
+  long long int data_size = 0;
+  for (int p = 0; p < num_players; ++p) {
+    for (int st = 0; st <= max_street; ++st) {
+      int pst = p * (max_street + 1) + st;
+      for (int nt = 0; nt < num_nts[pst]; ++nt) {
+	int ns = num_succs[pst][nt];
+	if (ns <= 1) continue;
+	if (offsets_[p][st][nt] != data_size) {
+	  fprintf(stderr, "%s: unexpected offset for p %i st %i nt %i\n", filename.c_str(), p,
+		  st, nt);
+	  exit(-1);
+	}
+	data_size += ((long long int)buckets.NumBuckets(st)) * (ns - 1) * (bits_ / 8);
+      }
+    }
+  }
+  if (end - data_ != data_size) {
+    fprintf(stderr, "%s has %lli bytes of data; expected %lli\n", filename.c_str(),
+	    (long long int)(end - data_), data_size);
+    exit(-1);
+  }
+}
+
+CompiledStrategy::~CompiledStrategy(void) {
+}
+
+const unsigned char *CompiledStrategy::Row(int p, int st, int nt, int b, int num_succs) const {
+  long long int offset = offsets_[p][st][nt];
+  if (offset < 0) {
+    fprintf(stderr, "CompiledStrategy: no table for p %i st %i nt %i\n", p, st, nt);
+    exit(-1);
+  }
+  int bytes = bits_ / 8;
+  return data_ + offset + ((long long int)b) * (num_succs - 1) * bytes;
+}
+
+int CompiledStrategy::Sample(int p, int st, int nt, int b, int num_succs, double r) const {
+  if (num_succs == 1) return 0;
+  const unsigned char *row = Row(p, st, nt, b, num_succs);
+  unsigned int u = r * max_value_;
+  int n = num_succs - 1;
+  if (bits_ == 8) {
+    for (int s = 0; s < n; ++s) {
+      if (u < row[s]) return s;
+    }
+  } else {
+    const unsigned short *us_row = (const unsigned short *)row;
+    for (int s = 0; s < n; ++s) {
+      if (u < us_row[s]) return s;
+    }
+  }
+  return n;
+}
+
+void CompiledStrategy::Probs(int p, int st, int nt, int b, int num_succs, double *probs) const {
+  if (num_succs == 0) return;
+  if (num_succs == 1) {
+    probs[0] = 1.0;
+    return;
+  }
+  const unsigned char *row = Row(p, st, nt, b, num_succs);
+  unsigned int last = 0;
+  for (int s = 0; s < num_succs; ++s) {
+    unsigned int cum;
+    if (s == num_succs - 1)  cum = max_value_;
+    else if (bits_ == 8)     cum = row[s];
+    else                     cum = ((const unsigned short *)row)[s];
+    probs[s] = (cum - last) / (double)max_value_;
+    last = cum;
+  }
+}
+
+// Quantizes the cumulative probabilities by rounding so that a succ's share of the range is as
+// close as possible to its probability.  The rounding errors don't accumulate.
+void CompiledStrategy::Compile(const Buckets &buckets, const BettingTree *betting_tree,
+			       DiskProbs *disk_probs, int bits, const string &filename) {
+  if (bits != 8 && bits != 16) {
+    fprintf(stderr, "CompiledStrategy::Compile: bits must be 8 or 16\n");
+    exit(-1);
+  }
+  unsigned int max_value = (1U << bits) - 1;
+  int num_players = Game::NumPlayers();
+  int max_street = Game::MaxStreet();
+  int num_pst = num_players * (max_street + 1);
+  unique_ptr<unique_ptr<int []> []> num_succs(new unique_ptr<int []>[num_pst]);
+  for (int p = 0; p < num_players; ++p) {
+    for (int st = 0; st <= max_street; ++st) {
+      int num_nt = betting_tree->NumNonterminals(p, st);
+      num_succs[p * (max_street + 1) + st].reset(new int[num_nt]);
+      for (int nt = 0; nt < num_nt; ++nt) num_succs[p * (max_street + 1) + st][nt] = 0;
+    }
+  }
+  GetNumSuccs(betting_tree->Root(), num_succs.get());
+
+  string tmp_filename = filename + ".tmp";
+  {
+    Writer writer(tmp_filename.c_str());
+    writer.WriteInt(bits);
+    for (int p = 0; p < num_players; ++p) {
+      for (int st = 0; st <= max_street; ++st) {
+	writer.WriteInt(betting_tree->NumNonterminals(p, st));
+      }
+    }
+    long long int offset = 0;
+    for (int p = 0; p < num_players; ++p) {
+      for (int st = 0; st <= max_street; ++st) {
+	int num_nt = betting_tree->NumNonterminals(p, st);
+	for (int nt = 0; nt < num_nt; ++nt) {
+	  int ns = num_succs[p * (max_street + 1) + st][nt];
+	  if (ns > 1) {
+	    writer.WriteLong(offset);
+	    offset += ((long long int)buckets.NumBuckets(st)) * (ns - 1) * (bits / 8);
+	  } else {
+	    writer.WriteLong(-1);
+	  }
+	}
+      }
+    }
+    for (int p = 0; p < num_players; ++p) {
+      for (int st = 0; st <= max_street; ++st) {
+	int num_nt = betting_tree->NumNonterminals(p, st);
+	int num_buckets = buckets.NumBuckets(st);
+	for (int nt = 0; nt < num_nt; ++nt) {
+	  int ns = num_succs[p * (max_street + 1) + st][nt];
+	  if (ns <= 1) continue;
+	  unique_ptr<double []> probs(new double[ns]);
+	  for (int b = 0; b < num_buckets; ++b) {
+	    disk_probs->Probs(p, st, nt, b, ns, probs.get());
+	    double cum = 0;
+	    for (int s = 0; s < ns - 1; ++s) {
+	      cum += probs[s];
+	      unsigned int q = cum * max_value + 0.5;
+	      if (q > max_value) q = max_value;
+	      if (bits == 8) writer.WriteUnsignedChar(q);
+	      else           writer.WriteUnsignedShort(q);
+	    }
+	  }
+	}
+      }
+    }
+  }
+  if (FileExists(filename.c_str())) RemoveFile(filename.c_str());
+  MoveFile(tmp_filename.c_str(), filename.c_str());
+}
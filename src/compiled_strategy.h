@@ -0,0 +1,53 @@
+#ifndef _COMPILED_STRATEGY_H_
+#define _COMPILED_STRATEGY_H_
+
+#include <memory>
+#include <string>
+
+class BettingAbstraction;
+class BettingTree;
+class Buckets;
+class CardAbstraction;
+class CFRConfig;
+class DiskProbs;
+class MappedFile;
+
+// A strategy compiled for playing: for every nonterminal with more than one succ and every
+// bucket, the cumulative distribution over the succs quantized to 8 or 16 bits.  Built from the
+// sumprobs by compile_strategy and mapped read-only, so choosing an action is one lookup and one
+// random draw, and the table is a small fraction of the size of the sumprobs.
+//
+// File format:
+//   bits (int)
+//   for each player and street: the number of nonterminals (int)
+//   for each player, street and nonterminal: the offset of its table in the data (long long
+//     int), or -1 if the player doesn't act there or there is only one succ
+//   the data: each table is num-buckets rows of num-succs - 1 cumulative values.  The last
+//     succ's value would always be the maximum, so it isn't stored.
+class CompiledStrategy {
+public:
+  CompiledStrategy(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
+		   const Buckets &buckets, const BettingTree *betting_tree, int it);
+  ~CompiledStrategy(void);
+  // Returns the succ chosen by a random number r in [0, 1).
+  int Sample(int p, int st, int nt, int b, int num_succs, double r) const;
+  void Probs(int p, int st, int nt, int b, int num_succs, double *probs) const;
+
+  static std::string Filename(const CardAbstraction &ca, const BettingAbstraction &ba,
+			      const CFRConfig &cc, int it);
+  static void Compile(const Buckets &buckets, const BettingTree *betting_tree,
+		      DiskProbs *disk_probs, int bits, const std::string &filename);
+private:
+  // Start of the cumulative values for the given bucket
+  const unsigned char *Row(int p, int st, int nt, int b, int num_succs) const;
+
+  int bits_;
+  // The largest quantized value; the threshold for a cumulative probability of one
+  unsigned int max_value_;
+  std::unique_ptr<MappedFile> file_;
+  const unsigned char *data_;
+  // offsets_[p][st][nt]
+  std::unique_ptr<std::unique_ptr<std::unique_ptr<long long int []> []> []> offsets_;
+};
+
+#endif
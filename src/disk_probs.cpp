@@ -1,12 +1,18 @@
 // Shouldn't do anything for resolve streets.
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <memory>
+#include <string>
 
 #include "betting_abstraction.h"
 #include "betting_tree.h"
+#include "board_tree.h"
 #include "buckets.h"
 #include "card_abstraction.h"
 #include "cfr_config.h"
@@ -16,8 +22,19 @@
 #include "game.h"
 #include "io.h"
 
+using std::string;
 using std::unique_ptr;
 
+// The number of rows of values at each node of the street: one per bucket, or one per board and
+// hand if the street has no card abstraction.
+long long int DiskProbs::NumHoldings(int st) const {
+  if (buckets_.None(st)) {
+    return BoardTree::NumBoards(st) * (long long int)Game::NumHoleCardPairs(st);
+  } else {
+    return buckets_.NumBuckets(st);
+  }
+}
+
 void DiskProbs::ComputeOffsets(Node *node, long long int **current_offsets) {
   if (node->Terminal()) return;
   int st = node->Street();
@@ -25,10 +42,9 @@ void DiskProbs::ComputeOffsets(Node *node, long long int **current_offsets) {
   int p = node->PlayerActing();
   long long int offset = current_offsets[p][st];
   offsets_[p][st][nt] = offset;
-  int num_buckets = buckets_.NumBuckets(st);
   int num_succs = node->NumSuccs();
   if (num_succs > 1) {
-    current_offsets[p][st] += num_buckets * prob_sizes_[st] * num_succs;
+    current_offsets[p][st] += NumHoldings(st) * prob_sizes_[st] * num_succs;
   }
   for (int s = 0; s < num_succs; ++s) {
     ComputeOffsets(node->IthSucc(s), current_offsets);
@@ -65,8 +81,9 @@ static CFRValueType ValueType(int st, const char *dir, int it) {
 }
 
 DiskProbs::DiskProbs(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
-		     const Buckets &buckets, const BettingTree *betting_tree, int it) :
-  buckets_(buckets) {
+		     const Buckets &buckets, const BettingTree *betting_tree, int it,
+		     long long int cache_bytes) :
+  buckets_(buckets), cache_hits_(0), cache_misses_(0) {
   char dir[500];
   sprintf(dir, "%s/%s.%u.%s.%i.%i.%i.%s.%s", Files::OldCFRBase(),
 	  Game::GameName().c_str(), Game::NumPlayers(),
@@ -75,6 +92,7 @@ DiskProbs::DiskProbs(const CardAbstraction &ca, const BettingAbstraction &ba, co
 	  ba.BettingAbstractionName().c_str(),
 	  cc.CFRConfigName().c_str());
   int max_street = Game::MaxStreet();
+  BoardTree::Create();
   prob_sizes_.reset(new int[max_street + 1]);
   for (int st = 0; st <= max_street; ++st) {
     CFRValueType value_type = ValueType(st, dir, it);
@@ -89,6 +107,29 @@ DiskProbs::DiskProbs(const CardAbstraction &ca, const BettingAbstraction &ba, co
     }
   }
   int num_players = Game::NumPlayers();
+  char buf[500];
+  fds_.reset(new int[num_players * (max_street + 1)]);
+  file_sizes_.reset(new long long int[num_players * (max_street + 1)]);
+  filenames_.reset(new string[num_players * (max_street + 1)]);
+  for (int p = 0; p < num_players; ++p) {
+    for (int st = 0; st <= max_street; ++st) {
+      char suffix;
+      if (prob_sizes_[st] == 1)      suffix = 'c';
+      else if (prob_sizes_[st] == 2) suffix = 's';
+      else if (prob_sizes_[st] == 4) suffix = 'i';
+      else                           suffix = 'd';
+      sprintf(buf, "%s/sumprobs.x.0.0.%i.%i.p%i.%c", dir, st, it, p, suffix);
+      int i = p * (max_street + 1) + st;
+      filenames_[i] = buf;
+      fds_[i] = open(buf, O_RDONLY, 0);
+      if (fds_[i] < 0) {
+	fprintf(stderr, "DiskProbs: couldn't open %s, errno %i\n", buf, errno);
+	exit(-1);
+      }
+      file_sizes_[i] = FileSize(buf);
+    }
+  }
+
   offsets_ = new long long int **[num_players];
   for (int p = 0; p < num_players; ++p) {
     offsets_[p] = new long long int *[max_street + 1];
@@ -97,94 +138,284 @@ DiskProbs::DiskProbs(const CardAbstraction &ca, const BettingAbstraction &ba, co
       offsets_[p][st] = new long long int[num_nt];
     }
   }
-  long long int **current_offsets = new long long int *[num_players];
-  for (int p = 0; p < num_players; ++p) {
-    current_offsets[p] = new long long int[max_street + 1];
-    for (int st = 0; st <= max_street; ++st) {
-      current_offsets[p][st] = 0LL;
+  sprintf(buf, "%s/disk_probs_index.x.0.0.%i", dir, it);
+  string index_filename = buf;
+  if (! ReadIndex(index_filename, betting_tree)) {
+    long long int **current_offsets = new long long int *[num_players];
+    for (int p = 0; p < num_players; ++p) {
+      current_offsets[p] = new long long int[max_street + 1];
+      for (int st = 0; st <= max_street; ++st) {
+	current_offsets[p][st] = 0LL;
+      }
     }
+    ComputeOffsets(betting_tree->Root(), current_offsets);
+    for (int p = 0; p < num_players; ++p) {
+      delete [] current_offsets[p];
+    }
+    delete [] current_offsets;
+    // Don't fail if the strategy directory is read-only; we just rebuild the offsets next time.
+    if (access(dir, W_OK) == 0) WriteIndex(index_filename, betting_tree);
   }
-  ComputeOffsets(betting_tree->Root(), current_offsets);
-  for (int p = 0; p < num_players; ++p) {
-    delete [] current_offsets[p];
-  }
-  delete [] current_offsets;
 
-  char buf[500];
-  readers_ = new Reader **[num_players];
+  max_cached_blocks_ = cache_bytes / kBlockSize;
+  pthread_mutex_init(&cache_mutex_, NULL);
+}
+
+DiskProbs::~DiskProbs(void) {
+  int num_players = Game::NumPlayers();
+  int max_street = Game::MaxStreet();
+  
+  for (int i = 0; i < num_players * (max_street + 1); ++i) {
+    close(fds_[i]);
+  }
+  
   for (int p = 0; p < num_players; ++p) {
-    readers_[p] = new Reader *[max_street + 1];
     for (int st = 0; st <= max_street; ++st) {
-      char suffix;
-      if (prob_sizes_[st] == 1)      suffix = 'c';
-      else if (prob_sizes_[st] == 2) suffix = 's';
-      else if (prob_sizes_[st] == 4) suffix = 'i';
-      else if (prob_sizes_[st] == 8) suffix = 'd';
-      sprintf(buf, "%s/sumprobs.x.0.0.%i.%i.p%i.%c", dir, st, it, p, suffix);
-      readers_[p][st] = new Reader(buf);
+      delete [] offsets_[p][st];
     }
+    delete [] offsets_[p];
   }
+  delete [] offsets_;
+  pthread_mutex_destroy(&cache_mutex_);
 }
 
-DiskProbs::~DiskProbs(void) {
+// The index starts with a header describing the sumprobs files it was built from: for each
+// player and street the value size, the number of holdings, the number of nonterminals and the
+// file size.  If any of these doesn't match we rebuild the index.  The header is followed by
+// the offsets themselves.
+bool DiskProbs::ReadIndex(const string &filename, const BettingTree *betting_tree) {
+  if (! FileExists(filename.c_str())) return false;
   int num_players = Game::NumPlayers();
   int max_street = Game::MaxStreet();
-  
+  long long int expected_size = 8LL + num_players * (max_street + 1) * 24LL;
   for (int p = 0; p < num_players; ++p) {
     for (int st = 0; st <= max_street; ++st) {
-      delete readers_[p][st];
+      expected_size += betting_tree->NumNonterminals(p, st) * 8LL;
     }
-    delete [] readers_[p];
   }
-  delete [] readers_;
-  
+  if (FileSize(filename.c_str()) != expected_size) {
+    fprintf(stderr, "DiskProbs: index %s is stale; rebuilding\n", filename.c_str());
+    return false;
+  }
+  Reader reader(filename.c_str());
+  if (reader.ReadIntOrDie() != num_players || reader.ReadIntOrDie() != max_street) {
+    fprintf(stderr, "DiskProbs: index %s is stale; rebuilding\n", filename.c_str());
+    return false;
+  }
   for (int p = 0; p < num_players; ++p) {
     for (int st = 0; st <= max_street; ++st) {
-      delete [] offsets_[p][st];
+      int prob_size = reader.ReadIntOrDie();
+      long long int num_holdings = reader.ReadLongOrDie();
+      int num_nt = reader.ReadIntOrDie();
+      long long int file_size = reader.ReadLongOrDie();
+      if (prob_size != prob_sizes_[st] || num_holdings != NumHoldings(st) ||
+	  num_nt != betting_tree->NumNonterminals(p, st) ||
+	  file_size != file_sizes_[p * (max_street + 1) + st]) {
+	fprintf(stderr, "DiskProbs: index %s is stale; rebuilding\n", filename.c_str());
+	return false;
+      }
     }
-    delete [] offsets_[p];
   }
-  delete [] offsets_;
+  for (int p = 0; p < num_players; ++p) {
+    for (int st = 0; st <= max_street; ++st) {
+      int num_nt = betting_tree->NumNonterminals(p, st);
+      for (int nt = 0; nt < num_nt; ++nt) {
+	offsets_[p][st][nt] = reader.ReadLongOrDie();
+      }
+    }
+  }
+  return true;
 }
 
-void DiskProbs::Probs(int p, int st, int nt, int b, int num_succs, double *probs) {
-  if (num_succs == 0) {
+// Written to a temporary file first so that a concurrently starting process never sees a
+// partial index.
+void DiskProbs::WriteIndex(const string &filename, const BettingTree *betting_tree) const {
+  int num_players = Game::NumPlayers();
+  int max_street = Game::MaxStreet();
+  char buf[600];
+  sprintf(buf, "%s.tmp.%i", filename.c_str(), (int)getpid());
+  {
+    Writer writer(buf);
+    writer.WriteInt(num_players);
+    writer.WriteInt(max_street);
+    for (int p = 0; p < num_players; ++p) {
+      for (int st = 0; st <= max_street; ++st) {
+	writer.WriteInt(prob_sizes_[st]);
+	writer.WriteLong(NumHoldings(st));
+	writer.WriteInt(betting_tree->NumNonterminals(p, st));
+	writer.WriteLong(file_sizes_[p * (max_street + 1) + st]);
+      }
+    }
+    for (int p = 0; p < num_players; ++p) {
+      for (int st = 0; st <= max_street; ++st) {
+	int num_nt = betting_tree->NumNonterminals(p, st);
+	for (int nt = 0; nt < num_nt; ++nt) {
+	  writer.WriteLong(offsets_[p][st][nt]);
+	}
+      }
+    }
+  }
+  if (rename(buf, filename.c_str()) != 0) {
+    fprintf(stderr, "DiskProbs: couldn't rename %s to %s\n", buf, filename.c_str());
+    exit(-1);
+  }
+}
+
+void DiskProbs::PRead(int p, int st, long long int offset, int num_bytes,
+		      unsigned char *buf) const {
+  int i = p * (Game::MaxStreet() + 1) + st;
+  int num_read = 0;
+  while (num_read < num_bytes) {
+    ssize_t ret = pread(fds_[i], buf + num_read, num_bytes - num_read, offset + num_read);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0) {
+      fprintf(stderr, "DiskProbs: pread of %i bytes at offset %lli failed, ret %lli errno %i\n",
+	      num_bytes - num_read, offset + num_read, (long long int)ret, errno);
+      fprintf(stderr, "File: %s\n", filenames_[i].c_str());
+      exit(-1);
+    }
+    num_read += ret;
+  }
+}
+
+long long int DiskProbs::BlockKey(int p, int st, long long int block) const {
+  long long int file_index = p * (Game::MaxStreet() + 1) + st;
+  return (file_index << 44) | block;
+}
+
+// Copies bytes offset...offset+num_bytes-1 of the (p, st) file into buf.  Any blocks in that
+// range that aren't cached are fetched from disk together with a single pread() (outside the
+// lock) and then added to the cache, evicting the least recently used blocks as needed.
+void DiskProbs::ReadBytes(int p, int st, long long int offset, int num_bytes,
+			  unsigned char *buf) {
+  if (max_cached_blocks_ == 0) {
+    PRead(p, st, offset, num_bytes, buf);
     return;
-  } else if (num_succs == 1) {
-    probs[0] = 1.0;
+  }
+  long long int first_block = offset / kBlockSize;
+  long long int last_block = (offset + num_bytes - 1) / kBlockSize;
+  bool all_hit = true;
+  pthread_mutex_lock(&cache_mutex_);
+  for (long long int block = first_block; block <= last_block; ++block) {
+    if (cache_.find(BlockKey(p, st, block)) == cache_.end()) {
+      all_hit = false;
+      break;
+    }
+  }
+  if (all_hit) {
+    for (long long int block = first_block; block <= last_block; ++block) {
+      Block &b = cache_[BlockKey(p, st, block)];
+      lru_.splice(lru_.begin(), lru_, b.lru_pos);
+      long long int block_start = block * kBlockSize;
+      long long int begin = offset > block_start ? offset : block_start;
+      long long int end = offset + num_bytes < block_start + b.size ?
+					       offset + num_bytes : block_start + b.size;
+      memcpy(buf + (begin - offset), b.data.get() + (begin - block_start), end - begin);
+    }
+    pthread_mutex_unlock(&cache_mutex_);
+    ++cache_hits_;
     return;
   }
-  
-  int prob_size = prob_sizes_[st];
-  long long int offset = offsets_[p][st][nt] + b * num_succs * prob_sizes_[st];
-  Reader *reader = readers_[p][st];
-  reader->SeekTo(offset);
-  unique_ptr<double []> raw(new double[num_succs]);
+  pthread_mutex_unlock(&cache_mutex_);
+  ++cache_misses_;
+
+  int file_index = p * (Game::MaxStreet() + 1) + st;
+  long long int span_start = first_block * kBlockSize;
+  long long int span_end = (last_block + 1) * kBlockSize;
+  if (span_end > file_sizes_[file_index]) span_end = file_sizes_[file_index];
+  int span_size = span_end - span_start;
+  unique_ptr<unsigned char []> span(new unsigned char[span_size]);
+  PRead(p, st, span_start, span_size, span.get());
+  memcpy(buf, span.get() + (offset - span_start), num_bytes);
+
+  pthread_mutex_lock(&cache_mutex_);
+  for (long long int block = first_block; block <= last_block; ++block) {
+    long long int key = BlockKey(p, st, block);
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+      // Another thread got here first
+      lru_.splice(lru_.begin(), lru_, it->second.lru_pos);
+      continue;
+    }
+    while ((long long int)cache_.size() >= max_cached_blocks_) {
+      cache_.erase(lru_.back());
+      lru_.pop_back();
+    }
+    long long int block_start = block * kBlockSize;
+    int size = span_end - block_start < kBlockSize ? span_end - block_start : kBlockSize;
+    Block &b = cache_[key];
+    b.data.reset(new unsigned char[size]);
+    memcpy(b.data.get(), span.get() + (block_start - span_start), size);
+    b.size = size;
+    lru_.push_front(key);
+    b.lru_pos = lru_.begin();
+  }
+  pthread_mutex_unlock(&cache_mutex_);
+}
+
+// Converts one row of raw sumprobs to probabilities.  If they are all zero, the first succ gets
+// probability one.
+static void Normalize(const unsigned char *bytes, int prob_size, int num_succs, double *probs) {
   double sum = 0;
   for (int s = 0; s < num_succs; ++s) {
     double p;
+    const unsigned char *ptr = bytes + s * prob_size;
     if (prob_size == 1) {
-      unsigned char c = reader->ReadUnsignedCharOrDie();
-      p = c;
+      p = *ptr;
     } else if (prob_size == 2) {
-      unsigned short s = reader->ReadUnsignedShortOrDie();
-      p = s;
+      unsigned short us;
+      memcpy(&us, ptr, 2);
+      p = us;
     } else if (prob_size == 4) {
-      int i = reader->ReadIntOrDie();
+      int i;
+      memcpy(&i, ptr, 4);
       p = i;
-    } else if (prob_size == 8) {
-      p = reader->ReadDoubleOrDie();
+    } else {
+      memcpy(&p, ptr, 8);
     }
-    raw[s] = p;
+    probs[s] = p;
     sum += p;
   }
   if (sum == 0) {
     probs[0] = 1.0;
     for (int s = 1; s < num_succs; ++s) probs[s] = 0.0;
-    return;
   } else {
     for (int s = 0; s < num_succs; ++s) {
-      probs[s] = raw[s] / sum;
+      probs[s] /= sum;
     }
   }
 }
+
+void DiskProbs::Probs(int p, int st, int nt, int b, int num_succs, double *probs) {
+  if (num_succs == 0) {
+    return;
+  } else if (num_succs == 1) {
+    probs[0] = 1.0;
+    return;
+  }
+  
+  int prob_size = prob_sizes_[st];
+  long long int offset = offsets_[p][st][nt] + ((long long int)b) * num_succs * prob_size;
+  unique_ptr<unsigned char []> bytes(new unsigned char[num_succs * prob_size]);
+  ReadBytes(p, st, offset, num_succs * prob_size, bytes.get());
+  Normalize(bytes.get(), prob_size, num_succs, probs);
+}
+
+void DiskProbs::ProbsRange(int p, int st, int nt, long long int b, int num_b, int num_succs,
+			   double *probs) {
+  if (num_succs == 0) {
+    return;
+  } else if (num_succs == 1) {
+    for (int i = 0; i < num_b; ++i) probs[i] = 1.0;
+    return;
+  }
+  int prob_size = prob_sizes_[st];
+  int row_bytes = num_succs * prob_size;
+  long long int offset = offsets_[p][st][nt] + b * row_bytes;
+  unique_ptr<unsigned char []> bytes(new unsigned char[num_b * (long long int)row_bytes]);
+  ReadBytes(p, st, offset, num_b * row_bytes, bytes.get());
+  for (int i = 0; i < num_b; ++i) {
+    Normalize(bytes.get() + i * (long long int)row_bytes, prob_size, num_succs,
+	      probs + i * num_succs);
+  }
+}
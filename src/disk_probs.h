@@ -1,7 +1,13 @@
 #ifndef _DISK_PROBS_H_
 #define _DISK_PROBS_H_
 
+#include <pthread.h>
+
+#include <atomic>
+#include <list>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 class BettingAbstraction;
 class BettingTree;
@@ -9,21 +15,63 @@ class Buckets;
 class CardAbstraction;
 class CFRConfig;
 class Node;
-class Reader;
 
+// Looks up sumprobs in the files on disk without loading them into memory.  Intended for agents
+// whose strategy is too large to hold in RAM.
+//
+// The offset of each node's values within its file is stored in an index file alongside the
+// sumprobs files.  The index is built the first time and reloaded thereafter.
+//
+// Streets without a card abstraction are supported too.  Their values are laid out by board,
+// with the hands of a board (sorted by hand strength on the final street) contiguous, so "b"
+// is gbd * num hole card pairs + hand index, and ProbsRange() reads a whole board at once.
+//
+// Reads are done with pread() so that multiple threads can share one DiskProbs.  Recently read
+// blocks are kept in an LRU cache limited to cache_bytes bytes (zero disables the cache).  Both
+// Probs() and the cache are thread-safe.
 class DiskProbs {
 public:
   DiskProbs(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
-	    const Buckets &buckets, const BettingTree *betting_tree, int it);
+	    const Buckets &buckets, const BettingTree *betting_tree, int it,
+	    long long int cache_bytes);
   ~DiskProbs(void);
   void Probs(int p, int st, int nt, int b, int num_succs, double *probs);
+  // The probs of num_b consecutive buckets (or hands) starting at b, as num_b rows of num_succs
+  // values.
+  void ProbsRange(int p, int st, int nt, long long int b, int num_b, int num_succs,
+		  double *probs);
+  long long int CacheHits(void) const {return cache_hits_.load();}
+  long long int CacheMisses(void) const {return cache_misses_.load();}
 private:
+  struct Block {
+    std::unique_ptr<unsigned char []> data;
+    int size;
+    std::list<long long int>::iterator lru_pos;
+  };
+
+  static const int kBlockSize = 4096;
+
+  long long int NumHoldings(int st) const;
   void ComputeOffsets(Node *node, long long int **current_offsets);
+  bool ReadIndex(const std::string &filename, const BettingTree *betting_tree);
+  void WriteIndex(const std::string &filename, const BettingTree *betting_tree) const;
+  void PRead(int p, int st, long long int offset, int num_bytes, unsigned char *buf) const;
+  void ReadBytes(int p, int st, long long int offset, int num_bytes, unsigned char *buf);
+  long long int BlockKey(int p, int st, long long int block) const;
 
   const Buckets &buckets_;
   std::unique_ptr<int []> prob_sizes_;
   long long int ***offsets_;
-  Reader ***readers_;
+  std::unique_ptr<int []> fds_;
+  std::unique_ptr<long long int []> file_sizes_;
+  std::unique_ptr<std::string []> filenames_;
+  // LRU cache of file blocks.  Most recently used keys are at the front of lru_.
+  long long int max_cached_blocks_;
+  std::unordered_map<long long int, Block> cache_;
+  std::list<long long int> lru_;
+  pthread_mutex_t cache_mutex_;
+  std::atomic<long long int> cache_hits_;
+  std::atomic<long long int> cache_misses_;
 };
 
 #endif
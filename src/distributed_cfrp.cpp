@@ -0,0 +1,412 @@
+// Distributed CFR+.  See distributed_cfrp.h for an overview.
+//
+// The protocol is binary and uses native byte order, so all machines must share an architecture.
+// Every request from the coordinator starts with an int message type.
+//
+//   kProcessBoards: it, p, player acting, nonterminal ID, previous-street board (five ints),
+//                   then the opponent reach probabilities (one double per hole card encoding).
+//                   The worker replies with one double per previous-street hand.
+//   kCheckpoint:    it.  The worker writes its values and replies with an int.
+//   kQuit:          no payload and no reply.
+//
+// When a worker connects the coordinator sends it three ints: its index, the number of workers
+// and the starting iteration.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "betting_abstraction.h"
+#include "betting_tree.h"
+#include "betting_trees.h"
+#include "board_tree.h"
+#include "buckets.h"
+#include "canonical_cards.h"
+#include "cfr_config.h"
+#include "cfr_utils.h" // DeleteOldFiles()
+#include "cfr_values.h"
+#include "distributed_cfrp.h"
+#include "files.h"
+#include "game.h"
+#include "io.h"
+#include "socket_io.h"
+#include "vcfr_state.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+DistributedCFRP::DistributedCFRP(const CardAbstraction &ca, const CFRConfig &cc,
+				 const Buckets &buckets, int num_threads) :
+  CFRP(ca, cc, buckets, num_threads) {
+  distributed_street_ = cc.DistributedStreet();
+  worker_ = false;
+  worker_index_ = -1;
+  bytes_sent_ = 0;
+  bytes_received_ = 0;
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+DistributedCFRP::~DistributedCFRP(void) {
+  pthread_mutex_destroy(&mutex_);
+}
+
+// The coordinator holds the values for the streets before the distributed street; the workers
+// hold the values for the remaining streets.
+void DistributedCFRP::Initialize(const BettingAbstraction &ba, bool worker) {
+  int max_street = Game::MaxStreet();
+  if (ba.Asymmetric()) {
+    fprintf(stderr, "Distributed CFR+ does not support asymmetric betting abstractions\n");
+    exit(-1);
+  }
+  if (subgame_street_ != -1) {
+    fprintf(stderr, "Distributed CFR+ does not support SubgameStreet\n");
+    exit(-1);
+  }
+  if (distributed_street_ < 1 || distributed_street_ > max_street) {
+    fprintf(stderr, "Bad distributed street %i\n", distributed_street_);
+    exit(-1);
+  }
+  for (int st = distributed_street_; st <= max_street; ++st) {
+    if (! buckets_.None(st)) {
+      fprintf(stderr, "Distributed CFR+ requires street %i to be unabstracted\n", st);
+      exit(-1);
+    }
+  }
+  // The coordinator merges the workers' files by summing them value by value, which it can't do
+  // with compressed files.
+  for (int st : cfr_config_.CompressedStreets()) {
+    if (st >= distributed_street_) {
+      fprintf(stderr, "Distributed CFR+ does not support CompressedStreets at or after the "
+	      "distributed street %i (got %i)\n", distributed_street_, st);
+      exit(-1);
+    }
+  }
+  CFRP::Initialize(ba, -1);
+  worker_ = worker;
+  unique_ptr<bool []> streets(new bool[max_street + 1]);
+  for (int st = 0; st <= max_street; ++st) {
+    streets[st] = worker_ ? st >= distributed_street_ : st < distributed_street_;
+  }
+  regrets_.reset(new CFRValues(nullptr, streets.get(), 0, 0, buckets_,
+			       betting_trees_->GetBettingTree()));
+  sumprobs_.reset(new CFRValues(nullptr, streets.get(), 0, 0, buckets_,
+				betting_trees_->GetBettingTree()));
+  regrets_->SetCompressedStreets(cfr_config_.CompressedStreets());
+  sumprobs_->SetCompressedStreets(cfr_config_.CompressedStreets());
+  if (worker_) {
+    dist_nodes_.reset(new vector<Node *>[Game::NumPlayers()]);
+    IndexNodes(betting_trees_->Root());
+  }
+}
+
+void DistributedCFRP::IndexNodes(Node *node) {
+  if (node->Terminal()) return;
+  int st = node->Street();
+  if (st == distributed_street_) {
+    int pa = node->PlayerActing();
+    int nt = node->NonterminalID();
+    vector<Node *> &nodes = dist_nodes_[pa];
+    if (nt >= (int)nodes.size()) nodes.resize(nt + 1, nullptr);
+    nodes[nt] = node;
+  }
+  int num_succs = node->NumSuccs();
+  for (int s = 0; s < num_succs; ++s) {
+    IndexNodes(node->IthSucc(s));
+  }
+}
+
+void DistributedCFRP::Send(SocketIO *socket_io, const void *data, int num_bytes) {
+  if (! socket_io->WriteNBytes((const char *)data, num_bytes)) {
+    fprintf(stderr, "Failed to send %i bytes\n", num_bytes);
+    exit(-1);
+  }
+  bytes_sent_ += num_bytes;
+}
+
+void DistributedCFRP::Receive(SocketIO *socket_io, void *data, int num_bytes) {
+  if (! socket_io->ReadNBytes(num_bytes, (char *)data)) {
+    fprintf(stderr, "Failed to receive %i bytes\n", num_bytes);
+    exit(-1);
+  }
+  bytes_received_ += num_bytes;
+}
+
+static int NumEncodings(void) {
+  int max_card1 = Game::MaxCard() + 1;
+  if (Game::NumCardsForStreet(0) == 1) return max_card1;
+  else                                 return max_card1 * max_card1;
+}
+
+// On the coordinator, farms the boards of the distributed street out to the workers.  All the
+// workers are sent the request before we wait for any reply so that they run concurrently.
+void DistributedCFRP::ProcessSuccBoards(Node *p0_node, Node *p1_node, int pgbd, int ngbd_begin,
+					int ngbd_end, VCFRState *state, int *prev_canons,
+					double *vals) {
+  if (worker_ || p0_node->Street() != distributed_street_) {
+    VCFR::ProcessSuccBoards(p0_node, p1_node, pgbd, ngbd_begin, ngbd_end, state, prev_canons,
+			    vals);
+    return;
+  }
+  int pst = distributed_street_ - 1;
+  int num_prev_hole_card_pairs = Game::NumHoleCardPairs(pst);
+  int num_encodings = NumEncodings();
+  int header[6];
+  header[0] = kProcessBoards;
+  header[1] = it_;
+  header[2] = state->P();
+  header[3] = p0_node->PlayerActing();
+  header[4] = p0_node->NonterminalID();
+  header[5] = pgbd;
+  double *opp_probs = state->OppProbs().get();
+  unique_ptr<double []> worker_vals(new double[num_prev_hole_card_pairs]);
+  int num_workers = workers_.size();
+  pthread_mutex_lock(&mutex_);
+  for (int w = 0; w < num_workers; ++w) {
+    Send(workers_[w].get(), header, sizeof(header));
+    Send(workers_[w].get(), opp_probs, num_encodings * sizeof(double));
+  }
+  for (int w = 0; w < num_workers; ++w) {
+    Receive(workers_[w].get(), worker_vals.get(), num_prev_hole_card_pairs * sizeof(double));
+    for (int i = 0; i < num_prev_hole_card_pairs; ++i) vals[i] += worker_vals[i];
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+// Worker w of n owns the w'th of n contiguous chunks of the successors of each board on the
+// street before the distributed street.
+void DistributedCFRP::WorkerProcessBoards(SocketIO *socket_io, int num_workers) {
+  int header[5];
+  Receive(socket_io, header, sizeof(header));
+  it_ = header[0];
+  int p = header[1];
+  int pa = header[2];
+  int nt = header[3];
+  int pgbd = header[4];
+  if (pa < 0 || pa >= Game::NumPlayers() || nt < 0 || nt >= (int)dist_nodes_[pa].size() ||
+      dist_nodes_[pa][nt] == nullptr) {
+    fprintf(stderr, "No node for pa %i nt %i\n", pa, nt);
+    exit(-1);
+  }
+  Node *node = dist_nodes_[pa][nt];
+  int num_encodings = NumEncodings();
+  std::shared_ptr<double []> opp_probs(new double[num_encodings]);
+  Receive(socket_io, opp_probs.get(), num_encodings * sizeof(double));
+
+  int nst = distributed_street_;
+  int pst = nst - 1;
+  int num_prev_hole_card_pairs = Game::NumHoleCardPairs(pst);
+  unique_ptr<double []> vals(new double[num_prev_hole_card_pairs]);
+  for (int i = 0; i < num_prev_hole_card_pairs; ++i) vals[i] = 0;
+  int succ_begin = BoardTree::SuccBoardBegin(pst, pgbd, nst);
+  int num_succs = BoardTree::SuccBoardEnd(pst, pgbd, nst) - succ_begin;
+  int ngbd_begin = succ_begin + (num_succs * worker_index_) / num_workers;
+  int ngbd_end = succ_begin + (num_succs * (worker_index_ + 1)) / num_workers;
+  if (ngbd_begin < ngbd_end) {
+    VCFRState state(p, opp_probs, hand_tree_.get(), "x");
+    unique_ptr<int []> prev_canons(new int[num_encodings]);
+    PrevCanons(state.Hands(pst, pgbd), prev_canons.get());
+    VCFR::ProcessSuccBoards(node, node, pgbd, ngbd_begin, ngbd_end, &state, prev_canons.get(),
+			    vals.get());
+  }
+  Send(socket_io, vals.get(), num_prev_hole_card_pairs * sizeof(double));
+}
+
+string DistributedCFRP::WorkerDir(const char *base, int worker_index) const {
+  char buf[100];
+  sprintf(buf, ".w%i", worker_index);
+  return CheckpointDir(base) + buf;
+}
+
+// The coordinator reads the trunk streets from the usual directory.  Each worker reads from its
+// own directory because the merged files contain the values of the other workers' boards.
+void DistributedCFRP::ReadFromCheckpoint(int it) {
+  if (! worker_) {
+    CFRP::ReadFromCheckpoint(it);
+    return;
+  }
+  string dir = WorkerDir(Files::OldCFRBase(), worker_index_);
+  regrets_->Read(dir.c_str(), it, betting_trees_->GetBettingTree(), "x", -1, false, false);
+  sumprobs_->Read(dir.c_str(), it, betting_trees_->GetBettingTree(), "x", -1, true, false);
+}
+
+void DistributedCFRP::WorkerCheckpoint(SocketIO *socket_io) {
+  int it;
+  Receive(socket_io, &it, sizeof(int));
+  string dir = WorkerDir(Files::NewCFRBase(), worker_index_);
+  Mkdir(dir.c_str());
+  regrets_->Write(dir.c_str(), it, betting_trees_->Root(), "x", -1, false);
+  sumprobs_->Write(dir.c_str(), it, betting_trees_->Root(), "x", -1, true);
+  int ack = 0;
+  Send(socket_io, &ack, sizeof(int));
+}
+
+void DistributedCFRP::RunWorker(const char *hostname, int port) {
+  unique_ptr<SocketIO> socket_io(new SocketIO(hostname, port));
+  if (! socket_io->Valid()) {
+    fprintf(stderr, "Couldn't connect to coordinator at %s:%i\n", hostname, port);
+    exit(-1);
+  }
+  int hello[3];
+  Receive(socket_io.get(), hello, sizeof(hello));
+  worker_index_ = hello[0];
+  int num_workers = hello[1];
+  int start_it = hello[2];
+  fprintf(stderr, "Worker %i of %i starting at it %i\n", worker_index_, num_workers, start_it);
+  InitializeValues(start_it);
+
+  while (true) {
+    int type;
+    Receive(socket_io.get(), &type, sizeof(int));
+    if (type == kProcessBoards) {
+      WorkerProcessBoards(socket_io.get(), num_workers);
+    } else if (type == kCheckpoint) {
+      WorkerCheckpoint(socket_io.get());
+    } else if (type == kQuit) {
+      break;
+    } else {
+      fprintf(stderr, "Unexpected message type %i\n", type);
+      exit(-1);
+    }
+  }
+}
+
+// Sums the workers' files for the distributed street and later into the main CFR directory.
+void DistributedCFRP::MergeWorkerFiles(int it, bool sumprobs) {
+  string dir = CheckpointDir(Files::NewCFRBase());
+  int num_workers = workers_.size();
+  int num_players = Game::NumPlayers();
+  int max_street = Game::MaxStreet();
+  char buf[500];
+  for (int p = 0; p < num_players; ++p) {
+    for (int st = distributed_street_; st <= max_street; ++st) {
+      char suffix = 0;
+      for (char c : {'d', 'i'}) {
+	sprintf(buf, "%s.w0/%s.x.0.0.%u.%u.p%u.%c", dir.c_str(), sumprobs ? "sumprobs" : "regrets",
+		st, it, p, c);
+	if (FileExists(buf)) {
+	  suffix = c;
+	  break;
+	}
+      }
+      if (suffix == 0) {
+	fprintf(stderr, "No worker file for p %i st %i\n", p, st);
+	exit(-1);
+      }
+      vector<unique_ptr<Reader>> readers;
+      for (int w = 0; w < num_workers; ++w) {
+	sprintf(buf, "%s.w%i/%s.x.0.0.%u.%u.p%u.%c", dir.c_str(), w,
+		sumprobs ? "sumprobs" : "regrets", st, it, p, suffix);
+	readers.emplace_back(new Reader(buf));
+      }
+      sprintf(buf, "%s/%s.x.0.0.%u.%u.p%u.%c", dir.c_str(), sumprobs ? "sumprobs" : "regrets",
+	      st, it, p, suffix);
+      Writer writer(buf);
+      while (! readers[0]->AtEnd()) {
+	if (suffix == 'd') {
+	  double sum = 0;
+	  for (int w = 0; w < num_workers; ++w) sum += readers[w]->ReadDoubleOrDie();
+	  writer.WriteDouble(sum);
+	} else {
+	  int sum = 0;
+	  for (int w = 0; w < num_workers; ++w) sum += readers[w]->ReadIntOrDie();
+	  writer.WriteInt(sum);
+	}
+      }
+      for (int w = 0; w < num_workers; ++w) {
+	if (! readers[w]->AtEnd()) {
+	  fprintf(stderr, "Worker %i file longer than expected for p %i st %i\n", w, p, st);
+	  exit(-1);
+	}
+      }
+    }
+  }
+}
+
+void DistributedCFRP::DistributedCheckpoint(int it) {
+  int num_workers = workers_.size();
+  int msg[2];
+  msg[0] = kCheckpoint;
+  msg[1] = it;
+  for (int w = 0; w < num_workers; ++w) Send(workers_[w].get(), msg, sizeof(msg));
+  Checkpoint(it);
+  for (int w = 0; w < num_workers; ++w) {
+    int ack;
+    Receive(workers_[w].get(), &ack, sizeof(int));
+  }
+  MergeWorkerFiles(it, false);
+  MergeWorkerFiles(it, true);
+}
+
+static double Secs(const struct timeval &start, const struct timeval &end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+void DistributedCFRP::RunCoordinator(int port, int num_workers, int start_it, int end_it) {
+  if (start_it == 0) {
+    fprintf(stderr, "CFR starts from iteration 1\n");
+    exit(-1);
+  }
+  if (num_workers < 1) {
+    fprintf(stderr, "Need at least one worker\n");
+    exit(-1);
+  }
+  if (start_it > 1) {
+    // Each worker resumes from its own files, so the slices must be the same as last time
+    string dir = WorkerDir(Files::OldCFRBase(), num_workers);
+    if (FileExists(dir.c_str())) {
+      fprintf(stderr, "%s exists; resume with the same number of workers as before\n",
+	      dir.c_str());
+      exit(-1);
+    }
+  }
+  int listen_sock = GetListenSocket(port);
+  if (listen_sock < 0) {
+    fprintf(stderr, "Couldn't listen on port %i\n", port);
+    exit(-1);
+  }
+  fprintf(stderr, "Waiting for %i workers on port %i\n", num_workers, port);
+  for (int w = 0; w < num_workers; ++w) {
+    workers_.emplace_back(new SocketIO(listen_sock));
+    if (! workers_[w]->Valid()) {
+      fprintf(stderr, "Failed to accept worker %i\n", w);
+      exit(-1);
+    }
+    int hello[3];
+    hello[0] = w;
+    hello[1] = num_workers;
+    hello[2] = start_it;
+    Send(workers_[w].get(), hello, sizeof(hello));
+  }
+  close(listen_sock);
+
+  DeleteOldFiles(card_abstraction_, betting_abstraction_name_, cfr_config_, end_it);
+  InitializeValues(start_it);
+
+  long long int total_bytes = 0;
+  struct timeval start, end;
+  for (it_ = start_it; it_ <= end_it; ++it_) {
+    fprintf(stderr, "It %u\n", it_);
+    for (int p = 1; p >= 0; --p) {
+      bytes_sent_ = 0;
+      bytes_received_ = 0;
+      gettimeofday(&start, NULL);
+      HalfIteration(p);
+      gettimeofday(&end, NULL);
+      fprintf(stderr, "It %i P%i: %.3f secs; %lli bytes sent; %lli bytes received\n", it_, p,
+	      Secs(start, end), bytes_sent_, bytes_received_);
+      total_bytes += bytes_sent_ + bytes_received_;
+    }
+  }
+  fprintf(stderr, "Total bytes transferred: %lli\n", total_bytes);
+
+  DistributedCheckpoint(end_it);
+
+  int quit = kQuit;
+  for (int w = 0; w < num_workers; ++w) Send(workers_[w].get(), &quit, sizeof(int));
+}
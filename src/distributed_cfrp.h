@@ -0,0 +1,72 @@
+#ifndef _DISTRIBUTED_CFRP_H_
+#define _DISTRIBUTED_CFRP_H_
+
+#include <pthread.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cfrp.h"
+
+class BettingAbstraction;
+class Buckets;
+class CardAbstraction;
+class CFRConfig;
+class Node;
+class SocketIO;
+class VCFRState;
+
+// CFR+ spread over several processes, possibly on different machines.  A coordinator runs the
+// trunk (the streets before the distributed street).  Whenever it reaches a node on the
+// distributed street it sends the opponent reach probabilities to all the workers.  Each worker
+// owns a fixed contiguous slice of the successor boards; it processes its slice and sends back
+// the values summed over its boards.  The regrets and sumprobs for the distributed street and
+// later streets live only on the workers.
+//
+// At checkpoint time each worker writes its values to a directory of its own and the coordinator
+// sums the worker files (which are zero outside each worker's slice) into the usual directory.
+// The coordinator and the workers must therefore share a filesystem.  The worker files are kept;
+// when resuming, each worker reads its own files, so the number of workers and the distributed
+// street must not change between runs.
+//
+// Only symmetric betting abstractions are supported, and the distributed street and the streets
+// after it must be unabstracted.
+class DistributedCFRP : public CFRP {
+public:
+  DistributedCFRP(const CardAbstraction &ca, const CFRConfig &cc, const Buckets &buckets,
+		  int num_threads);
+  virtual ~DistributedCFRP(void);
+  void Initialize(const BettingAbstraction &ba, bool worker);
+  void RunCoordinator(int port, int num_workers, int start_it, int end_it);
+  void RunWorker(const char *hostname, int port);
+protected:
+  static const int kProcessBoards = 1;
+  static const int kCheckpoint = 2;
+  static const int kQuit = 3;
+
+  virtual void ProcessSuccBoards(Node *p0_node, Node *p1_node, int pgbd, int ngbd_begin,
+				 int ngbd_end, VCFRState *state, int *prev_canons, double *vals);
+  virtual void ReadFromCheckpoint(int it);
+  std::string WorkerDir(const char *base, int worker_index) const;
+  void IndexNodes(Node *node);
+  void WorkerProcessBoards(SocketIO *socket_io, int num_workers);
+  void WorkerCheckpoint(SocketIO *socket_io);
+  void DistributedCheckpoint(int it);
+  void MergeWorkerFiles(int it, bool sumprobs);
+  void Send(SocketIO *socket_io, const void *data, int num_bytes);
+  void Receive(SocketIO *socket_io, void *data, int num_bytes);
+
+  int distributed_street_;
+  bool worker_;
+  int worker_index_;
+  std::vector<std::unique_ptr<SocketIO>> workers_;
+  // Worker only: the nodes on the distributed street indexed by player acting and nonterminal ID
+  std::unique_ptr<std::vector<Node *> []> dist_nodes_;
+  // Coordinator only: serializes requests to the workers and guards the byte counts
+  pthread_mutex_t mutex_;
+  long long int bytes_sent_;
+  long long int bytes_received_;
+};
+
+#endif
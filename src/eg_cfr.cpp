@@ -6,6 +6,7 @@
 
 #include "betting_trees.h"
 #include "board_tree.h"
+#include "cfr_values.h"
 #include "eg_cfr.h"
 #include "hand_value_tree.h"
 #include "resolving_method.h"
@@ -38,4 +39,37 @@ EGCFR::EGCFR(const CardAbstraction &ca, const CardAbstraction &base_ca,
   HandValueTree::Create();
   BoardTree::Create();
   it_ = 0;
+  time_limit_secs_ = -1;
+}
+
+void EGCFR::InitializeSumprobs(const bool *players, const bool *streets, int solve_bd,
+			       int subtree_st, BettingTrees *subtrees) {
+  if (warm_start_) {
+    sumprobs_ = warm_start_;
+    warm_start_.reset();
+    return;
+  }
+  sumprobs_.reset(new CFRValues(players, streets, solve_bd, subtree_st, buckets_,
+				subtrees->GetBettingTree()));
+  sumprobs_->AllocateAndClear(subtrees->GetBettingTree(), CFRValueType::CFR_DOUBLE, false, -1);
+}
+
+static double SecsBetween(const struct timespec &start, const struct timespec &finish) {
+  return (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+}
+
+// Called before each iteration.  Iterations take about the same time, so we stop if another one
+// as long as the last one would take us past the time limit.
+bool EGCFR::TimeForIteration(void) {
+  if (time_limit_secs_ < 0) return true;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (it_ == 1) {
+    solve_start_ = now;
+    it_start_ = now;
+    return true;
+  }
+  double last_it_secs = SecsBetween(it_start_, now);
+  it_start_ = now;
+  return SecsBetween(solve_start_, now) + last_it_secs <= time_limit_secs_;
 }
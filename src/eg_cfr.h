@@ -1,6 +1,8 @@
 #ifndef _EG_CFR_H_
 #define _EG_CFR_H_
 
+#include <time.h>
+
 #include <memory>
 #include <string>
 
@@ -22,15 +24,29 @@ class EGCFR : public VCFR {
   virtual void SolveSubgame(BettingTrees *subtrees, int solve_bd, const ReachProbs &reach_probs,
 			    const std::string &action_sequence, const HandTree *hand_tree,
 			    double *opp_cvs, int target_p, bool both_players, int num_its) = 0;
+  // SolveSubgame() stops early rather than run past secs.  It always completes at least one
+  // iteration.  A negative value (the default) means no limit.
+  void SetTimeLimit(double secs) {time_limit_secs_ = secs;}
+  // The next SolveSubgame() accumulates into these sumprobs rather than starting from zero.  They
+  // must be allocated for the subtrees and players passed to SolveSubgame().
+  void SetWarmStart(std::shared_ptr<CFRValues> sumprobs) {warm_start_ = sumprobs;}
+  int NumItsDone(void) const {return it_ - 1;}
  protected:
   virtual std::shared_ptr<double []> HalfIteration(BettingTrees *subtrees, int p,
 						   std::shared_ptr<double []> opp_probs,
 						   const HandTree *hand_tree,
 						   const std::string &action_sequence);
+  void InitializeSumprobs(const bool *players, const bool *streets, int solve_bd, int subtree_st,
+			  BettingTrees *subtrees);
+  bool TimeForIteration(void);
 
   const CardAbstraction &base_card_abstraction_;
   const BettingAbstraction &base_betting_abstraction_;
   const CFRConfig &base_cfr_config_;
+  double time_limit_secs_;
+  struct timespec solve_start_;
+  struct timespec it_start_;
+  std::shared_ptr<CFRValues> warm_start_;
 };
 
 #endif
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "betting_tree.h"
+#include "flat_betting_tree.h"
+
+static_assert(sizeof(FlatNode) == 16, "FlatNode should be 16 bytes");
+
+FlatBettingTree::FlatBettingTree(const BettingTree &betting_tree) {
+  Build(betting_tree.Root());
+}
+
+FlatBettingTree::FlatBettingTree(Node *root) {
+  Build(root);
+}
+
+// Returns the index of the node.  We reserve the node's slot and its range of successor indices
+// before recursing so that nodes end up in depth-first order.
+int FlatBettingTree::Build(Node *node) {
+  auto it = indices_.find(node);
+  if (it != indices_.end()) return it->second;
+  int num_succs = node->NumSuccs();
+  if (num_succs > 255 || node->LastBetTo() > 32767) {
+    fprintf(stderr, "FlatBettingTree: node doesn't fit: num succs %i last bet to %i\n",
+	    num_succs, node->LastBetTo());
+    exit(-1);
+  }
+  int n = nodes_.size();
+  indices_[node] = n;
+  FlatNode flat_node;
+  flat_node.id_ = node->ID();
+  flat_node.succ_begin_ = succs_.size();
+  flat_node.last_bet_to_ = node->LastBetTo();
+  flat_node.num_succs_ = num_succs;
+  flat_node.street_ = node->Street();
+  flat_node.player_acting_ = node->PlayerActing();
+  flat_node.num_remaining_ = node->NumRemaining();
+  flat_node.call_succ_index_ = node->CallSuccIndex();
+  flat_node.fold_succ_index_ = node->FoldSuccIndex();
+  nodes_.push_back(flat_node);
+  original_nodes_.push_back(node);
+  int succ_begin = succs_.size();
+  succs_.resize(succ_begin + num_succs);
+  for (int s = 0; s < num_succs; ++s) {
+    // Don't hold a reference into succs_ across the recursive call; it may be reallocated
+    int succ = Build(node->IthSucc(s));
+    succs_[succ_begin + s] = succ;
+  }
+  return n;
+}
+
+int FlatBettingTree::Index(const Node *node) const {
+  auto it = indices_.find(node);
+  if (it == indices_.end()) return -1;
+  return it->second;
+}
@@ -0,0 +1,73 @@
+#ifndef _FLAT_BETTING_TREE_H_
+#define _FLAT_BETTING_TREE_H_
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class BettingTree;
+class Node;
+
+// The per-node data of a FlatBettingTree packed into 16 bytes.  The accessors mirror those of
+// Node.
+class FlatNode {
+public:
+  int PlayerActing(void) const {return player_acting_;}
+  bool Terminal(void) const {return num_succs_ == 0;}
+  int TerminalID(void) const {return Terminal() ? id_ : -1;}
+  int NonterminalID(void) const {return Terminal() ? -1 : id_;}
+  int Street(void) const {return street_;}
+  int NumSuccs(void) const {return num_succs_;}
+  int NumRemaining(void) const {return num_remaining_;}
+  bool Showdown(void) const {return Terminal() && num_remaining_ > 1;}
+  int LastBetTo(void) const {return last_bet_to_;}
+  bool HasCallSucc(void) const {return call_succ_index_ >= 0;}
+  bool HasFoldSucc(void) const {return fold_succ_index_ >= 0;}
+  int CallSuccIndex(void) const {return call_succ_index_;}
+  int FoldSuccIndex(void) const {return fold_succ_index_;}
+private:
+  friend class FlatBettingTree;
+
+  int id_;
+  // Index into FlatBettingTree::succs_ of this node's first successor
+  int succ_begin_;
+  short last_bet_to_;
+  unsigned char num_succs_;
+  unsigned char street_;
+  unsigned char player_acting_;
+  unsigned char num_remaining_;
+  signed char call_succ_index_;
+  signed char fold_succ_index_;
+};
+
+// An immutable copy of a BettingTree laid out for fast traversal.  All the nodes live in one
+// array in depth-first order, so a node's first successor immediately follows it, and nodes are
+// referred to by 32-bit indices rather than by pointers.  Nodes that are shared (reentrant) in
+// the original tree are shared here too.
+//
+// The original tree must outlive the flat tree.  Index() and OriginalNode() map between the two
+// so that code can be converted to the flat tree one piece at a time.
+class FlatBettingTree {
+public:
+  FlatBettingTree(const BettingTree &betting_tree);
+  FlatBettingTree(Node *root);
+  ~FlatBettingTree(void) {}
+  int Root(void) const {return 0;}
+  int NumNodes(void) const {return nodes_.size();}
+  const FlatNode &GetNode(int n) const {return nodes_[n];}
+  int IthSucc(int n, int s) const {return succs_[nodes_[n].succ_begin_ + s];}
+  // Pointer to the num-succs successor indices of node n
+  const int *Succs(int n) const {return &succs_[nodes_[n].succ_begin_];}
+  // Returns -1 if node isn't part of the tree
+  int Index(const Node *node) const;
+  Node *OriginalNode(int n) const {return original_nodes_[n];}
+private:
+  int Build(Node *node);
+
+  std::vector<FlatNode> nodes_;
+  std::vector<int> succs_;
+  std::vector<Node *> original_nodes_;
+  std::unordered_map<const Node *, int> indices_;
+};
+
+#endif
@@ -24,13 +24,26 @@ HandEvaluator::HandEvaluator(void) {
 HandEvaluator::~HandEvaluator(void) {
 }
 
+void HandEvaluator::EvaluateBatch(const Card *cards, int num_cards, int num_hands,
+				  int *vals) const {
+  if (num_cards > kMaxNumCards) {
+    fprintf(stderr, "EvaluateBatch: too many cards: %i\n", num_cards);
+    exit(-1);
+  }
+  Card hand[kMaxNumCards];
+  for (int h = 0; h < num_hands; ++h) {
+    for (int i = 0; i < num_cards; ++i) hand[i] = cards[i * num_hands + h];
+    vals[h] = Evaluate(hand, num_cards);
+  }
+}
+
 LeducHandEvaluator::LeducHandEvaluator(void) : HandEvaluator() {
 }
 
 LeducHandEvaluator::~LeducHandEvaluator(void) {
 }
 
-int LeducHandEvaluator::Evaluate(Card *cards, int num_cards) {
+int LeducHandEvaluator::Evaluate(Card *cards, int num_cards) const {
   int r0 = Rank(cards[0]);
   int r1 = Rank(cards[1]);
   int hr, lr;
@@ -49,21 +62,21 @@ int LeducHandEvaluator::Evaluate(Card *cards, int num_cards) {
 }
 
 HoldemHandEvaluator::HoldemHandEvaluator(void) : HandEvaluator() {
-  ranks_ = new int[7];
-  suits_ = new int[7];
-  rank_counts_ = new int[13];
-  suit_counts_ = new int[4];
+  int num_cards = Game::MaxCard() + 1;
+  masks_ok_ = Game::NumSuits() <= 4 && Game::NumRanks() <= 13 && num_cards <= 64;
+  for (int c = 0; c < 64; ++c) card_masks_[c] = 0ULL;
+  if (masks_ok_) {
+    for (int c = 0; c < num_cards; ++c) {
+      card_masks_[c] = 1ULL << (16 * Suit(c) + Rank(c));
+    }
+  }
 }
 
 HoldemHandEvaluator::~HoldemHandEvaluator(void) {
-  delete [] suits_;
-  delete [] ranks_;
-  delete [] rank_counts_;
-  delete [] suit_counts_;
 }
 
 // Return values between 0 and 90
-int HoldemHandEvaluator::EvaluateTwo(Card *cards) {
+int HoldemHandEvaluator::EvaluateTwo(Card *cards) const {
   int r0 = Rank(cards[0]);
   int r1 = Rank(cards[1]);
   if (r0 == r1) {
@@ -103,7 +116,7 @@ int HoldemHandEvaluator::EvaluateTwo(Card *cards) {
 // 13 trips - 2366-2378
 // 169 (13 * 13) pairs (some values not possible) - 2197 - 2365
 // 2197 no-pairs (some values not possible) - 0...2196
-int HoldemHandEvaluator::EvaluateThree(Card *cards) {
+int HoldemHandEvaluator::EvaluateThree(Card *cards) const {
   unsigned int r0 = Rank(cards[0]);
   unsigned int r1 = Rank(cards[1]);
   unsigned int r2 = Rank(cards[2]);
@@ -150,25 +163,26 @@ int HoldemHandEvaluator::EvaluateThree(Card *cards) {
 // 28561...30757: pair
 // 0...28560:     no-pair
 // Next 715 (?) for no-pair
-int HoldemHandEvaluator::EvaluateFour(Card *cards) {
-  for (int r = 0; r <= 12; ++r) rank_counts_[r] = 0;
+int HoldemHandEvaluator::EvaluateFour(Card *cards) const {
+  int rank_counts[13];
+  for (int r = 0; r <= 12; ++r) rank_counts[r] = 0;
   for (int i = 0; i < 4; ++i) {
-    ++rank_counts_[Rank(cards[i])];
+    ++rank_counts[Rank(cards[i])];
   }
   int pair_rank1 = -1, pair_rank2 = -1;
   for (int r = 12; r >= 0; --r) {
-    if (rank_counts_[r] == 4) {
+    if (rank_counts[r] == 4) {
       return kH4Quads + r;
-    } else if (rank_counts_[r] == 3) {
+    } else if (rank_counts[r] == 3) {
       int kicker = -1;
       for (int r = 12; r >= 0; --r) {
-	if (rank_counts_[r] == 1) {
+	if (rank_counts[r] == 1) {
 	  kicker = r;
 	  break;
 	}
       }
       return kH4ThreeOfAKind + 13 * r + kicker;
-    } else if (rank_counts_[r] == 2) {
+    } else if (rank_counts[r] == 2) {
       if (pair_rank1 == -1) {
 	pair_rank1 = r;
       } else {
@@ -183,7 +197,7 @@ int HoldemHandEvaluator::EvaluateFour(Card *cards) {
   if (pair_rank1 >= 0) {
     int kicker1 = -1, kicker2 = -1;
     for (int r = 12; r >= 0; --r) {
-      if (rank_counts_[r] == 1) {
+      if (rank_counts[r] == 1) {
 	if (kicker1 == -1) {
 	  kicker1 = r;
 	} else {
@@ -196,7 +210,7 @@ int HoldemHandEvaluator::EvaluateFour(Card *cards) {
   }
   int kicker1 = -1, kicker2 = -1, kicker3 = -1, kicker4 = -1;
   for (int r = 12; r >= 0; --r) {
-    if (rank_counts_[r] == 1) {
+    if (rank_counts[r] == 1) {
       if (kicker1 == -1)      kicker1 = r;
       else if (kicker2 == -1) kicker2 = r;
       else if (kicker3 == -1) kicker3 = r;
@@ -206,7 +220,7 @@ int HoldemHandEvaluator::EvaluateFour(Card *cards) {
   return kicker1 * 2197 + kicker2 * 169 + kicker3 * 13 + kicker4;
 }
 
-int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
+int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) const {
   if (num_cards == 2) {
     return EvaluateTwo(cards);
   } else if (num_cards == 3) {
@@ -214,20 +228,21 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
   } else if (num_cards == 4) {
     return EvaluateFour(cards);
   }
-  for (int r = 0; r <= 12; ++r) rank_counts_[r] = 0;
-  for (int s = 0; s < 4; ++s)   suit_counts_[s] = 0;
+  int ranks[kMaxNumCards], suits[kMaxNumCards], rank_counts[13], suit_counts[4];
+  for (int r = 0; r <= 12; ++r) rank_counts[r] = 0;
+  for (int s = 0; s < 4; ++s)   suit_counts[s] = 0;
   for (int i = 0; i < num_cards; ++i) {
     Card c = cards[i];
     int r = Rank(c);
-    ranks_[i] = r;
-    ++rank_counts_[r];
+    ranks[i] = r;
+    ++rank_counts[r];
     int s = Suit(c);
-    suits_[i] = s;
-    ++suit_counts_[s];
+    suits[i] = s;
+    ++suit_counts[s];
   }
   int flush_suit = -1;
   for (int s = 0; s < 4; ++s) {
-    if (suit_counts_[s] >= 5) {
+    if (suit_counts[s] >= 5) {
       flush_suit = s;
       break;
     }
@@ -242,8 +257,8 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
     int r1 = r;
     int end = r - 4;
     while (r1 >= end &&
-	   ((r1 > -1 && rank_counts_[r1] > 0) ||
-	    (r1 == -1 && rank_counts_[12] > 0))) {
+	   ((r1 > -1 && rank_counts[r1] > 0) ||
+	    (r1 == -1 && rank_counts[12] > 0))) {
       --r1;
     }
     if (r1 == end - 1) {
@@ -255,9 +270,9 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
 	// end and r are in the flush suit.
 	int num = 0;
 	for (int i = 0; i < num_cards; ++i) {
-	  if (suits_[i] == flush_suit &&
-	      ((ranks_[i] >= end && ranks_[i] <= r) ||
-	       (end == -1 && ranks_[i] == 12))) {
+	  if (suits[i] == flush_suit &&
+	      ((ranks[i] >= end && ranks[i] <= r) ||
+	       (end == -1 && ranks[i] == 12))) {
 	    // This assumes we have no duplicate cards in input
 	    ++num;
 	  }
@@ -285,11 +300,11 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
   int pair_rank = -1;
   int pair2_rank = -1;
   for (int r = 12; r >= 0; --r) {
-    int ct = rank_counts_[r];
+    int ct = rank_counts[r];
     if (ct == 4) {
       int hr = -1;
       for (int i = 0; i < num_cards; ++i) {
-	int r1 = ranks_[i];
+	int r1 = ranks[i];
 	if (r1 != r && r1 > hr) hr = r1;
       }
       return kQuads + r * 13 + hr;
@@ -313,8 +328,8 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
   if (flush_suit >= 0) {
     int hr1 = -1, hr2 = -1, hr3 = -1, hr4 = -1, hr5 = -1;
     for (int i = 0; i < num_cards; ++i) {
-      if (suits_[i] == flush_suit) {
-	int r = ranks_[i];
+      if (suits[i] == flush_suit) {
+	int r = ranks[i];
 	if (r > hr1) {
 	  hr5 = hr4; hr4 = hr3; hr3 = hr2; hr2 = hr1; hr1 = r;
 	} else if (r > hr2) {
@@ -336,7 +351,7 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
   if (three_rank >= 0) {
     int hr1 = -1, hr2 = -1;
     for (int i = 0; i < num_cards; ++i) {
-      int r = ranks_[i];
+      int r = ranks[i];
       if (r != three_rank) {
 	if (r > hr1) {
 	  hr2 = hr1; hr1 = r;
@@ -359,7 +374,7 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
   if (pair2_rank >= 0) {
     int hr1 = -1;
     for (int i = 0; i < num_cards; ++i) {
-      int r = ranks_[i];
+      int r = ranks[i];
       if (r != pair_rank && r != pair2_rank && r > hr1) hr1 = r;
     }
     if (num_cards < 5) {
@@ -373,7 +388,7 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
   if (pair_rank >= 0) {
     int hr1 = -1, hr2 = -1, hr3 = -1;
     for (int i = 0; i < num_cards; ++i) {
-      int r = ranks_[i];
+      int r = ranks[i];
       if (r != pair_rank) {
 	if (r > hr1) {
 	  hr3 = hr2; hr2 = hr1; hr1 = r;
@@ -398,7 +413,7 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
 
   int hr1 = -1, hr2 = -1, hr3 = -1, hr4 = -1, hr5 = -1;
   for (int i = 0; i < num_cards; ++i) {
-    int r = ranks_[i];
+    int r = ranks[i];
     if (r > hr1) {
       hr5 = hr4; hr4 = hr3; hr3 = hr2; hr2 = hr1; hr1 = r;
     } else if (r > hr2) {
@@ -422,3 +437,124 @@ int HoldemHandEvaluator::Evaluate(Card *cards, int num_cards) {
     return kNoPair + hr1 * 28561 + hr2 * 2197 + hr3 * 169 + hr4 * 13 + hr5;
   }
 }
+
+static inline int HighBit(unsigned int m) {
+  return 31 - __builtin_clz(m);
+}
+
+// Returns a mask with bit j set if there is a straight whose top rank is j + 3.  Bit 0 of the
+// shifted mask stands for a low ace so that the wheel is found.
+static inline unsigned int Straights(unsigned int rank_mask) {
+  unsigned int m = (rank_mask << 1) | ((rank_mask >> 12) & 1);
+  return m & (m >> 1) & (m >> 2) & (m >> 3) & (m >> 4);
+}
+
+// Evaluates a hand of five to seven cards given as four 13-bit rank masks, one per suit, at bit
+// offsets 0, 16, 32 and 48.  Returns the same values as Evaluate().  Rank multiplicities come from
+// ANDs and ORs of the suit masks, and flushes and straights from population counts and shifts, so
+// the only branches are the ones that pick the hand category.
+int HoldemHandEvaluator::EvaluateMasks(unsigned long long int masks) {
+  unsigned int s0 = masks & 0x1fff;
+  unsigned int s1 = (masks >> 16) & 0x1fff;
+  unsigned int s2 = (masks >> 32) & 0x1fff;
+  unsigned int s3 = (masks >> 48) & 0x1fff;
+  unsigned int any = s0 | s1 | s2 | s3;
+  // At most one suit can have five cards when there are seven or fewer cards
+  unsigned int flush = 0;
+  if (__builtin_popcount(s0) >= 5)      flush = s0;
+  else if (__builtin_popcount(s1) >= 5) flush = s1;
+  else if (__builtin_popcount(s2) >= 5) flush = s2;
+  else if (__builtin_popcount(s3) >= 5) flush = s3;
+  if (flush) {
+    unsigned int sf = Straights(flush);
+    if (sf) return kStraightFlush + HighBit(sf) + 3;
+  }
+  unsigned int quads = s0 & s1 & s2 & s3;
+  if (quads) {
+    int r = HighBit(quads);
+    return kQuads + r * 13 + HighBit(any & ~(1U << r));
+  }
+  unsigned int trips = (s0 & s1 & s2) | (s0 & s1 & s3) | (s0 & s2 & s3) | (s1 & s2 & s3);
+  unsigned int pairs = ((s0 & s1) | (s0 & s2) | (s0 & s3) | (s1 & s2) | (s1 & s3) | (s2 & s3)) &
+    ~trips;
+  if (trips) {
+    int three_rank = HighBit(trips);
+    // A second set of trips plays as a pair
+    unsigned int pair_ranks = pairs | (trips & ~(1U << three_rank));
+    if (pair_ranks) return kFullHouse + three_rank * 13 + HighBit(pair_ranks);
+  }
+  if (flush) {
+    int hr1 = HighBit(flush);
+    flush &= ~(1U << hr1);
+    int hr2 = HighBit(flush);
+    flush &= ~(1U << hr2);
+    int hr3 = HighBit(flush);
+    flush &= ~(1U << hr3);
+    int hr4 = HighBit(flush);
+    flush &= ~(1U << hr4);
+    int hr5 = HighBit(flush);
+    return kFlush + hr1 * 28561 + hr2 * 2197 + hr3 * 169 + hr4 * 13 + hr5;
+  }
+  unsigned int straights = Straights(any);
+  if (straights) return kStraight + HighBit(straights) + 3;
+  if (trips) {
+    int three_rank = HighBit(trips);
+    unsigned int kickers = any & ~(1U << three_rank);
+    int hr1 = HighBit(kickers);
+    kickers &= ~(1U << hr1);
+    int hr2 = HighBit(kickers);
+    return kThreeOfAKind + three_rank * 169 + hr1 * 13 + hr2;
+  }
+  if (pairs) {
+    int pair_rank = HighBit(pairs);
+    unsigned int kickers = any & ~(1U << pair_rank);
+    unsigned int other_pairs = pairs & ~(1U << pair_rank);
+    if (other_pairs) {
+      // A third pair can supply the kicker
+      int pair2_rank = HighBit(other_pairs);
+      kickers &= ~(1U << pair2_rank);
+      return kTwoPair + pair_rank * 169 + pair2_rank * 13 + HighBit(kickers);
+    }
+    int hr1 = HighBit(kickers);
+    kickers &= ~(1U << hr1);
+    int hr2 = HighBit(kickers);
+    kickers &= ~(1U << hr2);
+    int hr3 = HighBit(kickers);
+    return kPair + pair_rank * 2197 + hr1 * 169 + hr2 * 13 + hr3;
+  }
+  int hr1 = HighBit(any);
+  any &= ~(1U << hr1);
+  int hr2 = HighBit(any);
+  any &= ~(1U << hr2);
+  int hr3 = HighBit(any);
+  any &= ~(1U << hr3);
+  int hr4 = HighBit(any);
+  any &= ~(1U << hr4);
+  int hr5 = HighBit(any);
+  return kNoPair + hr1 * 28561 + hr2 * 2197 + hr3 * 169 + hr4 * 13 + hr5;
+}
+
+// Works on chunks of hands.  Building the masks for a chunk is a branch-free loop over the card
+// positions that the compiler can vectorize; the masks are then evaluated one hand at a time.
+void HoldemHandEvaluator::EvaluateBatch(const Card *cards, int num_cards, int num_hands,
+					int *vals) const {
+  if (num_cards < 5) {
+    HandEvaluator::EvaluateBatch(cards, num_cards, num_hands, vals);
+    return;
+  }
+  if (num_cards > kMaxNumCards || ! masks_ok_) {
+    fprintf(stderr, "HoldemHandEvaluator::EvaluateBatch: unsupported hand or game\n");
+    exit(-1);
+  }
+  unsigned long long int masks[kBatchChunk];
+  for (int h0 = 0; h0 < num_hands; h0 += kBatchChunk) {
+    int n = num_hands - h0;
+    if (n > kBatchChunk) n = kBatchChunk;
+    for (int h = 0; h < n; ++h) masks[h] = 0ULL;
+    for (int i = 0; i < num_cards; ++i) {
+      const Card *these_cards = cards + i * (long long int)num_hands + h0;
+      for (int h = 0; h < n; ++h) masks[h] |= card_masks_[these_cards[h]];
+    }
+    for (int h = 0; h < n; ++h) vals[h0 + h] = EvaluateMasks(masks[h]);
+  }
+}
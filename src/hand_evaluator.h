@@ -5,13 +5,20 @@
 
 #include "cards.h"
 
+// Evaluate() and EvaluateBatch() keep no mutable state, so one evaluator can be shared by many
+// threads.
 class HandEvaluator {
 public:
   HandEvaluator(void);
   virtual ~HandEvaluator(void);
   static HandEvaluator *Create(const std::string &name);
-  virtual int Evaluate(Card *cards, int num_cards) = 0;
+  virtual int Evaluate(Card *cards, int num_cards) const = 0;
+  // Evaluates num_hands hands of num_cards cards each.  The cards are laid out by position:
+  // cards[i * num_hands + h] is the ith card of hand h.  The value of hand h goes in vals[h].
+  // The default implementation calls Evaluate() on each hand.
+  virtual void EvaluateBatch(const Card *cards, int num_cards, int num_hands, int *vals) const;
 
+  static const int kMaxNumCards = 7;
 private:
 };
 
@@ -19,14 +26,17 @@ class LeducHandEvaluator : public HandEvaluator {
  public:
   LeducHandEvaluator(void);
   ~LeducHandEvaluator(void);
-  int Evaluate(Card *cards, int num_cards);
+  int Evaluate(Card *cards, int num_cards) const;
 };
 
 class HoldemHandEvaluator : public HandEvaluator {
  public:
   HoldemHandEvaluator(void);
   ~HoldemHandEvaluator(void);
-  int Evaluate(Card *cards, int num_cards);
+  int Evaluate(Card *cards, int num_cards) const;
+  // Hands of five or more cards are evaluated from bit masks (see EvaluateMasks()); smaller hands
+  // go through Evaluate().
+  void EvaluateBatch(const Card *cards, int num_cards, int num_hands, int *vals) const;
 
   static const int kMaxHandVal = 775905;
   static const int kStraightFlush = 775892;
@@ -47,14 +57,18 @@ class HoldemHandEvaluator : public HandEvaluator {
   static const int kH4Pair = 28561;
   static const int kH4NoPair = 0;
  private:
-  int EvaluateTwo(Card *cards);
-  int EvaluateThree(Card *cards);
-  int EvaluateFour(Card *cards);
-
-  int *ranks_;
-  int *suits_;
-  int *rank_counts_;
-  int *suit_counts_;
+  // Number of hands whose masks we build at a time in EvaluateBatch()
+  static const int kBatchChunk = 256;
+
+  int EvaluateTwo(Card *cards) const;
+  int EvaluateThree(Card *cards) const;
+  int EvaluateFour(Card *cards) const;
+  static int EvaluateMasks(unsigned long long int masks);
+
+  // One bit per card: bit 16 * suit + rank.  OR-ing the masks of a hand's cards gives one 13-bit
+  // rank mask per suit.  Only set if the game has at most four suits and 13 ranks.
+  unsigned long long int card_masks_[64];
+  bool masks_ok_;
 };
 
 #endif
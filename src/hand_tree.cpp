@@ -3,9 +3,14 @@
 // preflop.  For large games, you might create the HandTree for all hands
 // rooted at a particular flop board.
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "board_tree.h"
@@ -15,16 +20,166 @@
 #include "hand_tree.h"
 #include "hand_value_tree.h"
 
+using std::list;
+using std::pair;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::unordered_map;
 using std::vector;
+using std::weak_ptr;
+
+// Default bound on the boards kept in the cache that no HandTree is using
+static const long long int kDefaultCacheBytes = 1LL << 30;
+// Don't bother purging expired entries from a smaller index
+static const size_t kMinPurgeSize = 1024;
+
+// The process-wide cache of board hands described in hand_tree.h.  Boards that some HandTree
+// holds are found through weak pointers; in addition, the most recently used boards are held
+// here, up to max_bytes_, so that building a HandTree right after destroying one for the same
+// boards (e.g., solving one subgame after another) doesn't rebuild them.
+class HandCache {
+public:
+  HandCache(void);
+  ~HandCache(void);
+  shared_ptr<const CanonicalCards> Get(int st, int gbd);
+  void SetMaxBytes(long long int max_bytes);
+private:
+  typedef pair<long long int, shared_ptr<const CanonicalCards>> Held;
+  struct Entry {
+    Entry(void) : in_lru(false) {}
+    weak_ptr<const CanonicalCards> hands;
+    // Whether lru_ holds the hands, and where
+    bool in_lru;
+    list<Held>::iterator lru_it;
+  };
+
+  static shared_ptr<const CanonicalCards> Build(int st, int gbd);
+  void Hold(long long int key, Entry *entry, const shared_ptr<const CanonicalCards> &hands);
+  void Evict(void);
+  void Purge(void);
+
+  unordered_map<long long int, Entry> entries_;
+  // Most recently used first
+  list<Held> lru_;
+  long long int max_bytes_;
+  long long int lru_bytes_;
+  // Purge expired entries when the index reaches this size
+  size_t purge_size_;
+  pthread_mutex_t mutex_;
+};
+
+HandCache::HandCache(void) {
+  max_bytes_ = kDefaultCacheBytes;
+  lru_bytes_ = 0;
+  purge_size_ = kMinPurgeSize;
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+HandCache::~HandCache(void) {
+  pthread_mutex_destroy(&mutex_);
+}
+
+shared_ptr<const CanonicalCards> HandCache::Build(int st, int gbd) {
+  const Card *board = BoardTree::Board(st, gbd);
+  int sg = BoardTree::SuitGroups(st, gbd);
+  CanonicalCards *hands = new CanonicalCards(2, board, Game::NumBoardCards(st), sg, false);
+  if (st == Game::MaxStreet()) {
+    hands->SortByHandStrength(board);
+  }
+  return shared_ptr<const CanonicalCards>(hands);
+}
+
+// Must be called with mutex_ held.
+void HandCache::Evict(void) {
+  Held &held = lru_.back();
+  lru_bytes_ -= held.second->NumBytes();
+  auto it = entries_.find(held.first);
+  it->second.in_lru = false;
+  bool last = held.second.use_count() == 1;
+  lru_.pop_back();
+  if (last) entries_.erase(it);
+}
+
+// Must be called with mutex_ held.  Drops the entries for boards that HandTrees have let go of
+// since they were evicted.
+void HandCache::Purge(void) {
+  for (auto it = entries_.begin(); it != entries_.end(); ) {
+    if (! it->second.in_lru && it->second.hands.expired()) it = entries_.erase(it);
+    else                                                    ++it;
+  }
+  purge_size_ = 2 * entries_.size();
+  if (purge_size_ < kMinPurgeSize) purge_size_ = kMinPurgeSize;
+}
+
+// Must be called with mutex_ held.
+void HandCache::Hold(long long int key, Entry *entry,
+		     const shared_ptr<const CanonicalCards> &hands) {
+  if (entry->in_lru) {
+    lru_.splice(lru_.begin(), lru_, entry->lru_it);
+    return;
+  }
+  long long int bytes = hands->NumBytes();
+  if (bytes > max_bytes_) return;
+  lru_.push_front(Held(key, hands));
+  entry->in_lru = true;
+  entry->lru_it = lru_.begin();
+  lru_bytes_ += bytes;
+  while (lru_bytes_ > max_bytes_) Evict();
+}
+
+shared_ptr<const CanonicalCards> HandCache::Get(int st, int gbd) {
+  long long int key = gbd * (long long int)(Game::MaxStreet() + 1) + st;
+  pthread_mutex_lock(&mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    shared_ptr<const CanonicalCards> hands = it->second.hands.lock();
+    if (hands) {
+      Hold(key, &it->second, hands);
+      pthread_mutex_unlock(&mutex_);
+      return hands;
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+
+  // Build without holding the lock.  If another thread builds the same board meanwhile, we use
+  // whichever copy got into the cache first.
+  shared_ptr<const CanonicalCards> hands = Build(st, gbd);
+  pthread_mutex_lock(&mutex_);
+  Entry &entry = entries_[key];
+  shared_ptr<const CanonicalCards> existing = entry.hands.lock();
+  if (existing) hands = existing;
+  else          entry.hands = hands;
+  Hold(key, &entry, hands);
+  if (entries_.size() >= purge_size_) Purge();
+  pthread_mutex_unlock(&mutex_);
+  return hands;
+}
+
+void HandCache::SetMaxBytes(long long int max_bytes) {
+  pthread_mutex_lock(&mutex_);
+  max_bytes_ = max_bytes;
+  while (lru_bytes_ > max_bytes_) Evict();
+  pthread_mutex_unlock(&mutex_);
+}
+
+static HandCache *TheHandCache(void) {
+  static HandCache cache;
+  return &cache;
+}
+
+shared_ptr<const CanonicalCards> HandTree::BoardHands(int st, int gbd) {
+  return TheHandCache()->Get(st, gbd);
+}
+
+void HandTree::SetCacheBytes(long long int cache_bytes) {
+  TheHandCache()->SetMaxBytes(cache_bytes);
+}
 
 HandTree::HandTree(int root_st, int root_bd, int final_st) {
   root_st_ = root_st;
   root_bd_ = root_bd;
   final_st_ = final_st;
-  hands_ = new CanonicalCards **[final_st_ + 1];
-  for (int st = 0; st < root_st_; ++st) {
-    hands_[st] = NULL;
-  }
+  hands_.reset(new unique_ptr<shared_ptr<const CanonicalCards> []>[final_st_ + 1]);
   BoardTree::Create();
   int max_street = Game::MaxStreet();
   // if (final_st == max_street) HandValueTree::Create();
@@ -35,33 +190,19 @@ HandTree::HandTree(int root_st, int root_bd, int final_st) {
     fprintf(stderr, "Hand value tree has not been created\n");
     exit(-1);
   }
+  HandCache *cache = TheHandCache();
   for (int st = root_st_; st <= final_st_; ++st) {
     int num_local_boards =
       BoardTree::NumLocalBoards(root_st_, root_bd_, st);
-    int num_board_cards = Game::NumBoardCards(st);
-    hands_[st] = new CanonicalCards *[num_local_boards];
+    hands_[st].reset(new shared_ptr<const CanonicalCards>[num_local_boards]);
     for (int lbd = 0; lbd < num_local_boards; ++lbd) {
       int gbd = BoardTree::GlobalIndex(root_st_, root_bd_, st, lbd);
-      const Card *board = BoardTree::Board(st, gbd);
-      int sg = BoardTree::SuitGroups(st, gbd);
-      hands_[st][lbd] = new CanonicalCards(2, board, num_board_cards, sg, false);
-      if (st == max_street) {
-	hands_[st][lbd]->SortByHandStrength(board);
-      }
+      hands_[st][lbd] = cache->Get(st, gbd);
     }
   }
 }
 
 HandTree::~HandTree(void) {
-  for (int st = root_st_; st <= final_st_; ++st) {
-    int num_local_boards =
-      BoardTree::NumLocalBoards(root_st_, root_bd_, st);
-    for (int lbd = 0; lbd < num_local_boards; ++lbd) {
-      delete hands_[st][lbd];
-    }
-    delete [] hands_[st];
-  }
-  delete [] hands_;
 }
 
 // Assumes hole cards are ordered
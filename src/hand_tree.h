@@ -1,18 +1,26 @@
 #ifndef _HAND_TREE_H_
 #define _HAND_TREE_H_
 
+#include <memory>
+
 #include "board_tree.h"
 #include "cards.h"
 
 class CanonicalCards;
 
+// The hands for a board don't depend on the tree they are part of, so they are shared between
+// HandTrees through a process-wide cache.  A board's hands are built (and, on the final street,
+// sorted by hand strength) the first time any HandTree needs them, and reused as long as some
+// HandTree still holds them or they are among the most recently used boards that fit in the
+// cache.  Constructing a HandTree for boards that are already in use is therefore cheap, and the
+// cache is safe to use from several threads at once.
 class HandTree {
 public:
   HandTree(int root_st, int root_bd, int final_st);
   ~HandTree(void);
   const CanonicalCards *Hands(int st, int gbd) const {
     int lbd = LocalBoardIndex(st, gbd);
-    return hands_[st][lbd];
+    return hands_[st][lbd].get();
   }
   int FinalSt(void) const {return final_st_;}
   int RootSt(void) const {return root_st_;}
@@ -20,11 +28,16 @@ public:
   int LocalBoardIndex(int st, int gbd) const {
     return BoardTree::LocalIndex(root_st_, root_bd_, st, gbd);
   }
+  // The cached hands for one board, for callers that walk boards one at a time rather than
+  // through a tree.
+  static std::shared_ptr<const CanonicalCards> BoardHands(int st, int gbd);
+  // Bounds the memory of the boards kept in the cache after no HandTree uses them any more.
+  static void SetCacheBytes(long long int cache_bytes);
 private:
   int root_st_;
   int root_bd_;
   int final_st_;
-  CanonicalCards ***hands_;
+  std::unique_ptr<std::unique_ptr<std::shared_ptr<const CanonicalCards> []> []> hands_;
 };
 
 int HCPIndex(int st, const Card *cards);
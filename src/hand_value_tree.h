@@ -1,8 +1,18 @@
 #ifndef _HAND_VALUE_TREE_H_
 #define _HAND_VALUE_TREE_H_
 
+#include <memory>
+
 #include "cards.h"
 
+class MappedFile;
+
+// Hand values for every set of num-cards cards (hole cards plus full board).  The values are
+// stored on disk in colex order: sets are ordered by their highest card, then their second highest
+// card, and so on.  The position of a set whose cards are c1 > c2 > ... > cn is therefore
+// C(c1, n) + C(c2, n-1) + ... + C(cn, 1).  We map the file rather than reading it, so a lookup is
+// a handful of hits on a small table of binomial coefficients plus one load, and processes that
+// use the same game share one copy of the values through the page cache.
 class HandValueTree {
 public:
   // Note: currently you need to make sure that this is called from only one thread.
@@ -14,26 +24,24 @@ public:
   // board and hole_cards should be sorted from high to low.
   static int Val(const int *board, const int *hole_cards);
   static int DiskRead(Card *cards);
+  // The colex index of a set of num_cards cards, which must be sorted from high to low.
+  // Requires that Create() has been called.
+  static int Index(const int *cards, int num_cards);
 private:
   HandValueTree(void) {}
 
-  static void ReadOne(void);
-  static void ReadTwo(void);
-  static void ReadThree(void);
-  static void ReadFour(void);
-  static void ReadFive(void);
-  static void ReadSix(void);
-  static void ReadSeven(void);
+  static const int kMaxNumCards = 7;
+  static const int kMaxDeckSize = 64;
+
+  static void BuildBinomials(void);
+  static void InitBinomials(void);
 
   static int num_board_cards_;
   static int num_cards_;
-  static int *tree1_;
-  static int **tree2_;
-  static int ***tree3_;
-  static int ****tree4_;
-  static int *****tree5_;
-  static int ******tree6_;
-  static int *******tree7_;
+  // binomials_[k][c] is C(c, k)
+  static int binomials_[kMaxNumCards + 1][kMaxDeckSize + 1];
+  static std::unique_ptr<MappedFile> file_;
+  static const int *vals_;
 };
 
 #endif
@@ -33,6 +33,7 @@
 #include <unistd.h>   // sleep()
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -78,7 +79,7 @@ public:
 	 bool resolve_a, bool resolve_b, const CardAbstraction &as_ca,
 	 const BettingAbstraction &as_ba, const CFRConfig &as_cc,
 	 const CardAbstraction &bs_ca, const BettingAbstraction &bs_ba,
-	 const CFRConfig &bs_cc, bool a_quantize, bool b_quantize);
+	 const CFRConfig &bs_cc, bool a_quantize, bool b_quantize, bool a_map, bool b_map);
   ~Player(void) {}
   void Go(int num_sampled_max_street_boards, bool deterministic, int num_threads);
   const CardAbstraction &ACardAbstraction(void) const {return a_card_abstraction_;}
@@ -146,7 +147,8 @@ Player::Player(const CardAbstraction &a_ca, const CardAbstraction &b_ca,
 	       bool resolve_a, bool resolve_b, const CardAbstraction &as_ca,
 	       const BettingAbstraction &as_ba, const CFRConfig &as_cc,
 	       const CardAbstraction &bs_ca, const BettingAbstraction &bs_ba,
-	       const CFRConfig &bs_cc, bool a_quantize, bool b_quantize) :
+	       const CFRConfig &bs_cc, bool a_quantize, bool b_quantize, bool a_map,
+	       bool b_map) :
   a_card_abstraction_(a_ca), b_card_abstraction_(b_ca),
   a_betting_abstraction_(a_ba), b_betting_abstraction_(b_ba),
   a_cfr_config_(a_cc), b_cfr_config_(b_cc),
@@ -216,7 +218,13 @@ Player::Player(const CardAbstraction &a_ca, const CardAbstraction &b_ca,
 	  a_ba.BettingAbstractionName().c_str(),
 	  a_cc.CFRConfigName().c_str());
   if (a_ba.Asymmetric()) {
+    if (a_map) {
+      fprintf(stderr, "Can't map the strategy of an asymmetric system\n");
+      exit(-1);
+    }
     a_probs_->ReadAsymmetric(dir, a_it, *a_betting_trees_, "x", -1, true, a_quantize);
+  } else if (a_map) {
+    a_probs_->Map(dir, a_it, a_betting_trees_->GetBettingTree(), "x", -1, true);
   } else {
     a_probs_->Read(dir, a_it, a_betting_trees_->GetBettingTree(), "x", -1, true, a_quantize);
   }
@@ -235,7 +243,13 @@ Player::Player(const CardAbstraction &a_ca, const CardAbstraction &b_ca,
 	    Game::NumSuits(), Game::MaxStreet(), b_ba.BettingAbstractionName().c_str(),
 	    b_cc.CFRConfigName().c_str());
     if (b_ba.Asymmetric()) {
+      if (b_map) {
+	fprintf(stderr, "Can't map the strategy of an asymmetric system\n");
+	exit(-1);
+      }
       b_probs_->ReadAsymmetric(dir, b_it, *b_betting_trees_, "x", -1, true, b_quantize);
+    } else if (b_map) {
+      b_probs_->Map(dir, b_it, b_betting_trees_->GetBettingTree(), "x", -1, true);
     } else {
       b_probs_->Read(dir, b_it, b_betting_trees_->GetBettingTree(), "x", -1, true, b_quantize);
     }
@@ -271,13 +285,11 @@ Player::Player(const CardAbstraction &a_ca, const CardAbstraction &b_ca,
 
 class PlayerThread {
 public:
-  PlayerThread(const Player &player, int thread_index, int num_threads,
-	       const vector<int> &sampled_boards);
+  PlayerThread(const Player &player, int thread_index, const vector<int> &sampled_boards,
+	       std::atomic<int> *next_sample, double *sample_outcomes);
   void Go(void);
   void Run(void);
   void Join(void);
-  double Sum(void) const {return sum_;}
-  double SumSqd(void) const {return sum_sqd_;}
   int NumResolves(void) const {return num_resolves_;}
   double ResolvingSecs(void) const {return resolving_secs_;}
 private:
@@ -291,8 +303,9 @@ private:
 
   const Player &player_;
   int thread_index_;
-  int num_threads_;
-  unique_ptr<shared_ptr<CanonicalCards> []> street_hands_;
+  // Hands for the current board's streets, from HandTree's cache, so boards that share a flop or
+  // turn share its hands, and threads share the sorting of the river hands.
+  unique_ptr<shared_ptr<const CanonicalCards> []> street_hands_;
   unique_ptr<EGCFR> a_eg_cfr_;
   unique_ptr<EGCFR> b_eg_cfr_;
   // When we resolve a street, the board index may change.  This is why we have separate
@@ -311,18 +324,28 @@ private:
   double sum_weights_;
   int num_resolves_;
   double resolving_secs_;
-  double sum_;
-  double sum_sqd_;
+  // Scratch space for Showdown() and Fold(), reused across nodes and boards
+  unique_ptr<double []> cum_opp_card_probs_;
+  unique_ptr<double []> total_opp_card_probs_;
+  unique_ptr<double []> win_probs_;
   const vector<int> &sampled_boards_;
+  // Threads claim samples from a shared cursor, so a thread that gets expensive boards doesn't
+  // hold up the others
+  std::atomic<int> *next_sample_;
+  double *sample_outcomes_;
   pthread_t pthread_id_;
 };
 
-PlayerThread::PlayerThread(const Player &player, int thread_index, int num_threads,
-			   const vector<int> &sampled_boards) :
-  player_(player), thread_index_(thread_index), num_threads_(num_threads),
-  sampled_boards_(sampled_boards) {
+PlayerThread::PlayerThread(const Player &player, int thread_index,
+			   const vector<int> &sampled_boards, std::atomic<int> *next_sample,
+			   double *sample_outcomes) :
+  player_(player), thread_index_(thread_index), sampled_boards_(sampled_boards),
+  next_sample_(next_sample), sample_outcomes_(sample_outcomes) {
   int max_street = Game::MaxStreet();
-  street_hands_.reset(new shared_ptr<CanonicalCards>[max_street + 1]);
+  street_hands_.reset(new shared_ptr<const CanonicalCards>[max_street + 1]);
+  cum_opp_card_probs_.reset(new double[Game::MaxCard() + 1]);
+  total_opp_card_probs_.reset(new double[Game::MaxCard() + 1]);
+  win_probs_.reset(new double[Game::NumHoleCardPairs(max_street)]);
   b_pos_ = 0;
   sum_b_outcomes_ = 0;
   sum_weights_ = 0;
@@ -368,8 +391,8 @@ void PlayerThread::Showdown(Node *a_node, Node *b_node, const ReachProbs &reach_
   // double *b_probs = b_pos_ == 0 ? reach_probs[0].get() : reach_probs[1].get();
   double *a_probs = reach_probs.Get(b_pos_^1).get();
   double *b_probs = reach_probs.Get(b_pos_).get();
-  unique_ptr<double []> cum_opp_card_probs(new double[52]);
-  unique_ptr<double []> total_opp_card_probs(new double[52]);
+  double *cum_opp_card_probs = cum_opp_card_probs_.get();
+  double *total_opp_card_probs = total_opp_card_probs_.get();
   for (Card c = 0; c < max_card1; ++c) {
     cum_opp_card_probs[c] = 0;
     total_opp_card_probs[c] = 0;
@@ -394,7 +417,7 @@ void PlayerThread::Showdown(Node *a_node, Node *b_node, const ReachProbs &reach_
   }
 
   double opp_cum_prob = 0;
-  unique_ptr<double []> win_probs(new double[num_hole_card_pairs]);
+  double *win_probs = win_probs_.get();
   double half_pot = a_node->LastBetTo();
   double sum_our_vals = 0, sum_joint_probs = 0;
 
@@ -470,8 +493,8 @@ void PlayerThread::Fold(Node *a_node, Node *b_node, const ReachProbs &reach_prob
   // double *b_probs = b_pos_ == 0 ? reach_probs[0].get() : reach_probs[1].get();
   double *a_probs = reach_probs.Get(b_pos_^1).get();
   double *b_probs = reach_probs.Get(b_pos_).get();
-  unique_ptr<double []> cum_opp_card_probs(new double[52]);
-  unique_ptr<double []> total_opp_card_probs(new double[52]);
+  double *cum_opp_card_probs = cum_opp_card_probs_.get();
+  double *total_opp_card_probs = total_opp_card_probs_.get();
   for (Card c = 0; c < max_card1; ++c) {
     cum_opp_card_probs[c] = 0;
     total_opp_card_probs[c] = 0;
@@ -686,24 +709,16 @@ double PlayerThread::ProcessMaxStreetBoard(int msbd) {
 
   if (player_.ResolveA() || player_.ResolveB()) {
     int resolve_st = player_.ResolveSt();
-    if (resolve_st < max_street) {
-      resolve_hand_tree_.reset(new HandTree(resolve_st, BoardTree::PredBoard(msbd_, resolve_st),
-					    max_street));
-    } else {
-      resolve_hand_tree_.reset(new HandTree(max_street, msbd_, max_street));
+    int resolve_bd = resolve_st < max_street ? BoardTree::PredBoard(msbd_, resolve_st) : msbd_;
+    // Consecutive samples often share the resolve board
+    if (! resolve_hand_tree_ || resolve_hand_tree_->RootBd() != resolve_bd) {
+      resolve_hand_tree_.reset(new HandTree(resolve_st, resolve_bd, max_street));
     }
   }
   
   for (int st = 0; st <= max_street; ++st) {
-    int num_board_cards = Game::NumBoardCards(st);
     int bd = st == max_street ? msbd_ : BoardTree::PredBoard(msbd_, st);
-    const Card *board = BoardTree::Board(st, bd);
-    int sg = BoardTree::SuitGroups(st, bd);
-    shared_ptr<CanonicalCards> hands(new CanonicalCards(2, board, num_board_cards, sg, false));
-    if (st == max_street) {
-      hands->SortByHandStrength(board);
-    }
-    street_hands_[st] = hands;
+    street_hands_[st] = HandTree::BoardHands(st, bd);
   }
   int num_players = Game::NumPlayers();
   unique_ptr<ReachProbs> reach_probs(ReachProbs::CreateRoot());
@@ -719,15 +734,13 @@ double PlayerThread::ProcessMaxStreetBoard(int msbd) {
 }
 
 void PlayerThread::Go(void) {
-  // Iterate through the sampled boards processing those that "belong" to this thread.
-  sum_ = 0;
-  sum_sqd_ = 0;
   int num_samples = sampled_boards_.size();
-  for (int i = thread_index_; i < num_samples; i += num_threads_) {
+  while (true) {
+    int i = next_sample_->fetch_add(1);
+    if (i >= num_samples) break;
     int bd = sampled_boards_[i];
     double avg_b_outcome = ProcessMaxStreetBoard(bd);
-    sum_ += avg_b_outcome;
-    sum_sqd_ += avg_b_outcome * avg_b_outcome;
+    sample_outcomes_[i] = avg_b_outcome;
     fprintf(stderr, "Thread %i sample %i outcome %f mbb %f\n", thread_index_, i, avg_b_outcome,
 	    (avg_b_outcome / 2.0) * 1000.0);
   }
@@ -766,9 +779,14 @@ void Player::Compute(int num_sampled_max_street_boards, bool deterministic, int
     int bd = board_samples_[s];
     sampled_boards.push_back(bd);
   }
+  // Boards that share a flop or turn are adjacent in board index order, so sorting lets
+  // consecutive samples reuse the same hands (and resolve hand trees).
+  std::sort(sampled_boards.begin(), sampled_boards.end());
+  std::atomic<int> next_sample(0);
+  unique_ptr<double []> sample_outcomes(new double[num_sampled_max_street_boards]);
   unique_ptr<PlayerThread * []> threads(new PlayerThread *[num_threads]);
   for (int i = 0; i < num_threads; ++i) {
-    threads[i] = new PlayerThread(*this, i, num_threads, sampled_boards);
+    threads[i] = new PlayerThread(*this, i, sampled_boards, &next_sample, sample_outcomes.get());
   }
   for (int i = 1; i < num_threads; ++i) {
     threads[i]->Run();
@@ -777,13 +795,16 @@ void Player::Compute(int num_sampled_max_street_boards, bool deterministic, int
   for (int i = 1; i < num_threads; ++i) {
     threads[i]->Join();
   }
+  // Sum in sample order so that the result doesn't depend on which thread did which sample
   *sum = 0;
   *sum_sqd = 0;
+  for (int i = 0; i < num_sampled_max_street_boards; ++i) {
+    *sum += sample_outcomes[i];
+    *sum_sqd += sample_outcomes[i] * sample_outcomes[i];
+  }
   int num_resolves = 0;
   double resolving_secs = 0;
   for (int i = 0; i < num_threads; ++i) {
-    *sum += threads[i]->Sum();
-    *sum_sqd += threads[i]->SumSqd();
     num_resolves += threads[i]->NumResolves();
     resolving_secs += threads[i]->ResolvingSecs();
   }
@@ -829,13 +850,15 @@ static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <A card params> <B card params> "
 	  "<A betting abstraction params> <B betting abstraction params> <A CFR params> "
 	  "<B CFR params> <A it> <B it> <num sampled max street boards> <num threads> "
-	  "[quantize|raw] [quantize|raw] [deterministic|nondeterministic] <resolve A> <resolve B> "
+	  "[quantize|raw|mmap] [quantize|raw|mmap] [deterministic|nondeterministic] <resolve A> "
+	  "<resolve B> "
 	  "(<resolve st>) (<A resolve card params> <A resolve betting params> "
 	  "<A resolve CFR config>) (<B resolve card params> <B resolve betting params> "
 	  "<B resolve CFR config>)\n", prog_name);
   fprintf(stderr, "\n");
   fprintf(stderr, "Specify 0 for <num sampled max street boards> to not sample\n");
   fprintf(stderr, "<resolve A> and <resolve B> must be \"true\" or \"false\"\n");
+  fprintf(stderr, "mmap maps the strategy files into memory rather than reading them\n");
   exit(-1);
 }
 
@@ -876,15 +899,17 @@ int main(int argc, char *argv[]) {
   if (sscanf(argv[10], "%i", &num_sampled_max_street_boards) != 1) Usage(argv[0]);
   if (sscanf(argv[11], "%i", &num_threads) != 1)                   Usage(argv[0]);
 
-  bool a_quantize = false, b_quantize = false;
+  bool a_quantize = false, b_quantize = false, a_map = false, b_map = false;
   string qa = argv[12];
-  if (qa == "quantize") a_quantize = true;
-  else if (qa == "raw") a_quantize = false;
-  else                  Usage(argv[0]);
+  if (qa == "quantize")  a_quantize = true;
+  else if (qa == "raw")  a_quantize = false;
+  else if (qa == "mmap") a_map = true;
+  else                   Usage(argv[0]);
   string qb = argv[13];
-  if (qb == "quantize") b_quantize = true;
-  else if (qb == "raw") b_quantize = false;
-  else                  Usage(argv[0]);
+  if (qb == "quantize")  b_quantize = true;
+  else if (qb == "raw")  b_quantize = false;
+  else if (qb == "mmap") b_map = true;
+  else                   Usage(argv[0]);
 
   bool deterministic = false;
   string da = argv[14];
@@ -946,6 +971,6 @@ int main(int argc, char *argv[]) {
 		*b_betting_abstraction, *a_cfr_config, *b_cfr_config, a_it, b_it, resolve_st,
 		resolve_a, resolve_b, *a_subgame_card_abstraction, *a_subgame_betting_abstraction,
 		*a_subgame_cfr_config, *b_subgame_card_abstraction, *b_subgame_betting_abstraction,
-		*b_subgame_cfr_config, a_quantize, b_quantize);
+		*b_subgame_cfr_config, a_quantize, b_quantize, a_map, b_map);
   player.Go(num_sampled_max_street_boards, deterministic, num_threads);
 }
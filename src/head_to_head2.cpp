@@ -1,31 +1,22 @@
-// This is unfinished and may not be an approach that will actually work.
+// head_to_head2 assesses head to head performance between two systems like head_to_head, but
+// without reading either strategy into memory.  It is for comparing systems that don't both fit
+// in RAM.
 //
-// This version of head_to_head changes the order of processing with the goal of efficiently
-// supporting online loading of the needed probabilities so that we do not need to read the
-// entire strategies into memory.
+// The outer loop is over sampled final street boards.  (Making an earlier street the outer loop
+// doesn't work: to get the fold and showdown EVs right for a turn hand we would need to know,
+// for every opponent hand, how many of the sampled river boards are consistent with both.)  For
+// each board we walk the two betting trees tracking each player's range, and look up the
+// sumprobs we need through a DiskProbs for each system.  On streets without a card abstraction
+// the sumprobs are laid out by board, so each node costs one read of that board's rows; on
+// bucketed streets we read one bucket at a time.
 //
-// TODO: need to set a_lbds_, a_gbds_, street_hands_.
+// The sampled boards are processed in board index order, so boards that share a flop or turn
+// are processed together and find that street's values still in the cache.  Memory is bounded
+// by the given budget: most of it goes to the DiskProbs block caches and the rest to the cache
+// of board hands.  The bucket tables are mapped rather than read (see Buckets) and so don't
+// count against it.
 //
-// It's probably tricky to get all the weights right.  IIRC, we struggled with this before.
-// Consider:
-// * Each turn board is consistent with varying number of sampled river boards.
-//     That doesn't seem so bad.  Just precompute the number of samples per turn board.
-// * Each turn *hand* is consistent with varying numbers of samples river boards.
-//     Can I precompute a number of samples per turn hand?  Are there 63 million turn
-//     hands?  Seems doable.
-//
-// How do we handle this in VCFR?  We scale down at street-initial nodes.
-//
-// Not sure what to do with the joint probs calculation.
-//
-// My thought was that on the turn for a given hand like AcKcQcJc/4h3d, I have precomputed the
-// number of sampled river boards that are extensions of AcKcQcJc and which contain neither the
-// 4h nor the 3d.  But now I don't think that works.  For AcKcQcJc/4h3d, I need to calculate the
-// fold EV at a given state.  It's not sufficient to know how many sampled river boards are
-// consistent with AcKcQcJc/4h3d.  To count how many hands I fold to, I need to know the same
-// for the opponent hands.  This is not easy to calculate.
-//
-// I think we're back to iterating over sampled river boards as the outer loop.
+// Resolving and asymmetric systems are not supported; use head_to_head for those.
 
 #include <math.h>
 #include <pthread.h>
@@ -35,6 +26,7 @@
 #include <sys/time.h> // gettimeofday()
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -46,131 +38,71 @@
 #include "board_tree.h"
 #include "buckets.h"
 #include "canonical_cards.h"
-#include "canonical.h"
 #include "card_abstraction.h"
 #include "card_abstraction_params.h"
 #include "cfr_config.h"
 #include "cfr_params.h"
-#include "cfr_values.h"
-#include "constants.h"
+#include "disk_probs.h"
 #include "files.h"
 #include "game.h"
 #include "game_params.h"
-#include "hand_samples.h"
 #include "hand_tree.h"
 #include "hand_value_tree.h"
 #include "io.h"
 #include "params.h"
-#include "rand.h"
 #include "reach_probs.h"
-#include "sorting.h"
-#include "subgame_utils.h" // CreateSubtrees()
-#include "unsafe_eg_cfr.h"
 
-using std::pair;
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
 using std::vector;
 
+// The part of the memory budget for the board hands.  The rest is for the sumprobs.
+static const double kHandsFraction = 0.125;
+
 class Player {
 public:
-  Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
-	 const CardAbstraction &a_ca, const CardAbstraction &b_ca, const CFRConfig &a_cc,
-	 const CFRConfig &b_cc, int a_it, int b_it, int resolve_st, bool resolve_a, bool resolve_b,
-	 const CardAbstraction &as_ca, const BettingAbstraction &as_ba, const CFRConfig &as_cc,
-	 const CardAbstraction &bs_ca, const BettingAbstraction &bs_ba, const CFRConfig &bc_cc,
-	 bool a_quantize, bool b_quantize);
+  Player(const CardAbstraction &a_ca, const CardAbstraction &b_ca,
+	 const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
+	 const CFRConfig &a_cc, const CFRConfig &b_cc, int a_it, int b_it,
+	 long long int memory_bytes);
   ~Player(void) {}
-  void Go(int num_sampled_max_street_boards, bool deterministic);
+  void Go(int num_sampled_max_street_boards, bool deterministic, int num_threads);
+  const BettingTrees &ABettingTrees(void) const {return *a_betting_trees_;}
+  const BettingTrees &BBettingTrees(void) const {return *b_betting_trees_;}
+  const Buckets &ABuckets(void) const {return *a_buckets_;}
+  const Buckets &BBuckets(void) const {return *b_buckets_;}
+  DiskProbs *AProbs(void) const {return a_probs_.get();}
+  DiskProbs *BProbs(void) const {return b_probs_.get();}
 private:
-  void Showdown(Node *a_node, Node *b_node, int gbd, const ReachProbs &reach_probs);
-  void Fold(Node *a_node, Node *b_node, int gbd, const ReachProbs &reach_probs);
-  void Nonterminal(Node *a_node, Node *b_node, int gbd, const string &action_sequence,
-		   const ReachProbs &reach_probs);
-  void Walk(Node *a_node, Node *b_node, int gbd, const string &action_sequence,
-	    const ReachProbs &reach_probs, int last_st);
-  void ProcessMaxStreetBoard(int msbd);
-
-  const BettingAbstraction &a_betting_abstraction_;
-  const BettingAbstraction &b_betting_abstraction_;
-  const BettingAbstraction &a_subgame_betting_abstraction_;
-  const BettingAbstraction &b_subgame_betting_abstraction_;
-  // bool a_asymmetric_;
-  // bool b_asymmetric_;
+  void Report(double sum, double sum_sqd, int num_sampled_max_street_boards);
+
+  shared_ptr<Buckets> a_buckets_;
+  shared_ptr<Buckets> b_buckets_;
   unique_ptr<BettingTrees> a_betting_trees_;
   unique_ptr<BettingTrees> b_betting_trees_;
-  shared_ptr<Buckets> a_base_buckets_;
-  shared_ptr<Buckets> b_base_buckets_;
-  bool share_probs_;
-  shared_ptr<CFRValues> a_probs_;
-  shared_ptr<CFRValues> b_probs_;
-  int resolve_st_;
-  bool resolve_a_;
-  bool resolve_b_;
-  // When we resolve a street, the board index may change.  This is why we have separate
-  // a boards and b boards.  Only one player may be resolving.
-  unique_ptr<int []> a_gbds_;
-  unique_ptr<int []> a_lbds_;
-  unique_ptr<int []> b_gbds_;
-  unique_ptr<int []> b_lbds_;
-  int msbd_;
-  int b_pos_;
-  // shared_ptr<HandTree> hand_tree_;
-  shared_ptr<HandTree> resolve_hand_tree_;
-  unique_ptr<shared_ptr<CanonicalCards> []> street_hands_;
-  double sum_b_outcomes_;
-  double sum_p0_outcomes_;
-  double sum_p1_outcomes_;
-  double sum_weights_;
-  shared_ptr<Buckets> a_subgame_buckets_;
-  shared_ptr<Buckets> b_subgame_buckets_;
-  unique_ptr<BettingTrees> a_subtrees_;
-  unique_ptr<BettingTrees> b_subtrees_;
-  unique_ptr<EGCFR> a_eg_cfr_;
-  unique_ptr<EGCFR> b_eg_cfr_;
-  unique_ptr<bool []> sampled_max_street_boards_;
-  unique_ptr<int []> max_street_board_samples_;
-  unique_ptr<HandSamples> hand_samples_;
-  int num_subgame_its_;
-  int num_resolves_;
-  double resolving_secs_;
+  shared_ptr<DiskProbs> a_probs_;
+  shared_ptr<DiskProbs> b_probs_;
+  int num_board_samples_;
+  unique_ptr<int []> board_samples_;
 };
 
-Player::Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
-	       const CardAbstraction &a_ca, const CardAbstraction &b_ca, const CFRConfig &a_cc,
-	       const CFRConfig &b_cc, int a_it, int b_it, int resolve_st, bool resolve_a,
-	       bool resolve_b, const CardAbstraction &as_ca, const BettingAbstraction &as_ba,
-	       const CFRConfig &as_cc, const CardAbstraction &bs_ca,
-	       const BettingAbstraction &bs_ba, const CFRConfig &bs_cc, bool a_quantize,
-	       bool b_quantize) :
-  a_betting_abstraction_(a_ba), b_betting_abstraction_(b_ba),
-  a_subgame_betting_abstraction_(as_ba), b_subgame_betting_abstraction_(bs_ba) {
+Player::Player(const CardAbstraction &a_ca, const CardAbstraction &b_ca,
+	       const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
+	       const CFRConfig &a_cc, const CFRConfig &b_cc, int a_it, int b_it,
+	       long long int memory_bytes) {
+  if (a_ba.Asymmetric() || b_ba.Asymmetric()) {
+    fprintf(stderr, "Asymmetric systems not supported\n");
+    exit(-1);
+  }
   int max_street = Game::MaxStreet();
-  a_gbds_.reset(new int[max_street + 1]);
-  a_lbds_.reset(new int[max_street + 1]);
-  b_gbds_.reset(new int[max_street + 1]);
-  b_lbds_.reset(new int[max_street + 1]);
-  a_gbds_[0] = 0;
-  a_lbds_[0] = 0;
-  b_gbds_[0] = 0;
-  b_lbds_[0] = 0;
-  sum_b_outcomes_ = 0;
-  sum_p0_outcomes_ = 0;
-  sum_p1_outcomes_ = 0;
-  sum_weights_ = 0;
-  resolve_a_ = resolve_a;
-  resolve_b_ = resolve_b;
-  resolve_st_ = resolve_st;
-  num_subgame_its_ = 200;
-
-  a_base_buckets_.reset(new Buckets(a_ca, false));
+  a_buckets_.reset(new Buckets(a_ca, false));
   if (a_ca.CardAbstractionName() == b_ca.CardAbstractionName()) {
     fprintf(stderr, "Sharing buckets\n");
-    b_base_buckets_ = a_base_buckets_;
+    b_buckets_ = a_buckets_;
   } else {
     fprintf(stderr, "Not sharing buckets\n");
-    b_base_buckets_.reset(new Buckets(b_ca, false));
+    b_buckets_.reset(new Buckets(b_ca, false));
   }
   BoardTree::Create();
   BoardTree::CreateLookup();
@@ -180,92 +112,97 @@ Player::Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
   a_betting_trees_.reset(new BettingTrees(a_ba));
   b_betting_trees_.reset(new BettingTrees(b_ba));
 
-  street_hands_.reset(new shared_ptr<CanonicalCards>[max_street + 1]);
-  
-  bool shared_probs = 
-    (a_ca.CardAbstractionName().c_str() == b_ca.CardAbstractionName() &&
-     a_ba.BettingAbstractionName().c_str() == b_ba.BettingAbstractionName() &&
-     a_cc.CFRConfigName() == b_cc.CFRConfigName() && a_it == b_it);
-  unique_ptr<bool []> a_streets(new bool[max_street + 1]);
-  unique_ptr<bool []> b_streets(new bool[max_street + 1]);
-  if (resolve_a_ && resolve_b_) {
-    for (int st = 0; st <= max_street; ++st) {
-      a_streets[st] = (st < resolve_st_);
-      b_streets[st] = (st < resolve_st_);
-    }
-  } else if (! resolve_a_ && ! resolve_b_) {
-    for (int st = 0; st <= max_street; ++st) {
-      a_streets[st] = true;
-      b_streets[st] = true;
-    }
-  } else {
-    // One system is being resolved
-    if (shared_probs) {
-      for (int st = 0; st <= max_street; ++st) {
-	a_streets[st] = true;
-	b_streets[st] = true;
-      }
-    } else {
-      for (int st = 0; st <= max_street; ++st) {
-	a_streets[st] = (st < resolve_st_ || ! resolve_a_);
-	b_streets[st] = (st < resolve_st_ || ! resolve_b_);
-      }
-    }
-  }
-
-  a_probs_.reset(new CFRValues(nullptr, a_streets.get(), 0, 0, *a_base_buckets_,
-			       *a_betting_trees_));
-  char dir[500];
-  
-  sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::OldCFRBase(),
-	  Game::GameName().c_str(), Game::NumPlayers(),
-	  a_ca.CardAbstractionName().c_str(),
-	  Game::NumRanks(), Game::NumSuits(), Game::MaxStreet(),
-	  a_ba.BettingAbstractionName().c_str(),
-	  a_cc.CFRConfigName().c_str());
-
-  if (a_ca.CardAbstractionName().c_str() == b_ca.CardAbstractionName() &&
-      a_ba.BettingAbstractionName().c_str() == b_ba.BettingAbstractionName() &&
-      a_cc.CFRConfigName() == b_cc.CFRConfigName() && a_it == b_it ) {
+  long long int hands_bytes = memory_bytes * kHandsFraction;
+  long long int probs_bytes = memory_bytes - hands_bytes;
+  HandTree::SetCacheBytes(hands_bytes);
+  if (a_ca.CardAbstractionName() == b_ca.CardAbstractionName() &&
+      a_ba.BettingAbstractionName() == b_ba.BettingAbstractionName() &&
+      a_cc.CFRConfigName() == b_cc.CFRConfigName() && a_it == b_it) {
     fprintf(stderr, "Sharing probs between A and B\n");
-    share_probs_ = true;
-  } else {
-    fprintf(stderr, "A and B do not share probs\n");
-    share_probs_ = false;
-  }
-    
-  if (share_probs_) {
+    a_probs_.reset(new DiskProbs(a_ca, a_ba, a_cc, *a_buckets_,
+				 a_betting_trees_->GetBettingTree(), a_it, probs_bytes));
     b_probs_ = a_probs_;
   } else {
-    b_probs_.reset(new CFRValues(nullptr, b_streets.get(), 0, 0, *b_base_buckets_,
-				 *b_betting_trees_));
+    fprintf(stderr, "A and B do not share probs\n");
+    a_probs_.reset(new DiskProbs(a_ca, a_ba, a_cc, *a_buckets_,
+				 a_betting_trees_->GetBettingTree(), a_it, probs_bytes / 2));
+    b_probs_.reset(new DiskProbs(b_ca, b_ba, b_cc, *b_buckets_,
+				 b_betting_trees_->GetBettingTree(), b_it, probs_bytes / 2));
   }
-  sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::OldCFRBase(), Game::GameName().c_str(),
-	  Game::NumPlayers(), b_ca.CardAbstractionName().c_str(), Game::NumRanks(),
-	  Game::NumSuits(), Game::MaxStreet(), b_ba.BettingAbstractionName().c_str(),
-	  b_cc.CFRConfigName().c_str());
-
-  // Check for dups for buckets
-  if (resolve_a_) {
-    a_subgame_buckets_.reset(new Buckets(as_ca, false));
-    a_eg_cfr_.reset(new UnsafeEGCFR(as_ca, a_ca, a_ba, as_cc, a_cc, *a_subgame_buckets_, 1));
+
+  // Want to be able to randomly sample a board from board_samples_.
+  // Sampling must be proportional to the frequency of the board.
+  int num_max_street_boards = BoardTree::NumBoards(max_street);
+  num_board_samples_ = 0;
+  for (int bd = 0; bd < num_max_street_boards; ++bd) {
+    num_board_samples_ += BoardTree::BoardCount(max_street, bd);
   }
-  if (resolve_b_) {
-    b_subgame_buckets_.reset(new Buckets(bs_ca, false));
-    b_eg_cfr_.reset(new UnsafeEGCFR(bs_ca, b_ca, b_ba, bs_cc, b_cc, *b_subgame_buckets_, 1));
+  board_samples_.reset(new int[num_board_samples_]);
+  int i = 0;
+  for (int bd = 0; bd < num_max_street_boards; ++bd) {
+    int bd_num_samples = BoardTree::BoardCount(max_street, bd);
+    for (int j = 0; j < bd_num_samples; ++j) {
+      board_samples_[i++] = bd;
+    }
   }
+}
+
+class PlayerThread {
+public:
+  PlayerThread(const Player &player, int thread_index, const vector<int> &sampled_boards,
+	       std::atomic<int> *next_sample, double *sample_outcomes);
+  void Go(void);
+  void Run(void);
+  void Join(void);
+private:
+  void Showdown(Node *a_node, Node *b_node, const ReachProbs &reach_probs);
+  void Fold(Node *a_node, Node *b_node, const ReachProbs &reach_probs);
+  void Nonterminal(Node *a_node, Node *b_node, const ReachProbs &reach_probs);
+  void Walk(Node *a_node, Node *b_node, const ReachProbs &reach_probs);
+  double ProcessMaxStreetBoard(int msbd);
+
+  const Player &player_;
+  int thread_index_;
+  unique_ptr<shared_ptr<const CanonicalCards> []> street_hands_;
+  unique_ptr<int []> gbds_;
+  int b_pos_;
+  double sum_b_outcomes_;
+  double sum_weights_;
+  // Scratch space for Showdown() and Fold(), reused across nodes and boards
+  unique_ptr<double []> cum_opp_card_probs_;
+  unique_ptr<double []> total_opp_card_probs_;
+  unique_ptr<double []> win_probs_;
+  const vector<int> &sampled_boards_;
+  std::atomic<int> *next_sample_;
+  double *sample_outcomes_;
+  pthread_t pthread_id_;
+};
 
-  hand_samples_.reset(new HandSamples(max_street));
+PlayerThread::PlayerThread(const Player &player, int thread_index,
+			   const vector<int> &sampled_boards, std::atomic<int> *next_sample,
+			   double *sample_outcomes) :
+  player_(player), thread_index_(thread_index), sampled_boards_(sampled_boards),
+  next_sample_(next_sample), sample_outcomes_(sample_outcomes) {
+  int max_street = Game::MaxStreet();
+  street_hands_.reset(new shared_ptr<const CanonicalCards>[max_street + 1]);
+  gbds_.reset(new int[max_street + 1]);
+  gbds_[0] = 0;
+  b_pos_ = 0;
+  sum_b_outcomes_ = 0;
+  sum_weights_ = 0;
+  cum_opp_card_probs_.reset(new double[Game::MaxCard() + 1]);
+  total_opp_card_probs_.reset(new double[Game::MaxCard() + 1]);
+  win_probs_.reset(new double[Game::NumHoleCardPairs(max_street)]);
 }
 
 // Compute outcome from B's perspective
-void Player::Showdown(Node *a_node, Node *b_node, int gbd, const ReachProbs &reach_probs) {
+void PlayerThread::Showdown(Node *a_node, Node *b_node, const ReachProbs &reach_probs) {
   Card max_card1 = Game::MaxCard() + 1;
 
   double *a_probs = reach_probs.Get(b_pos_^1).get();
   double *b_probs = reach_probs.Get(b_pos_).get();
-  unique_ptr<double []> cum_opp_card_probs(new double[52]);
-  unique_ptr<double []> total_opp_card_probs(new double[52]);
+  double *cum_opp_card_probs = cum_opp_card_probs_.get();
+  double *total_opp_card_probs = total_opp_card_probs_.get();
   for (Card c = 0; c < max_card1; ++c) {
     cum_opp_card_probs[c] = 0;
     total_opp_card_probs[c] = 0;
@@ -283,14 +220,10 @@ void Player::Showdown(Node *a_node, Node *b_node, int gbd, const ReachProbs &rea
     total_opp_card_probs[hi] += opp_prob;
     total_opp_card_probs[lo] += opp_prob;
     sum_opp_probs += opp_prob;
-    if (opp_prob > 1.0) {
-      fprintf(stderr, "Showdown: opp_prob (a) %f hcp %u\n", opp_prob, hcp);
-      exit(-1);
-    }
   }
 
   double opp_cum_prob = 0;
-  unique_ptr<double []> win_probs(new double[num_hole_card_pairs]);
+  double *win_probs = win_probs_.get();
   double half_pot = a_node->LastBetTo();
   double sum_our_vals = 0, sum_joint_probs = 0;
 
@@ -340,24 +273,12 @@ void Player::Showdown(Node *a_node, Node *b_node, int gbd, const ReachProbs &rea
     }
   }
 
-  // Scale to account for sampled frequency of board
-  double weight = max_street_board_samples_[gbd];
-  double wtd_sum_our_vals = sum_our_vals * weight;
-  double wtd_sum_joint_probs = sum_joint_probs * weight;
-  sum_b_outcomes_ += wtd_sum_our_vals;
-  if (b_pos_ == 0) {
-    sum_p0_outcomes_ += wtd_sum_our_vals;
-    sum_p1_outcomes_ -= wtd_sum_our_vals;
-  } else {
-    sum_p0_outcomes_ -= wtd_sum_our_vals;
-    sum_p1_outcomes_ += wtd_sum_our_vals;
-  }
-  sum_weights_ += wtd_sum_joint_probs;
+  sum_b_outcomes_ += sum_our_vals;
+  sum_weights_ += sum_joint_probs;
 }
-  
+
 // Compute outcome from B's perspective
-void Player::Fold(Node *a_node, Node *b_node, int gbd, const ReachProbs &reach_probs) {
-  int st = a_node->Street();
+void PlayerThread::Fold(Node *a_node, Node *b_node, const ReachProbs &reach_probs) {
   Card max_card1 = Game::MaxCard() + 1;
 
   double half_pot = a_node->LastBetTo();
@@ -368,20 +289,23 @@ void Player::Fold(Node *a_node, Node *b_node, int gbd, const ReachProbs &reach_p
     // B has folded
     half_pot = -half_pot;
   }
-  const CanonicalCards *hands = street_hands_[st].get();
+  int max_street = Game::MaxStreet();
+  // Note: we are going to iterate through max street hands even if this is a pre-max-street
+  // node.
+  const CanonicalCards *hands = street_hands_[max_street].get();
   double sum_our_vals = 0, sum_joint_probs = 0;
 
   double *a_probs = reach_probs.Get(b_pos_^1).get();
   double *b_probs = reach_probs.Get(b_pos_).get();
-  unique_ptr<double []> cum_opp_card_probs(new double[52]);
-  unique_ptr<double []> total_opp_card_probs(new double[52]);
+  double *cum_opp_card_probs = cum_opp_card_probs_.get();
+  double *total_opp_card_probs = total_opp_card_probs_.get();
   for (Card c = 0; c < max_card1; ++c) {
     cum_opp_card_probs[c] = 0;
     total_opp_card_probs[c] = 0;
   }
 
   double sum_opp_probs = 0;
-  int num_hole_card_pairs = Game::NumHoleCardPairs(st);
+  int num_hole_card_pairs = Game::NumHoleCardPairs(max_street);
   for (int hcp = 0; hcp < num_hole_card_pairs; ++hcp) {
     const Card *cards = hands->Cards(hcp);
     Card hi = cards[0];
@@ -399,39 +323,22 @@ void Player::Fold(Node *a_node, Node *b_node, int gbd, const ReachProbs &reach_p
     Card lo = cards[1];
     int enc = hi * max_card1 + lo;
     double our_prob = b_probs[enc];
-    // How to factor this in?
-    int hand_samples = hand_samples_->Count(st, gbd, i);
     // This is the sum of all the A reach probabilities consistent with B holding <hi, lo>.
     double sum_consistent_opp_probs = sum_opp_probs + a_probs[enc] -
       total_opp_card_probs[hi] - total_opp_card_probs[lo];
     sum_our_vals += our_prob * half_pot * sum_consistent_opp_probs;
-    sum_joint_probs += our_prob * sum_consistent_opp_probs;    
+    sum_joint_probs += our_prob * sum_consistent_opp_probs;
   }
 
-  // Used to scale to account for frequency of board
-  // double wtd_sum_our_vals = sum_our_vals * num_samples_;
-  // double wtd_sum_joint_probs = sum_joint_probs * num_samples_;
-  // Scaling must be done earlier now
-  double wtd_sum_our_vals = sum_our_vals;
-  double wtd_sum_joint_probs = sum_joint_probs;
-  sum_b_outcomes_ += wtd_sum_our_vals;
-  if (b_pos_ == 0) {
-    sum_p0_outcomes_ += wtd_sum_our_vals;
-    sum_p1_outcomes_ -= wtd_sum_our_vals;
-  } else {
-    sum_p0_outcomes_ -= wtd_sum_our_vals;
-    sum_p1_outcomes_ += wtd_sum_our_vals;
-  }
-  sum_weights_ += wtd_sum_joint_probs;
+  sum_b_outcomes_ += sum_our_vals;
+  sum_weights_ += sum_joint_probs;
 }
 
-void Player::Nonterminal(Node *a_node, Node *b_node, int gbd, const string &action_sequence,
-			 const ReachProbs &reach_probs) {
+void PlayerThread::Nonterminal(Node *a_node, Node *b_node, const ReachProbs &reach_probs) {
   int st = a_node->Street();
   int pa = a_node->PlayerActing();
-  // A and B may have different numbers of succs.  I think this may only be the case if either
-  // or both systems are asymmetric.  We need to map from succ indices in one space to succs
-  // indices in the other space.
+  // A and B may have different numbers of succs.  We need to map from succ indices in one space
+  // to succs indices in the other space.
   Node *acting_node = pa == b_pos_ ? b_node : a_node;
   Node *opp_node = pa == b_pos_ ? a_node : b_node;
   int acting_num_succs = acting_node->NumSuccs();
@@ -440,248 +347,178 @@ void Player::Nonterminal(Node *a_node, Node *b_node, int gbd, const string &acti
   if (acting_num_succs > opp_num_succs) {
     fprintf(stderr, "acting_num_succs (%i) > opp_num_succs (%i)\n", acting_num_succs,
 	    opp_num_succs);
-    fprintf(stderr, "b_pos_ %i pa %i st %i\n", b_pos_, pa, st);
-    fprintf(stderr, "a num succs %i nt %i pa %i\n", a_node->NumSuccs(), a_node->NonterminalID(),
-	    a_node->PlayerActing());
-    fprintf(stderr, "b num succs %i nt %i pa %i\n", b_node->NumSuccs(), b_node->NonterminalID(),
-	    b_node->PlayerActing());
     exit(-1);
   }
   unique_ptr<int []> succ_mapping = GetSuccMapping(acting_node, opp_node);
-  
+
+  const CanonicalCards *hands = street_hands_[st].get();
   shared_ptr<ReachProbs []> succ_reach_probs;
-  // shared_ptr<double []> **succ_reach_probs;
   if (pa == b_pos_) {
-    // This doesn't support multiplayer yet
-    const CFRValues *sumprobs;
-    if (resolve_b_ && st >= resolve_st_) {
-      sumprobs = b_eg_cfr_->Sumprobs().get();
-    } else {
-      sumprobs = b_probs_.get();
-    }
-    const Buckets &buckets =
-      (resolve_b_ && st >= resolve_st_) ? *b_subgame_buckets_ : *b_base_buckets_;
-    const CanonicalCards *hands = street_hands_[st].get();
-    succ_reach_probs = ReachProbs::CreateSuccReachProbs(b_node, b_gbds_[st], b_lbds_[st], hands,
-							buckets, sumprobs, reach_probs, false);
+    succ_reach_probs = ReachProbs::CreateSuccReachProbs(b_node, gbds_[st], hands,
+							player_.BBuckets(), player_.BProbs(),
+							reach_probs);
   } else {
-    const CFRValues *sumprobs;
-    if (resolve_a_ && st >= resolve_st_) {
-      sumprobs = a_eg_cfr_->Sumprobs().get();
-    } else {
-      sumprobs = a_probs_.get();
-    }
-    const Buckets &buckets =
-      (resolve_a_ && st >= resolve_st_) ? *a_subgame_buckets_ : *a_base_buckets_;
-    const CanonicalCards *hands = street_hands_[st].get();
-    succ_reach_probs = ReachProbs::CreateSuccReachProbs(a_node, a_gbds_[st], a_lbds_[st], hands,
-							buckets, sumprobs, reach_probs, false);
+    succ_reach_probs = ReachProbs::CreateSuccReachProbs(a_node, gbds_[st], hands,
+							player_.ABuckets(), player_.AProbs(),
+							reach_probs);
   }
   for (int s = 0; s < acting_num_succs; ++s) {
-    string action;
     Node *a_succ, *b_succ;
     if (pa == b_pos_) {
       b_succ = b_node->IthSucc(s);
       a_succ = a_node->IthSucc(succ_mapping[s]);
-      action = b_node->ActionName(s);
     } else {
       a_succ = a_node->IthSucc(s);
       b_succ = b_node->IthSucc(succ_mapping[s]);
-      action = a_node->ActionName(s);
     }
-    Walk(a_succ, b_succ, gbd, action_sequence + action, succ_reach_probs[s], st);
+    Walk(a_succ, b_succ, succ_reach_probs[s]);
   }
-#if 0
-  for (int s = 0; s < acting_num_succs; ++s) {
-    delete [] succ_reach_probs[s];
-  }
-  delete [] succ_reach_probs;
-#endif
 }
- 
-void Player::Walk(Node *a_node, Node *b_node, int gbd, const string &action_sequence,
-		  const ReachProbs &reach_probs, int last_st) {
-  int st = a_node->Street();
-  if (st > last_st) {
-    int pst = st - 1;
-    int max_street = Game::MaxStreet();
-    int ngbd_begin = BoardTree::SuccBoardBegin(pst, gbd, st);
-    int ngbd_end = BoardTree::SuccBoardEnd(pst, gbd, st);
-    for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
-      if (st == max_street && max_street_board_samples_[ngbd] == 0) continue;
-      Walk(a_node, b_node, ngbd, action_sequence, reach_probs, st);
-    }    
-  }
-  // How to tell if we should resolve?
-  if (st > last_st && st == resolve_st_) {
-    Node *next_a_node, *next_b_node;
-    if (resolve_a_ && a_node->LastBetTo() < a_betting_abstraction_.StackSize()) {
-      a_subtrees_.reset(CreateSubtrees(st, a_node->PlayerActing(), a_node->LastBetTo(), -1,
-				       a_subgame_betting_abstraction_));
-      int max_street = Game::MaxStreet();
-      int root_bd;
-      if (st == max_street) root_bd = msbd_;
-      else                  root_bd = BoardTree::PredBoard(msbd_, st);
-      struct timespec start, finish;
-      clock_gettime(CLOCK_MONOTONIC, &start);
-      a_eg_cfr_->SolveSubgame(a_subtrees_.get(), root_bd, reach_probs, action_sequence,
-			      resolve_hand_tree_.get(), nullptr, -1, true, num_subgame_its_);
-      clock_gettime(CLOCK_MONOTONIC, &finish);
-      resolving_secs_ += (finish.tv_sec - start.tv_sec);
-      resolving_secs_ += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
-      ++num_resolves_;
-      next_a_node = a_subtrees_->Root();
-      for (int st1 = st; st1 <= max_street; ++st1) {
-	int gbd;
-	if (st1 == max_street) gbd = msbd_;
-	else                   gbd = BoardTree::PredBoard(msbd_, st1);
-	a_lbds_[st1] = BoardTree::LocalIndex(st, root_bd, st1, gbd);
-      }
-    } else {
-      next_a_node = a_node;
-    }
-    if (resolve_b_ && b_node->LastBetTo() < b_betting_abstraction_.StackSize()) {
-      b_subtrees_.reset(CreateSubtrees(st, b_node->PlayerActing(), b_node->LastBetTo(), -1,
-				       b_subgame_betting_abstraction_));
-      int max_street = Game::MaxStreet();
-      int root_bd;
-      if (st == max_street) root_bd = msbd_;
-      else                  root_bd = BoardTree::PredBoard(msbd_, st);
-      printf("Resolving %s b_pos_ %i id %i lbt %i\n", action_sequence.c_str(), b_pos_,
-	     b_node->NonterminalID(), b_node->LastBetTo());
-      fflush(stdout);
-      struct timespec start, finish;
-      clock_gettime(CLOCK_MONOTONIC, &start);
-      b_eg_cfr_->SolveSubgame(b_subtrees_.get(), root_bd, reach_probs, action_sequence,
-			      resolve_hand_tree_.get(), nullptr, -1, true, num_subgame_its_);
-      clock_gettime(CLOCK_MONOTONIC, &finish);
-      resolving_secs_ += (finish.tv_sec - start.tv_sec);
-      resolving_secs_ += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
-      ++num_resolves_;
-      next_b_node = b_subtrees_->Root();
-      for (int st1 = st; st1 <= max_street; ++st1) {
-	int gbd;
-	if (st1 == max_street) gbd = msbd_;
-	else                   gbd = BoardTree::PredBoard(msbd_, st1);
-	b_lbds_[st1] = BoardTree::LocalIndex(st, root_bd, st1, gbd);
-      }
-    } else {
-      next_b_node = b_node;
-    }
-    Walk(next_a_node, next_b_node, gbd, action_sequence, reach_probs, st);
-    // Release the memory now.  And make sure stale sumprobs are not accidentally used later.
-    if (resolve_a_) {
-      a_eg_cfr_->ClearSumprobs();
-    }
-    if (resolve_b_) {
-      b_eg_cfr_->ClearSumprobs();
-    }
-    return;
-  }
+
+void PlayerThread::Walk(Node *a_node, Node *b_node, const ReachProbs &reach_probs) {
   if (a_node->Terminal()) {
     if (! b_node->Terminal()) {
       fprintf(stderr, "A terminal B nonterminal?!?\n");
       exit(-1);
     }
     if (a_node->Showdown()) {
-      Showdown(a_node, b_node, gbd, reach_probs);
+      Showdown(a_node, b_node, reach_probs);
     } else {
-      Fold(a_node, b_node, gbd, reach_probs);
+      Fold(a_node, b_node, reach_probs);
     }
   } else {
     if (b_node->Terminal()) {
       fprintf(stderr, "A nonterminal B terminal?!?\n");
       exit(-1);
     }
-    Nonterminal(a_node, b_node, gbd, action_sequence, reach_probs);
+    Nonterminal(a_node, b_node, reach_probs);
   }
 }
 
-void Player::Go(int num_sampled_max_street_boards, bool deterministic) {
-  num_resolves_ = 0;
-  resolving_secs_ = 0;
+double PlayerThread::ProcessMaxStreetBoard(int msbd) {
   int max_street = Game::MaxStreet();
-  int num_max_street_boards = BoardTree::NumBoards(max_street);
-  if (num_sampled_max_street_boards == 0 ||
-      num_sampled_max_street_boards > num_max_street_boards) {
-    num_sampled_max_street_boards = num_max_street_boards;
+  for (int st = 1; st <= max_street; ++st) {
+    gbds_[st] = st == max_street ? msbd : BoardTree::PredBoard(msbd, st);
   }
-
-  max_street_board_samples_.reset(new int[num_max_street_boards]);
-  if (num_sampled_max_street_boards == num_max_street_boards) {
-    fprintf(stderr, "Processing all max street boards\n");
-    for (int bd = 0; bd < num_max_street_boards; ++bd) {
-      int num_samples = BoardTree::BoardCount(max_street, bd);
-      max_street_board_samples_[bd] = num_samples;
-      hand_samples_->AddBoard(bd, num_samples);
-    }
-  } else {
-    for (int bd = 0; bd < num_max_street_boards; ++bd) max_street_board_samples_[bd] = 0;
-    struct drand48_data rand_buf;
-    if (deterministic) {
-      srand48_r(0, &rand_buf);
-    } else {
-      struct timeval time; 
-      gettimeofday(&time, NULL);
-      srand48_r((time.tv_sec * 1000) + (time.tv_usec / 1000), &rand_buf);
-    }
-    vector< pair<double, int> > v;
-    for (int bd = 0; bd < num_max_street_boards; ++bd) {
-      int board_count = BoardTree::BoardCount(max_street, bd);
-      for (int i = 0; i < board_count; ++i) {
-	double r;
-	drand48_r(&rand_buf, &r);
-	v.push_back(std::make_pair(r, bd));
-      }
-    }
-    std::sort(v.begin(), v.end());
-    for (int i = 0; i < num_sampled_max_street_boards; ++i) {
-      int bd = v[i].second;
-      ++max_street_board_samples_[bd];
-      hand_samples_->AddBoard(bd, 1);
-    }
+  for (int st = 0; st <= max_street; ++st) {
+    street_hands_[st] = HandTree::BoardHands(st, gbds_[st]);
   }
-
-  // What about a_gbds_, a_lbds_, resolve_hand_tree_, street_hands_
+  sum_b_outcomes_ = 0;
+  sum_weights_ = 0;
   int num_players = Game::NumPlayers();
   unique_ptr<ReachProbs> reach_probs(ReachProbs::CreateRoot());
-  Node *a_root, *b_root;
+  const BettingTrees &a_betting_trees = player_.ABettingTrees();
+  const BettingTrees &b_betting_trees = player_.BBettingTrees();
   for (b_pos_ = 0; b_pos_ < num_players; ++b_pos_) {
-    b_root = b_betting_trees_->Root(b_pos_);
-    a_root = a_betting_trees_->Root(b_pos_^1);
-    Walk(a_root, b_root, 0, "x", *reach_probs, 0);
+    Walk(a_betting_trees.Root(b_pos_^1), b_betting_trees.Root(b_pos_), *reach_probs);
   }
-  
-  double avg_b_outcome = sum_b_outcomes_ / sum_weights_;
-  // avg_b_outcome is in units of the small blind
-  double b_mbb_g = (avg_b_outcome / 2.0) * 1000.0;
-  fprintf(stderr, "Avg B outcome: %f (%.1f mbb/g)\n", avg_b_outcome, b_mbb_g);
-  double avg_p1_outcome = sum_p1_outcomes_ / sum_weights_;
-  double p1_mbb_g = (avg_p1_outcome / 2.0) * 1000.0;
-  fprintf(stderr, "Avg P1 outcome: %f (%.1f mbb/g)\n", avg_p1_outcome, p1_mbb_g);
-  fprintf(stderr, "%.1f secs spent resolving\n", resolving_secs_);
-  if (num_resolves_ > 0) {
-    fprintf(stderr, "Avg %.2f secs per resolve (%i resolves)\n", resolving_secs_ / num_resolves_,
-	    num_resolves_);
+  return sum_b_outcomes_ / sum_weights_;
+}
+
+void PlayerThread::Go(void) {
+  int num_samples = sampled_boards_.size();
+  while (true) {
+    int i = next_sample_->fetch_add(1);
+    if (i >= num_samples) break;
+    double avg_b_outcome = ProcessMaxStreetBoard(sampled_boards_[i]);
+    sample_outcomes_[i] = avg_b_outcome;
+    fprintf(stderr, "Thread %i sample %i outcome %f mbb %f\n", thread_index_, i, avg_b_outcome,
+	    (avg_b_outcome / 2.0) * 1000.0);
+  }
+}
+
+static void *player_thread_run(void *v_t) {
+  PlayerThread *t = (PlayerThread *)v_t;
+  t->Go();
+  return NULL;
+}
+
+void PlayerThread::Run(void) {
+  pthread_create(&pthread_id_, NULL, player_thread_run, this);
+}
+
+void PlayerThread::Join(void) {
+  pthread_join(pthread_id_, NULL);
+}
+
+void Player::Report(double sum, double sum_sqd, int num_sampled_max_street_boards) {
+  double mean = sum / num_sampled_max_street_boards;
+  double mean_mbb = (mean / 2.0) * 1000.0;
+  fprintf(stderr, "Mean B outcome: %f\n", mean);
+  fprintf(stderr, "MBB mean: %f\n", mean_mbb);
+  if (num_sampled_max_street_boards > 1) {
+    // Variance is the mean of the squares minus the square of the means
+    double var = sum_sqd / ((double)num_sampled_max_street_boards) - mean * mean;
+    double stddev = sqrt(var);
+    double sum_stddev = stddev * sqrt(num_sampled_max_street_boards);
+    double sum_lower = sum - 1.96 * sum_stddev;
+    double sum_upper = sum + 1.96 * sum_stddev;
+    double mbb_lower = ((sum_lower / (num_sampled_max_street_boards)) / 2.0) * 1000.0;
+    double mbb_upper = ((sum_upper / (num_sampled_max_street_boards)) / 2.0) * 1000.0;
+    fprintf(stderr, "MBB confidence interval: %f-%f\n", mbb_lower, mbb_upper);
+  }
+  fprintf(stderr, "A cache hits %lli misses %lli\n", a_probs_->CacheHits(),
+	  a_probs_->CacheMisses());
+  if (b_probs_ != a_probs_) {
+    fprintf(stderr, "B cache hits %lli misses %lli\n", b_probs_->CacheHits(),
+	    b_probs_->CacheMisses());
+  }
+}
+
+void Player::Go(int num_sampled_max_street_boards, bool deterministic, int num_threads) {
+  struct drand48_data rand_buf;
+  if (deterministic) {
+    srand48_r(0, &rand_buf);
+  } else {
+    struct timeval time;
+    gettimeofday(&time, NULL);
+    srand48_r((time.tv_sec * 1000) + (time.tv_usec / 1000), &rand_buf);
+  }
+  vector<int> sampled_boards;
+  double r;
+  for (int i = 0; i < num_sampled_max_street_boards; ++i) {
+    drand48_r(&rand_buf, &r);
+    // Choose a board by uniformly sampling from board_samples_.
+    int s = r * num_board_samples_;
+    sampled_boards.push_back(board_samples_[s]);
+  }
+  // Boards that share a flop or turn are adjacent in board index order, so sorting lets
+  // consecutive samples reuse the values and hands of the earlier streets.
+  std::sort(sampled_boards.begin(), sampled_boards.end());
+  std::atomic<int> next_sample(0);
+  unique_ptr<double []> sample_outcomes(new double[num_sampled_max_street_boards]);
+  unique_ptr<unique_ptr<PlayerThread> []> threads(new unique_ptr<PlayerThread>[num_threads]);
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i].reset(new PlayerThread(*this, i, sampled_boards, &next_sample,
+				      sample_outcomes.get()));
+  }
+  for (int i = 1; i < num_threads; ++i) {
+    threads[i]->Run();
+  }
+  threads[0]->Go();
+  for (int i = 1; i < num_threads; ++i) {
+    threads[i]->Join();
+  }
+  // Sum in sample order so that the result doesn't depend on which thread did which sample
+  double sum = 0, sum_sqd = 0;
+  for (int i = 0; i < num_sampled_max_street_boards; ++i) {
+    sum += sample_outcomes[i];
+    sum_sqd += sample_outcomes[i] * sample_outcomes[i];
   }
+  Report(sum, sum_sqd, num_sampled_max_street_boards);
 }
 
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <A card params> <B card params> "
 	  "<A betting abstraction params> <B betting abstraction params> <A CFR params> "
-	  "<B CFR params> <A it> <B it> <num sampled max street boards> [quantize|raw] "
-	  "[quantize|raw] [deterministic|nondeterministic] <resolve A> <resolve B> "
-	  "(<resolve st>) (<A resolve card params> <A resolve betting params> "
-	  "<A resolve CFR config>) (<B resolve card params> <B resolve betting params> "
-	  "<B resolve CFR config>)\n", prog_name);
-  fprintf(stderr, "\n");
-  fprintf(stderr, "Specify 0 for <num sampled max street boards> to not sample\n");
-  fprintf(stderr, "<resolve A> and <resolve B> must be \"true\" or \"false\"\n");
+	  "<B CFR params> <A it> <B it> <num sampled max street boards> <num threads> "
+	  "<memory GB> [deterministic|nondeterministic]\n", prog_name);
+  fprintf(stderr, "\n<memory GB> bounds the memory used for sumprobs and hands, e.g. 0.5\n");
   exit(-1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 16 && argc != 20 && argc != 23) Usage(argv[0]);
+  if (argc != 14) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
@@ -711,81 +548,24 @@ int main(int argc, char *argv[]) {
   unique_ptr<CFRConfig>
     b_cfr_config(new CFRConfig(*b_cfr_params));
 
-  int a_it, b_it, num_sampled_max_street_boards;
+  int a_it, b_it, num_sampled_max_street_boards, num_threads;
+  double memory_gb;
   if (sscanf(argv[8], "%i", &a_it) != 1)                           Usage(argv[0]);
   if (sscanf(argv[9], "%i", &b_it) != 1)                           Usage(argv[0]);
   if (sscanf(argv[10], "%i", &num_sampled_max_street_boards) != 1) Usage(argv[0]);
-
-  bool a_quantize = false, b_quantize = false;
-  string qa = argv[11];
-  if (qa == "quantize") a_quantize = true;
-  else if (qa == "raw") a_quantize = false;
-  else                  Usage(argv[0]);
-  string qb = argv[12];
-  if (qb == "quantize") b_quantize = true;
-  else if (qb == "raw") b_quantize = false;
-  else                  Usage(argv[0]);
-
+  if (sscanf(argv[11], "%i", &num_threads) != 1)                   Usage(argv[0]);
+  if (sscanf(argv[12], "%lf", &memory_gb) != 1)                    Usage(argv[0]);
+  if (num_sampled_max_street_boards < 1 || num_threads < 1)        Usage(argv[0]);
   bool deterministic = false;
   string da = argv[13];
   if (da == "deterministic")         deterministic = true;
   else if (da == "nondeterministic") deterministic = false;
   else                               Usage(argv[0]);
-  
-  bool resolve_a = false;
-  bool resolve_b = false;
-  string ra = argv[14];
-  if (ra == "true")       resolve_a = true;
-  else if (ra == "false") resolve_a = false;
-  else                    Usage(argv[0]);
-  string rb = argv[15];
-  if (rb == "true")       resolve_b = true;
-  else if (rb == "false") resolve_b = false;
-  else                    Usage(argv[0]);
-
-  if (resolve_a && resolve_b && argc != 23)     Usage(argv[0]);
-  if (resolve_a && ! resolve_b && argc != 20)   Usage(argv[0]);
-  if (! resolve_a && resolve_b && argc != 20)   Usage(argv[0]);
-  if (! resolve_a && ! resolve_b && argc != 16) Usage(argv[0]);
-
-  int resolve_st = -1;
-  if (resolve_a || resolve_b) {
-    if (sscanf(argv[16], "%i", &resolve_st) != 1) Usage(argv[0]);
-  }
-  
-  unique_ptr<CardAbstraction> a_subgame_card_abstraction, b_subgame_card_abstraction;
-  unique_ptr<BettingAbstraction> a_subgame_betting_abstraction, b_subgame_betting_abstraction;
-  unique_ptr<CFRConfig> a_subgame_cfr_config, b_subgame_cfr_config;
-  if (resolve_a) {
-    unique_ptr<Params> subgame_card_params = CreateCardAbstractionParams();
-    subgame_card_params->ReadFromFile(argv[17]);
-    a_subgame_card_abstraction.reset(new CardAbstraction(*subgame_card_params));
-    unique_ptr<Params> subgame_betting_params = CreateBettingAbstractionParams();
-    subgame_betting_params->ReadFromFile(argv[18]);
-    a_subgame_betting_abstraction.reset(new BettingAbstraction(*subgame_betting_params));
-    unique_ptr<Params> subgame_cfr_params = CreateCFRParams();
-    subgame_cfr_params->ReadFromFile(argv[19]);
-    a_subgame_cfr_config.reset(new CFRConfig(*subgame_cfr_params));
-  }
-  if (resolve_b) {
-    int a = resolve_a ? 20 : 17;
-    unique_ptr<Params> subgame_card_params = CreateCardAbstractionParams();
-    subgame_card_params->ReadFromFile(argv[a]);
-    b_subgame_card_abstraction.reset(new CardAbstraction(*subgame_card_params));
-    unique_ptr<Params> subgame_betting_params = CreateBettingAbstractionParams();
-    subgame_betting_params->ReadFromFile(argv[a+1]);
-    b_subgame_betting_abstraction.reset(new BettingAbstraction(*subgame_betting_params));
-    unique_ptr<Params> subgame_cfr_params = CreateCFRParams();
-    subgame_cfr_params->ReadFromFile(argv[a+2]);
-    b_subgame_cfr_config.reset(new CFRConfig(*subgame_cfr_params));
-  }
 
   HandValueTree::Create();
-  
-  Player player(*a_betting_abstraction, *b_betting_abstraction, *a_card_abstraction,
-		*b_card_abstraction, *a_cfr_config, *b_cfr_config, a_it, b_it, resolve_st,
-		resolve_a, resolve_b, *a_subgame_card_abstraction, *a_subgame_betting_abstraction,
-		*a_subgame_cfr_config, *b_subgame_card_abstraction, *b_subgame_betting_abstraction,
-		*b_subgame_cfr_config, a_quantize, b_quantize);
-  player.Go(num_sampled_max_street_boards, deterministic);
+
+  Player player(*a_card_abstraction, *b_card_abstraction, *a_betting_abstraction,
+		*b_betting_abstraction, *a_cfr_config, *b_cfr_config, a_it, b_it,
+		(long long int)(memory_gb * 1024 * 1024 * 1024));
+  player.Go(num_sampled_max_street_boards, deterministic, num_threads);
 }
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <string.h>
@@ -899,6 +900,38 @@ void ReadWriter::WriteInt(int i) {
   }
 }
 
+MappedFile::MappedFile(const char *filename) {
+  filename_ = filename;
+  fd_ = open(filename, O_RDONLY, 0);
+  if (fd_ < 0) {
+    fprintf(stderr, "MappedFile: couldn't open %s, errno %i\n", filename, errno);
+    exit(-1);
+  }
+  struct stat stbuf;
+  if (fstat(fd_, &stbuf) == -1) {
+    fprintf(stderr, "MappedFile: couldn't fstat %s, errno %i\n", filename, errno);
+    exit(-1);
+  }
+  size_ = stbuf.st_size;
+  if (size_ == 0) {
+    // mmap() of zero bytes fails
+    data_ = nullptr;
+    return;
+  }
+  void *addr = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "MappedFile: mmap of %s (%lli bytes) failed, errno %i\n", filename, size_,
+	    errno);
+    exit(-1);
+  }
+  data_ = (const unsigned char *)addr;
+}
+
+MappedFile::~MappedFile(void) {
+  if (data_) munmap((void *)data_, size_);
+  close(fd_);
+}
+
 bool IsADirectory(const char *path) {
   struct stat statbuf;
   if (stat(path, &statbuf) != 0) return 0;
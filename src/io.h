@@ -135,6 +135,22 @@ private:
   std::string filename_;
 };
 
+// A read-only, shared memory mapping of an entire file.  Pages are faulted in on demand and live
+// in the page cache, so several processes mapping the same file share one copy.
+class MappedFile {
+public:
+  MappedFile(const char *filename);
+  ~MappedFile(void);
+  const unsigned char *Data(void) const {return data_;}
+  long long int Size(void) const {return size_;}
+  const std::string &Filename(void) const {return filename_;}
+private:
+  int fd_;
+  const unsigned char *data_;
+  long long int size_;
+  std::string filename_;
+};
+
 bool FileExists(const char *filename);
 long long int FileSize(const char *filename);
 bool IsADirectory(const char *path);
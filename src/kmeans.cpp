@@ -1,392 +1,261 @@
-// May need to make sure we don't assign items to empty clusters.
-// Might want to call EliminateEmpty() on every iteration.
-// If you do this, then must set num_clusters in KMeansThread separately on each iteration.
-// Would like for code to be as generic as possible.  But different objects
-// being clustered will have different types of features.
-// Have to take the square root or the triangle equality based test will not
-// work properly.
-// Should we skip neighbors-based shortcut on first iteration?  The initial cluster assignment for
-// almost all objects is essentially random.  Why did I see an abbreviated percentage of 20% on
-// the first iteration?  Expected more like 1-2%.
-// How to choose neighbor_thresh?
-//   If time spent in ComputeIntraCentroidDistances() is dominating, consider setting
-//     neighbor_thresh to 0 to turn off this optimization altogether.  This may happen if the
-//     number of clusters gets too close to the number of objects.
-//   You want dist_pct to be as low as possible.
-//     A high dist_pct could mean either of two things:
-//       Neighbors lists are too long so we evaluate too many neighbors
-//       Neighbors lists are too short so we fall back to an exhaustive search too often
-//   In other words, you don't necessarily know what to do in response to a bad dist_pct
-//   But generally we want to choose a large enough threshold so that the abbreviated pct is quite
-//     high (well over 90%, I think?).  This assumes the length of a neighbors list is much lower
-//     than the total number of clusters which should be true typically.
+// Lloyd iterations use Hamerly's bounds.  For each object o we keep an upper bound u(o) on the
+// distance to its assigned centroid a(o) and a lower bound l(o) on the distance to every other
+// centroid.  For each centroid c we keep s(c), half the distance from c to the nearest other
+// centroid.  If u(o) <= max(s(a(o)), l(o)) then a(o) is still the nearest centroid and we skip o
+// without computing any distances.  Otherwise we tighten u(o) with one distance computation and
+// retest, and only if that fails do we search all centroids.  After the centroids move, u(o) grows
+// by the movement of a(o) and l(o) shrinks by the largest movement of any other centroid.
+//
+// Unlike Elkan's algorithm, which keeps k lower bounds per object, this needs only two floats per
+// object, which matters when clustering tens of millions of objects.
+//
+// Have to take the square root or the triangle inequality based tests will not work properly.
+//
+// Empty clusters are ignored by the searches, the separations and the movements.  In case of a
+// tie, the lower numbered cluster is chosen.
+//
+// The distance loop is kept simple over contiguous rows so that the compiler vectorizes it.
+//
+// The assignment step and the summing in the update step are split across threads.  Each thread
+// sums its own contiguous range of objects into double precision partial sums, and the partial
+// sums are combined in thread order, so the result doesn't depend on timing.
 
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
-#include <algorithm>
-#include <vector>
-
-#include "constants.h"
 #include "kmeans.h"
 #include "rand.h"
-#include "sorting.h"
-
-using std::vector;
 
 static int g_it = 0;
 
+static inline float Dist(const float *a, const float *b, int dim) {
+  float dist_sq = 0;
+  for (int d = 0; d < dim; ++d) {
+    float delta = a[d] - b[d];
+    dist_sq += delta * delta;
+  }
+  return sqrt(dist_sq);
+}
+
 class KMeansThread {
 public:
-  KMeansThread(int num_objects, int num_clusters, float **objects, int dim, double neighbor_thresh,
-	       int *cluster_sizes, float **means, int *assignments,
-	       vector< pair<float, int> > *neighbor_vectors, int thread_index, int num_threads);
-  ~KMeansThread(void) {}
+  KMeansThread(KMeans *kmeans, int thread_index, int num_threads);
+  ~KMeansThread(void);
   void Assign(void);
-  void ComputeIntraCentroidDistances(void);
-  void SortNeighbors();
-  void RunAssign(void);
-  void RunIntra(void);
-  void RunSort(void);
+  void AssignBatch(void);
+  void ComputeSeparations(void);
+  void Sum(void);
+  void Run(void (KMeansThread::*f)(void));
   void Join(void);
+  void Go(void) {(this->*f_)();}
   int NumChanged(void) const {return num_changed_;}
   double SumDists(void) const {return sum_dists_;}
+  unsigned long long int DistCount(void) const {return dist_count_;}
+  unsigned long long int NumSkipped(void) const {return num_skipped_;}
+  const double *Sums(void) const {return sums_;}
+  const int *Counts(void) const {return counts_;}
 private:
-  int ExhaustiveNearest(int o, float *obj, int guess_c, double guess_min_dist,
-			double *ret_min_dist);
-  int Nearest(int o, float *obj, double *ret_min_dist);
-
-  int num_objects_;
-  int num_clusters_;
-  float **objects_;
-  int dim_;
-  double neighbor_thresh_;
-  int *cluster_sizes_;
-  float **means_;
-  int *assignments_;
-  vector< pair<float, int> > *neighbor_vectors_;
+  int Nearest(const float *obj, float *ret_min_dist, float *ret_second_dist);
+
+  KMeans *kmeans_;
   int thread_index_;
   int num_threads_;
   int num_changed_;
   double sum_dists_;
-  unsigned long long int exhaustive_count_;
-  unsigned long long int abbreviated_count_;
   unsigned long long int dist_count_;
+  unsigned long long int num_skipped_;
+  // Partial sums for the update step
+  double *sums_;
+  int *counts_;
+  void (KMeansThread::*f_)(void);
   pthread_t pthread_id_;
 };
 
-KMeansThread::KMeansThread(int num_objects, int num_clusters, float **objects, int dim,
-			   double neighbor_thresh, int *cluster_sizes, float **means,
-			   int *assignments, vector< pair<float, int> > *neighbor_vectors,
-			   int thread_index, int num_threads) {
-  num_objects_ = num_objects;
-  num_clusters_ = num_clusters;
-  objects_ = objects;
-  dim_ = dim;
-  neighbor_thresh_ = neighbor_thresh;
-  cluster_sizes_ = cluster_sizes;
-  means_ = means;
-  assignments_ = assignments;
-  neighbor_vectors_ = neighbor_vectors;
+KMeansThread::KMeansThread(KMeans *kmeans, int thread_index, int num_threads) {
+  kmeans_ = kmeans;
   thread_index_ = thread_index;
   num_threads_ = num_threads;
   num_changed_ = 0;
+  sum_dists_ = 0;
+  dist_count_ = 0ULL;
+  num_skipped_ = 0ULL;
+  sums_ = new double[kmeans->num_clusters_ * kmeans->dim_];
+  counts_ = new int[kmeans->num_clusters_];
+  f_ = NULL;
 }
 
-#if 0
-// Could add early termination when dist exceeds min dist
-unsigned int KMeansThread::Nearest(unsigned int o, float *obj,
-				   double *ret_min_dist) {
-  // Initialize best_c to the current assignment.  This will make the triangle
-  // inequality based optimization work better.
-  unsigned int best_c = assignments_[o];
-  if (best_c == kMaxUInt) {
-    // Arbitrarily set best_c to first cluster with non-zero size
-    unsigned int c;
-    for (c = 0; c < num_clusters_; ++c) {
-      if (cluster_sizes_[c] > 0) {
-	best_c = c;
-	break;
-      }
-    }
-    if (c == num_clusters_) {
-      fprintf(stderr, "No clusters with non-zero size?!?\n");
-      exit(-1);
-    }
-  }
-  float orig_min_dist = 0;
-  for (unsigned int d = 0; d < dim_; ++d) {
-    float ov = obj[d];
-    float cm = means_[best_c][d];
-    float dim_delta = ov - cm;
-    orig_min_dist += dim_delta * dim_delta;
-  }
-  orig_min_dist = sqrt(orig_min_dist);
-  float min_dist = orig_min_dist;
-  unsigned char *neighbors = nearest_centroids_[best_c];
-  while (true) {
-    unsigned int c = *(unsigned int *)neighbors;
-    if (c == kMaxUInt) break;
-    if (c == best_c) continue;
-    if (cluster_sizes_[c] == 0) continue;
-    neighbors += sizeof(unsigned int);
-    float centroid_dist = *(float *)neighbors;
-    neighbors += sizeof(float);
-    if (centroid_dist >= 2 * orig_min_dist) {
-      continue;
-    }
-
-    float *cluster_means = means_[c];
-    float dist_sq = 0;
-    for (unsigned int d = 0; d < dim_; ++d) {
-      float ov = obj[d];
-      float cm = cluster_means[d];
-      float dim_delta = ov - cm;
-      dist_sq += dim_delta * dim_delta;
-    }
-    float dist = sqrt(dist_sq);
-    if (dist < min_dist) {
-      best_c = c;
-      min_dist = dist;
-    }
-  }
-  *ret_min_dist = min_dist;
-  return best_c;
+KMeansThread::~KMeansThread(void) {
+  delete [] sums_;
+  delete [] counts_;
 }
-#endif
 
-int KMeansThread::ExhaustiveNearest(int o, float *obj, int guess_c, double guess_min_dist,
-				    double *ret_min_dist) {
-  float min_dist = guess_min_dist;
-  int best_c = guess_c;
-  for (int c = 0; c < num_clusters_; ++c) {
-    if (c == best_c) continue;
-    if (cluster_sizes_[c] == 0) continue;
-
-    float *cluster_means = means_[c];
-    float dist_sq = 0;
-    for (int d = 0; d < dim_; ++d) {
-      float ov = obj[d];
-      float cm = cluster_means[d];
-      float dim_delta = ov - cm;
-      dist_sq += dim_delta * dim_delta;
-    }
-    float dist = sqrt(dist_sq);
-    ++dist_count_;
+// Searches every non-empty cluster.  Returns the nearest and sets the distances to the nearest
+// and the second nearest.
+int KMeansThread::Nearest(const float *obj, float *ret_min_dist, float *ret_second_dist) {
+  int num_clusters = kmeans_->num_clusters_;
+  int dim = kmeans_->dim_;
+  const int *cluster_sizes = kmeans_->cluster_sizes_;
+  const float *means = kmeans_->means_;
+  int best_c = -1;
+  float min_dist = HUGE_VALF, second_dist = HUGE_VALF;
+  for (int c = 0; c < num_clusters; ++c) {
+    if (cluster_sizes[c] == 0) continue;
+    float dist = Dist(obj, means + c * dim, dim);
     if (dist < min_dist) {
-      best_c = c;
+      second_dist = min_dist;
       min_dist = dist;
-    } else if (dist == min_dist) {
-      // In case of tie, choose the lower numbered cluster
-      if (c < best_c) best_c = c;
+      best_c = c;
+    } else if (dist < second_dist) {
+      second_dist = dist;
     }
   }
+  dist_count_ += num_clusters;
+  if (best_c == -1) {
+    fprintf(stderr, "No clusters with non-zero size?!?\n");
+    exit(-1);
+  }
   *ret_min_dist = min_dist;
+  *ret_second_dist = second_dist;
   return best_c;
 }
 
-// Finds the nearest centroid to the given object o.  We have the current
-// best assignment for o.  Call it c.  (If this is the first iteration,
-// then choose a cluster c arbitrarily.)  We will start by only considering
-// the nearest neighbors of c.  Let orig_dist be D(o, c).  Maintain the
-// closest cluster found which might be the original cluster or might be
-// one of the neighbors.  If we ever get to a neighboring cluster c' such
-// that D(o, c') >= 2 * orig_dist then we can quit (triangle inequality).
-// If we get to the end of the neighbors list then there are two possibilities
-// 1) we found a new best candidate; or 2) we did not.  In case (2) we have
-// no choice but to do an exhaustive search through all clusters which we do
-// with ExhaustiveNearest().  Hopefully this doesn't happen too often.  In
-// case (1) we can instead repeat the process we just followed, this time
-// using the neighbors list of the new best candidate.
-int KMeansThread::Nearest(int o, float *obj, double *ret_min_dist) {
-  // Initialize orig_best_c to the current assignment.  This will make the
-  // triangle inequality based optimization work better.
-  int orig_best_c = assignments_[o];
-  if (orig_best_c == -1) {
-    // Arbitrarily set orig_best_c to first cluster with non-zero size
-    int c;
-    for (c = 0; c < num_clusters_; ++c) {
-      if (cluster_sizes_[c] > 0) {
-	orig_best_c = c;
-	break;
-      }
-    }
-    if (c == num_clusters_) {
-      fprintf(stderr, "No clusters with non-zero size?!?\n");
-      exit(-1);
+void KMeansThread::Assign(void) {
+  int num_objects = kmeans_->num_objects_;
+  int num_clusters = kmeans_->num_clusters_;
+  int dim = kmeans_->dim_;
+  const float *objects = kmeans_->objects_;
+  const float *means = kmeans_->means_;
+  const int *cluster_sizes = kmeans_->cluster_sizes_;
+  const float *separations = kmeans_->separations_;
+  const float *movements = kmeans_->movements_;
+  int *assignments = kmeans_->assignments_;
+  float *upper_bounds = kmeans_->upper_bounds_;
+  float *lower_bounds = kmeans_->lower_bounds_;
+
+  // The largest and second largest movements of non-empty clusters.  An object's lower bound
+  // shrinks by the largest movement of any cluster other than its own.
+  int max_c = -1;
+  float max_movement = 0, second_max_movement = 0;
+  for (int c = 0; c < num_clusters; ++c) {
+    if (cluster_sizes[c] == 0) continue;
+    float m = movements[c];
+    if (m > max_movement) {
+      second_max_movement = max_movement;
+      max_movement = m;
+      max_c = c;
+    } else if (m > second_max_movement) {
+      second_max_movement = m;
     }
   }
-  float orig_dist = 0;
-  for (int d = 0; d < dim_; ++d) {
-    float ov = obj[d];
-    float cm = means_[orig_best_c][d];
-    float dim_delta = ov - cm;
-    orig_dist += dim_delta * dim_delta;
-  }
-  orig_dist = sqrt(orig_dist);
-  ++dist_count_;
-  // For testing purposes, if we can just call ExhaustiveNearest() here if
-  // we suspect a bug in the optimized code below.
-  if (neighbor_vectors_ == NULL) {
-    return ExhaustiveNearest(o, obj, orig_best_c, orig_dist, ret_min_dist);
-  }
-  float min_dist = orig_dist;
-  int best_c = orig_best_c;
-  while (true) {
-    const vector< pair<float, int> > &v = neighbor_vectors_[best_c];
-    int num = v.size();
-    for (int i = 0; i < num; ++i) {
-      float intra_dist = v[i].first;
-      int c = v[i].second;
-      if (cluster_sizes_[c] == 0) continue;
-      // Has to be orig_dist, not min_dist.
-      if (intra_dist >= 2 * orig_dist) {
-	// We sorted neighbors by distance so we can skip all other clusters
-	++abbreviated_count_;
-	*ret_min_dist = min_dist;
-	return best_c;
-      }
 
-      float *cluster_means = means_[c];
-      float dist_sq = 0;
-      for (int d = 0; d < dim_; ++d) {
-	float ov = obj[d];
-	float cm = cluster_means[d];
-	float dim_delta = ov - cm;
-	dist_sq += dim_delta * dim_delta;
+  num_changed_ = 0;
+  sum_dists_ = 0;
+  dist_count_ = 0ULL;
+  num_skipped_ = 0ULL;
+  for (int o = thread_index_; o < num_objects; o += num_threads_) {
+    if (g_it == 0 && thread_index_ == 0 && (o / num_threads_) % 1000000 == 0) {
+      fprintf(stderr, "It %i o %i/%i\n", g_it, o, num_objects);
+    }
+    const float *obj = objects + (long long int)o * dim;
+    int a = assignments[o];
+    if (a >= 0) {
+      upper_bounds[o] += movements[a];
+      lower_bounds[o] -= a == max_c ? second_max_movement : max_movement;
+      float z = separations[a] > lower_bounds[o] ? separations[a] : lower_bounds[o];
+      if (upper_bounds[o] <= z) {
+	++num_skipped_;
+	sum_dists_ += upper_bounds[o];
+	continue;
       }
-      float dist = sqrt(dist_sq);
+      upper_bounds[o] = Dist(obj, means + a * dim, dim);
       ++dist_count_;
-      if (dist < min_dist) {
-	best_c = c;
-	min_dist = dist;
-      } else if (dist == min_dist) {
-	// In case of tie, choose the lower numbered cluster
-	if (c < best_c) best_c = c;
+      if (upper_bounds[o] <= z) {
+	++num_skipped_;
+	sum_dists_ += upper_bounds[o];
+	continue;
       }
     }
-    if (best_c == orig_best_c) {
-      // We got to the end of the neighbors list and we a) could not prove
-      // that we had the best cluster, and b) didn't find a better candidate
-      // best cluster.  All we can do now is an exhaustive search of all
-      // the clusters.
-      ++exhaustive_count_;
-      return ExhaustiveNearest(o, obj, best_c, min_dist, ret_min_dist);
-    } else {
-      // We got to the end of the neighbors list and we could not prove
-      // that we had the best cluster, *but* we did find a better candidate
-      // cluster.  So we can now try to search the neighbors of this new
-      // better candidate.
-      orig_best_c = best_c;
-      orig_dist = min_dist;
-      continue;
-    }
+    float min_dist, second_dist;
+    int nearest = Nearest(obj, &min_dist, &second_dist);
+    if (nearest != a) ++num_changed_;
+    assignments[o] = nearest;
+    upper_bounds[o] = min_dist;
+    lower_bounds[o] = second_dist;
+    sum_dists_ += min_dist;
   }
-
-  fprintf(stderr, "Should never get here\n");
-  exit(-1);
 }
 
-void KMeansThread::Assign(void) {
-  abbreviated_count_ = 0ULL;
-  exhaustive_count_ = 0ULL;
-  dist_count_ = 0ULL;
-  num_changed_ = 0;
-  double dist;
-  sum_dists_ = 0;
-  for (int o = thread_index_; o < num_objects_; o += num_threads_) {
-    if (g_it == 0 && thread_index_ == 0 && (o / num_threads_) % 10000 == 0) {
-      fprintf(stderr, "It %i o %i/%i\n", g_it, o, num_objects_);
-    }
-    float *obj = objects_[o];
-    int nearest = Nearest(o, obj, &dist);
-    sum_dists_ += dist;
-    if (nearest != assignments_[o]) ++num_changed_;
-    assignments_[o] = nearest;
-  }
-  if (thread_index_ == 0) {
-    fprintf(stderr, "Abbreviated: %.2f%% (%llu/%llu)\n",
-	    100.0 * abbreviated_count_ /
-	    (double)(abbreviated_count_ + exhaustive_count_),
-	    num_threads_ * abbreviated_count_,
-	    num_threads_ * (abbreviated_count_ + exhaustive_count_));
-    fprintf(stderr, "Dist count: %llu\n", dist_count_);
-    // Divide by num_threads because we are reporting numbers for one thread
-    unsigned long long int naive_dist_count =
-      ((unsigned long long int)num_objects_) *
-      ((unsigned long long int)num_clusters_) / num_threads_;
-    fprintf(stderr, "Dist pct: %.2f%%\n",
-	    100.0 * dist_count_ / (double)naive_dist_count);
+void KMeansThread::AssignBatch(void) {
+  int batch_size = kmeans_->batch_size_;
+  int dim = kmeans_->dim_;
+  const float *objects = kmeans_->objects_;
+  const int *batch = kmeans_->batch_;
+  int *batch_assignments = kmeans_->batch_assignments_;
+  for (int i = thread_index_; i < batch_size; i += num_threads_) {
+    float min_dist, second_dist;
+    batch_assignments[i] = Nearest(objects + (long long int)batch[i] * dim, &min_dist,
+				   &second_dist);
   }
 }
 
-void KMeansThread::ComputeIntraCentroidDistances(void) {
-  // First loop puts c1 on c2's list for c1 < c2
-  for (int c1 = 0; c1 < num_clusters_ - 1; ++c1) {
-    if (cluster_sizes_[c1] == 0) continue;
-    float *cluster_means1 = means_[c1];
-    for (int c2 = c1 + 1; c2 < num_clusters_; ++c2) {
-      if (cluster_sizes_[c2] == 0) continue;
-      // Only do work that is mine
-      if (c2 % num_threads_ != thread_index_) continue;
-      float *cluster_means2 = means_[c2];
-      float dist_sq = 0;
-      for (int d = 0; d < dim_; ++d) {
-	float cm1 = cluster_means1[d];
-	float cm2 = cluster_means2[d];
-	float delta = cm2 - cm1;
-	dist_sq += delta * delta;
-      }
-      float dist = sqrt(dist_sq);
-      if (dist >= neighbor_thresh_) continue;
-      neighbor_vectors_[c2].push_back(make_pair(dist, c1));
-    }
+void KMeansThread::ComputeSeparations(void) {
+  int num_clusters = kmeans_->num_clusters_;
+  int dim = kmeans_->dim_;
+  const float *means = kmeans_->means_;
+  const int *cluster_sizes = kmeans_->cluster_sizes_;
+  float *separations = kmeans_->separations_;
+  for (int c1 = thread_index_; c1 < num_clusters; c1 += num_threads_) {
+    if (cluster_sizes[c1] == 0) continue;
+    float min_dist = HUGE_VALF;
+    for (int c2 = 0; c2 < num_clusters; ++c2) {
+      if (c2 == c1 || cluster_sizes[c2] == 0) continue;
+      float dist = Dist(means + c1 * dim, means + c2 * dim, dim);
+      if (dist < min_dist) min_dist = dist;
+    }
+    separations[c1] = 0.5 * min_dist;
   }
 }
 
-void KMeansThread::SortNeighbors(void) {
-  for (int c = 0; c < num_clusters_; ++c) {
-    // Only do work that is mine
-    if (c % num_threads_ != thread_index_) continue;
-    vector< pair<float, int> > *v = &neighbor_vectors_[c];
-    std::sort(v->begin(), v->end(), g_pfui_lower_compare);
+// Sums this thread's contiguous range of objects by cluster
+void KMeansThread::Sum(void) {
+  int num_objects = kmeans_->num_objects_;
+  int num_clusters = kmeans_->num_clusters_;
+  int dim = kmeans_->dim_;
+  const float *objects = kmeans_->objects_;
+  const int *assignments = kmeans_->assignments_;
+  for (int i = 0; i < num_clusters * dim; ++i) sums_[i] = 0;
+  for (int c = 0; c < num_clusters; ++c) counts_[c] = 0;
+  long long int block_size = ((long long int)num_objects + num_threads_ - 1) / num_threads_;
+  long long int begin = thread_index_ * block_size;
+  long long int end = begin + block_size;
+  if (end > num_objects) end = num_objects;
+  for (long long int o = begin; o < end; ++o) {
+    int c = assignments[o];
+    // During initialization we will assign some objects to cluster -1 meaning they are unassigned
+    if (c == -1) continue;
+    const float *obj = objects + o * dim;
+    double *sums = sums_ + c * dim;
+    for (int d = 0; d < dim; ++d) sums[d] += obj[d];
+    ++counts_[c];
   }
 }
 
-static void *thread_run_assign(void *v_t) {
-  KMeansThread *t = (KMeansThread *)v_t;
-  t->Assign();
-  return NULL;
-}
-
-void KMeansThread::RunAssign(void) {
-  pthread_create(&pthread_id_, NULL, thread_run_assign, this);
-}
-
-static void *thread_run_intra(void *v_t) {
+static void *thread_run(void *v_t) {
   KMeansThread *t = (KMeansThread *)v_t;
-  t->ComputeIntraCentroidDistances();
+  t->Go();
   return NULL;
 }
 
-void KMeansThread::RunIntra(void) {
-  pthread_create(&pthread_id_, NULL, thread_run_intra, this);
-}
-
-static void *thread_run_sort(void *v_t) {
-  KMeansThread *t = (KMeansThread *)v_t;
-  t->SortNeighbors();
-  return NULL;
-}
-
-void KMeansThread::RunSort(void) {
-  pthread_create(&pthread_id_, NULL, thread_run_sort, this);
+void KMeansThread::Run(void (KMeansThread::*f)(void)) {
+  f_ = f;
+  pthread_create(&pthread_id_, NULL, thread_run, this);
 }
 
 void KMeansThread::Join(void) {
-  pthread_join(pthread_id_, NULL); 
+  pthread_join(pthread_id_, NULL);
 }
 
 int KMeans::BinarySearch(double r, int begin, int end, double *cum_sq_distance_to_nearest,
@@ -455,7 +324,7 @@ void KMeans::SeedPlusPlus(void) {
   int o = RandBetween(0, num_objects_ - 1);
   used[o] = true;
   for (int f = 0; f < dim_; ++f) {
-    means_[0][f] = objects_[o][f];
+    means_[f] = objects_[(long long int)o * dim_ + f];
   }
   double *sq_distance_to_nearest = new double[num_objects_];
   double *cum_sq_distance_to_nearest = new double[num_objects_];
@@ -467,10 +336,10 @@ void KMeans::SeedPlusPlus(void) {
       continue;
     }
     double sq_dist = 0;
-    float *obj = objects_[o];
+    const float *obj = objects_ + (long long int)o * dim_;
     for (int d = 0; d < dim_; ++d) {
       double ov = obj[d];
-      double cm = means_[0][d];
+      double cm = means_[d];
       float dim_delta = ov - cm;
       sq_dist += dim_delta * dim_delta;
     }
@@ -498,8 +367,9 @@ void KMeans::SeedPlusPlus(void) {
     used[o] = true;
     // Helps with old version of search
     sq_distance_to_nearest[o] = 0;
+    float *mean = means_ + c * dim_;
     for (int f = 0; f < dim_; ++f) {
-      means_[c][f] = objects_[o][f];
+      mean[f] = objects_[(long long int)o * dim_ + f];
     }
     sum_min_sq_dist = 0;
     double cum_sq_dist = 0;
@@ -508,11 +378,11 @@ void KMeans::SeedPlusPlus(void) {
 	cum_sq_distance_to_nearest[o] = cum_sq_dist;
 	continue;
       }
-      float *obj = objects_[o];
+      const float *obj = objects_ + (long long int)o * dim_;
       double sq_dist = 0;
       for (int d = 0; d < dim_; ++d) {
 	double ov = obj[d];
-	double cm = means_[c][d];
+	double cm = mean[d];
 	float dim_delta = ov - cm;
 	sq_dist += dim_delta * dim_delta;
       }
@@ -540,7 +410,7 @@ void KMeans::Seed1(void) {
     } while (used[o]);
     used[o] = true;
     for (int f = 0; f < dim_; ++f) {
-      means_[c][f] = objects_[o][f];
+      means_[c * dim_ + f] = objects_[(long long int)o * dim_ + f];
     }
   }
   delete [] used;
@@ -557,33 +427,31 @@ void KMeans::Seed2(void) {
     for (int i = 0; i < num_sample; ++i) {
       int o = RandBetween(0, num_objects_ - 1);
       for (int f = 0; f < dim_; ++f) {
-	sums[f] += objects_[o][f];
+	sums[f] += objects_[(long long int)o * dim_ + f];
       }
     }
     for (int f = 0; f < dim_; ++f) {
-      means_[c][f] = sums[f] / num_sample;
+      means_[c * dim_ + f] = sums[f] / num_sample;
     }
   }
   delete [] sums;
 }
 
 // Should I assume dups have been removed?
-void KMeans::SingleObjectClusters(int num_clusters, int dim, int num_objects, float **objects) {
+void KMeans::SingleObjectClusters(int num_clusters, int dim, int num_objects,
+				  const float *objects) {
   num_clusters_ = num_objects;
   dim_ = dim;
   num_objects_ = num_objects;
   objects_ = objects;
   cluster_sizes_ = new int[num_clusters_];
-  means_ = new float *[num_clusters_];
-  for (int c = 0; c < num_clusters_; ++c) {
-    means_[c] = new float[dim];
-  }
+  means_ = new float[(long long int)num_clusters_ * dim_];
   assignments_ = new int[num_objects_];
   for (int o = 0; o < num_objects_; ++o) {
     int c = o;
     assignments_[o] = c;
     for (int f = 0; f < dim_; ++f) {
-      means_[c][f] = objects[o][f];
+      means_[(long long int)c * dim_ + f] = objects[(long long int)o * dim_ + f];
     }
     cluster_sizes_[c] = 1;
   }
@@ -591,13 +459,21 @@ void KMeans::SingleObjectClusters(int num_clusters, int dim, int num_objects, fl
   num_threads_ = 0;
 }
 
-KMeans::KMeans(int num_clusters, int dim, int num_objects, float **objects, double neighbor_thresh,
+KMeans::KMeans(int num_clusters, int dim, int num_objects, const float *objects, int batch_size,
 	       int num_threads) {
-  neighbor_vectors_ = NULL;
   cluster_sizes_ = NULL;
   means_ = NULL;
   assignments_ = NULL;
+  upper_bounds_ = NULL;
+  lower_bounds_ = NULL;
+  separations_ = NULL;
+  movements_ = NULL;
+  batch_ = NULL;
+  batch_assignments_ = NULL;
   threads_ = NULL;
+  batch_size_ = batch_size;
+  assign_time_ = 0;
+  update_time_ = 0;
   if (num_clusters >= num_objects) {
     fprintf(stderr, "Assigning every object to its own cluster\n");
     SingleObjectClusters(num_clusters, dim, num_objects, objects);
@@ -609,17 +485,22 @@ KMeans::KMeans(int num_clusters, int dim, int num_objects, float **objects, doub
   dim_ = dim;
   num_objects_ = num_objects;
   objects_ = objects;
-  neighbor_thresh_ = neighbor_thresh;
   cluster_sizes_ = new int[num_clusters_];
-  means_ = new float *[num_clusters_];
-  for (int c = 0; c < num_clusters_; ++c) {
-    means_[c] = new float[dim];
-  }
+  means_ = new float[(long long int)num_clusters_ * dim_];
   assignments_ = new int[num_objects_];
   for (int o = 0; o < num_objects_; ++o) assignments_[o] = -1;
-
-  intra_time_ = 0;
-  assign_time_ = 0;
+  upper_bounds_ = new float[num_objects_];
+  lower_bounds_ = new float[num_objects_];
+  separations_ = new float[num_clusters_];
+  movements_ = new float[num_clusters_];
+  for (int c = 0; c < num_clusters_; ++c) {
+    separations_[c] = 0;
+    movements_[c] = 0;
+  }
+  if (batch_size_ > 0) {
+    batch_ = new int[batch_size_];
+    batch_assignments_ = new int[batch_size_];
+  }
 
   // SeedPlusPlus() is pretty slow.  For now don't use when >= 10,000
   // clusters and more than 1m objects.  Could do 10k clusters and 3m objects
@@ -639,28 +520,10 @@ KMeans::KMeans(int num_clusters, int dim, int num_objects, float **objects, doub
   // properly in Update().
   for (int c = 0; c < num_clusters_; ++c) cluster_sizes_[c] = 1;
 
-  // If neighbor_thresh_ is zero, don't compute neighbors lists.
-  if (neighbor_thresh_ > 0) {
-    neighbor_vectors_ = new vector< pair<float, int> >[num_clusters_];
-  } else {
-    neighbor_vectors_ = NULL;
-  }
-
   num_threads_ = num_threads;
   threads_ = new KMeansThread *[num_threads_];
   for (int t = 0; t < num_threads_; ++t) {
-    threads_[t] = new KMeansThread(num_objects_, num_clusters_, objects_, dim_, neighbor_thresh_,
-				   cluster_sizes_, means_, assignments_, neighbor_vectors_,
-				   t, num_threads_);
-  }
-
-  // Normally we call this at the end of each iteration.  Call it once now
-  // before the first iteration to speed up the first call to Assign().
-  if (neighbor_thresh_ > 0) {
-    fprintf(stderr, "Calling initial ComputeIntraCentroidDistances()\n");
-    ComputeIntraCentroidDistances();
-    fprintf(stderr,
-	    "Back from initial call to ComputeIntraCentroidDistances()\n");
+    threads_[t] = new KMeansThread(this, t, num_threads_);
   }
 }
 
@@ -672,83 +535,52 @@ KMeans::~KMeans(void) {
     }
     delete [] threads_;
   }
-  delete [] neighbor_vectors_;
   delete [] cluster_sizes_;
-  for (int c = 0; c < num_clusters_; ++c) {
-    delete [] means_[c];
-  }
   delete [] means_;
   delete [] assignments_;
+  delete [] upper_bounds_;
+  delete [] lower_bounds_;
+  delete [] separations_;
+  delete [] movements_;
+  delete [] batch_;
+  delete [] batch_assignments_;
 }
 
-// Assumes cluster means are up-to-date
-void KMeans::ComputeIntraCentroidDistances(void) {
-  time_t start_t = time(NULL);
-
-  for (int c = 0; c < num_clusters_; ++c) {
-    neighbor_vectors_[c].clear();
-  }
-
+void KMeans::RunThreads(void (KMeansThread::*f)(void)) {
   for (int i = 1; i < num_threads_; ++i) {
-    threads_[i]->RunIntra();
+    threads_[i]->Run(f);
   }
   // Execute thread 0 in main execution thread
-  threads_[0]->ComputeIntraCentroidDistances();
+  (threads_[0]->*f)();
   for (int i = 1; i < num_threads_; ++i) {
     threads_[i]->Join();
   }
+}
 
-  fprintf(stderr, "Starting second loop\n");
-  for (int c1 = 1; c1 < num_clusters_; ++c1) {
-    if (cluster_sizes_[c1] == 0) continue;
-    vector< pair<float, int> > *v = &neighbor_vectors_[c1];
-    int num = v->size();
-    for (int i = 0; i < num; ++i) {
-      float dist = (*v)[i].first;
-      int c0 = (*v)[i].second;
-      neighbor_vectors_[c0].push_back(make_pair(dist, c1));
-    }
-  }
-
-  for (int i = 1; i < num_threads_; ++i) {
-    threads_[i]->RunSort();
-  }
-  threads_[0]->SortNeighbors();
-  for (int i = 1; i < num_threads_; ++i) {
-    threads_[i]->Join();
-  }
-
-  int sum_lens = 0;
-  for (int c = 0; c < num_clusters_; ++c) {
-    // printf("%i\n", (int)neighbor_vectors_[c].size());
-    sum_lens += neighbor_vectors_[c].size();
-  }
-  fprintf(stderr, "Avg neighbor vector length: %.1f\n", sum_lens / (double)num_clusters_);
-
-  time_t end_t = time(NULL);
-  double diff_sec = difftime(end_t, start_t);
-  intra_time_ += diff_sec;
-  fprintf(stderr, "Cum intra time: %f\n", intra_time_);
+// Assumes cluster means are up-to-date
+void KMeans::ComputeCentroidSeparations(void) {
+  RunThreads(&KMeansThread::ComputeSeparations);
 }
 
 int KMeans::Assign(double *avg_dist) {
   time_t start_t = time(NULL);
 
-  for (int i = 1; i < num_threads_; ++i) {
-    threads_[i]->RunAssign();
-  }
-  // Execute thread 0 in main execution thread
-  threads_[0]->Assign();
-  for (int i = 1; i < num_threads_; ++i) {
-    threads_[i]->Join();
-  }
+  RunThreads(&KMeansThread::Assign);
   int num_changed = 0;
   double sum_dists = 0;
+  unsigned long long int dist_count = 0ULL, num_skipped = 0ULL;
   for (int i = 0; i < num_threads_; ++i) {
     num_changed += threads_[i]->NumChanged();
     sum_dists += threads_[i]->SumDists();
+    dist_count += threads_[i]->DistCount();
+    num_skipped += threads_[i]->NumSkipped();
   }
   *avg_dist = sum_dists / num_objects_;
+  fprintf(stderr, "Skipped: %.2f%% (%llu/%i)\n", 100.0 * num_skipped / (double)num_objects_,
+	  num_skipped, num_objects_);
+  unsigned long long int naive_dist_count =
+    ((unsigned long long int)num_objects_) * ((unsigned long long int)num_clusters_);
+  fprintf(stderr, "Dist pct: %.2f%%\n", 100.0 * dist_count / (double)naive_dist_count);
 
   time_t end_t = time(NULL);
   double diff_sec = difftime(end_t, start_t);
@@ -758,37 +590,68 @@ int KMeans::Assign(double *avg_dist) {
   return num_changed;
 }
 
+// Recomputes the means and the cluster sizes from the assignments and records how far each
+// centroid moved.
 void KMeans::Update(void) {
-  float **sums = new float *[num_clusters_];
+  time_t start_t = time(NULL);
+
+  RunThreads(&KMeansThread::Sum);
+  double *sums = new double[dim_];
+  float *old_mean = new float[dim_];
   for (int c = 0; c < num_clusters_; ++c) {
-    sums[c] = new float[dim_];
-    for (int d = 0; d < dim_; ++d) {
-      sums[c][d] = 0;
-    }
+    for (int d = 0; d < dim_; ++d) sums[d] = 0;
     cluster_sizes_[c] = 0;
-  }
-  for (int o = 0; o < num_objects_; ++o) {
-    int c = assignments_[o];
-    // During initialization we will assign some objects to cluster -1
-    // meaning they are unassigned
-    if (c == -1) continue;
-    float *obj = objects_[o];
-    for (int d = 0; d < dim_; ++d) {
-      sums[c][d] += obj[d];
+    for (int t = 0; t < num_threads_; ++t) {
+      const double *thread_sums = threads_[t]->Sums() + c * dim_;
+      for (int d = 0; d < dim_; ++d) sums[d] += thread_sums[d];
+      cluster_sizes_[c] += threads_[t]->Counts()[c];
     }
-    ++cluster_sizes_[c];
-  }
-  for (int c = 0; c < num_clusters_; ++c) {
+    float *mean = means_ + c * dim_;
+    for (int d = 0; d < dim_; ++d) old_mean[d] = mean[d];
     if (cluster_sizes_[c] > 0) {
-      for (int d = 0; d < dim_; ++d) {
-	means_[c][d] = sums[c][d] / cluster_sizes_[c];
-      }
+      for (int d = 0; d < dim_; ++d) mean[d] = sums[d] / cluster_sizes_[c];
     } else {
-      for (int d = 0; d < dim_; ++d) means_[c][d] = 0;
+      for (int d = 0; d < dim_; ++d) mean[d] = 0;
     }
-    delete [] sums[c];
+    movements_[c] = Dist(old_mean, mean, dim_);
   }
   delete [] sums;
+  delete [] old_mean;
+
+  time_t end_t = time(NULL);
+  double diff_sec = difftime(end_t, start_t);
+  update_time_ += diff_sec;
+  fprintf(stderr, "Cum update time: %f\n", update_time_);
+}
+
+// Mini-batch k-means (Sculley, "Web-scale k-means clustering").  Each centroid moves toward the
+// objects assigned to it with a learning rate of one over the number of objects it has been
+// assigned so far.  Objects are sampled with replacement.  Assignments within a batch are found
+// in parallel; the centroid updates are applied in batch order.
+void KMeans::MiniBatchCluster(int num_its) {
+  long long int *counts = new long long int[num_clusters_];
+  for (int c = 0; c < num_clusters_; ++c) counts[c] = 0;
+  for (int it = 0; it < num_its; ++it) {
+    for (int i = 0; i < batch_size_; ++i) batch_[i] = RandBetween(0, num_objects_ - 1);
+    RunThreads(&KMeansThread::AssignBatch);
+    for (int i = 0; i < batch_size_; ++i) {
+      int c = batch_assignments_[i];
+      float eta = 1.0 / ++counts[c];
+      const float *obj = objects_ + (long long int)batch_[i] * dim_;
+      float *mean = means_ + c * dim_;
+      for (int d = 0; d < dim_; ++d) mean[d] = (1.0 - eta) * mean[d] + eta * obj[d];
+    }
+    if (it % 100 == 0 || it == num_its - 1) fprintf(stderr, "Batch %i/%i\n", it, num_its);
+  }
+  delete [] counts;
+  // Final pass assigns every object to its nearest centroid.  All assignments are still -1, so
+  // every object gets a full search.
+  g_it = 0;
+  double avg_dist;
+  Assign(&avg_dist);
+  fprintf(stderr, "Final avg dist %f\n", avg_dist);
+  // Sets the cluster sizes
+  Update();
 }
 
 void KMeans::EliminateEmpty(void) {
@@ -802,7 +665,7 @@ void KMeans::EliminateEmpty(void) {
       mapping[j] = i;
       cluster_sizes_[i] = cluster_sizes_[j];
       for (int d = 0; d < dim_; ++d) {
-	means_[i][d] = means_[j][d];
+	means_[i * dim_ + d] = means_[j * dim_ + d];
       }
       ++i;
     }
@@ -820,12 +683,17 @@ void KMeans::Cluster(int num_its) {
     // We already did the "clustering" in the constructor
     return;
   }
+  if (batch_size_ > 0) {
+    MiniBatchCluster(num_its);
+    EliminateEmpty();
+    return;
+  }
   int it = 0;
   while (true) {
     g_it = it;
     double avg_dist;
     int num_changed = Assign(&avg_dist);
-    fprintf(stderr, "It %i num_changed %i avg dist %f\n", it, num_changed, avg_dist);
+    fprintf(stderr, "It %i num_changed %i avg dist bound %f\n", it, num_changed, avg_dist);
 
     Update();
 
@@ -835,9 +703,7 @@ void KMeans::Cluster(int num_its) {
       break;
     }
 
-    if (neighbor_thresh_ > 0) {
-      ComputeIntraCentroidDistances();
-    }
+    ComputeCentroidSeparations();
 
     ++it;
   }
@@ -7,25 +7,34 @@ using namespace std;
 
 class KMeansThread;
 
+// The objects are a contiguous row-major matrix: object o's features are
+// objects[o * dim ... o * dim + dim - 1].  The caller owns the matrix and must keep it alive until
+// clustering is done.
+//
+// With a batch size of zero we run Lloyd's algorithm, using Hamerly's bounds to skip most of the
+// distance computations.  With a positive batch size we run mini-batch k-means: each iteration
+// samples batch_size objects and moves their nearest centroids toward them, and a final pass
+// assigns every object to its nearest centroid.  Mini-batch is much faster for very large numbers
+// of objects but generally gives somewhat worse clusterings.
 class KMeans {
 public:
-  KMeans(int num_clusters, int dim, int num_objects, float **objects, double neighbor_thresh,
+  KMeans(int num_clusters, int dim, int num_objects, const float *objects, int batch_size,
 	 int num_threads);
   ~KMeans(void);
   void Cluster(int num_its);
   int Assignment(int o) const {return assignments_[o];}
   int NumClusters(void) const {return num_clusters_;}
   int ClusterSize(int c) const {return cluster_sizes_[c];}
-  void SingleObjectClusters(int num_clusters, int dim, int num_objects, float **objects);
-
-  static const int kMaxNeighbors = 10000;
-
+  void SingleObjectClusters(int num_clusters, int dim, int num_objects, const float *objects);
 
  protected:
-  void ComputeIntraCentroidDistances(void);
-  int Nearest(int o, float *obj) const;
+  friend class KMeansThread;
+
+  void RunThreads(void (KMeansThread::*f)(void));
+  void ComputeCentroidSeparations(void);
   int Assign(double *avg_dist);
   void Update(void);
+  void MiniBatchCluster(int num_its);
   void EliminateEmpty(void);
   int BinarySearch(double r, int begin, int end, double *cum_sq_distance_to_nearest, bool *used);
   void SeedPlusPlus(void);
@@ -34,15 +43,26 @@ public:
 
   int num_objects_;
   int num_clusters_;
-  float **objects_;
+  const float *objects_;
   int dim_;
-  double neighbor_thresh_;
+  int batch_size_;
   int *cluster_sizes_;
-  float **means_;
+  // Row-major, like the objects
+  float *means_;
   int *assignments_;
-  vector< pair<float, int> > *neighbor_vectors_;
-  double intra_time_;
+  // Hamerly's bounds.  upper_bounds_[o] is an upper bound on the distance from object o to its
+  // centroid; lower_bounds_[o] is a lower bound on the distance to any other centroid.
+  float *upper_bounds_;
+  float *lower_bounds_;
+  // Half the distance from each centroid to the nearest other centroid
+  float *separations_;
+  // How far each centroid moved in the last update
+  float *movements_;
+  // Objects sampled for the current mini-batch
+  int *batch_;
+  int *batch_assignments_;
   double assign_time_;
+  double update_time_;
   int num_threads_;
   KMeansThread **threads_;
 };
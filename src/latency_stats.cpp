@@ -0,0 +1,123 @@
+#include <pthread.h>
+#include <time.h>
+
+#include <memory>
+
+#include "latency_stats.h"
+
+using std::unique_ptr;
+
+LatencyStats::LatencyStats(void) {
+  pthread_mutex_init(&mutex_, NULL);
+  counts_.reset(new long long int[kNumBuckets]);
+  Clear();
+}
+
+LatencyStats::~LatencyStats(void) {
+  pthread_mutex_destroy(&mutex_);
+}
+
+// Values below 2 * kSubBuckets get a bucket each.  Above that, the values between successive
+// powers of two are split evenly into kSubBuckets buckets.
+int LatencyStats::BucketIndex(long long int usecs) {
+  if (usecs < 0) return 0;
+  if (usecs < kSubBuckets) return usecs;
+  int e = 63 - __builtin_clzll(usecs);
+  int shift = e - kSubBucketBits;
+  return (shift + 1) * kSubBuckets + (int)((usecs >> shift) - kSubBuckets);
+}
+
+long long int LatencyStats::BucketUpperBound(int b) {
+  if (b < 2 * kSubBuckets) return b;
+  int shift = b / kSubBuckets - 1;
+  int sub = b % kSubBuckets;
+  return ((long long int)(kSubBuckets + sub + 1) << shift) - 1;
+}
+
+void LatencyStats::Record(long long int usecs) {
+  int b = BucketIndex(usecs);
+  pthread_mutex_lock(&mutex_);
+  ++counts_[b];
+  ++count_;
+  sum_ += usecs;
+  if (usecs > max_) max_ = usecs;
+  pthread_mutex_unlock(&mutex_);
+}
+
+// Copies other's data under its lock alone and then adds it in under ours, so we never hold both
+// locks and a.Merge(b) can't deadlock with a concurrent b.Merge(a).
+void LatencyStats::Merge(const LatencyStats &other) {
+  if (&other == this) return;
+  unique_ptr<long long int []> counts(new long long int[kNumBuckets]);
+  pthread_mutex_lock(&other.mutex_);
+  for (int b = 0; b < kNumBuckets; ++b) counts[b] = other.counts_[b];
+  long long int count = other.count_;
+  long long int sum = other.sum_;
+  long long int max = other.max_;
+  pthread_mutex_unlock(&other.mutex_);
+  pthread_mutex_lock(&mutex_);
+  for (int b = 0; b < kNumBuckets; ++b) counts_[b] += counts[b];
+  count_ += count;
+  sum_ += sum;
+  if (max > max_) max_ = max;
+  pthread_mutex_unlock(&mutex_);
+}
+
+void LatencyStats::Clear(void) {
+  pthread_mutex_lock(&mutex_);
+  for (int b = 0; b < kNumBuckets; ++b) counts_[b] = 0;
+  count_ = 0;
+  sum_ = 0;
+  max_ = 0;
+  pthread_mutex_unlock(&mutex_);
+}
+
+long long int LatencyStats::Count(void) const {
+  pthread_mutex_lock(&mutex_);
+  long long int count = count_;
+  pthread_mutex_unlock(&mutex_);
+  return count;
+}
+
+double LatencyStats::Mean(void) const {
+  pthread_mutex_lock(&mutex_);
+  double mean = count_ == 0 ? 0 : sum_ / (double)count_;
+  pthread_mutex_unlock(&mutex_);
+  return mean;
+}
+
+long long int LatencyStats::Max(void) const {
+  pthread_mutex_lock(&mutex_);
+  long long int max = max_;
+  pthread_mutex_unlock(&mutex_);
+  return max;
+}
+
+long long int LatencyStats::Percentile(double q) const {
+  pthread_mutex_lock(&mutex_);
+  long long int ret = 0;
+  if (count_ > 0) {
+    // The rank of the latency we want, counting from one
+    long long int rank = (long long int)(q * count_ + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count_) rank = count_;
+    long long int cum = 0;
+    for (int b = 0; b < kNumBuckets; ++b) {
+      cum += counts_[b];
+      if (cum >= rank) {
+	ret = BucketUpperBound(b);
+	break;
+      }
+    }
+    // The bucket's upper bound can overshoot the largest latency seen
+    if (ret > max_) ret = max_;
+  }
+  pthread_mutex_unlock(&mutex_);
+  return ret;
+}
+
+long long int LatencyStats::Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
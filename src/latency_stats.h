@@ -0,0 +1,42 @@
+#ifndef _LATENCY_STATS_H_
+#define _LATENCY_STATS_H_
+
+#include <pthread.h>
+
+#include <memory>
+
+// A thread-safe histogram of latencies in microseconds.  Buckets are logarithmically spaced with
+// kSubBuckets buckets per power of two, so a percentile is accurate to within about 3% while the
+// histogram stays small and fixed-size no matter how many latencies are recorded.
+class LatencyStats {
+public:
+  LatencyStats(void);
+  ~LatencyStats(void);
+  void Record(long long int usecs);
+  // Adds other's latencies to ours.
+  void Merge(const LatencyStats &other);
+  void Clear(void);
+  long long int Count(void) const;
+  double Mean(void) const;
+  long long int Max(void) const;
+  // Returns an upper bound on the latency below which a fraction q of the latencies fall.
+  long long int Percentile(double q) const;
+
+  // Microseconds on a clock that never goes backwards
+  static long long int Now(void);
+private:
+  static const int kSubBucketBits = 5;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  static const int kNumBuckets = (64 - kSubBucketBits) * kSubBuckets;
+
+  static int BucketIndex(long long int usecs);
+  static long long int BucketUpperBound(int b);
+
+  mutable pthread_mutex_t mutex_;
+  std::unique_ptr<long long int []> counts_;
+  long long int count_;
+  long long int sum_;
+  long long int max_;
+};
+
+#endif
@@ -275,8 +275,8 @@ int GetNBListenSocket(int port) {
     return -1;
   }
 
-  /* listen on the socket */
-  if ((ret = listen(sock, 8)) < 0) {
+  /* listen on the socket; allow for many clients connecting at once */
+  if ((ret = listen(sock, SOMAXCONN)) < 0) {
     Warning("listen() returned %i\n", ret);
     return -1;
   }
@@ -13,6 +13,16 @@
 // In each "duplicate" hand, we play N hands where strategy B is assigned to each of the N
 // positions one-by-one.
 //
+// Duplicate hands are played by a pool of threads, each with its own random number stream.
+// Progress is reported every few seconds, and play stops early once the 95% confidence interval
+// on B's outcome is narrower than the target (a target of zero plays all the hands).
+//
+// With "cv", each of the N hands is replayed with A in every position, using the same cards and
+// the same random numbers, and B's position's outcome in the replay is used as a control
+// variate.  Summed over the N positions its expectation is exactly zero because the game is
+// zero-sum, so the estimate stays unbiased; and when A and B play alike it cancels most of the
+// luck of the sampled actions.
+//
 // If I want to support asymmetric systems again, I may need to go back to having a separate
 // CFRValues object for each position.
 
@@ -22,7 +32,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h> // gettimeofday()
+#include <time.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
 
@@ -47,25 +60,93 @@
 #include "hand_value_tree.h"
 #include "io.h"
 #include "params.h"
-#include "rand.h"
 #include "sorting.h"
 
 using std::string;
 using std::unique_ptr;
 
+// How often to report progress
+static const double kProgressSecs = 10.0;
+// How often to check whether the confidence interval is narrow enough
+static const int kPollMicros = 100000;
+// The variance estimate isn't trusted enough to stop on before this many duplicate hands
+static const double kMinHandsToStop = 10000;
+
+// Indices of the running sums over duplicate hands of B's outcome (x) and of the control
+// variate (y)
+enum {kSumN, kSumX, kSumXX, kSumY, kSumYY, kSumXY, kNumSums};
+
+static double SecsSince(const struct timespec &start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1000000000.0;
+}
+
+// Need to divide by two to convert from small blind units to big blind units
+// Multiply by 1000 to go from big blinds to milli-big-blinds
+static double MBB(double outcome) {
+  return (outcome / 2.0) * 1000.0;
+}
+
+// B's mean outcome per hand and the half-width of its 95% confidence interval, both in mbb/g.
+// With a control variate, its coefficient is the variance-minimizing one estimated from the same
+// sums.
+static void Estimate(const double *sums, bool control_variate, double *mbb, double *half_width) {
+  double n = sums[kSumN];
+  double mean_x = sums[kSumX] / n;
+  double mean = mean_x;
+  double var = sums[kSumXX] / n - mean_x * mean_x;
+  if (control_variate) {
+    double mean_y = sums[kSumY] / n;
+    double var_y = sums[kSumYY] / n - mean_y * mean_y;
+    if (var_y > 0) {
+      double cov = sums[kSumXY] / n - mean_x * mean_y;
+      double c = cov / var_y;
+      mean -= c * mean_y;
+      var -= c * cov;
+    }
+  }
+  if (var < 0) var = 0;
+  // Each duplicate hand is N hands for B
+  int num_players = Game::NumPlayers();
+  *mbb = MBB(mean / num_players);
+  *half_width = MBB(1.96 * sqrt(var / n) / num_players);
+}
+
+// Gives each thread its own stream by scrambling the seed with the thread index (the splitmix64
+// finalizer), so that nearby seeds don't give nearby drand48 states.
+static void SeedStream(unsigned long long int seed, int thread_index,
+		       struct drand48_data *rand_buf) {
+  unsigned long long int z = seed + (thread_index + 1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  unsigned short seed16v[3];
+  seed16v[0] = z & 0xffff;
+  seed16v[1] = (z >> 16) & 0xffff;
+  seed16v[2] = (z >> 32) & 0xffff;
+  seed48_r(seed16v, rand_buf);
+}
+
 class Player {
 public:
   Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
 	 const CardAbstraction &a_ca, const CardAbstraction &b_ca, const CFRConfig &a_cc,
-	 const CFRConfig &b_cc, int a_it, int b_it);
+	 const CFRConfig &b_cc, int a_it, int b_it, bool map);
   ~Player(void);
-  void Go(unsigned long long int num_duplicate_hands);
+  void Go(unsigned long long int num_duplicate_hands, int num_threads, double target_half_width,
+	  bool control_variate);
+  Node *ARoot(int p) const {return a_betting_trees_->Root(p);}
+  Node *BRoot(int p) const {return b_betting_trees_->Root(p);}
+  void AProbs(int st, int p, int nt, int bd, int raw_hcp, int num_succs, int dsi,
+	      double *probs) const;
+  void BProbs(int st, int p, int nt, int bd, int raw_hcp, int num_succs, int dsi,
+	      double *probs) const;
+  // Claims the next duplicate hand; returns false when there are none left to play.
+  bool NextHand(void);
+  void ThreadDone(void) {++num_threads_done_;}
 private:
-  void DealNCards(Card *cards, int n);
-  void SetHCPsAndBoards(Card **raw_hole_cards, const Card *raw_board);
-  void Play(Node **nodes, int b_pos, int *contributions, int last_bet_to, bool *folded,
-	    int num_remaining, int last_player_acting, int last_st, double *outcomes);
-  void PlayDuplicateHand(unsigned long long int h, const Card *cards, double *a_sum, double *b_sum);
+  int Offset(const Buckets *buckets, int st, int bd, int raw_hcp, int num_succs) const;
 
   int num_players_;
   bool a_asymmetric_;
@@ -76,17 +157,162 @@ private:
   const Buckets *b_buckets_;
   unique_ptr<CFRValues> a_probs_;
   unique_ptr<CFRValues> b_probs_;
-  int *boards_;
-  int **raw_hcps_;
+  unsigned short **sorted_hcps_;
+  unsigned long long int num_duplicate_hands_;
+  std::atomic<unsigned long long int> next_hand_;
+  std::atomic<bool> stop_;
+  std::atomic<int> num_threads_done_;
+};
+
+class PlayerThread {
+public:
+  PlayerThread(Player &player, unsigned long long int seed, int thread_index,
+	       bool control_variate);
+  ~PlayerThread(void) {}
+  void Go(void);
+  void Run(void);
+  void Join(void);
+  double Sum(int i) const {return sums_[i].load(std::memory_order_relaxed);}
+  double SumPosOutcome(int p) const {return sum_pos_outcomes_[p];}
+private:
+  void DealHand(void);
+  void SetStreet(int st);
+  int HandValue(int p);
+  void Play(Node **nodes, int b_pos, int *contributions, int last_bet_to, bool *folded,
+	    int num_remaining, int last_player_acting, int last_st,
+	    struct drand48_data *rand_buf, double *outcomes);
+  void PlayHand(Node **nodes, int b_pos, struct drand48_data *rand_buf, double *outcomes);
+  void PlayDuplicateHand(double *b_outcome, double *baseline_outcome);
+
+  Player &player_;
+  int num_players_;
+  bool control_variate_;
+  struct drand48_data rand_buf_;
+  // The current deal.  The boards, hole card pairs and hand values are computed when first
+  // needed, and shared by the N hands of a duplicate hand and their replays.
+  unique_ptr<Card []> cards_;
+  unique_ptr<bool []> street_set_;
+  unique_ptr<int []> boards_;
+  unique_ptr<unique_ptr<int []> []> raw_hcps_;
+  bool hvs_set_;
   unique_ptr<int []> hvs_;
   unique_ptr<bool []> winners_;
-  unsigned short **sorted_hcps_;
   unique_ptr<double []> sum_pos_outcomes_;
-  struct drand48_data rand_buf_;
+  // Published after every duplicate hand for the reporting thread.  Only this thread writes
+  // them.
+  std::atomic<double> sums_[kNumSums];
+  pthread_t pthread_id_;
 };
 
-void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to, bool *folded,
-		  int num_remaining, int last_player_acting, int last_st, double *outcomes) {
+PlayerThread::PlayerThread(Player &player, unsigned long long int seed, int thread_index,
+			   bool control_variate) : player_(player) {
+  num_players_ = Game::NumPlayers();
+  control_variate_ = control_variate;
+  SeedStream(seed, thread_index, &rand_buf_);
+  int max_street = Game::MaxStreet();
+  // Assume 2 hole cards
+  cards_.reset(new Card[Game::NumBoardCards(max_street) + 2 * num_players_]);
+  street_set_.reset(new bool[max_street + 1]);
+  boards_.reset(new int[max_street + 1]);
+  boards_[0] = 0;
+  raw_hcps_.reset(new unique_ptr<int []>[num_players_]);
+  for (int p = 0; p < num_players_; ++p) {
+    raw_hcps_[p].reset(new int[max_street + 1]);
+  }
+  hvs_.reset(new int[num_players_]);
+  winners_.reset(new bool[num_players_]);
+  sum_pos_outcomes_.reset(new double[num_players_]);
+  for (int p = 0; p < num_players_; ++p) {
+    sum_pos_outcomes_[p] = 0;
+  }
+  for (int i = 0; i < kNumSums; ++i) {
+    sums_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+int Player::Offset(const Buckets *buckets, int st, int bd, int raw_hcp, int num_succs) const {
+  if (buckets->None(st)) {
+    // If card abstraction, hcp on river should be raw.  If no card abstraction, hcp on river
+    // should be sorted.
+    // Don't support full hold'em with no buckets.  Would get int overflow if we tried to do that.
+    int num_hole_card_pairs = Game::NumHoleCardPairs(st);
+    int hcp = st == Game::MaxStreet() ? sorted_hcps_[bd][raw_hcp] : raw_hcp;
+    return bd * num_hole_card_pairs * num_succs + hcp * num_succs;
+  } else {
+    unsigned int h = ((unsigned int)bd) * ((unsigned int)Game::NumHoleCardPairs(st)) + raw_hcp;
+    return buckets->Bucket(st, h) * num_succs;
+  }
+}
+
+void Player::AProbs(int st, int p, int nt, int bd, int raw_hcp, int num_succs, int dsi,
+		    double *probs) const {
+  int offset = Offset(a_buckets_, st, bd, raw_hcp, num_succs);
+  a_probs_->RMProbs(st, p, nt, offset, num_succs, dsi, probs);
+}
+
+void Player::BProbs(int st, int p, int nt, int bd, int raw_hcp, int num_succs, int dsi,
+		    double *probs) const {
+  int offset = Offset(b_buckets_, st, bd, raw_hcp, num_succs);
+  b_probs_->RMProbs(st, p, nt, offset, num_succs, dsi, probs);
+}
+
+bool Player::NextHand(void) {
+  if (stop_.load(std::memory_order_relaxed)) return false;
+  return next_hand_.fetch_add(1, std::memory_order_relaxed) < num_duplicate_hands_;
+}
+
+void PlayerThread::SetStreet(int st) {
+  // Assume 2 hole cards
+  const Card *raw_board = cards_.get() + 2 * num_players_;
+  if (st == 0) {
+    for (int p = 0; p < num_players_; ++p) {
+      raw_hcps_[p][0] = HCPIndex(st, cards_.get() + 2 * p);
+    }
+  } else {
+    // Store the hole cards *after* the board cards
+    int num_hole_cards = Game::NumCardsForStreet(0);
+    int num_board_cards = Game::NumBoardCards(st);
+    for (int p = 0; p < num_players_; ++p) {
+      Card canon_board[5];
+      Card canon_hole_cards[2];
+      CanonicalizeCards(raw_board, cards_.get() + 2 * p, st, canon_board, canon_hole_cards);
+      // Don't need to do this repeatedly
+      if (p == 0) {
+	boards_[st] = BoardTree::LookupBoard(canon_board, st);
+      }
+      Card canon_cards[7];
+      for (int i = 0; i < num_board_cards; ++i) {
+	canon_cards[num_hole_cards + i] = canon_board[i];
+      }
+      for (int i = 0; i < num_hole_cards; ++i) {
+	canon_cards[i] = canon_hole_cards[i];
+      }
+      raw_hcps_[p][st] = HCPIndex(st, canon_cards);
+    }
+  }
+  street_set_[st] = true;
+}
+
+int PlayerThread::HandValue(int p) {
+  if (! hvs_set_) {
+    int num_board_cards = Game::NumBoardCards(Game::MaxStreet());
+    Card hand_cards[7];
+    for (int i = 0; i < num_board_cards; ++i) {
+      hand_cards[i+2] = cards_[i + 2 * num_players_];
+    }
+    for (int q = 0; q < num_players_; ++q) {
+      hand_cards[0] = cards_[2 * q];
+      hand_cards[1] = cards_[2 * q + 1];
+      hvs_[q] = HandValueTree::Val(hand_cards);
+    }
+    hvs_set_ = true;
+  }
+  return hvs_[p];
+}
+
+void PlayerThread::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
+			bool *folded, int num_remaining, int last_player_acting, int last_st,
+			struct drand48_data *rand_buf, double *outcomes) {
   Node *p0_node = nodes[0];
   if (p0_node->Terminal()) {
     if (num_remaining == 1) {
@@ -119,7 +345,7 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
       for (int p = 0; p < num_players_; ++p) {
 	pot_size += contributions[p];
 	if (! folded[p]) {
-	  int hv = hvs_[p];
+	  int hv = HandValue(p);
 	  if (hv > best_hv) best_hv = hv;
 	}
       }
@@ -137,7 +363,7 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
 	  winners_[p] = false;
 	}
       }
-      
+
       for (int p = 0; p < num_players_; ++p) {
 	if (winners_[p]) {
 	  outcomes[p] = ((double)(pot_size - winner_contributions)) / ((double)num_winners);
@@ -148,15 +374,6 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
     }
     return;
   } else {
-#if 0
-    if (nodes[0]->NonterminalID() != nodes[1]->NonterminalID()) {
-      fprintf(stderr, "NT ID mismatch %i vs %i st %i vs %i lbt %i vs %i pa %i vs %i\n",
-	      nodes[0]->NonterminalID(), nodes[1]->NonterminalID(), nodes[0]->Street(),
-	      nodes[1]->Street(), nodes[0]->LastBetTo(), nodes[1]->LastBetTo(),
-	      nodes[0]->PlayerActing(), nodes[1]->PlayerActing());
-      exit(-1);
-    }
-#endif
     // Assumption is that we can get the street from any node
     int st = p0_node->Street();
     // Assumption is that we can get num_succs from any node
@@ -174,41 +391,20 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
       if (! folded[actual_pa]) break;
       ++actual_pa;
     }
-    
-    // Assumption is that we can get the default succ index from any node
-    // Won't work for asymmetric maybe
-    int dsi = p0_node->DefaultSuccIndex();
-    int bd = boards_[st];
-    int raw_hcp = raw_hcps_[actual_pa][st];
-    int num_hole_card_pairs = Game::NumHoleCardPairs(st);
-    int a_offset, b_offset;
-    // If card abstraction, hcp on river should be raw.  If no card
-    // abstraction, hcp on river should be sorted.  Right?
-    if (a_buckets_->None(st)) {
-      int hcp = st == Game::MaxStreet() ? sorted_hcps_[bd][raw_hcp] : raw_hcp;
-      a_offset = bd * num_hole_card_pairs * num_succs + hcp * num_succs;
-    } else {
-      unsigned int h = ((unsigned int)bd) * ((unsigned int)num_hole_card_pairs) + raw_hcp;
-      int b = a_buckets_->Bucket(st, h);
-      a_offset = b * num_succs;
-    }
-    if (b_buckets_->None(st)) {
-      // Don't support full hold'em with no buckets.  Would get int overflow if we tried to do that.
-      int hcp;
-      hcp = st == Game::MaxStreet() ? sorted_hcps_[bd][raw_hcp] : raw_hcp;
-      b_offset = bd * num_hole_card_pairs * num_succs + hcp * num_succs;
-    } else {
-      unsigned int h = ((unsigned int)bd) * ((unsigned int)num_hole_card_pairs) + raw_hcp;
-      int b = b_buckets_->Bucket(st, h);
-      b_offset = b * num_succs;
-    }
+
     int s;
     if (num_succs == 1) {
       s = 0;
     } else {
+      // Assumption is that we can get the default succ index from any node
+      // Won't work for asymmetric maybe
+      int dsi = p0_node->DefaultSuccIndex();
+      if (! street_set_[st]) SetStreet(st);
+      int bd = boards_[st];
+      int raw_hcp = raw_hcps_[actual_pa][st];
       double r;
-      drand48_r(&rand_buf_, &r);
-    
+      drand48_r(rand_buf, &r);
+
       double cum = 0;
       unique_ptr<double []> probs(new double[num_succs]);
       // The *actual* player acting may be different from the player acting value of the current
@@ -218,9 +414,9 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
       int nt = nodes[actual_pa]->NonterminalID();
       int node_pa = nodes[actual_pa]->PlayerActing();
       if (actual_pa == b_pos) {
-	b_probs_->RMProbs(st, node_pa, nt, b_offset, num_succs, dsi, probs.get());
+	player_.BProbs(st, node_pa, nt, bd, raw_hcp, num_succs, dsi, probs.get());
       } else {
-	a_probs_->RMProbs(st, node_pa, nt, a_offset, num_succs, dsi, probs.get());
+	player_.AProbs(st, node_pa, nt, bd, raw_hcp, num_succs, dsi, probs.get());
       }
       for (s = 0; s < num_succs - 1; ++s) {
 	double prob = probs[s];
@@ -236,7 +432,7 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
       }
       contributions[actual_pa] = last_bet_to;
       Play(succ_nodes.get(), b_pos, contributions, last_bet_to, folded, num_remaining, actual_pa,
-	   st, outcomes);
+	   st, rand_buf, outcomes);
     } else if (s == nodes[actual_pa]->FoldSuccIndex()) {
       unique_ptr<Node * []> succ_nodes(new Node *[num_players_]);
       for (int p = 0; p < num_players_; ++p) {
@@ -246,7 +442,7 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
       folded[actual_pa] = true;
       outcomes[actual_pa] = -(int)contributions[actual_pa];
       Play(succ_nodes.get(), b_pos, contributions, last_bet_to, folded, num_remaining - 1,
-	   actual_pa, st, outcomes);
+	   actual_pa, st, rand_buf, outcomes);
     } else {
       Node *my_succ = nodes[actual_pa]->IthSucc(s);
       int new_bet_to = my_succ->LastBetTo();
@@ -269,7 +465,7 @@ void Player::Play(Node **nodes, int b_pos, int *contributions, int last_bet_to,
       }
       contributions[actual_pa] = new_bet_to;
       Play(succ_nodes.get(), b_pos, contributions, new_bet_to, folded, num_remaining, actual_pa,
-	   st, outcomes);
+	   st, rand_buf, outcomes);
     }
   }
 }
@@ -279,194 +475,200 @@ static int PrecedingPlayer(int p) {
   else        return p - 1;
 }
 
-// Play one hand of duplicate, which is a pair of regular hands.  Return
-// outcome from A's perspective.
-void Player::PlayDuplicateHand(unsigned long long int h, const Card *cards, double *a_sum,
-			       double *b_sum) {
-  unique_ptr<double []> outcomes(new double[num_players_]);
+// Plays one hand from the given roots.  B plays in position b_pos; pass -1 for A in every
+// position.
+void PlayerThread::PlayHand(Node **nodes, int b_pos, struct drand48_data *rand_buf,
+			    double *outcomes) {
   unique_ptr<int []> contributions(new int[num_players_]);
   unique_ptr<bool []> folded(new bool[num_players_]);
   // Assume the big blind is last to act preflop
   // Assume the small blind is prior to the big blind
   int big_blind_p = PrecedingPlayer(Game::FirstToAct(0));
   int small_blind_p = PrecedingPlayer(big_blind_p);
-  *a_sum = 0;
-  *b_sum = 0;
-  for (int b_pos = 0; b_pos < num_players_; ++b_pos) {
-    for (int p = 0; p < num_players_; ++p) {
-      folded[p] = false;
-      if (p == small_blind_p) {
-	contributions[p] = Game::SmallBlind();
-      } else if (p == big_blind_p) {
-	contributions[p] = Game::BigBlind();
-      } else {
-	contributions[p] = 0;
-      }
+  for (int p = 0; p < num_players_; ++p) {
+    folded[p] = false;
+    if (p == small_blind_p) {
+      contributions[p] = Game::SmallBlind();
+    } else if (p == big_blind_p) {
+      contributions[p] = Game::BigBlind();
+    } else {
+      contributions[p] = 0;
     }
-    unique_ptr<Node * []> nodes(new Node *[num_players_]);
+  }
+  Play(nodes, b_pos, contributions.get(), Game::BigBlind(), folded.get(), num_players_, 1000, -1,
+       rand_buf, outcomes);
+}
+
+// Play one hand of duplicate, which is N regular hands.  Returns B's total outcome and, if we
+// are using the control variate, the total outcome of B's positions in the replays.
+void PlayerThread::PlayDuplicateHand(double *b_outcome, double *baseline_outcome) {
+  unique_ptr<double []> outcomes(new double[num_players_]);
+  unique_ptr<Node * []> nodes(new Node *[num_players_]);
+  *b_outcome = 0;
+  *baseline_outcome = 0;
+  for (int b_pos = 0; b_pos < num_players_; ++b_pos) {
     for (int p = 0; p < num_players_; ++p) {
-      if (p == b_pos) nodes[p] = b_betting_trees_->Root(p);
-      else            nodes[p] = a_betting_trees_->Root(p);
+      if (p == b_pos) nodes[p] = player_.BRoot(p);
+      else            nodes[p] = player_.ARoot(p);
     }
-    Play(nodes.get(), b_pos, contributions.get(), Game::BigBlind(), folded.get(), num_players_,
-	 1000, -1, outcomes.get());
+    // The replay draws the same random numbers
+    struct drand48_data replay_rand_buf = rand_buf_;
+    PlayHand(nodes.get(), b_pos, &rand_buf_, outcomes.get());
+    *b_outcome += outcomes[b_pos];
     for (int p = 0; p < num_players_; ++p) {
-      if (p == b_pos) *b_sum += outcomes[p];
-      else            *a_sum += outcomes[p];
       sum_pos_outcomes_[p] += outcomes[p];
     }
+    if (control_variate_) {
+      for (int p = 0; p < num_players_; ++p) {
+	nodes[p] = player_.ARoot(p);
+      }
+      PlayHand(nodes.get(), -1, &replay_rand_buf, outcomes.get());
+      *baseline_outcome += outcomes[b_pos];
+    }
   }
 }
 
-void Player::DealNCards(Card *cards, int n) {
+void PlayerThread::DealHand(void) {
+  int max_street = Game::MaxStreet();
+  int num_board_cards = Game::NumBoardCards(max_street);
+  int n = num_board_cards + 2 * num_players_;
   int max_card = Game::MaxCard();
   for (int i = 0; i < n; ++i) {
     Card c;
     while (true) {
-      // c = RandBetween(0, max_card);
       double r;
       drand48_r(&rand_buf_, &r);
       c = (max_card + 1) * r;
       int j;
       for (j = 0; j < i; ++j) {
-	if (cards[j] == c) break;
+	if (cards_[j] == c) break;
       }
       if (j == i) break;
     }
-    cards[i] = c;
+    cards_[i] = c;
+  }
+  for (int p = 0; p < num_players_; ++p) {
+    SortCards(cards_.get() + 2 * p, 2);
+  }
+  int num = 2 * num_players_;
+  for (int st = 1; st <= max_street; ++st) {
+    int num_street_cards = Game::NumCardsForStreet(st);
+    SortCards(cards_.get() + num, num_street_cards);
+    num += num_street_cards;
   }
+  for (int st = 0; st <= max_street; ++st) {
+    street_set_[st] = false;
+  }
+  hvs_set_ = false;
 }
 
-void Player::SetHCPsAndBoards(Card **raw_hole_cards, const Card *raw_board) {
-  int max_street = Game::MaxStreet();
-  for (int st = 0; st <= max_street; ++st) {
-    if (st == 0) {
-      for (int p = 0; p < num_players_; ++p) {
-	raw_hcps_[p][0] = HCPIndex(st, raw_hole_cards[p]);
-      }
-    } else {
-      // Store the hole cards *after* the board cards
-      int num_hole_cards = Game::NumCardsForStreet(0);
-      int num_board_cards = Game::NumBoardCards(st);
-      for (int p = 0; p < num_players_; ++p) {
-	Card canon_board[5];
-	Card canon_hole_cards[2];
-	CanonicalizeCards(raw_board, raw_hole_cards[p], st, canon_board, canon_hole_cards);
-	// Don't need to do this repeatedly
-	if (p == 0) {
-	  boards_[st] = BoardTree::LookupBoard(canon_board, st);
-	}
-	Card canon_cards[7];
-	for (int i = 0; i < num_board_cards; ++i) {
-	  canon_cards[num_hole_cards + i] = canon_board[i];
-	}
-	for (int i = 0; i < num_hole_cards; ++i) {
-	  canon_cards[i] = canon_hole_cards[i];
-	}
-	raw_hcps_[p][st] = HCPIndex(st, canon_cards);
-      }
+void PlayerThread::Go(void) {
+  double sums[kNumSums];
+  for (int i = 0; i < kNumSums; ++i) sums[i] = 0;
+  while (player_.NextHand()) {
+    DealHand();
+    double x, y;
+    PlayDuplicateHand(&x, &y);
+    sums[kSumN] += 1;
+    sums[kSumX] += x;
+    sums[kSumXX] += x * x;
+    sums[kSumY] += y;
+    sums[kSumYY] += y * y;
+    sums[kSumXY] += x * y;
+    for (int i = 0; i < kNumSums; ++i) {
+      sums_[i].store(sums[i], std::memory_order_relaxed);
     }
   }
+  player_.ThreadDone();
 }
 
-void Player::Go(unsigned long long int num_duplicate_hands) {
-  double sum_a_outcomes = 0, sum_b_outcomes = 0;
-  double sum_sqd_a_outcomes = 0, sum_sqd_b_outcomes = 0;
-  int max_street = Game::MaxStreet();
-  int num_board_cards = Game::NumBoardCards(max_street);
-  Card cards[100], hand_cards[7];
-  Card **hole_cards = new Card *[num_players_];
-  for (int p = 0; p < num_players_; ++p) {
-    hole_cards[p] = new Card[2];
-  }
-  struct timeval time; 
+static void *player_thread_run(void *v_t) {
+  PlayerThread *t = (PlayerThread *)v_t;
+  t->Go();
+  return NULL;
+}
+
+void PlayerThread::Run(void) {
+  pthread_create(&pthread_id_, NULL, player_thread_run, this);
+}
+
+void PlayerThread::Join(void) {
+  pthread_join(pthread_id_, NULL);
+}
+
+void Player::Go(unsigned long long int num_duplicate_hands, int num_threads,
+		double target_half_width, bool control_variate) {
+  num_duplicate_hands_ = num_duplicate_hands;
+  next_hand_ = 0;
+  stop_ = false;
+  num_threads_done_ = 0;
+  struct timeval time;
   gettimeofday(&time, NULL);
-  srand48_r((time.tv_sec * 1000) + (time.tv_usec / 1000), &rand_buf_);
-  for (unsigned long long int h = 0; h < num_duplicate_hands; ++h) {
-    // Assume 2 hole cards
-    DealNCards(cards, num_board_cards + 2 * num_players_);
-#if 0
-    OutputNCards(cards + 2 * num_players_, num_board_cards);
-    printf("\n");
-    OutputTwoCards(cards);
-    printf("\n");
-    OutputTwoCards(cards + 2);
-    printf("\n");
-    fflush(stdout);
-#endif
-    for (int p = 0; p < num_players_; ++p) {
-      SortCards(cards + 2 * p, 2);
-    }
-    int num = 2 * num_players_;
-    for (int st = 1; st <= max_street; ++st) {
-      int num_street_cards = Game::NumCardsForStreet(st);
-      SortCards(cards + num, num_street_cards);
-      num += num_street_cards;
+  unsigned long long int seed = (time.tv_sec * 1000ULL) + (time.tv_usec / 1000);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  unique_ptr<unique_ptr<PlayerThread> []> threads(new unique_ptr<PlayerThread>[num_threads]);
+  for (int t = 0; t < num_threads; ++t) {
+    threads[t].reset(new PlayerThread(*this, seed, t, control_variate));
+    threads[t]->Run();
+  }
+  double sums[kNumSums];
+  double last_report_secs = 0;
+  while (true) {
+    bool done = num_threads_done_ == num_threads;
+    if (! done) usleep(kPollMicros);
+    for (int i = 0; i < kNumSums; ++i) {
+      sums[i] = 0;
+      for (int t = 0; t < num_threads; ++t) sums[i] += threads[t]->Sum(i);
     }
-    for (int i = 0; i < num_board_cards; ++i) {
-      hand_cards[i+2] = cards[i + 2 * num_players_];
+    if (done) break;
+    if (sums[kSumN] == 0) continue;
+    double mbb, half_width;
+    Estimate(sums, control_variate, &mbb, &half_width);
+    double secs = SecsSince(start);
+    if (secs >= last_report_secs + kProgressSecs) {
+      fprintf(stderr, "%.0f dup hands (%.0f/sec): %.1f +/- %.1f mbb/g\n", sums[kSumN],
+	      sums[kSumN] / secs, mbb, half_width);
+      last_report_secs = secs;
     }
-    for (int p = 0; p < num_players_; ++p) {
-      hand_cards[0] = cards[2 * p];
-      hand_cards[1] = cards[2 * p + 1];
-      hvs_[p] = HandValueTree::Val(hand_cards);
-      hole_cards[p][0] = cards[2 * p];
-      hole_cards[p][1] = cards[2 * p + 1];
+    if (target_half_width > 0 && sums[kSumN] >= kMinHandsToStop &&
+	half_width <= target_half_width) {
+      stop_ = true;
     }
-    
-    SetHCPsAndBoards(hole_cards, cards + 2 * num_players_);
-
-    // PlayDuplicateHand() returns the result of a duplicate hand (which is
-    // N hands if N is the number of players)
-    double a_outcome, b_outcome;
-    PlayDuplicateHand(h, cards, &a_outcome, &b_outcome);
-    sum_a_outcomes += a_outcome;
-    sum_b_outcomes += b_outcome;
-    sum_sqd_a_outcomes += a_outcome * a_outcome;
-    sum_sqd_b_outcomes += b_outcome * b_outcome;
   }
-  for (int p = 0; p < num_players_; ++p) {
-    delete [] hole_cards[p];
+  for (int t = 0; t < num_threads; ++t) {
+    threads[t]->Join();
   }
-  delete [] hole_cards;
-#if 0
-  unsigned long long int num_a_hands =
-    (num_players_ - 1) * num_players_ * num_duplicate_hands;
-  double mean_a_outcome = sum_a_outcomes / (double)num_a_hands;
-#endif
+  double secs = SecsSince(start);
+
+  double num_dup_hands = sums[kSumN];
+  if (num_dup_hands == 0) return;
   // Divide by num_players because we evaluate B that many times (once for
   // each position).
-  unsigned long long int num_b_hands = num_duplicate_hands * num_players_;
-  double mean_b_outcome = sum_b_outcomes / (double)num_b_hands;
-  // Need to divide by two to convert from small blind units to big blind units
-  // Multiply by 1000 to go from big blinds to milli-big-blinds
-  double b_mbb_g = (mean_b_outcome / 2.0) * 1000.0;
-  fprintf(stderr, "Avg B outcome: %f (%.1f mbb/g) over %llu dup hands\n", mean_b_outcome, b_mbb_g,
-	  num_duplicate_hands);
-  // Variance is the mean of the squares minus the square of the means
-  double var_b =
-    (sum_sqd_b_outcomes / ((double)num_b_hands)) -
-    (mean_b_outcome * mean_b_outcome);
-  double stddev_b = sqrt(var_b);
-  double match_stddev = stddev_b * sqrt(num_b_hands);
-  double match_lower = sum_b_outcomes - 1.96 * match_stddev;
-  double match_upper = sum_b_outcomes + 1.96 * match_stddev;
-  double mbb_lower =
-    ((match_lower / (num_b_hands)) / 2.0) * 1000.0;
-  double mbb_upper =
-    ((match_upper / (num_b_hands)) / 2.0) * 1000.0;
-  fprintf(stderr, "MBB confidence interval: %f-%f\n", mbb_lower, mbb_upper);
+  double mean_b_outcome = sums[kSumX] / (num_dup_hands * num_players_);
+  fprintf(stderr, "Avg B outcome: %f (%.1f mbb/g) over %.0f dup hands in %.1f secs "
+	  "(%.0f/sec)\n", mean_b_outcome, MBB(mean_b_outcome), num_dup_hands, secs,
+	  num_dup_hands / secs);
+  double mbb, half_width;
+  Estimate(sums, false, &mbb, &half_width);
+  fprintf(stderr, "MBB confidence interval: %f-%f\n", mbb - half_width, mbb + half_width);
+  if (control_variate) {
+    Estimate(sums, true, &mbb, &half_width);
+    fprintf(stderr, "With control variate: %.1f mbb/g; confidence interval %f-%f\n", mbb,
+	    mbb - half_width, mbb + half_width);
+  }
 
   for (int p = 0; p < num_players_; ++p) {
-    double avg_outcome =
-      sum_pos_outcomes_[p] / (double)(num_players_ * num_duplicate_hands);
+    double sum_pos_outcomes = 0;
+    for (int t = 0; t < num_threads; ++t) sum_pos_outcomes += threads[t]->SumPosOutcome(p);
+    double avg_outcome = sum_pos_outcomes / (num_players_ * num_dup_hands);
     fprintf(stderr, "Avg P%u outcome: %f\n", p, avg_outcome);
   }
 }
 
 Player::Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
 	       const CardAbstraction &a_ca, const CardAbstraction &b_ca, const CFRConfig &a_cc,
-	       const CFRConfig &b_cc, int a_it, int b_it) {
+	       const CFRConfig &b_cc, int a_it, int b_it, bool map) {
   a_buckets_ = new Buckets(a_ca, false);
   if (strcmp(a_ca.CardAbstractionName().c_str(), b_ca.CardAbstractionName().c_str())) {
     b_buckets_ = new Buckets(b_ca, false);
@@ -474,9 +676,6 @@ Player::Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
     b_buckets_ = a_buckets_;
   }
   num_players_ = Game::NumPlayers();
-  hvs_.reset(new int[num_players_]);
-  winners_.reset(new bool[num_players_]);
-  sum_pos_outcomes_.reset(new double[num_players_]);
   BoardTree::Create();
   BoardTree::CreateLookup();
 
@@ -500,14 +699,22 @@ Player::Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
 	  a_ba.BettingAbstractionName().c_str(),
 	  a_cc.CFRConfigName().c_str());
   // Note assumption that we can use the betting tree for position 0
-  a_probs_->Read(dir, a_it, a_betting_trees_->GetBettingTree(), "x", -1, true, false);
+  if (map) {
+    a_probs_->Map(dir, a_it, a_betting_trees_->GetBettingTree(), "x", -1, true);
+  } else {
+    a_probs_->Read(dir, a_it, a_betting_trees_->GetBettingTree(), "x", -1, true, false);
+  }
 
   sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::OldCFRBase(), Game::GameName().c_str(),
 	  Game::NumPlayers(), b_ca.CardAbstractionName().c_str(), Game::NumRanks(),
 	  Game::NumSuits(), Game::MaxStreet(), b_ba.BettingAbstractionName().c_str(),
 	  b_cc.CFRConfigName().c_str());
   // Note assumption that we can use the betting tree for position 0
-  b_probs_->Read(dir, b_it, b_betting_trees_->GetBettingTree(), "x", -1, true, false);
+  if (map) {
+    b_probs_->Map(dir, b_it, b_betting_trees_->GetBettingTree(), "x", -1, true);
+  } else {
+    b_probs_->Read(dir, b_it, b_betting_trees_->GetBettingTree(), "x", -1, true, false);
+  }
 
 #if 0
   // If we want to go back to supporting asymmetric systems, may need to have a separate
@@ -526,13 +733,6 @@ Player::Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
 #endif
 
   int max_street = Game::MaxStreet();
-  boards_ = new int[max_street + 1];
-  boards_[0] = 0;
-  raw_hcps_ = new int *[num_players_];
-  for (int p = 0; p < num_players_; ++p) {
-    raw_hcps_[p] = new int[max_street + 1];
-  }
-
   if (a_buckets_->None(max_street) || b_buckets_->None(max_street)) {
     int num_hole_card_pairs = Game::NumHoleCardPairs(max_street);
     int num_boards = BoardTree::NumBoards(max_street);
@@ -563,10 +763,6 @@ Player::Player(const BettingAbstraction &a_ba, const BettingAbstraction &b_ba,
     sorted_hcps_ = nullptr;
     fprintf(stderr, "Not creating sorted_hcps_\n");
   }
-
-  for (int p = 0; p < num_players_; ++p) {
-    sum_pos_outcomes_[p] = 0;
-  }
 }
 
 Player::~Player(void) {
@@ -578,11 +774,6 @@ Player::~Player(void) {
     }
     delete [] sorted_hcps_;
   }
-  delete [] boards_;
-  for (int p = 0; p < num_players_; ++p) {
-    delete [] raw_hcps_[p];
-  }
-  delete [] raw_hcps_;
   if (b_buckets_ != a_buckets_) delete b_buckets_;
   delete a_buckets_;
 }
@@ -590,12 +781,17 @@ Player::~Player(void) {
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <A card params> <B card params> "
 	  "<A betting abstraction params> <B betting abstraction params> <A CFR params> "
-	  "<B CFR params> <A it> <B it> <num duplicate hands>\n", prog_name);
+	  "<B CFR params> <A it> <B it> <num duplicate hands> <num threads> <target CI> "
+	  "[cv|nocv] [read|mmap]\n", prog_name);
+  fprintf(stderr, "\n<target CI> is the half-width of the 95%% confidence interval in mbb/g at "
+	  "which to stop early; 0 plays all the hands.\n");
+  fprintf(stderr, "mmap maps the strategy files into memory rather than reading them; it can't "
+	  "be used with compressed strategies.\n");
   exit(-1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 11) Usage(argv[0]);
+  if (argc != 15) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
@@ -630,12 +826,24 @@ int main(int argc, char *argv[]) {
   if (sscanf(argv[9], "%i", &b_it) != 1) Usage(argv[0]);
   unsigned long long int num_duplicate_hands;
   if (sscanf(argv[10], "%llu", &num_duplicate_hands) != 1) Usage(argv[0]);
+  int num_threads;
+  if (sscanf(argv[11], "%i", &num_threads) != 1) Usage(argv[0]);
+  if (num_threads < 1)                            Usage(argv[0]);
+  double target_half_width;
+  if (sscanf(argv[12], "%lf", &target_half_width) != 1) Usage(argv[0]);
+  string cv_arg = argv[13];
+  bool control_variate;
+  if (cv_arg == "cv")        control_variate = true;
+  else if (cv_arg == "nocv") control_variate = false;
+  else                       Usage(argv[0]);
+  string map_arg = argv[14];
+  bool map;
+  if (map_arg == "read")      map = false;
+  else if (map_arg == "mmap") map = true;
+  else                        Usage(argv[0]);
   HandValueTree::Create();
 
-  // Leave this in if we don't want reproducibility
-  InitRand();
-
   Player player(*a_betting_abstraction, *b_betting_abstraction, *a_card_abstraction,
-		*b_card_abstraction, *a_cfr_config, *b_cfr_config, a_it, b_it);
-  player.Go(num_duplicate_hands);
+		*b_card_abstraction, *a_cfr_config, *b_cfr_config, a_it, b_it, map);
+  player.Go(num_duplicate_hands, num_threads, target_half_width, control_variate);
 }
@@ -8,6 +8,7 @@
 #include "canonical_cards.h"
 #include "cards.h"
 #include "cfr_values.h"
+#include "disk_probs.h"
 #include "game.h"
 #include "hand_tree.h"
 #include "reach_probs.h"
@@ -119,3 +120,70 @@ shared_ptr<ReachProbs []> ReachProbs::CreateSuccReachProbs(Node *node, int gbd,
   
   return succ_reach_probs;
 }
+
+shared_ptr<ReachProbs []> ReachProbs::CreateSuccReachProbs(Node *node, int gbd,
+							   const CanonicalCards *hands,
+							   const Buckets &buckets,
+							   DiskProbs *disk_probs,
+							   const ReachProbs &pred_reach_probs) {
+  int num_succs = node->NumSuccs();
+  if (num_succs == 0) {
+    fprintf(stderr, "CreateSuccReachProbs() called with zero-succ node\n");
+    exit(-1);
+  }
+  shared_ptr<ReachProbs []> succ_reach_probs(new ReachProbs[num_succs]);
+  int num_players = Game::NumPlayers();
+  // Can happen when we are all-in.  Only succ is check.
+  if (num_succs == 1) {
+    for (int p = 0; p < num_players; ++p) {
+      succ_reach_probs[0].Set(p, pred_reach_probs.Get(p));
+    }
+    return succ_reach_probs;
+  }
+  int pa = node->PlayerActing();
+  for (int s = 0; s < num_succs; ++s) {
+    for (int p = 0; p < num_players; ++p) {
+      if (p == pa) {
+	succ_reach_probs[s].Allocate(pa);
+      } else {
+	succ_reach_probs[s].Set(p, pred_reach_probs.Get(p));
+      }
+    }
+  }
+  int max_street = Game::MaxStreet();
+  int max_card1 = Game::MaxCard() + 1;
+  int st = node->Street();
+  int nt = node->NonterminalID();
+  int num_hole_card_pairs = Game::NumHoleCardPairs(st);
+  const Card *ms_board = st == max_street ? BoardTree::Board(max_street, gbd) : nullptr;
+  unique_ptr<double []> probs;
+  if (buckets.None(st)) {
+    probs.reset(new double[num_hole_card_pairs * num_succs]);
+    disk_probs->ProbsRange(pa, st, nt, gbd * (long long int)num_hole_card_pairs,
+			   num_hole_card_pairs, num_succs, probs.get());
+  } else {
+    probs.reset(new double[num_succs]);
+  }
+  for (int i = 0; i < num_hole_card_pairs; ++i) {
+    const Card *cards = hands->Cards(i);
+    Card hi = cards[0];
+    Card lo = cards[1];
+    int enc = hi * max_card1 + lo;
+    const double *hand_probs;
+    if (buckets.None(st)) {
+      hand_probs = probs.get() + i * num_succs;
+    } else {
+      // Hands on final street were reordered by hand strength, but bucket lookup requires the
+      // unordered hole card pair index
+      unsigned int hcp = st == max_street ? HCPIndex(st, ms_board, cards) : i;
+      unsigned int h = ((unsigned int)gbd) * ((unsigned int)num_hole_card_pairs) + hcp;
+      disk_probs->Probs(pa, st, nt, buckets.Bucket(st, h), num_succs, probs.get());
+      hand_probs = probs.get();
+    }
+    for (int s = 0; s < num_succs; ++s) {
+      succ_reach_probs[s].Set(pa, enc, pred_reach_probs.Get(pa, enc) * hand_probs[s]);
+    }
+  }
+  
+  return succ_reach_probs;
+}
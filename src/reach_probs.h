@@ -6,6 +6,7 @@
 class Buckets;
 class CanonicalCards;
 class CFRValues;
+class DiskProbs;
 class Node;
 
 class ReachProbs {
@@ -18,6 +19,13 @@ public:
 							     const CFRValues *sumprobs,
 							     const ReachProbs &pred_reach_probs,
 							     bool purify);
+  // As above, but reading the sumprobs from disk rather than memory.  gbd is the node's global
+  // board; on streets without a card abstraction the board's rows are read with one call.
+  static std::shared_ptr<ReachProbs []> CreateSuccReachProbs(Node *node, int gbd,
+							     const CanonicalCards *hands,
+							     const Buckets &buckets,
+							     DiskProbs *disk_probs,
+							     const ReachProbs &pred_reach_probs);
   std::shared_ptr<double []> Get(int p) const {return probs_[p];}
   void Set(int p, std::shared_ptr<double []> probs) {probs_[p] = probs;}
   double Get(int p, int enc) const {return probs_[p][enc];}
@@ -32,10 +32,11 @@ using std::shared_ptr;
 using std::unique_ptr;
 
 RGBR::RGBR(const CardAbstraction &ca, const CFRConfig &cc, const Buckets &buckets, bool current,
-	   bool quantize, int num_threads, const bool *streets) :
+	   bool quantize, int num_threads, const bool *streets, bool map) :
   CFRP(ca, cc, buckets, num_threads) {
   br_current_ = current;
   quantize_ = quantize;
+  map_ = map;
   value_calculation_ = true;
 
   int max_street = Game::MaxStreet();
@@ -102,12 +103,20 @@ double RGBR::Go(int it, int p, const BettingAbstraction &ba) {
   if (br_current_) {
     regrets_.reset(new CFRValues(players.get(), streets, 0, 0, buckets_,
 				 betting_trees_->GetBettingTree()));
-    regrets_->Read(dir, it_, betting_trees_->GetBettingTree(), "x", -1, false, quantize_);
+    if (map_) {
+      regrets_->Map(dir, it_, betting_trees_->GetBettingTree(), "x", -1, false);
+    } else {
+      regrets_->Read(dir, it_, betting_trees_->GetBettingTree(), "x", -1, false, quantize_);
+    }
     sumprobs_.reset();
   } else {
     sumprobs_.reset(new CFRValues(players.get(), streets, 0, 0, buckets_,
 				  betting_trees_->GetBettingTree()));
-    sumprobs_->Read(dir, it_, betting_trees_->GetBettingTree(), "x", -1, true, quantize_);
+    if (map_) {
+      sumprobs_->Map(dir, it_, betting_trees_->GetBettingTree(), "x", -1, true);
+    } else {
+      sumprobs_->Read(dir, it_, betting_trees_->GetBettingTree(), "x", -1, true, quantize_);
+    }
     regrets_.reset();
   }
 
@@ -11,11 +11,13 @@ class CFRConfig;
 class RGBR : public CFRP {
 public:
   RGBR(const CardAbstraction &ca, const CFRConfig &cc, const Buckets &buckets, bool current,
-       bool quantize, int num_threads, const bool *streets);
+       bool quantize, int num_threads, const bool *streets, bool map);
   virtual ~RGBR(void);
   double Go(int it, int p, const BettingAbstraction &ba);
  private:
   bool quantize_;
+  // Map the strategy files into memory (CFRValues::Map()) rather than reading them
+  bool map_;
 };
 
 #endif
@@ -5,183 +5,456 @@
 // for the postflop streets we iterate through all raw boards.  For the
 // preflop we iterate through only the canonical boards so I had to worry
 // about this.
+//
+// The raw river boards are looked up in the table of canonical river boards.  A hand's strength
+// on a raw board is the strength of the suit-mapped hand on the canonical board.
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
+#include <memory>
 #include <vector>
 
 #include "board_tree.h"
+#include "canonical.h"
 #include "canonical_cards.h"
 #include "cards.h"
 #include "constants.h"
 #include "game.h"
 #include "hand_value_tree.h"
+#include "io.h"
 #include "rollout.h"
-#include "sorting.h"
 
-using std::pair;
+using std::unique_ptr;
 using std::vector;
 
-static short *RiverHandStrength(const Card *board, bool wins) {
-  int max_street = Game::MaxStreet();
-  int num_board_cards = Game::NumBoardCards(max_street);
-
-  vector<int> vb(num_board_cards);
-  for (int i = 0; i < num_board_cards; ++i) vb[i] = board[i];
-  std::sort(vb.begin(), vb.end());
-  int *sorted_board = new int[num_board_cards];
-  for (int i = 0; i < num_board_cards; ++i) {
-    sorted_board[(num_board_cards - 1) - i] = vb[i];
-  }
-  int num_hole_card_pairs = Game::NumHoleCardPairs(max_street);
-  vector< pair<int, int> > v(num_hole_card_pairs);
+// Counting values into a histogram costs the size of the value range per hand; sorting costs
+// about n log n for n values.  We count when a hand gets at least this fraction of the range.
+static const int kCountingRatio = 8;
+// Roughly how many bytes of features we compute before writing them out
+static const long long int kBatchBytes = 64LL << 20;
+
+// Hole card pair index of two cards given their indices among the cards not on the board.  Hole
+// card pairs are ordered by high card and then by low card.
+static int PairIndex(int a, int b) {
+  if (a < b) std::swap(a, b);
+  return a * (a - 1) / 2 + b;
+}
+
+static long long int Choose(int n, int k) {
+  long long int c = 1;
+  for (int i = 0; i < k; ++i) c = c * (n - i) / (i + 1);
+  return c;
+}
+
+// Fills in the hole card pairs that don't conflict with the board, in hole card pair order.
+static void BoardHands(const Card *board, int num_board_cards, int *his, int *los) {
   int max_card = Game::MaxCard();
-  int hole_cards[2];
   int hcp = 0;
   for (int hi = 1; hi <= max_card; ++hi) {
     if (InCards(hi, board, num_board_cards)) continue;
-    hole_cards[0] = hi;
     for (int lo = 0; lo < hi; ++lo) {
       if (InCards(lo, board, num_board_cards)) continue;
-      hole_cards[1] = lo;
-      int hv = HandValueTree::Val(sorted_board, hole_cards);
-      int enc = hi * (max_card + 1) + lo;
-      v[hcp] = std::make_pair(hv, enc);
+      his[hcp] = hi;
+      los[hcp] = lo;
       ++hcp;
     }
   }
-  delete [] sorted_board;
-  sort(v.begin(), v.end(), g_pii_lower_compare);
+}
+
+class RolloutThread {
+public:
+  RolloutThread(Rollout *rollout);
+  void BuildRiver(void);
+  void Preflop(void);
+  void Features(void);
+  void Run(void (RolloutThread::*f)(void));
+  void Join(void);
+  void Go(void) {(this->*f_)();}
+  const int *PreflopCounts(void) const {return preflop_counts_.get();}
+private:
+  void RiverStrengths(const Card *board, short *values);
+  void Deal(int nst, int num_left, int below);
+  void Tally(void);
+  void Percentiles(int num_hands, short *out);
+
+  Rollout *rollout_;
+  int max_street_;
+  int max_card_;
+  // Scratch space for RiverStrengths(); keys are hand value << 32 | hole card pair index
+  unique_ptr<long long int []> keys_;
+  unique_ptr<int []> river_his_;
+  unique_ptr<int []> river_los_;
+  unique_ptr<int []> seen_;
+  unique_ptr<int []> beats_;
+  unique_ptr<short []> river_values_;
+  // The board being rolled out and the hands on it
+  Card board_[7];
+  unique_ptr<int []> his_;
+  unique_ptr<int []> los_;
+  int num_hands_;
+  // Index of each card among the cards not on the canonical river board, and of each raw card
+  // after suit mapping; -1 for board cards.
+  unique_ptr<int []> canon_index_;
+  unique_ptr<int []> raw_index_;
+  // River strengths reached by each hand: histograms if counting, otherwise lists
+  vector<int> counts_;
+  vector<short> vals_;
+  vector<int> num_vals_;
+  unique_ptr<int []> preflop_counts_;
+  void (RolloutThread::*f_)(void);
+  pthread_t pthread_id_;
+};
+
+RolloutThread::RolloutThread(Rollout *rollout) {
+  rollout_ = rollout;
+  max_street_ = Game::MaxStreet();
+  max_card_ = Game::MaxCard();
+  int num_river_hcps = Game::NumHoleCardPairs(max_street_);
+  keys_.reset(new long long int[num_river_hcps]);
+  river_his_.reset(new int[num_river_hcps]);
+  river_los_.reset(new int[num_river_hcps]);
+  seen_.reset(new int[max_card_ + 1]);
+  beats_.reset(new int[num_river_hcps]);
+  river_values_.reset(new short[num_river_hcps]);
+  int max_num_hands = Game::NumHoleCardPairs(0);
+  his_.reset(new int[max_num_hands]);
+  los_.reset(new int[max_num_hands]);
+  num_hands_ = 0;
+  canon_index_.reset(new int[max_card_ + 1]);
+  raw_index_.reset(new int[max_card_ + 1]);
+  f_ = NULL;
+}
+
+// Computes the wins or WMLs of every hole card pair on the given river board, in hole card pair
+// order.
+void RolloutThread::RiverStrengths(const Card *board, short *values) {
+  int num_board_cards = Game::NumBoardCards(max_street_);
+  int sorted_board[7];
+  for (int i = 0; i < num_board_cards; ++i) sorted_board[i] = board[i];
+  std::sort(sorted_board, sorted_board + num_board_cards, std::greater<int>());
+  int num_hole_card_pairs = Game::NumHoleCardPairs(max_street_);
+  int *his = river_his_.get(), *los = river_los_.get();
+  BoardHands(board, num_board_cards, his, los);
+  int hole_cards[2];
+  for (int hcp = 0; hcp < num_hole_card_pairs; ++hcp) {
+    hole_cards[0] = his[hcp];
+    hole_cards[1] = los[hcp];
+    long long int hv = HandValueTree::Val(sorted_board, hole_cards);
+    keys_[hcp] = (hv << 32) | hcp;
+  }
+  std::sort(keys_.get(), keys_.get() + num_hole_card_pairs);
 
-  int num_enc = (max_card + 1) * (max_card + 1);
-  short *values = new short[num_enc];
-  // Necessary?
-  for (int i = 0; i < num_enc; ++i) values[i] = 32000;
   int num_cards_in_deck = Game::NumCardsInDeck();
   // The number of possible hole card pairs containing a given card
   int num_buddies = (num_cards_in_deck - num_board_cards) - 1;
-  int *seen = new int[max_card + 1];
-  for (int i = 0; i <= max_card; ++i) seen[i] = 0;
-  int *beats = new int[num_hole_card_pairs];
-  int last_hv = -1;
+  int *seen = seen_.get();
+  for (int i = 0; i <= max_card_; ++i) seen[i] = 0;
+  int *beats = beats_.get();
   int j = 0;
   while (j < num_hole_card_pairs) {
     int begin_range = j;
+    long long int hv = keys_[j] >> 32;
     // Make three passes through the range of equally strong hands
     // First pass computes win counts for each hand and finds end of range
     // Second pass updates cumulative counters
     // Third pass computes lose counts for each hand
-    while (j < num_hole_card_pairs) {
-      int hv = v[j].first;
-      int enc = v[j].second;
-      int hi = enc / (max_card + 1);
-      int lo = enc % (max_card + 1);
-      if (hv != last_hv) {
-	last_hv = hv;
-	if (j != 0) break;
-      }
-      beats[j] = begin_range - seen[hi] - seen[lo];
+    while (j < num_hole_card_pairs && (keys_[j] >> 32) == hv) {
+      int hcp = keys_[j] & 0xffffffff;
+      beats[j] = begin_range - seen[his[hcp]] - seen[los[hcp]];
       ++j;
     }
     // Positions begin_range...j-1 (inclusive) all have the same hand value
     for (int k = begin_range; k < j; ++k) {
-      int enc = v[k].second;
-      int hi = enc / (max_card + 1);
-      int lo = enc % (max_card + 1);
-      ++seen[hi];
-      ++seen[lo];
+      int hcp = keys_[k] & 0xffffffff;
+      ++seen[his[hcp]];
+      ++seen[los[hcp]];
     }
-    if (wins) {
-      for (int k = begin_range; k < j; ++k) {
-	int enc = v[k].second;
-	values[enc] = (short)beats[k];
-      }
-    } else {
-      short base_lose = num_hole_card_pairs - j;
-      for (int k = begin_range; k < j; ++k) {
-	int enc = v[k].second;
-	int hi = enc / (max_card + 1);
-	int lo = enc % (max_card + 1);
+    for (int k = begin_range; k < j; ++k) {
+      int hcp = keys_[k] & 0xffffffff;
+      if (rollout_->wins_) {
+	values[hcp] = (short)beats[k];
+      } else {
 	// With five-card boards, there should be 46 hole card pairs containing,
 	// say, Kc.  52 cards - 5 on board - Kc
-	short lose = base_lose -
-	  ((num_buddies - seen[hi]) + (num_buddies - seen[lo]));
-	// beats[k] and lose are the two values we care about
+	short lose = (num_hole_card_pairs - j) -
+	  ((num_buddies - seen[his[hcp]]) + (num_buddies - seen[los[hcp]]));
 	// beats[k] - lose is the WML
-	short wml = ((short)beats[k]) - lose;
-	values[enc] = wml;
-	// OutputTwoCards(hi, lo);
-	// printf(" %i %i %i %u\n", (int)wml, beats[k], (int)lose, enc);
+	values[hcp] = ((short)beats[k]) - lose;
       }
     }
   }
-  delete [] seen;
-  delete [] beats;
-  return values;
 }
 
-static void GetPercentiles(vector<short> &wmls, double *percentiles, int num_percentiles,
-			   short *my_percentiles) {
-  sort(wmls.begin(), wmls.end());
-  int num = wmls.size();
-  for (int i = 0; i < num_percentiles; ++i) {
-    double percentile = percentiles[i];
-    int j = percentile * (num - 1) + 0.5;
-    if (j >= num) {
-      fprintf(stderr, "OOB pct %f j %u num %u\n", percentile, j, num);
-      exit(-1);
+void RolloutThread::BuildRiver(void) {
+  int num_boards = BoardTree::NumBoards(max_street_);
+  int bd;
+  while ((bd = rollout_->next_bd_++) < num_boards) {
+    if (bd % 100000 == 0) fprintf(stderr, "River bd %i/%i\n", bd, num_boards);
+    RiverStrengths(BoardTree::Board(max_street_, bd),
+		   rollout_->river_.get() + bd * (long long int)rollout_->num_river_hcps_);
+  }
+}
+
+// Num cards left after board cards and hole cards for target player removed from deck.  Assume
+// two hole cards.
+static int PreflopMaxWML(void) {
+  int num_remaining = Game::NumCardsInDeck() - Game::NumBoardCards(Game::MaxStreet()) -
+    Game::NumCardsForStreet(0);
+  return num_remaining * (num_remaining - 1) / 2;
+}
+
+// Counts the river strengths of every raw hole card pair over the canonical river boards,
+// weighted by board count.
+void RolloutThread::Preflop(void) {
+  int max_wml = PreflopMaxWML();
+  int num_wmls = 2 * max_wml + 1;
+  int num_enc = (max_card_ + 1) * (max_card_ + 1);
+  if (! preflop_counts_) preflop_counts_.reset(new int[num_enc * num_wmls]);
+  int *counts = preflop_counts_.get();
+  for (int i = 0; i < num_enc * num_wmls; ++i) counts[i] = 0;
+  int num_board_cards = Game::NumBoardCards(max_street_);
+  int num_hole_card_pairs = Game::NumHoleCardPairs(max_street_);
+  int num_boards = BoardTree::NumBoards(max_street_);
+  int bd;
+  while ((bd = rollout_->next_bd_++) < num_boards) {
+    if (bd % 1000 == 0) fprintf(stderr, "bd %i/%i\n", bd, num_boards);
+    const Card *board = BoardTree::Board(max_street_, bd);
+    int board_count = BoardTree::BoardCount(max_street_, bd);
+    const short *values;
+    if (rollout_->river_) {
+      values = rollout_->RiverValues(bd);
+      BoardHands(board, num_board_cards, river_his_.get(), river_los_.get());
+    } else {
+      RiverStrengths(board, river_values_.get());
+      values = river_values_.get();
+    }
+    for (int hcp = 0; hcp < num_hole_card_pairs; ++hcp) {
+      int enc = river_his_[hcp] * (max_card_ + 1) + river_los_[hcp];
+      // The raw WML values can be negative.  They range from -990 to 990,
+      // I think, for full-deck holdem.  We normalize them to the range
+      // 0 to 1980.
+      counts[enc * num_wmls + values[hcp] + max_wml] += board_count;
+    }
+  }
+}
+
+// Deals the rest of street nst (num_left more cards, each below the last one dealt on the
+// street) and then the later streets, and tallies every complete board.
+void RolloutThread::Deal(int nst, int num_left, int below) {
+  if (num_left == 0) {
+    if (nst == max_street_) {
+      Tally();
+      return;
     }
-    short wml = wmls[j];
-    my_percentiles[i] = wml;
+    ++nst;
+    num_left = Game::NumCardsForStreet(nst);
+    below = max_card_ + 1;
+  }
+  int i = Game::NumBoardCards(nst) - num_left;
+  for (Card c = below - 1; c >= num_left - 1; --c) {
+    if (InCards(c, board_, i)) continue;
+    board_[i] = c;
+    Deal(nst, num_left - 1, c);
   }
 }
 
+// Adds the river strength of every hand on the raw river board in board_.
+void RolloutThread::Tally(void) {
+  Card canon_board[7];
+  int suit_mapping[4];
+  CanonicalizeCards(board_, nullptr, max_street_, canon_board, nullptr, suit_mapping);
+  const short *values =
+    rollout_->RiverValues(BoardTree::LookupBoard(canon_board, max_street_));
+  int num_board_cards = Game::NumBoardCards(max_street_);
+  int index = 0;
+  for (Card c = 0; c <= max_card_; ++c) {
+    canon_index_[c] = InCards(c, canon_board, num_board_cards) ? -1 : index++;
+  }
+  for (Card c = 0; c <= max_card_; ++c) {
+    raw_index_[c] = canon_index_[MakeCard(Rank(c), suit_mapping[Suit(c)])];
+  }
+  int num_vals = rollout_->num_vals_;
+  int val_offset = rollout_->val_offset_;
+  int num_completions = rollout_->num_completions_;
+  bool counting = rollout_->counting_;
+  for (int h = 0; h < num_hands_; ++h) {
+    int a = raw_index_[his_[h]];
+    int b = raw_index_[los_[h]];
+    if (a < 0 || b < 0) continue;
+    short v = values[PairIndex(a, b)];
+    if (counting) {
+      ++counts_[h * num_vals + v + val_offset];
+      ++num_vals_[h];
+    } else {
+      vals_[h * num_completions + num_vals_[h]++] = v;
+    }
+  }
+}
+
+// For each hand, the value at each percentile of the sorted river strengths.
+void RolloutThread::Percentiles(int num_hands, short *out) {
+  const double *percentiles = rollout_->percentiles_;
+  int num_percentiles = rollout_->num_percentiles_;
+  const int *pct_order = rollout_->pct_order_.get();
+  int num_vals = rollout_->num_vals_;
+  int val_offset = rollout_->val_offset_;
+  int num_completions = rollout_->num_completions_;
+  for (int h = 0; h < num_hands; ++h) {
+    int num = num_vals_[h];
+    short *vals = nullptr;
+    const int *counts = nullptr;
+    if (rollout_->counting_) {
+      counts = &counts_[h * num_vals];
+    } else {
+      vals = &vals_[h * num_completions];
+      std::sort(vals, vals + num);
+    }
+    // Walk the histogram once, visiting the percentiles from smallest to largest
+    int w = -1, cum = 0;
+    for (int i = 0; i < num_percentiles; ++i) {
+      int p = pct_order[i];
+      double percentile = percentiles[p];
+      int j = percentile * (num - 1) + 0.5;
+      if (j >= num) {
+	fprintf(stderr, "OOB pct %f j %u num %u\n", percentile, j, num);
+	exit(-1);
+      }
+      if (counts) {
+	while (cum <= j) cum += counts[++w];
+	out[h * num_percentiles + p] = w - val_offset;
+      } else {
+	out[h * num_percentiles + p] = vals[j];
+      }
+    }
+  }
+}
+
+// Computes the features for the boards of the current batch.  On the river there is one
+// strength per hand, so every percentile is that strength.
+void RolloutThread::Features(void) {
+  int st = rollout_->st_;
+  int num_board_cards = Game::NumBoardCards(st);
+  int num_percentiles = rollout_->num_percentiles_;
+  num_hands_ = Game::NumHoleCardPairs(st);
+  int bd;
+  while ((bd = rollout_->next_bd_++) < rollout_->batch_end_) {
+    const Card *board = BoardTree::Board(st, bd);
+    short *out = rollout_->batch_.get() +
+      (bd - rollout_->batch_begin_) * (long long int)num_hands_ * num_percentiles;
+    if (st == max_street_) {
+      const short *values;
+      if (rollout_->river_) {
+	values = rollout_->RiverValues(bd);
+      } else {
+	RiverStrengths(board, river_values_.get());
+	values = river_values_.get();
+      }
+      for (int h = 0; h < num_hands_; ++h) {
+	for (int p = 0; p < num_percentiles; ++p) out[h * num_percentiles + p] = values[h];
+      }
+      continue;
+    }
+    for (int i = 0; i < num_board_cards; ++i) board_[i] = board[i];
+    BoardHands(board, num_board_cards, his_.get(), los_.get());
+    if (rollout_->counting_) {
+      counts_.assign(num_hands_ * rollout_->num_vals_, 0);
+    } else {
+      vals_.resize(num_hands_ * rollout_->num_completions_);
+    }
+    num_vals_.assign(num_hands_, 0);
+    Deal(st, 0, 0);
+    Percentiles(num_hands_, out);
+  }
+}
+
+static void *thread_run(void *v_t) {
+  RolloutThread *t = (RolloutThread *)v_t;
+  t->Go();
+  return NULL;
+}
+
+void RolloutThread::Run(void (RolloutThread::*f)(void)) {
+  f_ = f;
+  pthread_create(&pthread_id_, NULL, thread_run, this);
+}
+
+void RolloutThread::Join(void) {
+  pthread_join(pthread_id_, NULL);
+}
+
+Rollout::Rollout(bool wins, int num_threads) {
+  wins_ = wins;
+  num_threads_ = num_threads;
+  num_river_hcps_ = Game::NumHoleCardPairs(Game::MaxStreet());
+  // Wins range from 0 to num_river_hcps_ - 1; WMLs from -(num_river_hcps_ - 1) to the same.
+  val_offset_ = wins ? 0 : num_river_hcps_ - 1;
+  num_vals_ = val_offset_ + num_river_hcps_;
+  st_ = -1;
+  percentiles_ = nullptr;
+  num_percentiles_ = 0;
+  num_completions_ = 0;
+  counting_ = false;
+  batch_begin_ = 0;
+  batch_end_ = 0;
+  next_bd_ = 0;
+  threads_.reset(new unique_ptr<RolloutThread>[num_threads_]);
+  for (int t = 0; t < num_threads_; ++t) {
+    threads_[t].reset(new RolloutThread(this));
+  }
+}
+
+Rollout::~Rollout(void) {
+}
+
+void Rollout::RunThreads(void (RolloutThread::*f)(void)) {
+  for (int i = 1; i < num_threads_; ++i) {
+    threads_[i]->Run(f);
+  }
+  // Execute thread 0 in main execution thread
+  (threads_[0].get()->*f)();
+  for (int i = 1; i < num_threads_; ++i) {
+    threads_[i]->Join();
+  }
+}
+
+void Rollout::BuildRiverTable(void) {
+  if (river_) return;
+  BoardTree::CreateLookup();
+  long long int num_boards = BoardTree::NumBoards(Game::MaxStreet());
+  long long int num_values = num_boards * num_river_hcps_;
+  fprintf(stderr, "River table: %lli boards, %lli bytes\n", num_boards,
+	  num_values * (long long int)sizeof(short));
+  river_.reset(new short[num_values]);
+  next_bd_ = 0;
+  RunThreads(&RolloutThread::BuildRiver);
+}
+
 // We need to pool the WMLs for all the variants of each canonical hand.
-// What about for the flop/turn/river?
-static short *ComputePreflopPercentiles(double *percentiles, int num_percentiles,
-					bool wins) {
+short Rollout::WritePreflop(Writer *writer) {
   BoardTree::BuildBoardCounts();
-  int max_street = Game::MaxStreet();
-  int num_ms_board_cards = Game::NumBoardCards(max_street);
-  // Num cards left after board cards and hole cards for target player
-  // removed from deck.
-  int num_remaining = Game::NumCardsInDeck() - num_ms_board_cards -
-    Game::NumCardsForStreet(0);
-  // Assume two hole cards
-  int max_wml = num_remaining * (num_remaining - 1) / 2;
+  next_bd_ = 0;
+  RunThreads(&RolloutThread::Preflop);
+
+  int max_wml = PreflopMaxWML();
   int num_wmls = 2 * max_wml + 1;
   int max_card = Game::MaxCard();
   int num_enc = (max_card + 1) * (max_card + 1);
-  int **wml_counts = new int *[num_enc];
-  for (int enc = 0; enc < num_enc; ++enc) {
-    wml_counts[enc] = new int[num_wmls];
-    for (int w = 0; w < num_wmls; ++w) wml_counts[enc][w] = 0;
-  }
-  int num_boards = BoardTree::NumBoards(max_street);
-  for (int bd = 0; bd < num_boards; ++bd) {
-    if (bd % 1000 == 0) fprintf(stderr, "bd %i/%i\n", bd, num_boards);
-    const Card *board = BoardTree::Board(max_street, bd);
-    int board_count = BoardTree::BoardCount(max_street, bd);
-    short *river_wmls = RiverHandStrength(board, wins);
-    for (int enc = 0; enc < num_enc; ++enc) {
-      short wml = river_wmls[enc];
-      if (wml != 32000) {
-	// The raw WML values can be negative.  They range from -990 to 990,
-	// I think, for full-deck holdem.  We normalize them to the range
-	// 0 to 1980.
-	int norm_wml = wml + max_wml;
-	wml_counts[enc][norm_wml] += board_count;
-      }
-    }
-    delete [] river_wmls;
+  unique_ptr<int []> wml_counts(new int[num_enc * num_wmls]);
+  memcpy(wml_counts.get(), threads_[0]->PreflopCounts(), num_enc * num_wmls * sizeof(int));
+  for (int t = 1; t < num_threads_; ++t) {
+    const int *counts = threads_[t]->PreflopCounts();
+    for (int i = 0; i < num_enc * num_wmls; ++i) wml_counts[i] += counts[i];
   }
+
   CanonicalCards preflop_hands(2, NULL, 0, 0, false);
   int num_hole_card_pairs = Game::NumHoleCardPairs(0);
-  int num_vals = num_hole_card_pairs * num_percentiles;
-  short *pct_vals = new short[num_vals];
+  const double *percentiles = percentiles_;
+  int num_percentiles = num_percentiles_;
+  unique_ptr<short []> pct_vals(new short[num_hole_card_pairs * num_percentiles]);
   // Take all the counts for non-canonical hands and add them to the
   // counts for the canonical hands.
   int hcp = 0;
@@ -191,8 +464,8 @@ static short *ComputePreflopPercentiles(double *percentiles, int num_percentiles
       if (preflop_hands.NumVariants(hcp) == 0) {
 	int canon_enc = preflop_hands.Canon(hcp);
 	for (int w = 0; w < num_wmls; ++w) {
-	  wml_counts[canon_enc][w] += wml_counts[enc][w];
-	  wml_counts[enc][w] = 0;
+	  wml_counts[canon_enc * num_wmls + w] += wml_counts[enc * num_wmls + w];
+	  wml_counts[enc * num_wmls + w] = 0;
 	}
       }
       ++hcp;
@@ -200,13 +473,13 @@ static short *ComputePreflopPercentiles(double *percentiles, int num_percentiles
   }
 
   hcp = 0;
-  int *canon_enc_to_hcp = new int[num_enc];
+  unique_ptr<int []> canon_enc_to_hcp(new int[num_enc]);
   for (int hi = 1; hi <= max_card; ++hi) {
     for (int lo = 0; lo < hi; ++lo) {
       if (preflop_hands.NumVariants(hcp) > 0) {
 	int enc = hi * (max_card + 1) + lo;
 	canon_enc_to_hcp[enc] = hcp;
-	int *counts = wml_counts[enc];
+	int *counts = &wml_counts[enc * num_wmls];
 	int sum_counts = 0;
 	for (int w = 0; w < num_wmls; ++w) sum_counts += counts[w];
 	int p = 0, cum = 0;
@@ -234,11 +507,6 @@ static short *ComputePreflopPercentiles(double *percentiles, int num_percentiles
     }
   }
 
-  for (int enc = 0; enc < num_enc; ++enc) {
-    delete [] wml_counts[enc];
-  }
-  delete [] wml_counts;
-
   // Copy the percentile values from the canonical hands to the
   // non-canonical ones.
   hcp = 0;
@@ -255,124 +523,56 @@ static short *ComputePreflopPercentiles(double *percentiles, int num_percentiles
     }
   }
 
-  delete [] canon_enc_to_hcp;
-
-  return pct_vals;
+  short max_val = kMinShort;
+  for (int i = 0; i < num_hole_card_pairs * num_percentiles; ++i) {
+    writer->WriteShort(pct_vals[i]);
+    if (pct_vals[i] > max_val) max_val = pct_vals[i];
+  }
+  return max_val;
 }
 
-// Not practical for preflop for full-deck holdem.
-static vector<short> *ComputeRollout(Card *board, bool wins, unsigned int st) {
-  unsigned int max_street = Game::MaxStreet();
-  unsigned int max_card = Game::MaxCard();
-  unsigned int num_enc = (max_card + 1) * (max_card + 1);
-  vector<short> *wmls = new vector<short>[num_enc];
-  if (st == max_street) {
-    short *wmls1 = RiverHandStrength(board, wins);
-    for (unsigned int i = 0; i < num_enc; ++i) {
-      short wml = wmls1[i];
-      if (wml != 32000) {
-	wmls[i].push_back(wml);
-      }
-    }
-    delete [] wmls1;
-  } else {
-    unsigned int num_board_cards = Game::NumBoardCards(st);
-    unsigned int nst = st + 1;
-    unsigned int num_new_board_cards = Game::NumCardsForStreet(nst);
-    if (num_new_board_cards == 1) {
-      for (unsigned int c = 0; c <= max_card; ++c) {
-	if (InCards(c, board, num_board_cards)) continue;
-	board[num_board_cards] = c;
-	vector<short> *next_wmls = ComputeRollout(board, wins, nst);
-	for (unsigned int i = 0; i < num_enc; ++i) {
-	  vector<short> &v = next_wmls[i];
-	  unsigned int num = v.size();
-	  for (unsigned int j = 0; j < num; ++j) {
-	    wmls[i].push_back(v[j]);
-	  }
-	}
-	delete [] next_wmls;
-      }
-    } else if (num_new_board_cards == 3) {
-      unsigned int hi, mid, lo;
-      for (hi = 2; hi <= max_card; ++hi) {
-	if (InCards(hi, board, num_board_cards)) continue;
-	board[num_board_cards] = hi;
-	for (mid = 1; mid < hi; ++mid) {
-	  if (InCards(mid, board, num_board_cards)) continue;
-	  board[num_board_cards + 1] = mid;
-	  for (lo = 0; lo < mid; ++lo) {
-	    board[num_board_cards + 2] = lo;
-	    vector<short> *next_wmls = ComputeRollout(board, wins, nst);
-	    for (unsigned int i = 0; i < num_enc; ++i) {
-	      vector<short> &v = next_wmls[i];
-	      unsigned int num = v.size();
-	      for (unsigned int j = 0; j < num; ++j) {
-		wmls[i].push_back(v[j]);
-	      }
-	    }
-	    delete [] next_wmls;
-	  }
-	}
-      }
-    } else {
-      fprintf(stderr, "Unhandled number of new board cards: %u\n",
-	      num_new_board_cards);
-      exit(-1);
-    }
+// On the flop and turn, deal out all the raw completions of the board and look up the river
+// strengths of every hand.  Boards are computed in parallel a batch at a time and written in
+// order.
+short Rollout::Write(int st, const double *percentiles, int num_percentiles, Writer *writer) {
+  int max_street = Game::MaxStreet();
+  if (st > 0 && st < max_street) BuildRiverTable();
+  st_ = st;
+  percentiles_ = percentiles;
+  num_percentiles_ = num_percentiles;
+  pct_order_.reset(new int[num_percentiles]);
+  for (int p = 0; p < num_percentiles; ++p) pct_order_[p] = p;
+  std::sort(pct_order_.get(), pct_order_.get() + num_percentiles,
+	    [percentiles](int p1, int p2) {return percentiles[p1] < percentiles[p2];});
+  if (st == 0) return WritePreflop(writer);
+
+  num_completions_ = 1;
+  int num_left = Game::NumCardsInDeck() - Game::NumBoardCards(st);
+  for (int nst = st + 1; nst <= max_street; ++nst) {
+    int num_street_cards = Game::NumCardsForStreet(nst);
+    num_completions_ *= Choose(num_left, num_street_cards);
+    num_left -= num_street_cards;
   }
-  return wmls;
-}
+  counting_ = num_completions_ * (long long int)kCountingRatio >= num_vals_;
 
-// On turn, deal out all river cards.  Compute WML for all hands.
-short *ComputeRollout(unsigned int st, double *percentiles, unsigned int num_percentiles,
-		      double squashing, bool wins) {
-  unsigned int num_boards = BoardTree::NumBoards(st);
-  unsigned int num_board_cards = Game::NumBoardCards(st);
-  unsigned int num_hole_card_pairs = Game::NumHoleCardPairs(st);
-  unsigned long long int num_hands = num_boards * num_hole_card_pairs;
-  unsigned long long int num_vals = num_hands * num_percentiles;
-  short *pct_vals;
-  if (st == 0) {
-    pct_vals = ComputePreflopPercentiles(percentiles, num_percentiles, wins);
-  } else {
-    pct_vals = new short[num_vals];
-    Card board[5];
-    for (unsigned int bd = 0; bd < num_boards; ++bd) {
-      if (bd % 1000 == 0) fprintf(stderr, "bd %i\n", bd);
-      const Card *st_board = BoardTree::Board(st, bd);
-      for (unsigned int i = 0; i < num_board_cards; ++i) {
-	board[i] = st_board[i];
-      }
-      unsigned int h = bd * num_hole_card_pairs;
-      vector<short> *wmls = ComputeRollout(board, wins, st);
-      unsigned int max_card = Game::MaxCard();
-      unsigned int num_enc = (max_card + 1) * (max_card + 1);
-      for (unsigned int i = 0; i < num_enc; ++i) {
-	vector<short> &v = wmls[i];
-	if (v.size() == 0) continue;
-	GetPercentiles(v, percentiles, num_percentiles, &pct_vals[h * num_percentiles]);
-	++h;
-      }
-      delete [] wmls;
+  int num_boards = BoardTree::NumBoards(st);
+  long long int num_board_vals = Game::NumHoleCardPairs(st) * (long long int)num_percentiles;
+  int batch_size = std::max(1LL, kBatchBytes / (num_board_vals * (long long int)sizeof(short)));
+  batch_size = std::min(batch_size, num_boards);
+  batch_.reset(new short[batch_size * num_board_vals]);
+  short max_val = kMinShort;
+  for (batch_begin_ = 0; batch_begin_ < num_boards; batch_begin_ = batch_end_) {
+    batch_end_ = std::min(batch_begin_ + batch_size, num_boards);
+    next_bd_ = batch_begin_;
+    RunThreads(&RolloutThread::Features);
+    long long int num_vals = (batch_end_ - batch_begin_) * num_board_vals;
+    for (long long int i = 0; i < num_vals; ++i) {
+      short val = batch_[i];
+      writer->WriteShort(val);
+      if (val > max_val) max_val = val;
     }
+    fprintf(stderr, "st %i bd %i/%i\n", st, batch_end_, num_boards);
   }
-  if (squashing == 1.0) {
-    return pct_vals;
-  }
-  short min_val = 32700;
-  short max_val = -32700;
-  for (unsigned long long int i = 0; i < num_vals; ++i) {
-    short val = pct_vals[i];
-    if (val < min_val) min_val = val;
-    if (val > max_val) max_val = val;
-  }
-  // Renormalize vals so that worse hands have higher values and the lowest
-  // value is zero.  Then squash by raising to the given power.
-  for (unsigned long long int i = 0; i < num_vals; ++i) {
-    short val = pct_vals[i];
-    short norm_val = -(val - max_val);
-    pct_vals[i] = (short)pow(norm_val, squashing);
-  }
-  return pct_vals;
+  batch_.reset();
+  return max_val;
 }
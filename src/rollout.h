@@ -1,10 +1,62 @@
 #ifndef _ROLLOUT_H_
 #define _ROLLOUT_H_
 
+#include <atomic>
+#include <memory>
+
 #include "cards.h"
 
-short *ComputeRollout(unsigned int st, double *percentiles,
-		      unsigned int num_percentiles,
-		      double squashing, bool wins);
+class RolloutThread;
+class Writer;
+
+// Computes features for every hand on every board of a street from the distribution of the hand's
+// river strength (wins or WMLs) over all the ways the rest of the board can come out.
+//
+// River strengths are computed once per canonical river board into a table shared by the
+// threads; the flop and turn features are then tallied from the table rather than by
+// reevaluating every river board reached.  The table has NumBoards(max street) *
+// NumHoleCardPairs(max street) shorts (about 5 GB for full holdem) and it relies on
+// BoardTree::CreateLookup().  Without the table, the preflop and river features are computed
+// directly.
+class Rollout {
+public:
+  Rollout(bool wins, int num_threads);
+  ~Rollout(void);
+  void BuildRiverTable(void);
+  // Writes num_percentiles shorts for each hand, in board order and then hole card pair order.
+  // Builds the river table first if st is a postflop street short of the river.  Returns the
+  // largest value written.
+  short Write(int st, const double *percentiles, int num_percentiles, Writer *writer);
+private:
+  friend class RolloutThread;
+
+  void RunThreads(void (RolloutThread::*f)(void));
+  short WritePreflop(Writer *writer);
+  const short *RiverValues(int rbd) const {
+    return river_.get() + rbd * (long long int)num_river_hcps_;
+  }
+
+  bool wins_;
+  int num_threads_;
+  std::unique_ptr<std::unique_ptr<RolloutThread> []> threads_;
+  int num_river_hcps_;
+  // Index into the histograms for a river strength of zero
+  int val_offset_;
+  int num_vals_;
+  std::unique_ptr<short []> river_;
+
+  // What the threads are working on
+  int st_;
+  const double *percentiles_;
+  int num_percentiles_;
+  // Indices of the percentiles from smallest to largest
+  std::unique_ptr<int []> pct_order_;
+  int num_completions_;
+  bool counting_;
+  int batch_begin_;
+  int batch_end_;
+  std::atomic<int> next_bd_;
+  std::unique_ptr<short []> batch_;
+};
 
 #endif
@@ -0,0 +1,345 @@
+// Load generator for run_acpc_server.  Each thread plays hands against the server: the
+// opponent's actions are random and our actions are whatever the server responds with.  The
+// server keeps one hand per connection, so a pipeline depth of N gives each thread N connections,
+// each carrying one hand at a time; the thread sends on all of them without waiting and handles
+// whichever response arrives first.  Reports the throughput and the latency seen by the clients.
+//
+// Example:
+//   ../bin/run_acpc_load holdem_params mb1b1_params localhost 9000 16 1000 1
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+
+#include "betting_abstraction.h"
+#include "betting_abstraction_params.h"
+#include "game.h"
+#include "game_params.h"
+#include "latency_stats.h"
+#include "nb_socket_io.h"
+#include "params.h"
+
+using std::string;
+using std::unique_ptr;
+
+// Matches run_acpc_server
+static const int kBigBlind = 100;
+static const int kResponseTimeoutSecs = 10;
+
+class SimHand {
+public:
+  SimHand(int hand_no, int stack_size, struct drand48_data *rand_buf);
+  ~SimHand(void) {}
+  // Plays the opponent's actions until it is our turn or the hand is over.
+  void PlayOpponent(struct drand48_data *rand_buf);
+  void ApplyOurAction(const string &response);
+  string Request(void) const;
+  bool Over(void) const {return over_;}
+private:
+  void Call(void);
+  void Raise(int new_bet_to);
+  string CardString(void) const;
+
+  int hand_no_;
+  int we_p_;
+  int stack_size_;
+  int cards_[9];
+  string action_;
+  int st_;
+  int pa_;
+  int bet_to_;
+  int street_start_;
+  bool call_ends_street_;
+  bool over_;
+};
+
+SimHand::SimHand(int hand_no, int stack_size, struct drand48_data *rand_buf) {
+  hand_no_ = hand_no;
+  we_p_ = hand_no % 2;
+  stack_size_ = stack_size;
+  int num_cards = Game::NumCardsInDeck();
+  int num_needed = 4 + Game::NumBoardCards(Game::MaxStreet());
+  for (int i = 0; i < num_needed; ++i) {
+    bool dup;
+    do {
+      long int r;
+      lrand48_r(rand_buf, &r);
+      cards_[i] = r % num_cards;
+      dup = false;
+      for (int j = 0; j < i; ++j) if (cards_[j] == cards_[i]) dup = true;
+    } while (dup);
+  }
+  st_ = 0;
+  pa_ = 1;
+  bet_to_ = kBigBlind;
+  street_start_ = kBigBlind;
+  call_ends_street_ = false;
+  over_ = false;
+}
+
+void SimHand::Call(void) {
+  action_ += "c";
+  if (! call_ends_street_) {
+    call_ends_street_ = true;
+    pa_ ^= 1;
+  } else if (st_ == Game::MaxStreet() || bet_to_ == stack_size_) {
+    over_ = true;
+  } else {
+    ++st_;
+    action_ += "/";
+    pa_ = 0;
+    call_ends_street_ = false;
+    street_start_ = bet_to_;
+  }
+}
+
+void SimHand::Raise(int new_bet_to) {
+  if (new_bet_to > stack_size_) new_bet_to = stack_size_;
+  if (new_bet_to <= bet_to_) {
+    Call();
+    return;
+  }
+  char buf[20];
+  sprintf(buf, "r%i", new_bet_to);
+  action_ += buf;
+  bet_to_ = new_bet_to;
+  call_ends_street_ = true;
+  pa_ ^= 1;
+}
+
+void SimHand::PlayOpponent(struct drand48_data *rand_buf) {
+  while (! over_ && pa_ != we_p_) {
+    bool facing_bet = bet_to_ > street_start_ || (st_ == 0 && ! call_ends_street_);
+    double r;
+    drand48_r(rand_buf, &r);
+    if (facing_bet && r < 0.1) {
+      action_ += "f";
+      over_ = true;
+    } else if (r < 0.55 || bet_to_ == stack_size_) {
+      Call();
+    } else {
+      double r2;
+      drand48_r(rand_buf, &r2);
+      Raise(bet_to_ + kBigBlind + (int)(r2 * 2 * bet_to_));
+    }
+  }
+}
+
+// The response is the request with our action appended after a colon, or "null".
+void SimHand::ApplyOurAction(const string &response) {
+  size_t colon = response.rfind(':');
+  if (response == "null" || colon == string::npos || colon + 1 == response.size()) {
+    over_ = true;
+    return;
+  }
+  char c = response[colon + 1];
+  if (c == 'f') {
+    action_ += "f";
+    over_ = true;
+  } else if (c == 'r') {
+    Raise(bet_to_ + atoi(response.c_str() + colon + 2));
+  } else {
+    Call();
+  }
+}
+
+static string CardToString(int c) {
+  static const char *kRanks = "23456789TJQKA";
+  static const char *kSuits = "cdhs";
+  int num_suits = Game::NumSuits();
+  string s;
+  s += kRanks[c / num_suits];
+  s += kSuits[c % num_suits];
+  return s;
+}
+
+string SimHand::CardString(void) const {
+  string hole = CardToString(cards_[0]) + CardToString(cards_[1]);
+  string s = we_p_ == 0 ? hole + "|" : "|" + hole;
+  int i = 4;
+  for (int st = 1; st <= st_; ++st) {
+    s += "/";
+    for (int j = 0; j < Game::NumCardsForStreet(st); ++j) s += CardToString(cards_[i++]);
+  }
+  return s;
+}
+
+string SimHand::Request(void) const {
+  char buf[100];
+  sprintf(buf, "MATCHSTATE:%i:%i:", we_p_, hand_no_);
+  return buf + action_ + ":" + CardString();
+}
+
+class LoadThread {
+public:
+  LoadThread(const string &host, int port, int stack_size, int num_hands, int depth, int t);
+  ~LoadThread(void) {}
+  void Run(void);
+  void RunThread(void);
+  void Join(void);
+  const LatencyStats &Stats(void) const {return stats_;}
+  long long int NumNulls(void) const {return num_nulls_;}
+private:
+  struct Conn {
+    unique_ptr<NBSocketIO> socket_io;
+    unique_ptr<SimHand> hand;
+    long long int sent_usecs;
+  };
+
+  bool Send(Conn *conn);
+  void Advance(Conn *conn);
+
+  const string &host_;
+  int port_;
+  int stack_size_;
+  int num_hands_;
+  int depth_;
+  int t_;
+  int next_hand_;
+  struct drand48_data rand_buf_;
+  LatencyStats stats_;
+  long long int num_nulls_;
+  pthread_t pthread_id_;
+};
+
+LoadThread::LoadThread(const string &host, int port, int stack_size, int num_hands, int depth,
+		       int t) :
+  host_(host), port_(port), stack_size_(stack_size), num_hands_(num_hands), depth_(depth),
+  t_(t) {
+  srand48_r(t, &rand_buf_);
+  next_hand_ = 0;
+  num_nulls_ = 0;
+}
+
+// Plays the opponent and sends a request if it is then our turn.  Returns false if the hand is
+// over instead.
+bool LoadThread::Send(Conn *conn) {
+  conn->hand->PlayOpponent(&rand_buf_);
+  if (conn->hand->Over()) return false;
+  conn->sent_usecs = LatencyStats::Now();
+  if (! conn->socket_io->WriteMessage(conn->hand->Request())) {
+    fprintf(stderr, "Thread %i: couldn't write request\n", t_);
+    exit(-1);
+  }
+  return true;
+}
+
+// Sends the next request on the connection, starting new hands as the current one ends.  Leaves
+// the connection without a hand once this thread's hands run out.
+void LoadThread::Advance(Conn *conn) {
+  while (! conn->hand || ! Send(conn)) {
+    if (next_hand_ == num_hands_) {
+      conn->hand.reset();
+      return;
+    }
+    // Hand numbers are unique across threads
+    conn->hand.reset(new SimHand(t_ * num_hands_ + next_hand_++, stack_size_, &rand_buf_));
+  }
+}
+
+void LoadThread::RunThread(void) {
+  unique_ptr<Conn []> conns(new Conn[depth_]);
+  for (int i = 0; i < depth_; ++i) {
+    conns[i].socket_io.reset(new NBSocketIO(host_.c_str(), port_));
+    if (! conns[i].socket_io->Valid()) {
+      fprintf(stderr, "Thread %i: couldn't connect to %s:%i\n", t_, host_.c_str(), port_);
+      exit(-1);
+    }
+  }
+  for (int i = 0; i < depth_; ++i) Advance(&conns[i]);
+  unique_ptr<struct pollfd []> pfds(new struct pollfd[depth_]);
+  unique_ptr<int []> pfd_conns(new int[depth_]);
+  while (true) {
+    int num_pfds = 0;
+    for (int i = 0; i < depth_; ++i) {
+      if (! conns[i].hand) continue;
+      pfds[num_pfds].fd = conns[i].socket_io->FD();
+      pfds[num_pfds].events = POLLIN;
+      pfd_conns[num_pfds++] = i;
+    }
+    if (num_pfds == 0) break;
+    if (poll(pfds.get(), num_pfds, kResponseTimeoutSecs * 1000) <= 0) {
+      fprintf(stderr, "Thread %i: no response from server\n", t_);
+      exit(-1);
+    }
+    for (int j = 0; j < num_pfds; ++j) {
+      if (pfds[j].revents == 0) continue;
+      Conn *conn = &conns[pfd_conns[j]];
+      string response;
+      if (! conn->socket_io->ReadMessage(&response, kResponseTimeoutSecs)) {
+	fprintf(stderr, "Thread %i: no response from server\n", t_);
+	exit(-1);
+      }
+      stats_.Record(LatencyStats::Now() - conn->sent_usecs);
+      if (response == "null") ++num_nulls_;
+      conn->hand->ApplyOurAction(response);
+      Advance(conn);
+    }
+  }
+}
+
+static void *load_thread_run(void *v_t) {
+  LoadThread *t = (LoadThread *)v_t;
+  t->RunThread();
+  return NULL;
+}
+
+void LoadThread::Run(void) {
+  pthread_create(&pthread_id_, NULL, load_thread_run, this);
+}
+
+void LoadThread::Join(void) {
+  pthread_join(pthread_id_, NULL);
+}
+
+static void Usage(const char *prog_name) {
+  fprintf(stderr, "USAGE: %s <game params> <betting params> <host> <port> <num threads> "
+	  "<hands per thread> <pipeline depth>\n", prog_name);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 8) Usage(argv[0]);
+  unique_ptr<Params> game_params = CreateGameParams();
+  game_params->ReadFromFile(argv[1]);
+  Game::Initialize(*game_params);
+  unique_ptr<Params> betting_params = CreateBettingAbstractionParams();
+  betting_params->ReadFromFile(argv[2]);
+  unique_ptr<BettingAbstraction>
+    betting_abstraction(new BettingAbstraction(*betting_params));
+  string host = argv[3];
+  int port, num_threads, num_hands, depth;
+  if (sscanf(argv[4], "%i", &port) != 1)                                  Usage(argv[0]);
+  if (sscanf(argv[5], "%i", &num_threads) != 1 || num_threads < 1)         Usage(argv[0]);
+  if (sscanf(argv[6], "%i", &num_hands) != 1 || num_hands < 1)             Usage(argv[0]);
+  if (sscanf(argv[7], "%i", &depth) != 1 || depth < 1)                     Usage(argv[0]);
+  if (Game::NumSuits() > 4 || Game::NumRanks() > 13) {
+    fprintf(stderr, "ACPC card strings require a standard deck\n");
+    exit(-1);
+  }
+  int stack_size = kBigBlind * betting_abstraction->StackSize();
+
+  unique_ptr<unique_ptr<LoadThread> []> threads(new unique_ptr<LoadThread>[num_threads]);
+  long long int start = LatencyStats::Now();
+  for (int t = 0; t < num_threads; ++t) {
+    threads[t].reset(new LoadThread(host, port, stack_size, num_hands, depth, t));
+    threads[t]->Run();
+  }
+  LatencyStats stats;
+  long long int num_nulls = 0;
+  for (int t = 0; t < num_threads; ++t) {
+    threads[t]->Join();
+    stats.Merge(threads[t]->Stats());
+    num_nulls += threads[t]->NumNulls();
+  }
+  double secs = (LatencyStats::Now() - start) / 1000000.0;
+  long long int num = stats.Count();
+  printf("%lli requests in %.2f secs (%.1f/sec); %lli null responses\n", num, secs,
+	 num / secs, num_nulls);
+  printf("Latency usecs: mean %.1f p50 %lli p99 %lli max %lli\n", stats.Mean(),
+	 stats.Percentile(0.5), stats.Percentile(0.99), stats.Max());
+}
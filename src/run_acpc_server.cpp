@@ -26,12 +26,14 @@ using std::unique_ptr;
 
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <card params> <betting params> "
-	  "<CFR params> <it> <seed> <port>\n", prog_name);
+	  "<CFR params> <it> <seed> <port> <num workers> <cache MB>\n", prog_name);
+  fprintf(stderr, "\n<cache MB> bounds the memory used to cache blocks of the sumprobs files "
+	  "when there is no compiled strategy; 0 turns the cache off.\n");
   exit(-1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 8) Usage(argv[0]);
+  if (argc != 10) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
@@ -47,17 +49,21 @@ int main(int argc, char *argv[]) {
   unique_ptr<Params> cfr_params = CreateCFRParams();
   cfr_params->ReadFromFile(argv[4]);
   unique_ptr<CFRConfig> cfr_config(new CFRConfig(*cfr_params));
-  int it, seed, port;
+  int it, seed, port, num_workers;
   if (sscanf(argv[5], "%i", &it) != 1)   Usage(argv[0]);
   if (sscanf(argv[6], "%i", &seed) != 1) Usage(argv[0]);
   if (sscanf(argv[7], "%i", &port) != 1) Usage(argv[0]);
+  if (sscanf(argv[8], "%i", &num_workers) != 1 || num_workers < 1) Usage(argv[0]);
+  long long int cache_mb;
+  if (sscanf(argv[9], "%lli", &cache_mb) != 1 || cache_mb < 0) Usage(argv[0]);
 
   BoardTree::Create();
   BoardTree::CreateLookup();
 
   int big_blind = 100;
 
-  Agent agent(*card_abstraction, *betting_abstraction, *cfr_config, it, big_blind, seed);
-  ACPCServer server(1, port, agent);
+  Agent agent(*card_abstraction, *betting_abstraction, *cfr_config, it, big_blind, seed,
+	      cache_mb << 20);
+  ACPCServer server(num_workers, port, agent);
   server.MainLoop();
 }
@@ -23,6 +23,7 @@
 #include "game_params.h"
 #include "io.h"
 #include "params.h"
+#include "resolving_method.h"
 #include "split.h"
 
 using std::string;
@@ -30,12 +31,19 @@ using std::unique_ptr;
 
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <card params> <betting params> <CFR params> <it> <seed> "
-	  "<hostname> <port>\n", prog_name);
+	  "<hostname> <port> <cache MB> [<subgame card params> <subgame betting params> "
+	  "<subgame CFR params> [unsafe|cfrd|combined] <resolve st> <resolve its> "
+	  "<resolve secs> <num resolve threads>]\n", prog_name);
+  fprintf(stderr, "\nWith the optional arguments, we resolve the rest of each hand when it "
+	  "reaches the resolve street, stopping early if need be to answer within resolve secs.  The "
+	  "subgame card abstraction must be unbucketed.\n");
+  fprintf(stderr, "<cache MB> bounds the memory used to cache blocks of the sumprobs files when "
+	  "there is no compiled strategy; 0 turns the cache off.\n");
   exit(-1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 9) Usage(argv[0]);
+  if (argc != 10 && argc != 18) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
@@ -57,15 +65,51 @@ int main(int argc, char *argv[]) {
   string hostname = argv[7];
   int port;
   if (sscanf(argv[8], "%i", &port) != 1) Usage(argv[0]);
+  long long int cache_mb;
+  if (sscanf(argv[9], "%lli", &cache_mb) != 1 || cache_mb < 0) Usage(argv[0]);
+  long long int cache_bytes = cache_mb << 20;
 
   BoardTree::Create();
   BoardTree::CreateLookup();
 
   int big_blind = 100;
 
-  Agent agent(*card_abstraction, *betting_abstraction, *cfr_config, it, big_blind, seed);
+  unique_ptr<Agent> agent;
+  unique_ptr<CardAbstraction> subgame_card_abstraction;
+  unique_ptr<BettingAbstraction> subgame_betting_abstraction;
+  unique_ptr<CFRConfig> subgame_cfr_config;
+  if (argc == 10) {
+    agent.reset(new Agent(*card_abstraction, *betting_abstraction, *cfr_config, it, big_blind,
+			  seed, cache_bytes));
+  } else {
+    unique_ptr<Params> subgame_card_params = CreateCardAbstractionParams();
+    subgame_card_params->ReadFromFile(argv[10]);
+    subgame_card_abstraction.reset(new CardAbstraction(*subgame_card_params));
+    unique_ptr<Params> subgame_betting_params = CreateBettingAbstractionParams();
+    subgame_betting_params->ReadFromFile(argv[11]);
+    subgame_betting_abstraction.reset(new BettingAbstraction(*subgame_betting_params));
+    unique_ptr<Params> subgame_cfr_params = CreateCFRParams();
+    subgame_cfr_params->ReadFromFile(argv[12]);
+    subgame_cfr_config.reset(new CFRConfig(*subgame_cfr_params));
+    string m = argv[13];
+    ResolvingMethod method;
+    if (m == "unsafe")        method = ResolvingMethod::UNSAFE;
+    else if (m == "cfrd")     method = ResolvingMethod::CFRD;
+    else if (m == "combined") method = ResolvingMethod::COMBINED;
+    else                      Usage(argv[0]);
+    int resolve_st, resolve_its, num_resolve_threads;
+    double resolve_secs;
+    if (sscanf(argv[14], "%i", &resolve_st) != 1)          Usage(argv[0]);
+    if (sscanf(argv[15], "%i", &resolve_its) != 1)         Usage(argv[0]);
+    if (sscanf(argv[16], "%lf", &resolve_secs) != 1)       Usage(argv[0]);
+    if (sscanf(argv[17], "%i", &num_resolve_threads) != 1) Usage(argv[0]);
+    agent.reset(new Agent(*card_abstraction, *betting_abstraction, *cfr_config,
+			  subgame_card_abstraction.get(), subgame_betting_abstraction.get(),
+			  subgame_cfr_config.get(), method, it, big_blind, resolve_st,
+			  resolve_its, resolve_secs, num_resolve_threads, seed, cache_bytes));
+  }
   fprintf(stderr, "Constructed agent\n");
-  Bot bot(agent, hostname, port);
+  Bot bot(*agent, hostname, port);
   fprintf(stderr, "Calling MainLoop\n");
   bot.MainLoop();
   fprintf(stderr, "Exited MainLoop\n");
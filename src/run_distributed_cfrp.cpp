@@ -0,0 +1,88 @@
+// Runs CFR+ with the boards of one street (DistributedStreet in the CFR params; by default the
+// flop) farmed out to worker processes.  Start the coordinator first and then the workers:
+//
+//   run_distributed_cfrp <params...> 8 coordinator 4000 2 1 200
+//   run_distributed_cfrp <params...> 8 worker coordhost 4000    (once per worker)
+//
+// All processes must see the same filesystem.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <string>
+
+#include "betting_abstraction.h"
+#include "betting_abstraction_params.h"
+#include "betting_trees.h"
+#include "buckets.h"
+#include "card_abstraction.h"
+#include "card_abstraction_params.h"
+#include "cfr_config.h"
+#include "cfr_params.h"
+#include "distributed_cfrp.h"
+#include "files.h"
+#include "game.h"
+#include "game_params.h"
+#include "params.h"
+
+using std::string;
+using std::unique_ptr;
+
+static void Usage(const char *prog_name) {
+  fprintf(stderr, "USAGE: %s <game params> <card params> <betting params> <CFR params> "
+	  "<num threads> coordinator <port> <num workers> <start it> <end it>\n", prog_name);
+  fprintf(stderr, "       %s <game params> <card params> <betting params> <CFR params> "
+	  "<num threads> worker <coordinator host> <port>\n", prog_name);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 7) Usage(argv[0]);
+  string role = argv[6];
+  if (role == "coordinator") {
+    if (argc != 11) Usage(argv[0]);
+  } else if (role == "worker") {
+    if (argc != 9) Usage(argv[0]);
+  } else {
+    Usage(argv[0]);
+  }
+  Files::Init();
+  unique_ptr<Params> game_params = CreateGameParams();
+  game_params->ReadFromFile(argv[1]);
+  Game::Initialize(*game_params);
+  unique_ptr<Params> card_params = CreateCardAbstractionParams();
+  card_params->ReadFromFile(argv[2]);
+  unique_ptr<CardAbstraction>
+    card_abstraction(new CardAbstraction(*card_params));
+  unique_ptr<Params> betting_params = CreateBettingAbstractionParams();
+  betting_params->ReadFromFile(argv[3]);
+  unique_ptr<BettingAbstraction>
+    betting_abstraction(new BettingAbstraction(*betting_params));
+  unique_ptr<Params> cfr_params = CreateCFRParams();
+  cfr_params->ReadFromFile(argv[4]);
+  unique_ptr<CFRConfig> cfr_config(new CFRConfig(*cfr_params));
+  int num_threads;
+  if (sscanf(argv[5], "%i", &num_threads) != 1) Usage(argv[0]);
+  if (cfr_config->Algorithm() != "cfrp") {
+    fprintf(stderr, "Unsupported algorithm: %s\n", cfr_config->Algorithm().c_str());
+    exit(-1);
+  }
+  Buckets buckets(*card_abstraction, false);
+
+  DistributedCFRP cfr(*card_abstraction, *cfr_config, buckets, num_threads);
+  if (role == "coordinator") {
+    int port, num_workers, start_it, end_it;
+    if (sscanf(argv[7], "%i", &port) != 1)        Usage(argv[0]);
+    if (sscanf(argv[8], "%i", &num_workers) != 1) Usage(argv[0]);
+    if (sscanf(argv[9], "%i", &start_it) != 1)    Usage(argv[0]);
+    if (sscanf(argv[10], "%i", &end_it) != 1)     Usage(argv[0]);
+    cfr.Initialize(*betting_abstraction, false);
+    cfr.RunCoordinator(port, num_workers, start_it, end_it);
+  } else {
+    int port;
+    if (sscanf(argv[8], "%i", &port) != 1) Usage(argv[0]);
+    cfr.Initialize(*betting_abstraction, true);
+    cfr.RunWorker(argv[7], port);
+  }
+}
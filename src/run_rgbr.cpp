@@ -27,7 +27,7 @@ using std::vector;
 
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <card params> <betting params> "
-	  "<CFR params> <num threads> <it> [current|avg] [quantize|raw] (<streets>)\n",
+	  "<CFR params> <num threads> <it> [current|avg] [quantize|raw|mmap] (<streets>)\n",
 	  prog_name);
   exit(-1);
 }
@@ -58,10 +58,11 @@ int main(int argc, char *argv[]) {
   else if (carg == "avg") current = false;
   else                    Usage(argv[0]);
   string qarg = argv[8];
-  bool quantize;
-  if (qarg == "quantize") quantize = true;
-  else if (qarg == "raw") quantize = false;
-  else                    Usage(argv[0]);
+  bool quantize = false, map = false;
+  if (qarg == "quantize")  quantize = true;
+  else if (qarg == "raw")  quantize = false;
+  else if (qarg == "mmap") map = true;
+  else                     Usage(argv[0]);
   int max_street = Game::MaxStreet();
   unique_ptr<bool []> streets(new bool[max_street + 1]);
   if (argc == 10) {
@@ -87,7 +88,7 @@ int main(int argc, char *argv[]) {
   for (int p = 0; p < num_players; ++p) evs[p] = 0;
 
   RGBR rgbr(*card_abstraction, *cfr_config, buckets, current, quantize, num_threads,
-	    streets.get());
+	    streets.get(), map);
   if (betting_abstraction->Asymmetric()) {
     if (num_players > 2) {
       fprintf(stderr, "How to handle more than two players?!?\n");
@@ -1,11 +1,15 @@
+#include <errno.h>
 #include <netdb.h> // gethostbyname(), hostent
 #include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
 #include <unistd.h> // gethostname()
 
 #include <memory>
 #include <queue>
 #include <string>
 
+#include "latency_stats.h"
 #include "logging.h"
 #include "nb_socket_io.h"
 #include "server.h"
@@ -19,31 +23,26 @@ Worker::Worker(Server *server) : server_(server) {
 }
 
 void Worker::MainLoop(void) {
-  queue<NBSocketIO *> *request_queue = server_->GetRequestQueue();
+  queue<Connection *> *run_queue = server_->GetRunQueue();
   pthread_mutex_t *queue_mutex = server_->GetQueueMutex();
   pthread_cond_t *queue_not_empty = server_->GetQueueNotEmpty();
-  pthread_cond_t *queue_not_full = server_->GetQueueNotFull();
 
   while (true) {
     pthread_mutex_lock(queue_mutex);
 
     // Wait while the queue is empty.
-    while (request_queue->empty()) {
+    while (run_queue->empty()) {
       pthread_cond_wait(queue_not_empty, queue_mutex);
     }
 
-    NBSocketIO *socket_io = request_queue->front();
-    request_queue->pop();
+    Connection *conn = run_queue->front();
+    run_queue->pop();
 
-    pthread_cond_signal(queue_not_full);
     pthread_mutex_unlock(queue_mutex);
 
-    // I used to WaitForReadable(1) here.  Don't think I need to now.  With blocking sockets,
-    // wanted to "fail fast", rather than waiting for read() to time out.
     busy_ = true;
-    server_->HandleRequest(socket_io);
+    server_->ServeRequest(conn);
     busy_ = false;
-    delete socket_io;
   }
 }
 
@@ -61,11 +60,22 @@ void Worker::Join(void) {
   pthread_join(pthread_id_, NULL);
 }
 
+Connection::Connection(NBSocketIO *socket_io, ConnectionState *state) :
+  socket_io_(socket_io), state_(state) {
+  scheduled_ = false;
+  paused_ = false;
+  closed_ = false;
+}
+
+Connection::~Connection(void) {
+}
+
 Server::Server(int num_workers, int port) :
   num_workers_(num_workers), port_(port) {
   pthread_mutex_init(&queue_mutex_, NULL);
   pthread_cond_init(&queue_not_empty_, NULL);
-  pthread_cond_init(&queue_not_full_, NULL);
+  num_connections_ = 0;
+  epoll_fd_ = -1;
   // If we don't do this, then when the server tries to write to a socket that has been closed,
   // the server exits.
   signal(SIGPIPE, SIG_IGN);
@@ -74,10 +84,10 @@ Server::Server(int num_workers, int port) :
 Server::~Server(void) {
   pthread_mutex_destroy(&queue_mutex_);
   pthread_cond_destroy(&queue_not_empty_);
-  pthread_cond_destroy(&queue_not_full_);
   for (int i = 0; i < num_workers_; ++i) {
     delete workers_[i];
   }
+  if (epoll_fd_ >= 0) close(epoll_fd_);
 }
 
 void Server::SpawnWorkers(void) {
@@ -88,48 +98,196 @@ void Server::SpawnWorkers(void) {
   }
 }
 
-void Server::MainLoop(void) {
-  fd_set listen_fds;
-  struct timeval tv;
+// Must be called with queue_mutex_ held.
+void Server::Schedule(Connection *conn) {
+  run_queue_.push(conn);
+  // Inform waiting threads that queue has a request
+  pthread_cond_signal(&queue_not_empty_);
+}
+
+void Server::ServeRequest(Connection *conn) {
+  pthread_mutex_lock(&queue_mutex_);
+  Request request = std::move(conn->pending_.front());
+  conn->pending_.pop_front();
+  if (conn->paused_ && ! conn->closed_ &&
+      (int)conn->pending_.size() <= kMaxPendingRequests / 2) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->socket_io_->FD(), &ev);
+    conn->paused_ = false;
+  }
+  pthread_mutex_unlock(&queue_mutex_);
 
+  string response;
+  HandleRequest(conn, request.message, &response);
+  // A failed write means the client has gone away, which the acceptor will notice.
+  conn->socket_io_->WriteMessage(response);
+  long long int latency = LatencyStats::Now() - request.arrival_usecs;
+  total_stats_.Record(latency);
+  interval_stats_.Record(latency);
+
+  bool done = false;
+  pthread_mutex_lock(&queue_mutex_);
+  if (conn->pending_.empty()) {
+    conn->scheduled_ = false;
+    done = conn->closed_;
+  } else {
+    // Back of the line
+    Schedule(conn);
+  }
+  pthread_mutex_unlock(&queue_mutex_);
+  if (done) delete conn;
+}
+
+void Server::Accept(void) {
+  // The listen socket is non-blocking, so this fails harmlessly if another client got there
+  // first.
+  unique_ptr<NBSocketIO> socket_io(new NBSocketIO(listen_sock_));
+  if (! socket_io->Valid()) return;
+  int fd = socket_io->FD();
+  Connection *conn = new Connection(socket_io.release(), CreateConnectionState());
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = conn;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    Warning("epoll_ctl() failed to add fd %i; errno %i\n", fd, errno);
+    delete conn;
+    return;
+  }
+  ++num_connections_;
+}
+
+// Called when the client has closed the connection or violated the protocol.
+void Server::Close(Connection *conn) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->socket_io_->FD(), NULL);
+  --num_connections_;
+  pthread_mutex_lock(&queue_mutex_);
+  conn->closed_ = true;
+  // Otherwise the worker deletes the connection once it has answered the pending requests.
+  bool done = ! conn->scheduled_;
+  pthread_mutex_unlock(&queue_mutex_);
+  if (done) delete conn;
+}
+
+// Moves the complete requests in the read buffer to the pending queue.  Returns false if the
+// client sent something other than a length-prefixed message.
+bool Server::ParseRequests(Connection *conn, long long int now) {
+  string &buf = conn->read_buf_;
+  size_t pos = 0;
+  bool ok = true;
+  pthread_mutex_lock(&queue_mutex_);
+  while (buf.size() - pos >= 10) {
+    char len_str[11];
+    buf.copy(len_str, 10, pos);
+    len_str[10] = 0;
+    int len;
+    if (sscanf(len_str, "%10d", &len) != 1 || len < 0 || len > kMaxRequestLen) {
+      ok = false;
+      break;
+    }
+    if (buf.size() - pos - 10 < (size_t)len) break;
+    Request request;
+    request.message.assign(buf, pos + 10, len);
+    request.arrival_usecs = now;
+    conn->pending_.push_back(std::move(request));
+    pos += 10 + len;
+  }
+  if (! conn->pending_.empty() && ! conn->scheduled_) {
+    conn->scheduled_ = true;
+    Schedule(conn);
+  }
+  if (ok && (int)conn->pending_.size() >= kMaxPendingRequests) {
+    // Stop reading until the workers catch up
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.ptr = conn;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->socket_io_->FD(), &ev);
+    conn->paused_ = true;
+  }
+  pthread_mutex_unlock(&queue_mutex_);
+  buf.erase(0, pos);
+  return ok;
+}
+
+void Server::ReadRequests(Connection *conn) {
+  int fd = conn->socket_io_->FD();
+  char buf[65536];
+  bool eof = false;
+  while (true) {
+    ssize_t ret = read(fd, buf, sizeof(buf));
+    if (ret > 0) {
+      conn->read_buf_.append(buf, ret);
+      if (ret < (ssize_t)sizeof(buf)) break;
+    } else if (ret == 0) {
+      eof = true;
+      break;
+    } else {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) eof = true;
+      break;
+    }
+  }
+  if (! ParseRequests(conn, LatencyStats::Now()) || eof) Close(conn);
+}
+
+void Server::OutputStats(void) {
+  long long int now = LatencyStats::Now();
+  double secs = (now - interval_start_usecs_) / 1000000.0;
+  long long int num = interval_stats_.Count();
+  if (num > 0) {
+    Output("%i connections; %lli requests in %.1f secs (%.1f/sec); latency usecs: p50 %lli "
+	   "p99 %lli max %lli; %lli requests total\n", num_connections_, num, secs, num / secs,
+	   interval_stats_.Percentile(0.5), interval_stats_.Percentile(0.99),
+	   interval_stats_.Max(), total_stats_.Count());
+  }
+  interval_stats_.Clear();
+  interval_start_usecs_ = now;
+}
+
+void Server::MainLoop(void) {
   SpawnWorkers();
 
-  listen_sock_ = GetListenSocket(port_);
+  listen_sock_ = GetNBListenSocket(port_);
   if (listen_sock_ < 0) {
     FatalError("Could not initialize listen_sock_\n");
   }
+  epoll_fd_ = epoll_create1(0);
+  if (epoll_fd_ < 0) {
+    FatalError("epoll_create1() failed; errno %i\n", errno);
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  // The listen socket is the only one without a connection
+  ev.data.ptr = nullptr;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_sock_, &ev) != 0) {
+    FatalError("epoll_ctl() failed on listen socket; errno %i\n", errno);
+  }
   launch_time_ = time(NULL);
   launch_timestamp_ = UTCTimestamp();
-  num_requests_ = 0;
+  interval_start_usecs_ = LatencyStats::Now();
 
   // A callback in which to take any actions that should occur before the execution of the main
   // loop.
   PreMainLoop();
-  
+
   Output("Listening for connection on port %i\n", port_);
 
+  struct epoll_event events[kMaxEvents];
   while (true) {
-    FD_ZERO(&listen_fds);
-    FD_SET(listen_sock_, &listen_fds);
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
-    // Wait for up to 1 second for a connection.
-    if (select(listen_sock_ + 1, &listen_fds, NULL, NULL, &tv) == 1) {
-      NBSocketIO *socket_io = new NBSocketIO(listen_sock_);
-      // Push onto the queue under mutex protection
-      pthread_mutex_lock(&queue_mutex_);
-
-      // Wait until there’s room in the queue.
-      while (request_queue_.size() == kRequestQueueMaxSize) {
-	pthread_cond_wait(&queue_not_full_, &queue_mutex_);
+    // Wait for up to 1 second so that the periodic actions get run
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, 1000);
+    for (int i = 0; i < num_events; ++i) {
+      Connection *conn = (Connection *)events[i].data.ptr;
+      if (conn == nullptr) {
+	Accept();
+      } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+	ReadRequests(conn);
       }
-      request_queue_.push(socket_io);
-      // Inform waiting threads that queue has a request
-      pthread_cond_signal(&queue_not_empty_);
-
-      pthread_mutex_unlock(&queue_mutex_);
     }
 
+    if (LatencyStats::Now() - interval_start_usecs_ >= kStatsIntervalSecs * 1000000LL) {
+      OutputStats();
+    }
     ExecutePeriodicActions();
   }
 }
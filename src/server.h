@@ -1,10 +1,15 @@
 #ifndef _SERVER_H_
 #define _SERVER_H_
 
+#include <pthread.h>
+
+#include <deque>
 #include <memory>
 #include <queue>
 #include <string>
 
+#include "latency_stats.h"
+
 class NBSocketIO;
 class Server;
 
@@ -22,37 +27,109 @@ protected:
   pthread_t pthread_id_;
 };
 
+// Whatever a Server subclass needs to remember about a client between requests; e.g., the state
+// of the match being played over the connection.
+class ConnectionState {
+public:
+  virtual ~ConnectionState(void) {}
+};
+
+struct Request {
+  std::string message;
+  // When the whole request had been read, in LatencyStats::Now() microseconds
+  long long int arrival_usecs;
+};
+
+// A client connection.  Requests and responses are length-prefixed messages, as written by
+// SocketIO::WriteMessage().  The acceptor reads requests as they arrive and queues them here,
+// so a client may send many requests without waiting for the responses.  At most one worker
+// handles a connection at a time, so the requests on a connection are handled, and responded
+// to, in the order they were sent.
+class Connection {
+public:
+  Connection(NBSocketIO *socket_io, ConnectionState *state);
+  ~Connection(void);
+  NBSocketIO *GetSocketIO(void) {return socket_io_.get();}
+  ConnectionState *GetState(void) {return state_.get();}
+private:
+  friend class Server;
+
+  std::unique_ptr<NBSocketIO> socket_io_;
+  std::unique_ptr<ConnectionState> state_;
+  // Bytes read that don't yet make up a whole request
+  std::string read_buf_;
+  std::deque<Request> pending_;
+  // True while the connection is on the run queue or being handled by a worker
+  bool scheduled_;
+  // True while we have stopped reading from the connection because too many requests are
+  // pending
+  bool paused_;
+  // True once the client has gone away.  The connection is deleted as soon as it is not
+  // scheduled.
+  bool closed_;
+};
+
+// A single acceptor thread waits on all the sockets with epoll.  It accepts connections, reads
+// requests and puts connections with pending requests on the run queue.  Workers take
+// connections off the run queue, handle one request and write the response.  A connection with
+// more requests pending goes to the back of the run queue so that busy clients can't starve the
+// others.
+//
+// Every kStatsIntervalSecs the server outputs the throughput and the p50/p99 latency of the
+// requests finished in the interval.  Latency is measured from when the acceptor has read the
+// whole request to when the response has been written.
 class Server {
 public:
   Server(int num_workers, int port);
   virtual ~Server(void);
   virtual void MainLoop(void);
-  virtual bool HandleRequest(NBSocketIO *socket_io) = 0;
-  std::queue<NBSocketIO *> *GetRequestQueue(void) {return &request_queue_;}
+  // Computes the response to a request.  Called by worker threads, so must be thread-safe;
+  // requests on the same connection are never handled concurrently, though.
+  virtual void HandleRequest(Connection *conn, const std::string &request,
+			     std::string *response) = 0;
+  // Returns the state to attach to a new connection; may be null.
+  virtual ConnectionState *CreateConnectionState(void) {return nullptr;}
+  virtual const char *ServerName(void) {return "";}
+  void ServeRequest(Connection *conn);
+  std::queue<Connection *> *GetRunQueue(void) {return &run_queue_;}
   pthread_mutex_t *GetQueueMutex(void) {return &queue_mutex_;}
   pthread_cond_t *GetQueueNotEmpty(void) {return &queue_not_empty_;}
-  pthread_cond_t *GetQueueNotFull(void) {return &queue_not_full_;}
-  virtual const char *ServerName(void) {return "";}
-  void IncrementNumRequests(void) {++num_requests_;}
-  int GetNumRequests(void) const {return num_requests_;}
+  long long int GetNumRequests(void) const {return total_stats_.Count();}
+  const LatencyStats &TotalStats(void) const {return total_stats_;}
 protected:
-  static const int kRequestQueueMaxSize = 100;
-  
+  // Stop reading from a connection when this many of its requests are pending and start again
+  // when half of them have been handled.
+  static const int kMaxPendingRequests = 100;
+  static const int kMaxRequestLen = 1 << 20;
+  static const int kMaxEvents = 256;
+  static const int kStatsIntervalSecs = 10;
+
   virtual void SpawnWorkers(void);
   virtual void PreMainLoop(void) {}
   virtual void ExecutePeriodicActions(void) {}
-  
+  void Accept(void);
+  void ReadRequests(Connection *conn);
+  bool ParseRequests(Connection *conn, long long int now);
+  void Close(Connection *conn);
+  void Schedule(Connection *conn);
+  void OutputStats(void);
+
   int num_workers_;
   int port_;
   int listen_sock_;
+  int epoll_fd_;
   std::unique_ptr<Worker * []> workers_;
   time_t launch_time_;
   std::string launch_timestamp_;
-  int num_requests_;
-  std::queue<NBSocketIO *> request_queue_;
+  // Connections with pending requests that no worker is handling.  Protected by queue_mutex_,
+  // as are the pending requests and flags of every connection.
+  std::queue<Connection *> run_queue_;
   pthread_mutex_t queue_mutex_;
   pthread_cond_t queue_not_empty_;
-  pthread_cond_t queue_not_full_;
+  int num_connections_;
+  LatencyStats total_stats_;
+  LatencyStats interval_stats_;
+  long long int interval_start_usecs_;
 };
 
 std::string GetHostname(void);
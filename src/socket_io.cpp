@@ -156,6 +156,23 @@ bool SocketIO::WriteMessage(const string &str) const {
   return true;
 }
 
+bool SocketIO::WriteNBytes(const char *bytes, int n) const {
+  if (n < 0 || n > kMaxMessageLen) {
+    Warning("SocketIO::WriteNBytes() bad n %i\n", n);
+    return false;
+  }
+  int cum = 0;
+  while (cum < n) {
+    ssize_t ret = write(fd_, bytes + cum, n - cum);
+    if (ret <= 0) {
+      Warning("SocketIO::WriteNBytes: failed to write; ret %i; n %i cum %i\n", (int)ret, n, cum);
+      return false;
+    }
+    cum += ret;
+  }
+  return true;
+}
+
 bool SocketIO::ReadNBytes(int n, char *bytes) const {
   if (n < 0 || n > kMaxMessageLen) {
     Warning("SocketIO::ReadNBytes() bad n %i\n", n);
@@ -16,6 +16,8 @@ public:
   bool WriteDouble(double d) const;
   // Doesn't use our protocol
   bool WriteRaw(const std::string &str) const;
+  // Writes exactly n bytes, looping over partial writes.  Suitable for binary data.
+  bool WriteNBytes(const char *bytes, int n) const;
   virtual bool ReadChar(char *c) const;
   virtual bool ReadInt(int *i) const;
   virtual bool ReadDouble(double *d) const;
@@ -10,13 +10,23 @@
 // strategy in (inside ReadBaseSubgameStrategy()).
 //
 // Should allow trunk sumprobs to be quantized.
+//
+// The walk of the trunk runs in the main thread and queues one job per subgame (street-initial
+// node and board) for a fixed pool of <num outer threads> workers.  A job is only admitted when
+// the estimated memory of the jobs in flight, its own included, fits in the RAM budget, so the
+// main thread blocks rather than letting large subgames pile up.  The budget covers the subgames
+// only; the base strategy and trunk hand tree come on top.  With "resume", subgames already in
+// the store from an earlier run are skipped.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "betting_abstraction.h"
@@ -45,15 +55,29 @@
 #include "params.h"
 #include "reach_probs.h"
 #include "split.h"
-#include "subgame_utils.h" // WriteSubgame()
+#include "subgame_store.h"
+#include "subgame_utils.h" // HaveSubgame(), WriteSubgame()
 #include "unsafe_eg_cfr.h"
 #include "vcfr.h"
+#include "work_stealing_pool.h"
 
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
+using std::unordered_map;
 using std::vector;
 
+// How often to report progress
+static const double kProgressSecs = 60.0;
+// Rough bytes per hand in a subgame hand tree
+static const long long int kHandBytes = 16;
+
+static double SecsSince(const struct timespec &start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1000000000.0;
+}
+
 class SubgameSolver {
 public:
   SubgameSolver(const CardAbstraction &base_card_abstraction,
@@ -64,22 +88,34 @@ public:
 		const Buckets &base_buckets, const Buckets &subgame_buckets, int solve_st,
 		ResolvingMethod method, bool cfrs, bool card_level, bool zero_sum, bool current,
 		const bool *pure_streets, bool base_mem, int base_it, int num_subgame_its,
-		int num_inner_threads, int num_outer_threads);
-  ~SubgameSolver(void) {}
+		int num_inner_threads, int num_outer_threads, double ram_budget_gb, bool resume);
+  ~SubgameSolver(void);
   void Walk(Node *node, const string &action_sequence, int gbd, const ReachProbs &reach_probs,
 	    int last_bet_size, int num_street_bets, int num_bets, int num_players_to_act,
 	    int last_st);
   void Walk(void);
 private:
+  // The subgame betting tree below one trunk node, shared by the jobs for all of its boards
+  struct SubgameTree {
+    unique_ptr<BettingTrees> subtrees;
+    // For each street, the total number of succs of the nonterminals on that street
+    unique_ptr<long long int []> street_succs;
+  };
+
   BettingTrees *CreateSubtrees(Node *node, int target_p, bool base);
-  void Split(Node *node, const string &action_sequence, int pgbd, const ReachProbs &reach_probs,
-	     int num_bets);
   void StreetInitial(Node *node, const string &action_sequence, int pgbd,
 		     const ReachProbs &reach_probs, int num_bets);
-  void ResolveUnsafe(Node *node, int gbd, const string &action_sequence,
-		     const ReachProbs &reach_probs);
-  void ResolveSafe(Node *node, int gbd, const string &action_sequence,
-		   const ReachProbs &reach_probs);
+  long long int CountSubgameRoots(Node *node, int last_st);
+  long long int SubgameBytes(const SubgameTree &tree, int gbd);
+  void Enqueue(Node *node, int gbd, const string &action_sequence,
+	       const ReachProbs &reach_probs);
+  void RunJob(Node *node, BettingTrees *subgame_subtrees, int gbd,
+	      const string &action_sequence, const ReachProbs &reach_probs, long long int bytes);
+  void ReportProgress(bool force);
+  void ResolveUnsafe(Node *node, BettingTrees *subgame_subtrees, int gbd,
+		     const string &action_sequence, const ReachProbs &reach_probs);
+  void ResolveSafe(Node *node, BettingTrees *subgame_subtrees, int gbd,
+		   const string &action_sequence, const ReachProbs &reach_probs);
 
   const CardAbstraction &base_card_abstraction_;
   const CardAbstraction &subgame_card_abstraction_;
@@ -93,6 +129,7 @@ private:
   unique_ptr<HandTree> trunk_hand_tree_;
   shared_ptr<CFRValues> trunk_sumprobs_;
   unique_ptr<DynamicCBR> dynamic_cbr_;
+  unique_ptr<SubgameStore> store_;
   int solve_st_;
   ResolvingMethod method_;
   bool cfrs_;
@@ -105,8 +142,22 @@ private:
   int num_subgame_its_;
   int num_inner_threads_;
   int num_outer_threads_;
-  int num_resolves_;
+  long long int ram_budget_;
+  bool resume_;
+  unordered_map<Node *, shared_ptr<SubgameTree>> subgame_trees_;
+  unique_ptr<WorkStealingPool> pool_;
+  TaskGroup jobs_;
+  // Guards everything below
+  pthread_mutex_t mutex_;
+  pthread_cond_t job_done_;
+  int num_jobs_in_flight_;
+  long long int bytes_in_flight_;
+  long long int num_subgames_;
+  long long int num_solved_;
+  long long int num_skipped_;
   double resolving_secs_;
+  struct timespec start_;
+  double last_report_secs_;
 };
 
 SubgameSolver::SubgameSolver(const CardAbstraction &base_card_abstraction,
@@ -118,7 +169,7 @@ SubgameSolver::SubgameSolver(const CardAbstraction &base_card_abstraction,
 			     int solve_st, ResolvingMethod method, bool cfrs, bool card_level,
 			     bool zero_sum, bool current, const bool *pure_streets, bool base_mem,
 			     int base_it, int num_subgame_its, int num_inner_threads,
-			     int num_outer_threads) :
+			     int num_outer_threads, double ram_budget_gb, bool resume) :
   base_card_abstraction_(base_card_abstraction),
   subgame_card_abstraction_(subgame_card_abstraction),
   base_betting_abstraction_(base_betting_abstraction),
@@ -137,6 +188,11 @@ SubgameSolver::SubgameSolver(const CardAbstraction &base_card_abstraction,
   num_subgame_its_ = num_subgame_its;
   num_inner_threads_ = num_inner_threads;
   num_outer_threads_ = num_outer_threads;
+  ram_budget_ = ram_budget_gb * 1024.0 * 1024.0 * 1024.0;
+  resume_ = resume;
+  pool_.reset(new WorkStealingPool(num_outer_threads_));
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&job_done_, NULL);
 
   base_betting_trees_.reset(new BettingTrees(base_betting_abstraction_));
 
@@ -176,6 +232,10 @@ SubgameSolver::SubgameSolver(const CardAbstraction &base_card_abstraction,
     fprintf(stderr, "Asymmetric not supported yet\n");
     exit(-1);
   }
+  // We only write, and check what is there when resuming, so there's no point caching anything
+  store_.reset(new SubgameStore(base_card_abstraction_, subgame_card_abstraction_,
+				base_betting_abstraction_, subgame_betting_abstraction_,
+				base_cfr_config_, subgame_cfr_config_, method_, 0, 0));
 #if 0
   // How do I handle this?
   if (base_betting_abstraction_.Asymmetric()) {
@@ -219,6 +279,11 @@ SubgameSolver::SubgameSolver(const CardAbstraction &base_card_abstraction,
   }
 }
 
+SubgameSolver::~SubgameSolver(void) {
+  pthread_cond_destroy(&job_done_);
+  pthread_mutex_destroy(&mutex_);
+}
+
 // Get rid of this; use CreateSubtrees() from subgame_utils.cpp instead
 // Assume no bet pending
 // Doesn't support multiplayer yet
@@ -243,93 +308,135 @@ BettingTrees *SubgameSolver::CreateSubtrees(Node *node, int target_p, bool base)
   return new BettingTrees(subtree_root.get());
 }
 
-class SSThread {
-public:
-  SSThread(Node *node, const string &action_sequence, int pgbd, const ReachProbs &reach_probs,
-	   int num_bets, SubgameSolver *solver, int thread_index, int num_threads);
-  ~SSThread(void) {}
-  void Run(void);
-  void Join(void);
-  void Go(void);
-private:
-  Node *node_;
-  string action_sequence_;
-  int pgbd_;
-  const ReachProbs &reach_probs_;
-  int num_bets_;
-  SubgameSolver *solver_;
-  int thread_index_;
-  int num_threads_;
-  pthread_t pthread_id_;
-};
-
-SSThread::SSThread(Node *node, const string &action_sequence, int pgbd,
-		   const ReachProbs &reach_probs, int num_bets, SubgameSolver *solver,
-		   int thread_index, int num_threads) :
-  node_(node), action_sequence_(action_sequence), pgbd_(pgbd), reach_probs_(reach_probs),
-  num_bets_(num_bets), solver_(solver), thread_index_(thread_index), num_threads_(num_threads) {
+void SubgameSolver::StreetInitial(Node *node, const string &action_sequence, int pgbd,
+				  const ReachProbs &reach_probs, int num_bets) {
+  int nst = node->Street();
+  int pst = node->Street() - 1;
+  int ngbd_begin = BoardTree::SuccBoardBegin(pst, pgbd, nst);
+  int ngbd_end = BoardTree::SuccBoardEnd(pst, pgbd, nst);
+  for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
+    Walk(node, action_sequence, ngbd, reach_probs, 0, 0, num_bets, 2, nst);
+  }
 }
 
-void SSThread::Go(void) {
-  int nst = node_->Street();
-  int pst = nst - 1;
-  int ngbd_begin = BoardTree::SuccBoardBegin(pst, pgbd_, nst);
-  int ngbd_end = BoardTree::SuccBoardEnd(pst, pgbd_, nst);
-  for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
-    if (ngbd % num_threads_ != thread_index_) continue;
-    // Street initial
-    solver_->Walk(node_, action_sequence_, ngbd, reach_probs_, 0, 0, num_bets_, 2, nst);
+// The number of street-initial nodes on the solve street that Walk() reaches.  Each is solved
+// once for every board on the solve street.
+long long int SubgameSolver::CountSubgameRoots(Node *node, int last_st) {
+  if (node->Terminal()) return 0;
+  int st = node->Street();
+  if (st > last_st && node->LastBetTo() == base_betting_abstraction_.StackSize()) return 0;
+  if (st == solve_st_) return 1;
+  long long int num_roots = 0;
+  int num_succs = node->NumSuccs();
+  for (int s = 0; s < num_succs; ++s) {
+    num_roots += CountSubgameRoots(node->IthSucc(s), st);
   }
+  return num_roots;
 }
 
-static void *ss_thread_run(void *v_t) {
-  SSThread *t = (SSThread *)v_t;
-  t->Go();
-  return NULL;
+static void CountSuccs(Node *node, long long int *street_succs) {
+  if (node->Terminal()) return;
+  int num_succs = node->NumSuccs();
+  street_succs[node->Street()] += num_succs;
+  for (int s = 0; s < num_succs; ++s) CountSuccs(node->IthSucc(s), street_succs);
 }
 
-void SSThread::Run(void) {
-  pthread_create(&pthread_id_, NULL, ss_thread_run, this);
+// An estimate of the memory needed to solve the subgame: the regrets and sumprobs (doubles) for
+// every board, hand and succ, plus the hand tree.
+long long int SubgameSolver::SubgameBytes(const SubgameTree &tree, int gbd) {
+  int root_st = tree.subtrees->Root()->Street();
+  int max_street = Game::MaxStreet();
+  long long int bytes = 0;
+  for (int st = root_st; st <= max_street; ++st) {
+    long long int num_hands =
+      BoardTree::NumLocalBoards(root_st, gbd, st) * (long long int)Game::NumHoleCardPairs(st);
+    bytes += num_hands * (tree.street_succs[st] * 2 * (long long int)sizeof(double) + kHandBytes);
+  }
+  return bytes;
 }
 
-void SSThread::Join(void) {
-  pthread_join(pthread_id_, NULL); 
+// Must be called with mutex_ held.
+void SubgameSolver::ReportProgress(bool force) {
+  double secs = SecsSince(start_);
+  if (! force && secs < last_report_secs_ + kProgressSecs) return;
+  last_report_secs_ = secs;
+  long long int num_done = num_solved_ + num_skipped_;
+  fprintf(stderr, "%lli/%lli subgames done (%lli skipped); %.0f secs", num_done, num_subgames_,
+	  num_skipped_, secs);
+  if (num_solved_ > 0 && num_done < num_subgames_) {
+    fprintf(stderr, "; ETA %.0f secs", secs * (num_subgames_ - num_done) / num_solved_);
+  }
+  fprintf(stderr, "\n");
 }
 
-void SubgameSolver::Split(Node *node, const string &action_sequence, int pgbd,
-			  const ReachProbs &reach_probs, int num_bets) {
-  unique_ptr<SSThread * []> threads(new SSThread *[num_outer_threads_]);
-  for (int t = 0; t < num_outer_threads_; ++t) {
-    threads[t] = new SSThread(node, action_sequence, pgbd, reach_probs, num_bets, this, t,
-			      num_outer_threads_);
+// Called from the main thread only.  Blocks until the job can be admitted.
+void SubgameSolver::Enqueue(Node *node, int gbd, const string &action_sequence,
+			    const ReachProbs &reach_probs) {
+  shared_ptr<SubgameTree> &tree = subgame_trees_[node];
+  if (! tree) {
+    int max_street = Game::MaxStreet();
+    tree.reset(new SubgameTree);
+    // Don't support asymmetric yet
+    tree->subtrees.reset(CreateSubtrees(node, 0, false));
+    tree->street_succs.reset(new long long int[max_street + 1]);
+    for (int st = 0; st <= max_street; ++st) tree->street_succs[st] = 0;
+    CountSuccs(tree->subtrees->Root(), tree->street_succs.get());
+  }
+  if (resume_ && HaveSubgame(action_sequence, tree->subtrees->Root(), gbd, store_.get())) {
+    pthread_mutex_lock(&mutex_);
+    ++num_skipped_;
+    ReportProgress(false);
+    pthread_mutex_unlock(&mutex_);
+    return;
   }
-  for (int t = 1; t < num_outer_threads_; ++t) threads[t]->Run();
-  // Do first thread in main thread
-  threads[0]->Go();
-  for (int t = 1; t < num_outer_threads_; ++t) threads[t]->Join();
-  for (int t = 0; t < num_outer_threads_; ++t) delete threads[t];
+  long long int bytes = SubgameBytes(*tree, gbd);
+  pthread_mutex_lock(&mutex_);
+  // A job too big for the budget still runs, but on its own.  Allowing two jobs per worker keeps
+  // the workers busy while the main thread computes the next reach probs.
+  while (num_jobs_in_flight_ > 0 &&
+	 (num_jobs_in_flight_ >= 2 * num_outer_threads_ ||
+	  bytes_in_flight_ + bytes > ram_budget_)) {
+    pthread_cond_wait(&job_done_, &mutex_);
+  }
+  ++num_jobs_in_flight_;
+  bytes_in_flight_ += bytes;
+  pthread_mutex_unlock(&mutex_);
+
+  // The reach probs passed in belong to the caller, so the job gets its own (shallow) copy.
+  int num_players = Game::NumPlayers();
+  shared_ptr<ReachProbs> job_reach_probs(ReachProbs::CreateRoot());
+  for (int p = 0; p < num_players; ++p) job_reach_probs->Set(p, reach_probs.Get(p));
+  pool_->Submit(&jobs_, [this, node, tree, gbd, action_sequence, job_reach_probs, bytes]() {
+    RunJob(node, tree->subtrees.get(), gbd, action_sequence, *job_reach_probs, bytes);
+  });
 }
 
-void SubgameSolver::StreetInitial(Node *node, const string &action_sequence, int pgbd,
-				  const ReachProbs &reach_probs, int num_bets) {
-  int nst = node->Street();
-  if (nst == 1 && num_outer_threads_ > 1) {
-    Split(node, action_sequence, pgbd, reach_probs, num_bets);
+void SubgameSolver::RunJob(Node *node, BettingTrees *subgame_subtrees, int gbd,
+			   const string &action_sequence, const ReachProbs &reach_probs,
+			   long long int bytes) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (method_ == ResolvingMethod::UNSAFE) {
+    ResolveUnsafe(node, subgame_subtrees, gbd, action_sequence, reach_probs);
   } else {
-    int pst = node->Street() - 1;
-    int ngbd_begin = BoardTree::SuccBoardBegin(pst, pgbd, nst);
-    int ngbd_end = BoardTree::SuccBoardEnd(pst, pgbd, nst);
-    for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
-      Walk(node, action_sequence, ngbd, reach_probs, 0, 0, num_bets, 2, nst);
-    }
+    ResolveSafe(node, subgame_subtrees, gbd, action_sequence, reach_probs);
   }
+  double secs = SecsSince(start);
+  pthread_mutex_lock(&mutex_);
+  --num_jobs_in_flight_;
+  bytes_in_flight_ -= bytes;
+  ++num_solved_;
+  resolving_secs_ += secs;
+  ReportProgress(false);
+  pthread_cond_broadcast(&job_done_);
+  pthread_mutex_unlock(&mutex_);
 }
 
 // Currently assume that this is a street-initial node.
 // Might need to do up to four solves.  Imagine we have an asymmetric base
 // betting tree, and an asymmetric solving method.
-void SubgameSolver::ResolveUnsafe(Node *node, int gbd, const string &action_sequence,
-				  const ReachProbs &reach_probs) {
+void SubgameSolver::ResolveUnsafe(Node *node, BettingTrees *subgame_subtrees, int gbd,
+				  const string &action_sequence, const ReachProbs &reach_probs) {
   int st = node->Street();
   fprintf(stderr, "ResolveUnsafe %s st %i nt %i gbd %i\n", action_sequence.c_str(), st,
 	  node->NonterminalID(), gbd);
@@ -347,94 +454,81 @@ void SubgameSolver::ResolveUnsafe(Node *node, int gbd, const string &action_sequ
     fprintf(stderr, "Method not supported yet\n");
     exit(-1);
   }
-  
-  int num_asym_players = base_betting_abstraction_.Asymmetric() ? num_players : 1;
-  for (int asym_p = 0; asym_p < num_asym_players; ++asym_p) {
-    BettingTrees *base_subtrees = nullptr;
-    BettingTrees *subgame_subtrees = CreateSubtrees(node, asym_p, false);
-    if (! base_mem_) {
-      fprintf(stderr, "base_mem_ false not supported currently\n");
-      exit(-1);
+
+  // The constructor rejects asymmetric base betting abstractions, so the subgame is solved once
+  // for the only target player.
+  BettingTrees *base_subtrees = nullptr;
+  if (! base_mem_) {
+    fprintf(stderr, "base_mem_ false not supported currently\n");
+    exit(-1);
 #if 0
-      base_subtrees = CreateSubtrees(node, asym_p, true);
-      // The action sequence passed in should specify the root of the system
-      // we are reading (the base system).
-      // We never finished implementing this function.
-      unique_ptr<CFRValues> base_subgame_strategy =
-	    ReadBaseSubgameStrategy(base_card_abstraction_, base_betting_abstraction_,
-				    base_cfr_config_, base_betting_trees_.get(), base_buckets_,
-				    subgame_buckets_, base_it_, node,  gbd, "x", reach_probs,
-				    base_subtrees, current_, asym_p);
-      // We are calculating CBRs from the *base* strategy, not the resolved
-      // endgame strategy.  So pass in base_card_abstraction_, etc.
-      dynamic_cbr_.reset(new DynamicCBR2(base_card_abstraction_, base_betting_abstraction_,
-					 base_cfr_config_, base_buckets_, 1));
-      if (current_) dynamic_cbr_->MoveRegrets(base_subgame_strategy);
-      else          dynamic_cbr_->MoveSumprobs(base_subgame_strategy);
+    base_subtrees = CreateSubtrees(node, 0, true);
+    // The action sequence passed in should specify the root of the system
+    // we are reading (the base system).
+    // We never finished implementing this function.
+    unique_ptr<CFRValues> base_subgame_strategy =
+	  ReadBaseSubgameStrategy(base_card_abstraction_, base_betting_abstraction_,
+				  base_cfr_config_, base_betting_trees_.get(), base_buckets_,
+				  subgame_buckets_, base_it_, node,  gbd, "x", reach_probs,
+				  base_subtrees, current_, 0);
+    // We are calculating CBRs from the *base* strategy, not the resolved
+    // endgame strategy.  So pass in base_card_abstraction_, etc.
+    dynamic_cbr_.reset(new DynamicCBR2(base_card_abstraction_, base_betting_abstraction_,
+				       base_cfr_config_, base_buckets_, 1));
+    if (current_) dynamic_cbr_->MoveRegrets(base_subgame_strategy);
+    else          dynamic_cbr_->MoveSumprobs(base_subgame_strategy);
 #endif
-    }
+  }
 
-    if (method_ == ResolvingMethod::UNSAFE) {
-      // One solve for unsafe endgame solving, no t_vals
-      struct timespec start, finish;
-      clock_gettime(CLOCK_MONOTONIC, &start);
-      eg_cfr->SolveSubgame(subgame_subtrees, gbd, reach_probs, action_sequence, &hand_tree, nullptr,
-			   -1, true, num_subgame_its_);
-      clock_gettime(CLOCK_MONOTONIC, &finish);
-      resolving_secs_ += (finish.tv_sec - start.tv_sec);
-      resolving_secs_ += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
-      num_resolves_ += 1;
-      // Write out the P0 and P1 strategies
-      for (int solve_p = 0; solve_p < num_players; ++solve_p) {
-	WriteSubgame(subgame_subtrees->Root(), action_sequence, action_sequence, gbd,
-		     base_card_abstraction_, subgame_card_abstraction_, base_betting_abstraction_,
-		     subgame_betting_abstraction_, base_cfr_config_, subgame_cfr_config_, method_,
-		     eg_cfr->Sumprobs().get(), st, gbd, asym_p, solve_p, st);
+  if (method_ == ResolvingMethod::UNSAFE) {
+    // One solve for unsafe endgame solving, no t_vals
+    eg_cfr->SolveSubgame(subgame_subtrees, gbd, reach_probs, action_sequence, &hand_tree, nullptr,
+			 -1, true, num_subgame_its_);
+    // Write out the P0 and P1 strategies
+    for (int solve_p = 0; solve_p < num_players; ++solve_p) {
+      WriteSubgame(subgame_subtrees->Root(), action_sequence, action_sequence, gbd,
+		   eg_cfr->Sumprobs().get(), st, gbd, solve_p, st, store_.get());
+    }
+  } else {
+    for (int solve_p = 0; solve_p < num_players; ++solve_p) {
+      // What should I be supplying for the betting abstraction, CFR
+      // config and betting tree?  Does it matter?
+      if (! card_level_) {
+	fprintf(stderr, "DynamicCBR cannot compute bucket-level CVs\n");
+	exit(-1);
       }
-    } else {
-      for (int solve_p = 0; solve_p < num_players; ++solve_p) {
-	// What should I be supplying for the betting abstraction, CFR
-	// config and betting tree?  Does it matter?
-	if (! card_level_) {
-	  fprintf(stderr, "DynamicCBR cannot compute bucket-level CVs\n");
-	  exit(-1);
-	}
-	shared_ptr<double []> t_vals;
-	if (method_ != ResolvingMethod::UNSAFE) {
-	  if (base_mem_) {
-	    // When base_mem_ is true, we use a global betting tree, a global
-	    // hand tree and have a global base strategy.
-	    // We assume that pure_streets_[st] tells us whether to purify
-	    // for the entire endgame.
-	    t_vals = dynamic_cbr_->Compute(node, reach_probs, gbd, trunk_hand_tree_.get(),
-					   solve_p^1, cfrs_, zero_sum_, current_,
-					   pure_streets_[st]);
-	  } else {
-	    t_vals = dynamic_cbr_->Compute(base_subtrees->Root(), reach_probs, gbd, &hand_tree,
-					   solve_p^1, cfrs_, zero_sum_, current_,
-					   pure_streets_[st]);
-	  }
+      shared_ptr<double []> t_vals;
+      if (method_ != ResolvingMethod::UNSAFE) {
+	if (base_mem_) {
+	  // When base_mem_ is true, we use a global betting tree, a global
+	  // hand tree and have a global base strategy.
+	  // We assume that pure_streets_[st] tells us whether to purify
+	  // for the entire endgame.
+	  t_vals = dynamic_cbr_->Compute(node, reach_probs, gbd, trunk_hand_tree_.get(),
+					 solve_p^1, cfrs_, zero_sum_, current_,
+					 pure_streets_[st]);
+	} else {
+	  t_vals = dynamic_cbr_->Compute(base_subtrees->Root(), reach_probs, gbd, &hand_tree,
+					 solve_p^1, cfrs_, zero_sum_, current_,
+					 pure_streets_[st]);
 	}
+      }
 
-	// Pass in false for both_players.  I am doing separate solves for
-	// each player.
-	eg_cfr->SolveSubgame(subgame_subtrees, gbd, reach_probs, action_sequence, &hand_tree,
-			     t_vals.get(), solve_p, false, num_subgame_its_);
+      // Pass in false for both_players.  I am doing separate solves for
+      // each player.
+      eg_cfr->SolveSubgame(subgame_subtrees, gbd, reach_probs, action_sequence, &hand_tree,
+			   t_vals.get(), solve_p, false, num_subgame_its_);
 
-	WriteSubgame(subgame_subtrees->Root(), action_sequence, action_sequence, gbd,
-		     base_card_abstraction_, subgame_card_abstraction_, base_betting_abstraction_,
-		     subgame_betting_abstraction_, base_cfr_config_, subgame_cfr_config_, method_,
-		     eg_cfr->Sumprobs().get(), st, gbd, asym_p, solve_p, st);
-      }
+      WriteSubgame(subgame_subtrees->Root(), action_sequence, action_sequence, gbd,
+		   eg_cfr->Sumprobs().get(), st, gbd, solve_p, st, store_.get());
     }
-  
-    delete base_subtrees;
-    delete subgame_subtrees;
   }
+
+  delete base_subtrees;
 }
 
-void SubgameSolver::ResolveSafe(Node *node, int gbd, const string &action_sequence,
-				const ReachProbs &reach_probs) {
+void SubgameSolver::ResolveSafe(Node *node, BettingTrees *subgame_subtrees, int gbd,
+				const string &action_sequence, const ReachProbs &reach_probs) {
   int st = node->Street();
   fprintf(stderr, "ResolveSafe %s st %i nt %i gbd %i\n", action_sequence.c_str(), st,
 	  node->NonterminalID(), gbd);
@@ -453,8 +547,6 @@ void SubgameSolver::ResolveSafe(Node *node, int gbd, const string &action_sequen
     fprintf(stderr, "ResolveSafe unsupported method\n");
     exit(-1);
   }
-  // Don't support asymmetric yet
-  unique_ptr<BettingTrees> subgame_subtrees(CreateSubtrees(node, 0, false));
   for (int solve_p = 0; solve_p < num_players; ++solve_p) {
     if (! card_level_) {
       fprintf(stderr, "DynamicCBR cannot compute bucket-level CVs\n");
@@ -472,21 +564,13 @@ void SubgameSolver::ResolveSafe(Node *node, int gbd, const string &action_sequen
       t_vals = dynamic_cbr_->Compute(node, reach_probs, gbd, &hand_tree, solve_p^1, cfrs_,
 				     zero_sum_, current_, pure_streets_[st]);
     }
-    struct timespec start, finish;
-    clock_gettime(CLOCK_MONOTONIC, &start);
     // Pass in false for both_players.  I am doing separate solves for
     // each player.
-    eg_cfr->SolveSubgame(subgame_subtrees.get(), gbd, reach_probs, action_sequence, &hand_tree,
+    eg_cfr->SolveSubgame(subgame_subtrees, gbd, reach_probs, action_sequence, &hand_tree,
 			 t_vals.get(), solve_p, false, num_subgame_its_);
-    clock_gettime(CLOCK_MONOTONIC, &finish);
-    resolving_secs_ += (finish.tv_sec - start.tv_sec);
-    resolving_secs_ += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
-    num_resolves_ += 1;
 
     WriteSubgame(subgame_subtrees->Root(), action_sequence, action_sequence, gbd,
-		 base_card_abstraction_, subgame_card_abstraction_, base_betting_abstraction_,
-		 subgame_betting_abstraction_, base_cfr_config_, subgame_cfr_config_, method_,
-		 eg_cfr->Sumprobs().get(), st, gbd, 0, solve_p, st);
+		 eg_cfr->Sumprobs().get(), st, gbd, solve_p, st, store_.get());
   }
 }
 
@@ -507,11 +591,7 @@ void SubgameSolver::Walk(Node *node, const string &action_sequence, int gbd,
     // Do we assume that this is a street-initial node?
     // We do assume no bet pending
     // Skip if we are already all in?
-    if (method_ == ResolvingMethod::UNSAFE) {
-      ResolveUnsafe(node, gbd, action_sequence, reach_probs);
-    } else {
-      ResolveSafe(node, gbd, action_sequence, reach_probs);
-    }
+    Enqueue(node, gbd, action_sequence, reach_probs);
     return;
   }
 
@@ -540,15 +620,24 @@ void SubgameSolver::Walk(Node *node, const string &action_sequence, int gbd,
 }
 
 void SubgameSolver::Walk(void) {
-  num_resolves_ = 0;
+  num_jobs_in_flight_ = 0;
+  bytes_in_flight_ = 0;
+  num_subgames_ = CountSubgameRoots(base_betting_trees_->Root(), 0) *
+    (long long int)BoardTree::NumBoards(solve_st_);
+  num_solved_ = 0;
+  num_skipped_ = 0;
   resolving_secs_ = 0.0;
+  clock_gettime(CLOCK_MONOTONIC, &start_);
+  last_report_secs_ = 0.0;
   int last_bet_size = Game::BigBlind() - Game::SmallBlind();
   unique_ptr<ReachProbs> reach_probs(ReachProbs::CreateRoot());
   Walk(base_betting_trees_->Root(), "x", 0, *reach_probs, last_bet_size, 0, 0, 2, 0);
-  if (num_resolves_ > 0) {
-    fprintf(stderr, "Avg resolve: %f secs (%f/%i)\n", resolving_secs_ / num_resolves_,
-	    resolving_secs_, num_resolves_);
-  } else {
+  pool_->Wait(&jobs_);
+  ReportProgress(true);
+  if (num_solved_ > 0) {
+    fprintf(stderr, "Avg subgame: %f secs (%f/%lli)\n", resolving_secs_ / num_solved_,
+	    resolving_secs_, num_solved_);
+  } else if (num_skipped_ == 0) {
     fprintf(stderr, "No resolves?!?\n");
   }
 }
@@ -558,7 +647,7 @@ static void Usage(const char *prog_name) {
 	  "<base betting params> <subgame betting params> <base CFR params> <subgame CFR params> "
 	  "<solve street> <base it> <num subgame its> [unsafe|cfrd|maxmargin|combined] [cbrs|cfrs] "
 	  "[card|bucket] [zerosum|raw] [current|avg] <pure streets> [mem|disk] "
-	  "<num inner threads> <num outer threads>\n", prog_name);
+	  "<num inner threads> <num outer threads> <RAM budget GB> [new|resume]\n", prog_name);
   fprintf(stderr, "\n");
   fprintf(stderr, "\"current\" or \"avg\" signifies whether we use the opponent's current strategy "
 	  "(from regrets) in the subgame CBR calculation, or, as per usual, the avg strategy (from "
@@ -577,12 +666,17 @@ static void Usage(const char *prog_name) {
   fprintf(stderr, "We support two different methods of multithreading.  The first type is the "
 	  "multithreading inside of VCFR.  The second type is the multithreading inside of "
 	  "solve_all_subgames.  <num inner threads> controls the first type; <num outer threads> "
-	  "controls the second type.\n");
+	  "controls the second type: a fixed pool of workers, each solving one subgame at a "
+	  "time.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "<RAM budget GB> bounds the estimated memory of the subgames being solved at "
+	  "once; the base strategy is not included.  \"new\" deletes any subgames from an "
+	  "earlier run; \"resume\" keeps them and only solves the subgames that are missing.\n");
   exit(-1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 20) Usage(argv[0]);
+  if (argc != 22) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
@@ -660,6 +754,14 @@ int main(int argc, char *argv[]) {
   int num_inner_threads, num_outer_threads;
   if (sscanf(argv[18], "%i", &num_inner_threads) != 1) Usage(argv[0]);
   if (sscanf(argv[19], "%i", &num_outer_threads) != 1) Usage(argv[0]);
+  if (num_outer_threads < 1)                           Usage(argv[0]);
+  double ram_budget_gb;
+  if (sscanf(argv[20], "%lf", &ram_budget_gb) != 1)    Usage(argv[0]);
+  string r = argv[21];
+  bool resume;
+  if (r == "new")         resume = false;
+  else if (r == "resume") resume = true;
+  else                    Usage(argv[0]);
 
   if (num_inner_threads > 1 && solve_st == max_street) {
     fprintf(stderr, "Can't have num_inner_threads > 1 if solve_st == max_street\n");
@@ -673,15 +775,18 @@ int main(int argc, char *argv[]) {
   BoardTree::Create();
   HandValueTree::Create();
 
+  // Before the solver opens the store
+  if (! resume) {
+    for (int asym_p = 0; asym_p <= 1; ++asym_p) {
+      DeleteAllSubgames(*base_card_abstraction, *subgame_card_abstraction,
+			*base_betting_abstraction, *subgame_betting_abstraction, *base_cfr_config,
+			*subgame_cfr_config, method, asym_p);
+    }
+  }
   SubgameSolver solver(*base_card_abstraction, *subgame_card_abstraction, *base_betting_abstraction,
 		       *subgame_betting_abstraction, *base_cfr_config, *subgame_cfr_config,
 		       base_buckets, subgame_buckets, solve_st, method, cfrs, card_level, zero_sum,
 		       current, pure_streets.get(), base_mem, base_it, num_subgame_its,
-		       num_inner_threads, num_outer_threads);
-  for (int asym_p = 0; asym_p <= 1; ++asym_p) {
-    DeleteAllSubgames(*base_card_abstraction, *subgame_card_abstraction, *base_betting_abstraction,
-		      *subgame_betting_abstraction, *base_cfr_config, *subgame_cfr_config, method,
-		      asym_p);
-  }
+		       num_inner_threads, num_outer_threads, ram_budget_gb, resume);
   solver.Walk();
 }
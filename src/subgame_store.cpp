@@ -0,0 +1,255 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "betting_abstraction.h"
+#include "card_abstraction.h"
+#include "cfr_config.h"
+#include "files.h"
+#include "game.h"
+#include "io.h"
+#include "subgame_store.h"
+
+using std::string;
+using std::unique_ptr;
+
+static void PReadOrDie(int fd, void *buf, long long int num_bytes, long long int offset,
+		       const string &filename) {
+  unsigned char *ptr = (unsigned char *)buf;
+  while (num_bytes > 0) {
+    ssize_t ret = pread(fd, ptr, num_bytes, offset);
+    if (ret <= 0) {
+      if (ret < 0 && errno == EINTR) continue;
+      fprintf(stderr, "Read of %s at offset %lli failed; errno %i\n", filename.c_str(), offset,
+	      errno);
+      exit(-1);
+    }
+    ptr += ret;
+    num_bytes -= ret;
+    offset += ret;
+  }
+}
+
+string SubgameStore::Filename(const CardAbstraction &base_ca, const CardAbstraction &subgame_ca,
+			      const BettingAbstraction &base_ba,
+			      const BettingAbstraction &subgame_ba, const CFRConfig &base_cc,
+			      const CFRConfig &subgame_cc, ResolvingMethod method, int asym_p) {
+  char dir[500], buf[500];
+  sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::NewCFRBase(), Game::GameName().c_str(),
+	  Game::NumPlayers(), base_ca.CardAbstractionName().c_str(), Game::NumRanks(),
+	  Game::NumSuits(), Game::MaxStreet(), base_ba.BettingAbstractionName().c_str(),
+	  base_cc.CFRConfigName().c_str());
+  if (base_ba.Asymmetric()) {
+    sprintf(buf, "%s.p%u/subgames.%s.%s.%s.%s.p%u", dir, asym_p,
+	    subgame_ca.CardAbstractionName().c_str(), subgame_ba.BettingAbstractionName().c_str(),
+	    subgame_cc.CFRConfigName().c_str(), ResolvingMethodName(method), asym_p);
+  } else {
+    sprintf(buf, "%s/subgames.%s.%s.%s.%s", dir, subgame_ca.CardAbstractionName().c_str(),
+	    subgame_ba.BettingAbstractionName().c_str(), subgame_cc.CFRConfigName().c_str(),
+	    ResolvingMethodName(method));
+  }
+  return buf;
+}
+
+SubgameStore::SubgameStore(const CardAbstraction &base_ca, const CardAbstraction &subgame_ca,
+			   const BettingAbstraction &base_ba, const BettingAbstraction &subgame_ba,
+			   const CFRConfig &base_cc, const CFRConfig &subgame_cc,
+			   ResolvingMethod method, int asym_p, long long int cache_bytes) {
+  filename_ = Filename(base_ca, subgame_ca, base_ba, subgame_ba, base_cc, subgame_cc, method,
+		       asym_p);
+  Mkdir(filename_.substr(0, filename_.rfind('/')).c_str());
+  fd_ = open(filename_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0666);
+  if (fd_ < 0) {
+    fprintf(stderr, "Couldn't open %s; errno %i\n", filename_.c_str(), errno);
+    exit(-1);
+  }
+  indexed_size_ = 0;
+  cache_bytes_ = cache_bytes;
+  cached_bytes_ = 0;
+  pthread_mutex_init(&mutex_, NULL);
+  // Holding the lock, no one is in the middle of an append, so anything after the last whole
+  // record was left by a writer that died.  Later appends would go after it and never be indexed.
+  Lock();
+  CatchUp();
+  struct stat sbuf;
+  if (fstat(fd_, &sbuf) != 0) {
+    fprintf(stderr, "Couldn't stat %s; errno %i\n", filename_.c_str(), errno);
+    exit(-1);
+  }
+  if (sbuf.st_size > indexed_size_) {
+    fprintf(stderr, "Truncating partial record at offset %lli of %s\n", indexed_size_,
+	    filename_.c_str());
+    if (ftruncate(fd_, indexed_size_) != 0) {
+      fprintf(stderr, "Couldn't truncate %s; errno %i\n", filename_.c_str(), errno);
+      exit(-1);
+    }
+  }
+  Unlock();
+}
+
+SubgameStore::~SubgameStore(void) {
+  pthread_mutex_destroy(&mutex_);
+  close(fd_);
+}
+
+// Serializes appends and the truncation of partial records across processes.
+void SubgameStore::Lock(void) {
+  while (flock(fd_, LOCK_EX) != 0) {
+    if (errno == EINTR) continue;
+    fprintf(stderr, "Couldn't lock %s; errno %i\n", filename_.c_str(), errno);
+    exit(-1);
+  }
+}
+
+void SubgameStore::Unlock(void) {
+  flock(fd_, LOCK_UN);
+}
+
+string SubgameStore::Key(int st, int gbd, const string &action_sequence) {
+  char buf[50];
+  sprintf(buf, "%i.%i.", st, gbd);
+  return buf + action_sequence;
+}
+
+// Indexes the records appended since we last looked, by us or by other processes.  A record
+// that is only partly there is still being written (or was left by a writer that died, which the
+// constructor cleans up), so we stop before it.
+void SubgameStore::CatchUp(void) {
+  struct stat sbuf;
+  if (fstat(fd_, &sbuf) != 0) {
+    fprintf(stderr, "Couldn't stat %s; errno %i\n", filename_.c_str(), errno);
+    exit(-1);
+  }
+  long long int file_size = sbuf.st_size;
+  long long int header_bytes = kHeaderInts * sizeof(int);
+  int header[kHeaderInts];
+  string action_sequence;
+  while (file_size - indexed_size_ >= header_bytes) {
+    PReadOrDie(fd_, header, header_bytes, indexed_size_, filename_);
+    if (header[0] != kMagic || header[3] < 0 || header[4] < 0) {
+      fprintf(stderr, "%s is corrupt at offset %lli\n", filename_.c_str(), indexed_size_);
+      exit(-1);
+    }
+    int len = header[3];
+    int num_values = header[4];
+    long long int record_bytes = header_bytes + len + num_values * (long long int)sizeof(double);
+    if (file_size - indexed_size_ < record_bytes) break;
+    action_sequence.resize(len);
+    PReadOrDie(fd_, &action_sequence[0], len, indexed_size_ + header_bytes, filename_);
+    Location &loc = index_[Key(header[1], header[2], action_sequence)];
+    loc.offset = indexed_size_ + header_bytes + len;
+    loc.num_values = num_values;
+    indexed_size_ += record_bytes;
+  }
+}
+
+// Must be called with mutex_ held.
+void SubgameStore::Cache(const string &key, const double *values, int num_values) {
+  long long int bytes = num_values * (long long int)sizeof(double);
+  auto it = cache_.find(key);
+  if (it != cache_.end()) {
+    cached_bytes_ -= it->second.num_values * (long long int)sizeof(double);
+    lru_.erase(it->second.lru_it);
+    cache_.erase(it);
+  }
+  if (bytes > cache_bytes_) return;
+  while (cached_bytes_ + bytes > cache_bytes_) {
+    auto victim = cache_.find(lru_.back());
+    cached_bytes_ -= victim->second.num_values * (long long int)sizeof(double);
+    cache_.erase(victim);
+    lru_.pop_back();
+  }
+  lru_.push_front(key);
+  CacheEntry &entry = cache_[key];
+  entry.values.reset(new double[num_values]);
+  memcpy(entry.values.get(), values, bytes);
+  entry.num_values = num_values;
+  entry.lru_it = lru_.begin();
+  cached_bytes_ += bytes;
+}
+
+void SubgameStore::Put(int st, int gbd, const string &action_sequence, const double *values,
+		       int num_values) {
+  int len = action_sequence.size();
+  long long int header_bytes = kHeaderInts * sizeof(int);
+  long long int values_bytes = num_values * (long long int)sizeof(double);
+  long long int record_bytes = header_bytes + len + values_bytes;
+  unique_ptr<unsigned char []> record(new unsigned char[record_bytes]);
+  int header[kHeaderInts] = {kMagic, st, gbd, len, num_values};
+  memcpy(record.get(), header, header_bytes);
+  memcpy(record.get() + header_bytes, action_sequence.data(), len);
+  memcpy(record.get() + header_bytes + len, values, values_bytes);
+  string key = Key(st, gbd, action_sequence);
+
+  pthread_mutex_lock(&mutex_);
+  // With O_APPEND the record goes at the end of the file even if another process has appended
+  // since we last looked, and the file offset ends up just past it.
+  Lock();
+  ssize_t ret = write(fd_, record.get(), record_bytes);
+  Unlock();
+  if (ret != record_bytes) {
+    fprintf(stderr, "Write to %s failed; ret %lli errno %i\n", filename_.c_str(),
+	    (long long int)ret, errno);
+    exit(-1);
+  }
+  long long int end = lseek(fd_, 0, SEEK_CUR);
+  long long int record_start = end - record_bytes;
+  Location &loc = index_[key];
+  loc.offset = record_start + header_bytes + len;
+  loc.num_values = num_values;
+  // Otherwise CatchUp() will index the other processes' records and then ours again.
+  if (record_start == indexed_size_) indexed_size_ = end;
+  Cache(key, values, num_values);
+  pthread_mutex_unlock(&mutex_);
+}
+
+bool SubgameStore::Get(int st, int gbd, const string &action_sequence, double *values,
+		       int num_values) {
+  string key = Key(st, gbd, action_sequence);
+  long long int bytes = num_values * (long long int)sizeof(double);
+  pthread_mutex_lock(&mutex_);
+  auto cit = cache_.find(key);
+  if (cit != cache_.end()) {
+    bool ok = cit->second.num_values == num_values;
+    if (ok) {
+      memcpy(values, cit->second.values.get(), bytes);
+      lru_.splice(lru_.begin(), lru_, cit->second.lru_it);
+    }
+    pthread_mutex_unlock(&mutex_);
+    return ok;
+  }
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    CatchUp();
+    it = index_.find(key);
+  }
+  if (it == index_.end() || it->second.num_values != num_values) {
+    pthread_mutex_unlock(&mutex_);
+    return false;
+  }
+  PReadOrDie(fd_, values, bytes, it->second.offset, filename_);
+  Cache(key, values, num_values);
+  pthread_mutex_unlock(&mutex_);
+  return true;
+}
+
+bool SubgameStore::Contains(int st, int gbd, const string &action_sequence, int num_values) {
+  string key = Key(st, gbd, action_sequence);
+  pthread_mutex_lock(&mutex_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    CatchUp();
+    it = index_.find(key);
+  }
+  bool ret = it != index_.end() && it->second.num_values == num_values;
+  pthread_mutex_unlock(&mutex_);
+  return ret;
+}
@@ -0,0 +1,84 @@
+#ifndef _SUBGAME_STORE_H_
+#define _SUBGAME_STORE_H_
+
+#include <pthread.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "resolving_method.h"
+
+class BettingAbstraction;
+class CardAbstraction;
+class CFRConfig;
+
+// Resolved subgame strategies for one combination of base abstraction, subgame abstraction and
+// resolving method, kept in a single append-only log rather than one file per subgame.  Each
+// record holds one node's values for one board, keyed by street, global board index and action
+// sequence.  Writing a key again supersedes the earlier record.
+//
+// An index from key to file offset is built when the store is opened, so a lookup is one hash
+// probe and one read, and recently used values are kept in memory up to the given number of
+// bytes.  Several processes can share a store: records are appended with a single write() under
+// an exclusive flock(), and a lookup that misses picks up whatever other processes have appended
+// since.  A partial record left at the end by a writer that died is truncated on open.
+//
+// Record format:
+//   magic (int), st (int), gbd (int), length of the action sequence (int), number of values
+//     (int), the action sequence (chars), the values (doubles)
+class SubgameStore {
+public:
+  SubgameStore(const CardAbstraction &base_ca, const CardAbstraction &subgame_ca,
+	       const BettingAbstraction &base_ba, const BettingAbstraction &subgame_ba,
+	       const CFRConfig &base_cc, const CFRConfig &subgame_cc, ResolvingMethod method,
+	       int asym_p, long long int cache_bytes);
+  ~SubgameStore(void);
+  void Put(int st, int gbd, const std::string &action_sequence, const double *values,
+	   int num_values);
+  // Returns false if there is no record for the key, or it doesn't have num_values values.
+  bool Get(int st, int gbd, const std::string &action_sequence, double *values,
+	   int num_values);
+  // Whether there is a record for the key with num_values values
+  bool Contains(int st, int gbd, const std::string &action_sequence, int num_values);
+  long long int NumRecords(void) const {return index_.size();}
+
+  static std::string Filename(const CardAbstraction &base_ca, const CardAbstraction &subgame_ca,
+			      const BettingAbstraction &base_ba,
+			      const BettingAbstraction &subgame_ba, const CFRConfig &base_cc,
+			      const CFRConfig &subgame_cc, ResolvingMethod method, int asym_p);
+private:
+  struct Location {
+    long long int offset;
+    int num_values;
+  };
+  struct CacheEntry {
+    std::unique_ptr<double []> values;
+    int num_values;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  static std::string Key(int st, int gbd, const std::string &action_sequence);
+  void Lock(void);
+  void Unlock(void);
+  void CatchUp(void);
+  void Cache(const std::string &key, const double *values, int num_values);
+
+  static const int kMagic = 0x53554247;
+  static const int kHeaderInts = 5;
+
+  std::string filename_;
+  int fd_;
+  // Everything before this offset has been indexed
+  long long int indexed_size_;
+  std::unordered_map<std::string, Location> index_;
+  long long int cache_bytes_;
+  long long int cached_bytes_;
+  // Most recently used first
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, CacheEntry> cache_;
+  pthread_mutex_t mutex_;
+};
+
+#endif
@@ -31,6 +31,7 @@
 #include "io.h"
 #include "reach_probs.h"
 #include "resolving_method.h"
+#include "subgame_store.h"
 
 using std::shared_ptr;
 using std::string;
@@ -304,25 +305,20 @@ unique_ptr<CFRValues> ReadBaseSubgameStrategy(const CardAbstraction &base_card_a
   return strategy;
 }
 
-// Only write out strategy for nodes at or below below_action_sequence.
+// Only write out strategy for nodes at or below below_action_sequence.  There is one record per
+// board for each of target_pa's nodes: if we resolve more than one street, the sumprobs object
+// contains more than one board's data for the later streets.
 void WriteSubgame(Node *node, const string &action_sequence, const string &below_action_sequence,
-		  int gbd, const CardAbstraction &base_card_abstraction,
-		  const CardAbstraction &subgame_card_abstraction,
-		  const BettingAbstraction &base_betting_abstraction,
-		  const BettingAbstraction &subgame_betting_abstraction,
-		  const CFRConfig &base_cfr_config, const CFRConfig &subgame_cfr_config,
-		  ResolvingMethod method, const CFRValues *sumprobs, int root_bd_st, int root_bd,
-		  int asym_p, int target_pa, int last_st) {
+		  int gbd, const CFRValues *sumprobs, int root_bd_st, int root_bd, int target_pa,
+		  int last_st, SubgameStore *store) {
   if (node->Terminal()) return;
   int st = node->Street();
   if (st > last_st) {
     int ngbd_begin = BoardTree::SuccBoardBegin(last_st, gbd, st);
     int ngbd_end = BoardTree::SuccBoardEnd(last_st, gbd, st);
     for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
-      WriteSubgame(node, action_sequence, below_action_sequence, ngbd, base_card_abstraction,
-		   subgame_card_abstraction, base_betting_abstraction, subgame_betting_abstraction,
-		   base_cfr_config, subgame_cfr_config, method, sumprobs, root_bd_st, root_bd,
-		   asym_p, target_pa, st);
+      WriteSubgame(node, action_sequence, below_action_sequence, ngbd, sumprobs, root_bd_st,
+		   root_bd, target_pa, st, store);
     }
     return;
   }
@@ -331,150 +327,82 @@ void WriteSubgame(Node *node, const string &action_sequence, const string &below
     if (below_action_sequence.size() <= action_sequence.size() &&
 	std::equal(below_action_sequence.begin(), below_action_sequence.end(),
 		   action_sequence.begin())) {
-      char dir[500], dir2[500], dir3[500], filename[500];
-      sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::NewCFRBase(),
-	      Game::GameName().c_str(), Game::NumPlayers(),
-	      base_card_abstraction.CardAbstractionName().c_str(),
-	      Game::NumRanks(), Game::NumSuits(), Game::MaxStreet(),
-	      base_betting_abstraction.BettingAbstractionName().c_str(),
-	      base_cfr_config.CFRConfigName().c_str());
-      if (base_betting_abstraction.Asymmetric()) {
-	sprintf(dir2, "%s.p%u/subgames.%s.%s.%s.%s.p%u.p%u", dir, asym_p,
-		subgame_card_abstraction.CardAbstractionName().c_str(),
-		subgame_betting_abstraction.BettingAbstractionName().c_str(),
-		subgame_cfr_config.CFRConfigName().c_str(),
-		ResolvingMethodName(method), asym_p, target_pa);
-      } else {
-	sprintf(dir2, "%s/subgames.%s.%s.%s.%s.p%u", dir, 
-		subgame_card_abstraction.CardAbstractionName().c_str(),
-		subgame_betting_abstraction.BettingAbstractionName().c_str(),
-		subgame_cfr_config.CFRConfigName().c_str(),
-		ResolvingMethodName(method), target_pa);
-      }
-      Mkdir(dir2);
-    
       if (action_sequence == "") {
 	fprintf(stderr, "Empty action sequence not allowed\n");
 	exit(-1);
       }
-      sprintf(dir3, "%s/%s", dir2, action_sequence.c_str());
-      Mkdir(dir3);
-
-      sprintf(filename, "%s/%u", dir3, gbd);
-
-      // If we resolve more than one street, things get a little tricky.  We are writing one
-      // file per final-street board, but this sumprobs object will contain more than one
-      // board's data.
-      Writer writer(filename);
-      int num_hole_card_pairs = Game::NumHoleCardPairs(node->Street());
+      // Assume doubles; subgame solving is unabstracted
+      CFRStreetValues<double> *street_values =
+	dynamic_cast<CFRStreetValues<double> *>(sumprobs->StreetValues(st));
+      if (street_values == nullptr) {
+	fprintf(stderr, "WriteSubgame: expected double sumprobs\n");
+	exit(-1);
+      }
+      int num_hole_card_pairs = Game::NumHoleCardPairs(st);
       int lbd = BoardTree::LocalIndex(root_bd_st, root_bd, st, gbd);
-      sumprobs->WriteBoardValuesForNode(node, &writer, nullptr, lbd, num_hole_card_pairs);
+      int num_values = num_hole_card_pairs * num_succs;
+      const double *values = street_values->AllValues(target_pa, node->NonterminalID());
+      store->Put(st, gbd, action_sequence, values + lbd * num_values, num_values);
     }
   }
 
   for (int s = 0; s < num_succs; ++s) {
     string action = node->ActionName(s);
-    WriteSubgame(node->IthSucc(s), action_sequence + action,
-		 below_action_sequence, gbd,
-		 base_card_abstraction, subgame_card_abstraction,
-		 base_betting_abstraction, subgame_betting_abstraction,
-		 base_cfr_config, subgame_cfr_config, method, sumprobs,
-		 root_bd_st, root_bd, asym_p, target_pa, st);
+    WriteSubgame(node->IthSucc(s), action_sequence + action, below_action_sequence, gbd,
+		 sumprobs, root_bd_st, root_bd, target_pa, st, store);
   }
 }
 
-static void ReadSubgame(Node *node, const string &action_sequence, int gbd,
-			const CardAbstraction &base_card_abstraction,
-			const CardAbstraction &subgame_card_abstraction,
-			const BettingAbstraction &base_betting_abstraction,
-			const BettingAbstraction &subgame_betting_abstraction,
-			const CFRConfig &base_cfr_config, const CFRConfig &subgame_cfr_config,
-			ResolvingMethod method,	CFRValues *sumprobs, int root_bd_st, int root_bd,
-			int asym_p, int target_pa, int last_st) {
-  if (node->Terminal()) {
-    return;
-  }
+// Returns false if any of target_pa's records is missing.
+static bool ReadSubgame(Node *node, const string &action_sequence, int gbd, CFRValues *sumprobs,
+			int root_bd_st, int root_bd, int target_pa, int last_st,
+			SubgameStore *store) {
+  if (node->Terminal()) return true;
   int st = node->Street();
   if (st > last_st) {
     int ngbd_begin = BoardTree::SuccBoardBegin(last_st, gbd, st);
     int ngbd_end = BoardTree::SuccBoardEnd(last_st, gbd, st);
     for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
-      ReadSubgame(node, action_sequence, ngbd, base_card_abstraction,
-		  subgame_card_abstraction, base_betting_abstraction,
-		  subgame_betting_abstraction, base_cfr_config,
-		  subgame_cfr_config, method, sumprobs, root_bd_st, root_bd,
-		  asym_p, target_pa, st);
+      if (! ReadSubgame(node, action_sequence, ngbd, sumprobs, root_bd_st, root_bd, target_pa,
+			st, store)) {
+	return false;
+      }
     }
-    return;
+    return true;
   }
   int num_succs = node->NumSuccs();
   if (node->PlayerActing() == target_pa && num_succs > 1) {
-    char dir[500], dir2[500], dir3[500], filename[500];
-    sprintf(dir, "%s/%s.%u.%s.%u.%u.%u.%s.%s", Files::NewCFRBase(),
-	    Game::GameName().c_str(), Game::NumPlayers(),
-	    base_card_abstraction.CardAbstractionName().c_str(),
-	    Game::NumRanks(), Game::NumSuits(), Game::MaxStreet(),
-	    base_betting_abstraction.BettingAbstractionName().c_str(),
-	    base_cfr_config.CFRConfigName().c_str());
-    if (base_betting_abstraction.Asymmetric()) {
-      sprintf(dir2, "%s.p%u/subgames.%s.%s.%s.%s.p%u.p%u", dir, asym_p,
-	      subgame_card_abstraction.CardAbstractionName().c_str(),
-	      subgame_betting_abstraction.BettingAbstractionName().c_str(),
-	      subgame_cfr_config.CFRConfigName().c_str(),
-	      ResolvingMethodName(method), asym_p, target_pa);
-    } else {
-      sprintf(dir2, "%s/subgames.%s.%s.%s.%s.p%u", dir, 
-	      subgame_card_abstraction.CardAbstractionName().c_str(),
-	      subgame_betting_abstraction.BettingAbstractionName().c_str(),
-	      subgame_cfr_config.CFRConfigName().c_str(),
-	      ResolvingMethodName(method), target_pa);
-    }
-    
-    if (action_sequence == "") {
-      fprintf(stderr, "Empty action sequence not allowed\n");
+    CFRStreetValues<double> *street_values =
+      dynamic_cast<CFRStreetValues<double> *>(sumprobs->StreetValues(st));
+    if (street_values == nullptr) {
+      fprintf(stderr, "ReadSubgame: expected double sumprobs\n");
       exit(-1);
     }
-    sprintf(dir3, "%s/%s", dir2, action_sequence.c_str());
-
-    sprintf(filename, "%s/%u", dir3, gbd);
-
-    Reader reader(filename);
-    // Assume doubles in file
-    // Also assume subgame solving is unabstracted
-    // We write only one board's data per file, even on streets later than
-    // solve street.
+    int nt = node->NonterminalID();
+    street_values->InitializeValuesForReading(target_pa, nt, num_succs);
+    int num_hole_card_pairs = Game::NumHoleCardPairs(st);
     int lbd = BoardTree::LocalIndex(root_bd_st, root_bd, st, gbd);
-    int num_hole_card_pairs = Game::NumHoleCardPairs(node->Street());
-    sumprobs->ReadBoardValuesForNode(node, &reader, nullptr, lbd, num_hole_card_pairs);
-    if (! reader.AtEnd()) {
-      fprintf(stderr, "Reader didn't get to end; pos %lli size %lli\nFile: %s\n",
-	      reader.BytePos(), reader.FileSize(), filename);
-      exit(-1);
-    }
+    int num_values = num_hole_card_pairs * num_succs;
+    double *values = street_values->AllValues(target_pa, nt) + lbd * num_values;
+    if (! store->Get(st, gbd, action_sequence, values, num_values)) return false;
   }
 
   for (int s = 0; s < num_succs; ++s) {
     string action = node->ActionName(s);
-    ReadSubgame(node->IthSucc(s), action_sequence + action, gbd, base_card_abstraction,
-		subgame_card_abstraction, base_betting_abstraction, subgame_betting_abstraction,
-		base_cfr_config, subgame_cfr_config, method, sumprobs, root_bd_st, root_bd, asym_p,
-		target_pa, st);
+    if (! ReadSubgame(node->IthSucc(s), action_sequence + action, gbd, sumprobs, root_bd_st,
+		      root_bd, target_pa, st, store)) {
+      return false;
+    }
   }
+  return true;
 }
 
-// I always load probabilities for both players because I need the reach
-// probabilities for both players in case we are performing nested subgame
-// solving.  In addition, as long as we are zero-summing the T-values, we
-// need the strategy for both players for the CBR computation.
+// We normally load probabilities for both players because we need the reach probabilities for
+// both players in case we are performing nested subgame solving.  In addition, as long as we are
+// zero-summing the T-values, we need the strategy for both players for the CBR computation.
 unique_ptr<CFRValues> ReadSubgame(const string &action_sequence, BettingTrees *subtrees, int gbd,
-				  const CardAbstraction &base_card_abstraction,
-				  const CardAbstraction &subgame_card_abstraction,
-				  const BettingAbstraction &base_betting_abstraction,
-				  const BettingAbstraction &subgame_betting_abstraction,
-				  const CFRConfig &base_cfr_config,
-				  const CFRConfig &subgame_cfr_config,
-				  const Buckets &subgame_buckets, ResolvingMethod method,
-				  int root_bd_st, int root_bd, int asym_p) {
+				  const Buckets &subgame_buckets, const bool *players,
+				  int root_bd_st, int root_bd, SubgameStore *store) {
   int max_street = Game::MaxStreet();
   unique_ptr<bool []> subgame_streets(new bool[max_street + 1]);
   for (int st = 0; st <= max_street; ++st) {
@@ -484,7 +412,7 @@ unique_ptr<CFRValues> ReadSubgame(const string &action_sequence, BettingTrees *s
 
   // Buckets needed for num buckets and for knowing what streets are
   // bucketed.
-  unique_ptr<CFRValues> sumprobs(new CFRValues(nullptr, subgame_streets.get(), gbd,
+  unique_ptr<CFRValues> sumprobs(new CFRValues(players, subgame_streets.get(), gbd,
 					       subtrees->Root()->Street(), subgame_buckets,
 					       subtrees->GetBettingTree()));
   // Assume doubles
@@ -493,53 +421,63 @@ unique_ptr<CFRValues> ReadSubgame(const string &action_sequence, BettingTrees *s
   }
 
   for (int target_pa = 0; target_pa <= 1; ++target_pa) {
-    ReadSubgame(subtrees->Root(), action_sequence, gbd, base_card_abstraction,
-		subgame_card_abstraction, base_betting_abstraction,
-		subgame_betting_abstraction, base_cfr_config,
-		subgame_cfr_config, method, sumprobs.get(), root_bd_st, root_bd,
-		asym_p, target_pa, subtrees->Root()->Street());
+    if (players && ! players[target_pa]) continue;
+    if (! ReadSubgame(subtrees->Root(), action_sequence, gbd, sumprobs.get(), root_bd_st,
+		      root_bd, target_pa, subtrees->Root()->Street(), store)) {
+      return nullptr;
+    }
   }
   
   return sumprobs;
 }
 
+static bool HaveSubgame(Node *node, const string &action_sequence, int gbd, int target_pa,
+			int last_st, SubgameStore *store) {
+  if (node->Terminal()) return true;
+  int st = node->Street();
+  if (st > last_st) {
+    int ngbd_begin = BoardTree::SuccBoardBegin(last_st, gbd, st);
+    int ngbd_end = BoardTree::SuccBoardEnd(last_st, gbd, st);
+    for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
+      if (! HaveSubgame(node, action_sequence, ngbd, target_pa, st, store)) return false;
+    }
+    return true;
+  }
+  int num_succs = node->NumSuccs();
+  if (node->PlayerActing() == target_pa && num_succs > 1) {
+    int num_values = Game::NumHoleCardPairs(st) * num_succs;
+    if (! store->Contains(st, gbd, action_sequence, num_values)) return false;
+  }
+  for (int s = 0; s < num_succs; ++s) {
+    string action = node->ActionName(s);
+    if (! HaveSubgame(node->IthSucc(s), action_sequence + action, gbd, target_pa, st, store)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool HaveSubgame(const string &action_sequence, Node *root, int gbd, SubgameStore *store) {
+  for (int target_pa = 0; target_pa <= 1; ++target_pa) {
+    if (! HaveSubgame(root, action_sequence, gbd, target_pa, root->Street(), store)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void DeleteAllSubgames(const CardAbstraction &base_card_abstraction,
 		       const CardAbstraction &subgame_card_abstraction,
 		       const BettingAbstraction &base_betting_abstraction,
 		       const BettingAbstraction &subgame_betting_abstraction,
 		       const CFRConfig &base_cfr_config, const CFRConfig &subgame_cfr_config,
 		       ResolvingMethod method, int asym_p) {
-  char dir[500], dir2[500];
-  sprintf(dir, "%s/%s.%s.%u.%u.%u.%s.%s", Files::OldCFRBase(),
-	  Game::GameName().c_str(),
-	  base_card_abstraction.CardAbstractionName().c_str(),
-	  Game::NumRanks(), Game::NumSuits(), Game::MaxStreet(),
-	  base_betting_abstraction.BettingAbstractionName().c_str(),
-	  base_cfr_config.CFRConfigName().c_str());
-  if (base_betting_abstraction.Asymmetric()) {
-    for (int target_pa = 0; target_pa <= 1; ++target_pa) {
-      sprintf(dir2, "%s.p%u/subgames.%s.%s.%s.%s.p%u.p%u", dir, asym_p,
-	      subgame_card_abstraction.CardAbstractionName().c_str(),
-	      subgame_betting_abstraction.BettingAbstractionName().c_str(),
-	      subgame_cfr_config.CFRConfigName().c_str(),
-	      ResolvingMethodName(method), asym_p, target_pa);
-      if (FileExists(dir2)) {
-	fprintf(stderr, "Recursively deleting %s\n", dir2);
-	RecursivelyDeleteDirectory(dir2);
-      }
-    }
-  } else {
-    for (int target_pa = 0; target_pa <= 1; ++target_pa) {
-      sprintf(dir2, "%s/subgames.%s.%s.%s.%s.p%u", dir,
-	      subgame_card_abstraction.CardAbstractionName().c_str(),
-	      subgame_betting_abstraction.BettingAbstractionName().c_str(),
-	      subgame_cfr_config.CFRConfigName().c_str(),
-	      ResolvingMethodName(method), target_pa);
-      if (FileExists(dir2)) {
-	fprintf(stderr, "Recursively deleting %s\n", dir2);
-	RecursivelyDeleteDirectory(dir2);
-      }
-    }
+  string filename = SubgameStore::Filename(base_card_abstraction, subgame_card_abstraction,
+					   base_betting_abstraction, subgame_betting_abstraction,
+					   base_cfr_config, subgame_cfr_config, method, asym_p);
+  if (FileExists(filename.c_str())) {
+    fprintf(stderr, "Deleting %s\n", filename.c_str());
+    RemoveFile(filename.c_str());
   }
 }
 
@@ -16,6 +16,7 @@ class CFRValues;
 class HandTree;
 class Node;
 class ReachProbs;
+class SubgameStore;
 
 BettingTrees *CreateSubtrees(int st, int player_acting, int last_bet_to, int target_p,
 			     const BettingAbstraction &betting_abstraction);
@@ -34,23 +35,17 @@ ReadBaseSubgameStrategy(const CardAbstraction &base_card_abstraction,
 			const std::string &action_sequence, double **reach_probs,
 			BettingTree *subtree, bool current, int target_p);
 void WriteSubgame(Node *node, const std::string &action_sequence,
-		  const std::string &below_action_sequence, int gbd,
-		  const CardAbstraction &base_card_abstraction,
-		  const CardAbstraction &subgame_card_abstraction,
-		  const BettingAbstraction &base_betting_abstraction,
-		  const BettingAbstraction &subgame_betting_abstraction,
-		  const CFRConfig &base_cfr_config, const CFRConfig &subgame_cfr_config,
-		  ResolvingMethod method, const CFRValues *sumprobs, int root_bd_st, int root_bd,
-		  int target_p, int cfr_target_p, int last_st);
+		  const std::string &below_action_sequence, int gbd, const CFRValues *sumprobs,
+		  int root_bd_st, int root_bd, int target_pa, int last_st, SubgameStore *store);
+// Reads the strategy of the given players (both if players is null).  Returns null if the store
+// doesn't have all of it.
 std::unique_ptr<CFRValues>
 ReadSubgame(const std::string &action_sequence, BettingTrees *subtrees, int gbd,
-	    const CardAbstraction &base_card_abstraction,
-	    const CardAbstraction &subgame_card_abstraction,
-	    const BettingAbstraction &base_betting_abstraction,
-	    const BettingAbstraction &subgame_betting_abstraction,
-	    const CFRConfig &base_cfr_config, const CFRConfig &subgame_cfr_config,
-	    const Buckets &subgame_buckets, ResolvingMethod method, int root_bd_st,
-	    int root_bd, int target_p);
+	    const Buckets &subgame_buckets, const bool *players, int root_bd_st, int root_bd,
+	    SubgameStore *store);
+// Whether the store has the strategies of both players for the whole subgame, as written by
+// WriteSubgame().
+bool HaveSubgame(const std::string &action_sequence, Node *root, int gbd, SubgameStore *store);
 void DeleteAllSubgames(const CardAbstraction &base_card_abstraction,
 		       const CardAbstraction &subgame_card_abstraction,
 		       const BettingAbstraction &base_betting_abstraction,
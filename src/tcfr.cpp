@@ -6,10 +6,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <unistd.h> // sleep()
 
 #include <algorithm>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "betting_abstraction.h"
 #include "betting_tree.h"
@@ -35,6 +38,34 @@ using namespace std;
 // #define BC 1
 #define SWITCH 1
 
+TCFRDeltas::TCFRDeltas(int num_threads, int merge_interval,
+		       const vector<unsigned long long int> &nodes,
+		       const vector<long long int> &value_offsets) :
+  num_threads_(num_threads), merge_interval_(merge_interval), node_offsets_(nodes),
+  value_offsets_(value_offsets) {
+  if (merge_interval_ < 1) {
+    fprintf(stderr, "DeltaMergeInterval must be positive\n");
+    exit(-1);
+  }
+  long long int num_values = value_offsets_.back();
+  regrets_.reset(new unique_ptr<long long int []>[num_threads_]);
+  sumprobs_.reset(new unique_ptr<unsigned int []>[num_threads_]);
+  dirty_.reset(new vector<pair<int, int>>[num_threads_]);
+  for (int t = 0; t < num_threads_; ++t) {
+    regrets_[t].reset(new long long int[num_values]);
+    sumprobs_[t].reset(new unsigned int[num_values]);
+    for (long long int i = 0; i < num_values; ++i) {
+      regrets_[t][i] = 0;
+      sumprobs_[t][i] = 0;
+    }
+  }
+  pthread_barrier_init(&barrier_, NULL, num_threads_);
+}
+
+TCFRDeltas::~TCFRDeltas(void) {
+  pthread_barrier_destroy(&barrier_);
+}
+
 TCFRThread::TCFRThread(const BettingAbstraction &ba, const CFRConfig &cc, const Buckets &buckets,
 		       int batch_index, int thread_index, int num_threads, unsigned char *data,
 		       int target_player, float *rngs, unsigned int *uncompress,
@@ -42,7 +73,8 @@ TCFRThread::TCFRThread(const BettingAbstraction &ba, const CFRConfig &cc, const
 		       bool **sumprob_streets, const double *boost_thresholds, const bool *freeze,
 		       unsigned char *hvb_table, unsigned char ***cards_to_indices,
 		       int num_raw_boards, const int *board_table, int batch_size,
-		       unsigned long long int *total_its) :
+		       unsigned long long int *total_its, TCFRDeltas *deltas,
+		       unsigned long long int *write_counts) :
   betting_abstraction_(ba), cfr_config_(cc), buckets_(buckets) {
   batch_index_ = batch_index;
   thread_index_ = thread_index;
@@ -65,6 +97,9 @@ TCFRThread::TCFRThread(const BettingAbstraction &ba, const CFRConfig &cc, const
   board_table_ = board_table;
   batch_size_ = batch_size;
   total_its_ = total_its;
+  deltas_ = deltas;
+  write_counts_ = write_counts;
+  merge_secs_ = 0;
   
   max_street_ = Game::MaxStreet();
   char_quantized_streets_.reset(new bool[max_street_ + 1]);
@@ -361,7 +396,10 @@ void TCFRThread::Run(void) {
   }
   
   while (1) {
-    if (*total_its_ >= ((unsigned long long int)batch_size_) * num_threads_) {
+    // With delta streets every thread must do the same number of iterations so that they all
+    // reach the same merge points.
+    if (deltas_ ? it_ > (unsigned long long int)batch_size_ :
+	*total_its_ >= ((unsigned long long int)batch_size_) * num_threads_) {
       fprintf(stderr, "Thread %u performed %llu iterations\n", thread_index_, it_);
       break;
     }
@@ -455,6 +493,10 @@ void TCFRThread::Run(void) {
     }
 
     ++it_;
+    if (deltas_ && ((it_ - 1) % deltas_->MergeInterval() == 0 ||
+		    it_ > (unsigned long long int)batch_size_)) {
+      MergeDeltas();
+    }
     if (it_ % 10000000 == 0 && thread_index_ == 0) {
       for (int p = 0; p < num_players_; ++p) {
 	fprintf(stderr, "It %llu avg P%u val %f\n", it_, p, sum_values[p] / (double)denoms[p]);
@@ -479,6 +521,105 @@ void TCFRThread::Run(void) {
   }
 }
 
+// All threads stop here.  Each then walks every thread's dirty list and merges the buckets
+// assigned to it; a bucket is assigned to exactly one thread so no locking is needed.  The
+// second barrier keeps anyone from running iterations (and touching the dirty lists) until every
+// bucket has been merged.
+void TCFRThread::MergeDeltas(void) {
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  deltas_->Wait();
+  for (int t = 0; t < num_threads_; ++t) {
+    const vector<pair<int, int>> &dirty = deltas_->Dirty(t);
+    int num_dirty = dirty.size();
+    for (int i = 0; i < num_dirty; ++i) {
+      int n = dirty[i].first;
+      int b = dirty[i].second;
+      if ((n + b) % num_threads_ == thread_index_) MergeBucket(n, b);
+    }
+  }
+  deltas_->Wait();
+  deltas_->ClearDirty(thread_index_);
+  gettimeofday(&end, NULL);
+  merge_secs_ += (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+// Sums the threads' buffers for one bucket of one node and applies them the way Process()
+// applies a single update: pruned succs are left alone, the smallest regret is shifted to zero
+// and regrets are capped.  Sumprobs are halved while any exceeds the ceiling.  The buffers are
+// zeroed, so merging the same bucket again before the next update does nothing.
+void TCFRThread::MergeBucket(int n, int b) {
+  unsigned char *ptr = data_ + deltas_->NodeOffset(n);
+  int st = ptr[1];
+  int num_succs = ptr[2];
+  int fold_succ_index = ptr[3];
+  int pa = ptr[5];
+  bool sumprobs = sumprob_streets_[pa][st] && (! asymmetric_ || target_player_ == pa);
+  int size_bucket_data = num_succs * sizeof(T_REGRET);
+  if (sumprobs) size_bucket_data += num_succs * sizeof(T_SUM_PROB);
+  unsigned int pruning_threshold = pruning_thresholds_[st];
+  T_SUM_PROB ceiling = sumprob_ceilings_[st];
+  long long int i = deltas_->ValueOffset(n) + b * num_succs;
+  long long int regret_deltas[kMaxSuccs];
+  unsigned int sumprob_deltas[kMaxSuccs];
+  bool any_regret = false, any_sumprob = false;
+  for (int s = 0; s < num_succs; ++s) {
+    regret_deltas[s] = 0;
+    sumprob_deltas[s] = 0;
+  }
+  for (int t = 0; t < num_threads_; ++t) {
+    long long int *rd = deltas_->Regrets(t) + i;
+    unsigned int *sd = deltas_->Sumprobs(t) + i;
+    for (int s = 0; s < num_succs; ++s) {
+      if (rd[s] != 0) {
+	regret_deltas[s] += rd[s];
+	rd[s] = 0;
+	any_regret = true;
+      }
+      if (sd[s] != 0) {
+	sumprob_deltas[s] += sd[s];
+	sd[s] = 0;
+	any_sumprob = true;
+      }
+    }
+  }
+  unsigned char *ptr1 = SUCCPTR(ptr) + num_succs * 8 + b * size_bucket_data;
+  if (any_regret) {
+    T_REGRET *bucket_regrets = (T_REGRET *)ptr1;
+    long long int min_regret = 0;
+    bool first = true;
+    for (int s = 0; s < num_succs; ++s) {
+      if (s != fold_succ_index && bucket_regrets[s] >= pruning_threshold) continue;
+      long long int r = bucket_regrets[s] + regret_deltas[s];
+      if (first || r < min_regret) min_regret = r;
+      first = false;
+    }
+    for (int s = 0; s < num_succs; ++s) {
+      if (s != fold_succ_index && bucket_regrets[s] >= pruning_threshold) continue;
+      long long int r = bucket_regrets[s] + regret_deltas[s] - min_regret;
+      if (r > 2000000000) r = 2000000000;
+      bucket_regrets[s] = r;
+    }
+  }
+  if (any_sumprob && sumprobs) {
+    T_SUM_PROB *bucket_sumprobs = (T_SUM_PROB *)(ptr1 + num_succs * sizeof(T_REGRET));
+    bool too_extreme = false;
+    for (int s = 0; s < num_succs; ++s) {
+      unsigned long long int sp = bucket_sumprobs[s] + (unsigned long long int)sumprob_deltas[s];
+      if (sp > 4000000000ULL) sp = 4000000000ULL;
+      bucket_sumprobs[s] = sp;
+      if (bucket_sumprobs[s] > ceiling) too_extreme = true;
+    }
+    while (too_extreme) {
+      too_extreme = false;
+      for (int s = 0; s < num_succs; ++s) {
+	bucket_sumprobs[s] /= 2;
+	if (bucket_sumprobs[s] > ceiling) too_extreme = true;
+      }
+    }
+  }
+}
+
 static void *thread_run(void *v_t) {
   TCFRThread *t = (TCFRThread *)v_t;
   t->Run();
@@ -810,6 +951,21 @@ T_VALUE TCFRThread::Process(unsigned char *ptr, int last_player_acting, int last
 	  if (s == 0 || i_regret < min_regret) min_regret = i_regret;
 	  succ_iregrets[s] = i_regret;
 	}
+	if (write_counts_) ++write_counts_[NODEINDEX(ptr)];
+	unsigned int delta_slot = DELTASLOT(ptr);
+	if (delta_slot != kNoDeltaSlot) {
+	  // Accumulate the increments in our buffer; MergeDeltas() applies them.  Delta streets
+	  // are never quantized.
+	  T_REGRET *bucket_regrets = (T_REGRET *)ptr1;
+	  long long int *deltas = deltas_->Regrets(thread_index_) +
+	    deltas_->ValueOffset(delta_slot) + our_bucket * num_succs;
+	  deltas_->MarkDirty(thread_index_, delta_slot, our_bucket);
+	  for (int s = 0; s < num_succs; ++s) {
+	    if (s != fold_succ_index && bucket_regrets[s] >= pruning_threshold) continue;
+	    deltas[s] += succ_iregrets[s] - (int)bucket_regrets[s];
+	  }
+	  return val;
+	}
 	int offset = -min_regret;
 	for (int s = 0; s < num_succs; ++s) {
 	  // Assume no pruning if quantization for now
@@ -945,15 +1101,23 @@ T_VALUE TCFRThread::Process(unsigned char *ptr, int last_player_acting, int last
 	  } else {
 	    these_sum_probs = (T_SUM_PROB *)(ptr1 + num_succs * sizeof(T_REGRET));
 	  }
-	  T_SUM_PROB ceiling = sumprob_ceilings_[st];
-	  these_sum_probs[ss] += 1;
-	  bool sum_prob_too_extreme = false;
-	  if (these_sum_probs[ss] > ceiling) {
-	    sum_prob_too_extreme = true;
-	  }
-	  if (sum_prob_too_extreme) {
-	    for (int s = 0; s < num_succs; ++s) {
-	      these_sum_probs[s] /= 2;
+	  if (write_counts_) ++write_counts_[NODEINDEX(ptr)];
+	  unsigned int delta_slot = DELTASLOT(ptr);
+	  if (delta_slot != kNoDeltaSlot) {
+	    ++deltas_->Sumprobs(thread_index_)[deltas_->ValueOffset(delta_slot) +
+					       opp_bucket * num_succs + ss];
+	    deltas_->MarkDirty(thread_index_, delta_slot, opp_bucket);
+	  } else {
+	    T_SUM_PROB ceiling = sumprob_ceilings_[st];
+	    these_sum_probs[ss] += 1;
+	    bool sum_prob_too_extreme = false;
+	    if (these_sum_probs[ss] > ceiling) {
+	      sum_prob_too_extreme = true;
+	    }
+	    if (sum_prob_too_extreme) {
+	      for (int s = 0; s < num_succs; ++s) {
+		these_sum_probs[s] /= 2;
+	      }
 	    }
 	  }
 	  T_SUM_PROB *action_sumprobs = nullptr;
@@ -1562,7 +1726,8 @@ void TCFR::RunBatch(int batch_size) {
 		     num_cfr_threads_, data_, target_player_, rngs_, uncompress_, short_uncompress_,
 		     pruning_thresholds_, sumprob_streets_, boost_thresholds_.get(),
 		     freeze_.get(), hvb_table_, cards_to_indices_, num_raw_boards_,
-		     board_table_.get(), batch_size, &total_its_);
+		     board_table_.get(), batch_size, &total_its_, deltas_.get(),
+		     write_counts_ ? write_counts_[i].get() : nullptr);
     cfr_threads_[i] = cfr_thread;
   }
 
@@ -1576,6 +1741,14 @@ void TCFR::RunBatch(int batch_size) {
   for (int i = 0; i < num_cfr_threads_; ++i) {
     total_full_process_count_ += cfr_threads_[i]->FullProcessCount();
   }
+  if (deltas_) {
+    fprintf(stderr, "Merge secs (including waiting at barriers):");
+    for (int i = 0; i < num_cfr_threads_; ++i) {
+      fprintf(stderr, " %.2f", cfr_threads_[i]->MergeSecs());
+    }
+    fprintf(stderr, "\n");
+  }
+  if (write_counts_) ReportContention();
 
   for (int i = 0; i < num_cfr_threads_; ++i) {
     delete cfr_threads_[i];
@@ -1629,7 +1802,9 @@ void TCFR::Run(int start_batch_index, int end_batch_index, int batch_size, int s
 //   Byte 4:      Call succ index
 //   Byte 5:      Player acting
 //   Bytes 6-7:   Last-bet-to
-//   Byte 8:      Beginning of succ ptrs
+//   Bytes 8-11:  Delta slot (index into TCFRDeltas) or kNoDeltaSlot
+//   Bytes 12-15: Node index (for the contention profiler)
+//   Byte 16:     Beginning of succ ptrs
 // The next num-succs * 8 bytes are for the succ ptrs
 // For each bucket
 //   num-succs * sizeof(T_REGRET) for the regrets
@@ -1637,7 +1812,9 @@ void TCFR::Run(int start_batch_index, int end_batch_index, int batch_size, int s
 //     num-succs * sizeof(T_SUM_PROB) for the sum-probs
 // If boosting: num_succs * sizeof(T_SUM_PROB) for the action-sum-probs
 unsigned char *TCFR::Prepare(unsigned char *ptr, Node *node, unsigned short last_bet_to,
-			     unsigned long long int ***offsets) {
+			     unsigned long long int ***offsets,
+			     vector<unsigned long long int> *delta_nodes,
+			     vector<long long int> *delta_value_offsets) {
   if (node->Terminal()) {
     ptr[0] = 1;
     return ptr + 4;
@@ -1656,7 +1833,18 @@ unsigned char *TCFR::Prepare(unsigned char *ptr, Node *node, unsigned short last
   ptr[4] = csi;
   ptr[5] = pa;
   *(unsigned short *)(ptr + 6) = last_bet_to;
-  unsigned char *succ_ptr = ptr + 8;
+  NODEINDEX(ptr) = node_offsets_.size();
+  node_offsets_.push_back(ptr - data_);
+  node_nts_.push_back(node->NonterminalID());
+  if (num_succs > 1 && cfr_config_.DeltaStreet(st)) {
+    DELTASLOT(ptr) = delta_nodes->size();
+    delta_nodes->push_back(ptr - data_);
+    delta_value_offsets->push_back(delta_value_offsets->back() +
+				   buckets_.NumBuckets(st) * num_succs);
+  } else {
+    DELTASLOT(ptr) = kNoDeltaSlot;
+  }
+  unsigned char *succ_ptr = SUCCPTR(ptr);
 
   unsigned char *ptr1 = succ_ptr + num_succs * 8;
   if (num_succs > 1) {
@@ -1729,10 +1917,10 @@ unsigned char *TCFR::Prepare(unsigned char *ptr, Node *node, unsigned short last
     }
     *((unsigned long long int *)(succ_ptr + s * 8)) = ull_offset;
     if (s == fsi || s == csi) {
-      ptr1 = Prepare(ptr1, succ, last_bet_to, offsets);
+      ptr1 = Prepare(ptr1, succ, last_bet_to, offsets, delta_nodes, delta_value_offsets);
     } else {
       unsigned short new_bet_to = succ->LastBetTo();
-      ptr1 = Prepare(ptr1, succ, new_bet_to, offsets);
+      ptr1 = Prepare(ptr1, succ, new_bet_to, offsets, delta_nodes, delta_value_offsets);
     }
   }
   return ptr1;
@@ -1752,7 +1940,7 @@ void TCFR::MeasureTree(Node *node, bool ***seen, unsigned long long int *allocat
   
   // This is the number of bytes needed for everything else (e.g.,
   // num-succs).
-  int this_sz = 8;
+  int this_sz = 16;
 
   int num_succs = node->NumSuccs();
   // Eight bytes per succ
@@ -1833,7 +2021,10 @@ void TCFR::Prepare(void) {
       }
     }
   }
-  unsigned char *end = Prepare(data_, betting_tree_->Root(), Game::BigBlind(), offsets);
+  vector<unsigned long long int> delta_nodes;
+  vector<long long int> delta_value_offsets(1, 0LL);
+  unsigned char *end = Prepare(data_, betting_tree_->Root(), Game::BigBlind(), offsets,
+			       &delta_nodes, &delta_value_offsets);
   unsigned long long int sz = end - data_;
   if (sz != allocation_size) {
     fprintf(stderr, "Didn't fill expected number of bytes: sz %llu as %llu\n", sz, allocation_size);
@@ -1847,6 +2038,52 @@ void TCFR::Prepare(void) {
     delete [] offsets[st];
   }
   delete [] offsets;
+
+  if (delta_nodes.size() > 0) {
+    for (int st = 0; st <= max_street; ++st) {
+      if (cfr_config_.DeltaStreet(st) &&
+	  (char_quantized_streets_[st] || short_quantized_streets_[st])) {
+	fprintf(stderr, "Delta streets cannot be quantized\n");
+	exit(-1);
+      }
+    }
+    deltas_.reset(new TCFRDeltas(num_cfr_threads_, cfr_config_.DeltaMergeInterval(), delta_nodes,
+				 delta_value_offsets));
+    fprintf(stderr, "%i delta nodes; %lli bytes of delta buffers per thread\n",
+	    (int)delta_nodes.size(), delta_value_offsets.back() * 12);
+  }
+}
+
+// Reports the nodes updated most often in the last batch, summed over threads.  Nodes that are
+// updated often by many threads are the ones worth making delta nodes.
+void TCFR::ReportContention(void) {
+  static const int kNumToShow = 20;
+  int num_nodes = node_offsets_.size();
+  vector<pair<unsigned long long int, int>> counts;
+  unsigned long long int total = 0;
+  for (int n = 0; n < num_nodes; ++n) {
+    unsigned long long int count = 0;
+    for (int t = 0; t < num_cfr_threads_; ++t) {
+      count += write_counts_[t][n];
+      write_counts_[t][n] = 0;
+    }
+    if (count > 0) counts.push_back(make_pair(count, n));
+    total += count;
+  }
+  int num_to_show = std::min(kNumToShow, (int)counts.size());
+  partial_sort(counts.begin(), counts.begin() + num_to_show, counts.end(),
+	       [](const pair<unsigned long long int, int> &a,
+		  const pair<unsigned long long int, int> &b) {
+		 return a.first > b.first || (a.first == b.first && a.second < b.second);
+	       });
+  fprintf(stderr, "Most written nodes (%llu writes in total):\n", total);
+  for (int i = 0; i < num_to_show; ++i) {
+    int n = counts[i].second;
+    unsigned char *ptr = data_ + node_offsets_[n];
+    fprintf(stderr, "  st %i pa %i nt %i: %llu writes (%.2f%%)%s\n", (int)ptr[1], (int)ptr[5],
+	    node_nts_[n], counts[i].first, 100.0 * counts[i].first / total,
+	    DELTASLOT(ptr) != kNoDeltaSlot ? " delta" : "");
+  }
 }
 
 static int Factorial(int n) {
@@ -1996,6 +2233,14 @@ TCFR::TCFR(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRCon
 #endif
 
   Prepare();
+  if (cfr_config_.ProfileContention()) {
+    int num_nodes = node_offsets_.size();
+    write_counts_.reset(new unique_ptr<unsigned long long int []>[num_cfr_threads_]);
+    for (int t = 0; t < num_cfr_threads_; ++t) {
+      write_counts_[t].reset(new unsigned long long int[num_nodes]);
+      for (int n = 0; n < num_nodes; ++n) write_counts_[t][n] = 0;
+    }
+  }
 
   rngs_ = new float[kNumPregenRNGs];
   uncompress_ = new unsigned int[256];
@@ -1,7 +1,11 @@
 #ifndef _TCFR_H_
 #define _TCFR_H_
 
+#include <pthread.h>
+
 #include <memory>
+#include <utility>
+#include <vector>
 
 // #include "cfr.h"
 
@@ -20,10 +24,52 @@ class Writer;
 #define T_VALUE int
 #define T_SUM_PROB unsigned int
 
-#define SUCCPTR(ptr) (ptr + 8)
+// See TCFR::Prepare() for the layout of a node
+#define SUCCPTR(ptr) (ptr + 16)
+#define DELTASLOT(ptr) (*(unsigned int *)(ptr + 8))
+#define NODEINDEX(ptr) (*(unsigned int *)(ptr + 12))
+static const unsigned int kNoDeltaSlot = 4294967295U;
 
 static const int kNumPregenRNGs = 10000000;
 
+// Per-thread buffers for the DeltaStreets option.  Nodes on a delta street are not updated in
+// place.  Instead each thread adds its regret increments and sumprob counts to its own buffers,
+// and every DeltaMergeInterval iterations all threads stop at a barrier and merge the buffers
+// into the shared values.  Between merges the shared values for those nodes are read-only, so
+// threads no longer fight over the cache lines of hot nodes.  The merge sums the buffers with
+// integer arithmetic, so its result doesn't depend on thread timing.
+//
+// Each thread also records the (delta node, bucket) pairs it has updated since the last merge so
+// that the merge only visits those buckets rather than scanning the whole buffers.
+class TCFRDeltas {
+public:
+  TCFRDeltas(int num_threads, int merge_interval, const std::vector<unsigned long long int> &nodes,
+	     const std::vector<long long int> &value_offsets);
+  ~TCFRDeltas(void);
+  int NumNodes(void) const {return node_offsets_.size();}
+  int MergeInterval(void) const {return merge_interval_;}
+  unsigned long long int NodeOffset(int n) const {return node_offsets_[n];}
+  long long int ValueOffset(int n) const {return value_offsets_[n];}
+  long long int *Regrets(int t) const {return regrets_[t].get();}
+  unsigned int *Sumprobs(int t) const {return sumprobs_[t].get();}
+  void MarkDirty(int t, int n, int b) {dirty_[t].push_back(std::make_pair(n, b));}
+  const std::vector<std::pair<int, int>> &Dirty(int t) const {return dirty_[t];}
+  void ClearDirty(int t) {dirty_[t].clear();}
+  void Wait(void) {pthread_barrier_wait(&barrier_);}
+private:
+  int num_threads_;
+  int merge_interval_;
+  // Offset within the TCFR data of each delta node
+  std::vector<unsigned long long int> node_offsets_;
+  // Offset of each delta node's values within a thread's buffers; one value per bucket and succ
+  std::vector<long long int> value_offsets_;
+  std::unique_ptr<std::unique_ptr<long long int []> []> regrets_;
+  std::unique_ptr<std::unique_ptr<unsigned int []> []> sumprobs_;
+  // May contain duplicates; merging a bucket a second time is a no-op
+  std::unique_ptr<std::vector<std::pair<int, int>> []> dirty_;
+  pthread_barrier_t barrier_;
+};
+
 class TCFRThread {
 public:
   TCFRThread(const BettingAbstraction &ba, const CFRConfig &cc, const Buckets &buckets,
@@ -32,7 +78,8 @@ public:
 	     unsigned int *short_uncompress, unsigned int *pruning_thresholds,
 	     bool **sumprob_streets, const double *boost_thresholds, const bool *freeze,
 	     unsigned char *hvb_table, unsigned char ***cards_to_indices, int num_raw_boards,
-	     const int *board_table_, int batch_size, unsigned long long int *total_its);
+	     const int *board_table_, int batch_size, unsigned long long int *total_its,
+	     TCFRDeltas *deltas, unsigned long long int *write_counts);
   virtual ~TCFRThread(void);
   void RunThread(void);
   void Join(void);
@@ -42,6 +89,7 @@ public:
   unsigned long long int FullProcessCount(void) const {
     return full_process_count_;
   }
+  double MergeSecs(void) const {return merge_secs_;}
  protected:
   static const int kStackDepth = 500;
   static const int kMaxSuccs = 50;
@@ -50,6 +98,8 @@ public:
   void HVBDealHand(void);
   void NoHVBDealHand(void);
   int Round(double d);
+  void MergeDeltas(void);
+  void MergeBucket(int n, int b);
 
   const BettingAbstraction &betting_abstraction_;
   const CFRConfig &cfr_config_;
@@ -117,6 +167,11 @@ public:
   int board_count_;
   bool deal_twice_;
   int **force_regrets_;
+  // Null unless some streets are delta streets
+  TCFRDeltas *deltas_;
+  // Number of updates of each node by this thread; null unless profiling contention
+  unsigned long long int *write_counts_;
+  double merge_secs_;
 };
 
 class TCFR {
@@ -135,9 +190,12 @@ private:
   void Run(void);
   void RunBatch(int batch_size);
   unsigned char *Prepare(unsigned char *ptr, Node *node, unsigned short last_bet_to,
-			 unsigned long long int ***offsets);
+			 unsigned long long int ***offsets,
+			 std::vector<unsigned long long int> *delta_nodes,
+			 std::vector<long long int> *delta_value_offsets);
   void MeasureTree(Node *node, bool ***seen, unsigned long long int *allocation_size);
   void Prepare(void);
+  void ReportContention(void);
 
   const CardAbstraction &card_abstraction_;
   const BettingAbstraction &betting_abstraction_;
@@ -168,6 +226,12 @@ private:
   unsigned long long int total_process_count_;
   unsigned long long int total_full_process_count_;
   unsigned long long int total_its_;
+  unique_ptr<TCFRDeltas> deltas_;
+  // Offset, street and nonterminal ID of each nonterminal, indexed by NODEINDEX()
+  std::vector<unsigned long long int> node_offsets_;
+  std::vector<int> node_nts_;
+  // Per-thread write counts for the contention profiler
+  unique_ptr<unique_ptr<unsigned long long int []> []> write_counts_;
 };
 
 #endif
@@ -29,6 +29,9 @@ using std::string;
 using std::unique_ptr;
 using std::vector;
 
+// Memory budget for the Agent's cache of sumprobs blocks
+static const long long int kDiskProbsCacheBytes = 1LL << 30;
+
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <card params> <betting params> "
 	  "<CFR params> <it> <seed>\n", prog_name);
@@ -60,7 +63,8 @@ int main(int argc, char *argv[]) {
   BoardTree::CreateLookup();
 
   int big_blind = 100;
-  Agent agent(*card_abstraction, *betting_abstraction, *cfr_config, it, big_blind, seed);
+  Agent agent(*card_abstraction, *betting_abstraction, *cfr_config, it, big_blind, seed,
+	      kDiskProbsCacheBytes);
   string action = "";
   unique_ptr<Card []> board(new Card[5]);
   unique_ptr<Card []> hole_cards(new Card[4]);
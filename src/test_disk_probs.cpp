@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/time.h>
 
 #include <memory>
 
@@ -65,12 +66,12 @@ static void Verify(Node *node, DiskProbs *disk_probs, CFRValues *sumprobs, const
 
 static void Usage(const char *prog_name) {
   fprintf(stderr, "USAGE: %s <game params> <card params> <betting params> "
-	  "<CFR params> <it>\n", prog_name);
+	  "<CFR params> <it> (<cache MB>)\n", prog_name);
   exit(-1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 6) Usage(argv[0]);
+  if (argc != 6 && argc != 7) Usage(argv[0]);
   Files::Init();
   unique_ptr<Params> game_params = CreateGameParams();
   game_params->ReadFromFile(argv[1]);
@@ -88,12 +89,15 @@ int main(int argc, char *argv[]) {
   unique_ptr<CFRConfig> cfr_config(new CFRConfig(*cfr_params));
   int it;
   if (sscanf(argv[5], "%i", &it) != 1) Usage(argv[0]);
+  long long int cache_mb = 0;
+  if (argc == 7 && sscanf(argv[6], "%lli", &cache_mb) != 1) Usage(argv[0]);
 
   Buckets buckets(*card_abstraction, true);
   BettingTrees betting_trees(*betting_abstraction);
   const BettingTree *betting_tree = betting_trees.GetBettingTree();
   unique_ptr<DiskProbs> disk_probs(new DiskProbs(*card_abstraction, *betting_abstraction,
-						 *cfr_config, buckets, betting_tree, it));
+						 *cfr_config, buckets, betting_tree, it,
+						 cache_mb * 1024LL * 1024LL));
 
   char dir[500];
   sprintf(dir, "%s/%s.%u.%s.%i.%i.%i.%s.%s", Files::OldCFRBase(),
@@ -106,5 +110,11 @@ int main(int argc, char *argv[]) {
   sumprobs.reset(new CFRValues(nullptr, nullptr, 0, 0, buckets, betting_tree));
   bool quantize = false;
   sumprobs->Read(dir, it, betting_tree, "x", -1, true, quantize);
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
   Verify(betting_tree->Root(), disk_probs.get(), sumprobs.get(), buckets);
+  gettimeofday(&end, NULL);
+  fprintf(stderr, "Verified in %.2f secs; cache hits %lli misses %lli\n",
+	  (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0,
+	  disk_probs->CacheHits(), disk_probs->CacheMisses());
 }
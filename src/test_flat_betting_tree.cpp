@@ -0,0 +1,129 @@
+// Checks that a FlatBettingTree mirrors the BettingTree it was compiled from and compares the
+// cost of traversing each.  The traversal visits every node depth-first and accumulates
+// something from each node so that it can't be optimized away; it is a stand-in for the
+// tree-walking overhead of VCFR and friends.
+//
+// Example:
+//   ../bin/test_flat_betting_tree holdem_params mb2b2_params 100
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <memory>
+#include <vector>
+
+#include "betting_abstraction.h"
+#include "betting_abstraction_params.h"
+#include "betting_tree.h"
+#include "files.h"
+#include "flat_betting_tree.h"
+#include "game.h"
+#include "game_params.h"
+#include "params.h"
+
+using std::unique_ptr;
+using std::vector;
+
+static void Compare(Node *node, const FlatBettingTree &flat, int n, vector<bool> *seen) {
+  const FlatNode &flat_node = flat.GetNode(n);
+  if (flat.OriginalNode(n) != node || flat.Index(node) != n ||
+      flat_node.Terminal() != node->Terminal() ||
+      flat_node.TerminalID() != node->TerminalID() ||
+      flat_node.NonterminalID() != node->NonterminalID() ||
+      flat_node.Street() != node->Street() ||
+      flat_node.PlayerActing() != node->PlayerActing() ||
+      flat_node.NumSuccs() != node->NumSuccs() ||
+      flat_node.NumRemaining() != node->NumRemaining() ||
+      flat_node.Showdown() != node->Showdown() ||
+      flat_node.LastBetTo() != node->LastBetTo() ||
+      flat_node.HasCallSucc() != node->HasCallSucc() ||
+      flat_node.HasFoldSucc() != node->HasFoldSucc() ||
+      flat_node.CallSuccIndex() != node->CallSuccIndex() ||
+      flat_node.FoldSuccIndex() != node->FoldSuccIndex()) {
+    fprintf(stderr, "Mismatch at flat node %i\n", n);
+    exit(-1);
+  }
+  if ((*seen)[n]) return;
+  (*seen)[n] = true;
+  int num_succs = node->NumSuccs();
+  for (int s = 0; s < num_succs; ++s) {
+    Compare(node->IthSucc(s), flat, flat.IthSucc(n, s), seen);
+  }
+}
+
+static long long int Walk(Node *node) {
+  if (node->Terminal()) {
+    return node->Showdown() ? node->LastBetTo() : -node->LastBetTo();
+  }
+  long long int sum = node->Street() + node->PlayerActing();
+  int num_succs = node->NumSuccs();
+  for (int s = 0; s < num_succs; ++s) {
+    sum += Walk(node->IthSucc(s));
+  }
+  return sum;
+}
+
+static long long int Walk(const FlatBettingTree &flat, int n) {
+  const FlatNode &node = flat.GetNode(n);
+  if (node.Terminal()) {
+    return node.Showdown() ? node.LastBetTo() : -node.LastBetTo();
+  }
+  long long int sum = node.Street() + node.PlayerActing();
+  int num_succs = node.NumSuccs();
+  const int *succs = flat.Succs(n);
+  for (int s = 0; s < num_succs; ++s) {
+    sum += Walk(flat, succs[s]);
+  }
+  return sum;
+}
+
+static double Secs(const struct timeval &start, const struct timeval &end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+static void Usage(const char *prog_name) {
+  fprintf(stderr, "USAGE: %s <game params> <betting params> <num reps>\n", prog_name);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) Usage(argv[0]);
+  Files::Init();
+  unique_ptr<Params> game_params = CreateGameParams();
+  game_params->ReadFromFile(argv[1]);
+  Game::Initialize(*game_params);
+  unique_ptr<Params> betting_params = CreateBettingAbstractionParams();
+  betting_params->ReadFromFile(argv[2]);
+  unique_ptr<BettingAbstraction> ba(new BettingAbstraction(*betting_params));
+  int num_reps;
+  if (sscanf(argv[3], "%i", &num_reps) != 1) Usage(argv[0]);
+
+  BettingTree betting_tree(*ba);
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  FlatBettingTree flat(betting_tree);
+  gettimeofday(&end, NULL);
+  fprintf(stderr, "Built flat tree with %i nodes in %.3f secs\n", flat.NumNodes(),
+	  Secs(start, end));
+
+  vector<bool> seen(flat.NumNodes(), false);
+  Compare(betting_tree.Root(), flat, flat.Root(), &seen);
+  fprintf(stderr, "Flat tree matches\n");
+
+  long long int node_sum = 0, flat_sum = 0;
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < num_reps; ++r) node_sum += Walk(betting_tree.Root());
+  gettimeofday(&end, NULL);
+  double node_secs = Secs(start, end);
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < num_reps; ++r) flat_sum += Walk(flat, flat.Root());
+  gettimeofday(&end, NULL);
+  double flat_secs = Secs(start, end);
+  if (node_sum != flat_sum) {
+    fprintf(stderr, "Sums differ: %lli %lli\n", node_sum, flat_sum);
+    exit(-1);
+  }
+  fprintf(stderr, "Node traversal %.3f secs; flat traversal %.3f secs (%.2fx)\n", node_secs,
+	  flat_secs, node_secs / flat_secs);
+}
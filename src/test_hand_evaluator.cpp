@@ -0,0 +1,108 @@
+// Checks HoldemHandEvaluator::EvaluateBatch() against Evaluate() on every hand of five, six and
+// seven cards and compares the rate of the two.
+//
+// Example:
+//   ../bin/test_hand_evaluator holdem_params
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <memory>
+
+#include "cards.h"
+#include "files.h"
+#include "game.h"
+#include "game_params.h"
+#include "hand_evaluator.h"
+#include "params.h"
+
+using std::unique_ptr;
+
+static double Secs(const struct timeval &start, const struct timeval &end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+// Advances cards (ascending) to the next set of num_cards cards from a deck of num_deck_cards.
+// Returns false when there are no more sets.
+static bool NextSet(int *cards, int num_cards, int num_deck_cards) {
+  for (int i = num_cards - 1; i >= 0; --i) {
+    if (cards[i] < num_deck_cards - num_cards + i) {
+      ++cards[i];
+      for (int j = i + 1; j < num_cards; ++j) cards[j] = cards[j-1] + 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void Test(const HandEvaluator &he, int num_cards) {
+  static const int kChunk = 1 << 20;
+  int num_deck_cards = Game::MaxCard() + 1;
+  unique_ptr<Card []> soa(new Card[num_cards * kChunk]);
+  unique_ptr<int []> batch_vals(new int[kChunk]);
+  unique_ptr<int []> single_vals(new int[kChunk]);
+  int set[HandEvaluator::kMaxNumCards];
+  for (int i = 0; i < num_cards; ++i) set[i] = i;
+  bool more = true;
+  long long int num_hands = 0;
+  double batch_secs = 0, single_secs = 0;
+  struct timeval start, end;
+  while (more) {
+    int n = 0;
+    while (more && n < kChunk) {
+      for (int i = 0; i < num_cards; ++i) soa[i * kChunk + n] = set[i];
+      ++n;
+      more = NextSet(set, num_cards, num_deck_cards);
+    }
+    // Pack the columns together if the last chunk is short
+    if (n < kChunk) {
+      for (int i = 1; i < num_cards; ++i) {
+	for (int h = 0; h < n; ++h) soa[i * n + h] = soa[i * kChunk + h];
+      }
+    }
+    gettimeofday(&start, NULL);
+    he.EvaluateBatch(soa.get(), num_cards, n, batch_vals.get());
+    gettimeofday(&end, NULL);
+    batch_secs += Secs(start, end);
+    gettimeofday(&start, NULL);
+    Card hand[HandEvaluator::kMaxNumCards];
+    for (int h = 0; h < n; ++h) {
+      for (int i = 0; i < num_cards; ++i) hand[i] = soa[i * n + h];
+      single_vals[h] = he.Evaluate(hand, num_cards);
+    }
+    gettimeofday(&end, NULL);
+    single_secs += Secs(start, end);
+    for (int h = 0; h < n; ++h) {
+      if (batch_vals[h] != single_vals[h]) {
+	fprintf(stderr, "Mismatch on %i-card hand:", num_cards);
+	for (int i = 0; i < num_cards; ++i) {
+	  fprintf(stderr, " ");
+	  OutputCard(soa[i * n + h]);
+	}
+	fprintf(stderr, " batch %i single %i\n", batch_vals[h], single_vals[h]);
+	exit(-1);
+      }
+    }
+    num_hands += n;
+  }
+  fprintf(stderr, "%i cards: %lli hands match; single %.1fM hands/sec; batch %.1fM hands/sec\n",
+	  num_cards, num_hands, num_hands / single_secs / 1000000.0,
+	  num_hands / batch_secs / 1000000.0);
+}
+
+static void Usage(const char *prog_name) {
+  fprintf(stderr, "USAGE: %s <game params>\n", prog_name);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) Usage(argv[0]);
+  Files::Init();
+  unique_ptr<Params> game_params = CreateGameParams();
+  game_params->ReadFromFile(argv[1]);
+  Game::Initialize(*game_params);
+  unique_ptr<HandEvaluator> he(HandEvaluator::Create(Game::GameName()));
+  int max_num_cards = Game::NumCardsForStreet(0) + Game::NumBoardCards(Game::MaxStreet());
+  for (int num_cards = 5; num_cards <= max_num_cards; ++num_cards) Test(*he, num_cards);
+}
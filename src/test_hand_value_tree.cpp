@@ -0,0 +1,224 @@
+// Checks the mapped HandValueTree against the seven-level pointer tree it replaced and compares
+// the lookup rate of the two.  The pointer tree is built here from the same file, exactly as the
+// old HandValueTree::ReadSeven() did.  Every seven-card set is checked, and then both structures
+// evaluate the same random deals.  Only games with seven-card hands (e.g., holdem) are supported.
+//
+// Example:
+//   ../bin/test_hand_value_tree holdem_params 100000000
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+#include "cards.h"
+#include "files.h"
+#include "game.h"
+#include "game_params.h"
+#include "hand_value_tree.h"
+#include "io.h"
+#include "params.h"
+
+using std::unique_ptr;
+
+static double Secs(const struct timeval &start, const struct timeval &end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+static long long int ResidentBytes(void) {
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp == NULL) return 0;
+  long long int size = 0, resident = 0;
+  if (fscanf(fp, "%lli %lli", &size, &resident) != 2) resident = 0;
+  fclose(fp);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static int *******ReadPointerTree(void) {
+  int max_card = Game::MaxCard();
+  char buf[500];
+  sprintf(buf, "%s/hand_value_tree.%s.%i.%i.7", Files::StaticBase(),
+	  Game::GameName().c_str(), Game::NumRanks(), Game::NumSuits());
+  Reader reader(buf);
+  int num_cards = max_card + 1;
+  int *******tree7 = new int ******[num_cards];
+  for (int i = 0; i < num_cards; ++i) tree7[i] = NULL;
+  for (int i1 = 6; i1 < num_cards; ++i1) {
+    int ******tree1 = new int *****[i1];
+    tree7[i1] = tree1;
+    for (int i2 = 5; i2 < i1; ++i2) {
+      int *****tree2 = new int ****[i2];
+      tree1[i2] = tree2;
+      for (int i3 = 4; i3 < i2; ++i3) {
+	int ****tree3 = new int ***[i3];
+	tree2[i3] = tree3;
+	for (int i4 = 3; i4 < i3; ++i4) {
+	  int ***tree4 = new int **[i4];
+	  tree3[i4] = tree4;
+	  for (int i5 = 2; i5 < i4; ++i5) {
+	    int **tree5 = new int *[i5];
+	    tree4[i5] = tree5;
+	    for (int i6 = 1; i6 < i5; ++i6) {
+	      int *tree6 = new int[i6];
+	      tree5[i6] = tree6;
+	      for (int i7 = 0; i7 < i6; ++i7) {
+		tree6[i7] = reader.ReadIntOrDie();
+	      }
+	    }
+	  }
+	}
+      }
+    }
+  }
+  return tree7;
+}
+
+// The lookup the old HandValueTree::Val(board, hole_cards) did for seven cards
+static int PointerTreeVal(int *******tree7, const int *board, const int *hole_cards) {
+  int a[7];
+  int i = 0, j = 0, k = 0;
+  int b = board[i];
+  int h = hole_cards[j];
+  while (i < 5 || j < 2) {
+    if (b > h) {
+      a[k++] = b;
+      ++i;
+      if (i < 5) b = board[i];
+      else       b = -1;
+    } else {
+      a[k++] = h;
+      ++j;
+      if (j < 2) h = hole_cards[j];
+      else       h = -1;
+    }
+  }
+  return tree7[a[0]][a[1]][a[2]][a[3]][a[4]][a[5]][a[6]];
+}
+
+// Walks every seven-card set in file order.  We split each set into a board and hole cards in an
+// arbitrary way so that the merge in HandValueTree::Val() is exercised.
+static void Verify(int *******tree7) {
+  int num_cards = Game::MaxCard() + 1;
+  long long int num_checked = 0;
+  int a[7];
+  for (a[0] = 6; a[0] < num_cards; ++a[0]) {
+    for (a[1] = 5; a[1] < a[0]; ++a[1]) {
+      for (a[2] = 4; a[2] < a[1]; ++a[2]) {
+	for (a[3] = 3; a[3] < a[2]; ++a[3]) {
+	  for (a[4] = 2; a[4] < a[3]; ++a[4]) {
+	    for (a[5] = 1; a[5] < a[4]; ++a[5]) {
+	      for (a[6] = 0; a[6] < a[5]; ++a[6]) {
+		int hole_cards[2], board[5];
+		hole_cards[0] = a[1];
+		hole_cards[1] = a[4];
+		board[0] = a[0];
+		board[1] = a[2];
+		board[2] = a[3];
+		board[3] = a[5];
+		board[4] = a[6];
+		int v = tree7[a[0]][a[1]][a[2]][a[3]][a[4]][a[5]][a[6]];
+		if (HandValueTree::Val(board, hole_cards) != v ||
+		    HandValueTree::Index(a, 7) != num_checked) {
+		  fprintf(stderr, "Mismatch at set %lli\n", num_checked);
+		  exit(-1);
+		}
+		++num_checked;
+	      }
+	    }
+	  }
+	}
+      }
+    }
+  }
+  fprintf(stderr, "Checked %lli sets\n", num_checked);
+}
+
+// Fills in num_deals random deals of two hole cards and five board cards, each sorted from high
+// to low.
+static void Deal(int num_deals, int *boards, int *hole_cards) {
+  int num_cards = Game::MaxCard() + 1;
+  srand48(0);
+  for (int d = 0; d < num_deals; ++d) {
+    int cards[7];
+    for (int i = 0; i < 7; ++i) {
+      bool dup;
+      do {
+	cards[i] = drand48() * num_cards;
+	dup = false;
+	for (int j = 0; j < i; ++j) if (cards[j] == cards[i]) dup = true;
+      } while (dup);
+    }
+    int *board = boards + d * 5;
+    int *hole = hole_cards + d * 2;
+    for (int i = 0; i < 5; ++i) board[i] = cards[i];
+    for (int i = 0; i < 2; ++i) hole[i] = cards[5 + i];
+    std::sort(board, board + 5, std::greater<int>());
+    std::sort(hole, hole + 2, std::greater<int>());
+  }
+}
+
+static void Usage(const char *prog_name) {
+  fprintf(stderr, "USAGE: %s <game params> <num evals>\n", prog_name);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) Usage(argv[0]);
+  Files::Init();
+  unique_ptr<Params> game_params = CreateGameParams();
+  game_params->ReadFromFile(argv[1]);
+  Game::Initialize(*game_params);
+  int num_evals;
+  if (sscanf(argv[2], "%i", &num_evals) != 1) Usage(argv[0]);
+  int max_street = Game::MaxStreet();
+  if (Game::NumCardsForStreet(0) != 2 || Game::NumBoardCards(max_street) != 5) {
+    fprintf(stderr, "Only games with two hole cards and five board cards are supported\n");
+    exit(-1);
+  }
+
+  struct timeval start, end;
+  long long int rss0 = ResidentBytes();
+  gettimeofday(&start, NULL);
+  int *******tree7 = ReadPointerTree();
+  gettimeofday(&end, NULL);
+  long long int rss1 = ResidentBytes();
+  fprintf(stderr, "Pointer tree: loaded in %.2f secs; %.1f MB resident\n", Secs(start, end),
+	  (rss1 - rss0) / 1048576.0);
+
+  gettimeofday(&start, NULL);
+  HandValueTree::Create();
+  gettimeofday(&end, NULL);
+  fprintf(stderr, "Mapped table: mapped in %.4f secs\n", Secs(start, end));
+  Verify(tree7);
+  long long int rss2 = ResidentBytes();
+  fprintf(stderr, "Mapped table: %.1f MB resident after touching every value (shared)\n",
+	  (rss2 - rss1) / 1048576.0);
+
+  unique_ptr<int []> boards(new int[num_evals * 5LL]);
+  unique_ptr<int []> hole_cards(new int[num_evals * 2LL]);
+  Deal(num_evals, boards.get(), hole_cards.get());
+
+  long long int tree_sum = 0, table_sum = 0;
+  gettimeofday(&start, NULL);
+  for (int d = 0; d < num_evals; ++d) {
+    tree_sum += PointerTreeVal(tree7, boards.get() + d * 5, hole_cards.get() + d * 2);
+  }
+  gettimeofday(&end, NULL);
+  double tree_secs = Secs(start, end);
+  gettimeofday(&start, NULL);
+  for (int d = 0; d < num_evals; ++d) {
+    table_sum += HandValueTree::Val(boards.get() + d * 5, hole_cards.get() + d * 2);
+  }
+  gettimeofday(&end, NULL);
+  double table_secs = Secs(start, end);
+  if (tree_sum != table_sum) {
+    fprintf(stderr, "Sums differ: %lli %lli\n", tree_sum, table_sum);
+    exit(-1);
+  }
+  fprintf(stderr, "Pointer tree: %.1fM evals/sec\n", num_evals / tree_secs / 1000000.0);
+  fprintf(stderr, "Mapped table: %.1fM evals/sec\n", num_evals / table_secs / 1000000.0);
+}
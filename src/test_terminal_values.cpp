@@ -0,0 +1,197 @@
+// Checks the vectorized Showdown() and Fold() in cfr_utils.cpp against the original scalar
+// implementations and reports the time taken by each.  Uses random max street boards and random
+// opponent reach probabilities.
+//
+// Example:
+//   ../bin/test_terminal_values holdem_params 1000 100
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <memory>
+#include <vector>
+
+#include "betting_tree.h"
+#include "canonical_cards.h"
+#include "cards.h"
+#include "cfr_utils.h"
+#include "files.h"
+#include "game.h"
+#include "game_params.h"
+#include "hand_value_tree.h"
+#include "params.h"
+#include "rand.h"
+
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+
+// The scalar implementation of Showdown() prior to vectorization
+static shared_ptr<double []> OldShowdown(Node *node, const CanonicalCards *hands,
+					 double *opp_probs, double sum_opp_probs,
+					 double *total_card_probs) {
+  int max_card1 = Game::MaxCard() + 1;
+  double cum_prob = 0;
+  double cum_card_probs[52];
+  for (Card c = 0; c < max_card1; ++c) cum_card_probs[c] = 0;
+  int num_hole_card_pairs = hands->NumRaw();
+  unique_ptr<double []> win_probs(new double[num_hole_card_pairs]);
+  double half_pot = node->LastBetTo();
+  shared_ptr<double []> vals(new double[num_hole_card_pairs]);
+
+  int j = 0;
+  while (j < num_hole_card_pairs) {
+    int last_hand_val = hands->HandValue(j);
+    int begin_range = j;
+    while (j < num_hole_card_pairs) {
+      int hand_val = hands->HandValue(j);
+      if (hand_val != last_hand_val) break;
+      const Card *cards = hands->Cards(j);
+      win_probs[j] = cum_prob - cum_card_probs[cards[0]] - cum_card_probs[cards[1]];
+      ++j;
+    }
+    for (int k = begin_range; k < j; ++k) {
+      const Card *cards = hands->Cards(k);
+      double prob = opp_probs[cards[0] * max_card1 + cards[1]];
+      cum_card_probs[cards[0]] += prob;
+      cum_card_probs[cards[1]] += prob;
+      cum_prob += prob;
+    }
+    for (int k = begin_range; k < j; ++k) {
+      const Card *cards = hands->Cards(k);
+      double better_hi_prob = total_card_probs[cards[0]] - cum_card_probs[cards[0]];
+      double better_lo_prob = total_card_probs[cards[1]] - cum_card_probs[cards[1]];
+      double lose_prob = (sum_opp_probs - cum_prob) - better_hi_prob - better_lo_prob;
+      vals[k] = (win_probs[k] - lose_prob) * half_pot;
+    }
+  }
+  return vals;
+}
+
+// The scalar implementation of Fold() prior to vectorization
+static shared_ptr<double []> OldFold(Node *node, int p, const CanonicalCards *hands,
+				     double *opp_probs, double sum_opp_probs,
+				     double *total_card_probs) {
+  int max_card1 = Game::MaxCard() + 1;
+  double half_pot = p == node->PlayerActing() ? node->LastBetTo() : -node->LastBetTo();
+  int num_hole_card_pairs = hands->NumRaw();
+  shared_ptr<double []> vals(new double[num_hole_card_pairs]);
+  for (int i = 0; i < num_hole_card_pairs; ++i) {
+    const Card *cards = hands->Cards(i);
+    double opp_prob = opp_probs[cards[0] * max_card1 + cards[1]];
+    vals[i] = half_pot *
+      (sum_opp_probs + opp_prob - (total_card_probs[cards[0]] + total_card_probs[cards[1]]));
+  }
+  return vals;
+}
+
+static double Secs(const struct timeval &start, const struct timeval &end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+static void Compare(const shared_ptr<double []> &vals1, const shared_ptr<double []> &vals2,
+		    int n, const char *label) {
+  for (int i = 0; i < n; ++i) {
+    double diff = fabs(vals1[i] - vals2[i]);
+    if (diff > 1e-9 * (1.0 + fabs(vals1[i]))) {
+      fprintf(stderr, "%s mismatch i %i: %.17f %.17f\n", label, i, vals1[i], vals2[i]);
+      exit(-1);
+    }
+  }
+}
+
+static void Usage(const char *prog_name) {
+  fprintf(stderr, "USAGE: %s <game params> <num boards> <num reps>\n", prog_name);
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) Usage(argv[0]);
+  Files::Init();
+  unique_ptr<Params> game_params = CreateGameParams();
+  game_params->ReadFromFile(argv[1]);
+  Game::Initialize(*game_params);
+  int num_boards, num_reps;
+  if (sscanf(argv[2], "%i", &num_boards) != 1) Usage(argv[0]);
+  if (sscanf(argv[3], "%i", &num_reps) != 1)   Usage(argv[0]);
+  if (Game::NumCardsForStreet(0) != 2) {
+    fprintf(stderr, "Only games with two hole cards supported\n");
+    exit(-1);
+  }
+  HandValueTree::Create();
+  InitRandFixed();
+
+  int max_st = Game::MaxStreet();
+  int num_board_cards = Game::NumBoardCards(max_st);
+  int max_card1 = Game::MaxCard() + 1;
+  int num_encodings = max_card1 * max_card1;
+  Node showdown_node(0, 50, 0, 0, 0, 2);
+  Node fold_node(1, 50, 0, 0, 1, 1);
+  vector< unique_ptr<CanonicalCards> > all_hands(num_boards);
+  vector< unique_ptr<double []> > all_opp_probs(num_boards);
+  for (int bd = 0; bd < num_boards; ++bd) {
+    Card board[7];
+    for (int i = 0; i < num_board_cards; ++i) {
+      Card c;
+      do {
+	c = RandBetween(0, max_card1 - 1);
+      } while (InCards(c, board, i));
+      board[i] = c;
+    }
+    all_hands[bd].reset(new CanonicalCards(2, board, num_board_cards, 0, false));
+    all_hands[bd]->SortByHandStrength(board);
+    all_opp_probs[bd].reset(new double[num_encodings]);
+    for (int i = 0; i < num_encodings; ++i) all_opp_probs[bd][i] = RandZeroToOne();
+  }
+
+  unique_ptr<double []> total_card_probs(new double[max_card1]);
+  double old_showdown_secs = 0, new_showdown_secs = 0, old_fold_secs = 0, new_fold_secs = 0;
+  struct timeval start, end;
+  for (int bd = 0; bd < num_boards; ++bd) {
+    const CanonicalCards *hands = all_hands[bd].get();
+    double *opp_probs = all_opp_probs[bd].get();
+    int n = hands->NumRaw();
+    double sum_opp_probs;
+    CommonBetResponseCalcs(max_st, hands, opp_probs, &sum_opp_probs, total_card_probs.get());
+    Compare(OldShowdown(&showdown_node, hands, opp_probs, sum_opp_probs, total_card_probs.get()),
+	    Showdown(&showdown_node, hands, opp_probs, sum_opp_probs, total_card_probs.get()), n,
+	    "Showdown");
+    for (int p = 0; p <= 1; ++p) {
+      Compare(OldFold(&fold_node, p, hands, opp_probs, sum_opp_probs, total_card_probs.get()),
+	      Fold(&fold_node, p, hands, opp_probs, sum_opp_probs, total_card_probs.get()), n,
+	      "Fold");
+    }
+
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < num_reps; ++r) {
+      OldShowdown(&showdown_node, hands, opp_probs, sum_opp_probs, total_card_probs.get());
+    }
+    gettimeofday(&end, NULL);
+    old_showdown_secs += Secs(start, end);
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < num_reps; ++r) {
+      Showdown(&showdown_node, hands, opp_probs, sum_opp_probs, total_card_probs.get());
+    }
+    gettimeofday(&end, NULL);
+    new_showdown_secs += Secs(start, end);
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < num_reps; ++r) {
+      OldFold(&fold_node, r & 1, hands, opp_probs, sum_opp_probs, total_card_probs.get());
+    }
+    gettimeofday(&end, NULL);
+    old_fold_secs += Secs(start, end);
+    gettimeofday(&start, NULL);
+    for (int r = 0; r < num_reps; ++r) {
+      Fold(&fold_node, r & 1, hands, opp_probs, sum_opp_probs, total_card_probs.get());
+    }
+    gettimeofday(&end, NULL);
+    new_fold_secs += Secs(start, end);
+  }
+  fprintf(stderr, "Results match on %i boards\n", num_boards);
+  fprintf(stderr, "Showdown: old %.3f secs new %.3f secs (%.2fx)\n", old_showdown_secs,
+	  new_showdown_secs, old_showdown_secs / new_showdown_secs);
+  fprintf(stderr, "Fold: old %.3f secs new %.3f secs (%.2fx)\n", old_fold_secs, new_fold_secs,
+	  old_fold_secs / new_fold_secs);
+}
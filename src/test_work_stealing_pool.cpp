@@ -0,0 +1,90 @@
+// Checks that WorkStealingPool::Shared() never has more than one pool running: a caller that
+// asks for more threads than the live pool has gets that pool, and the number of threads in the
+// process stays at the main thread plus one pool's workers.  Also checks that no more tasks run
+// at once than the pool has workers, even with nested groups.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+
+#include "work_stealing_pool.h"
+
+using std::shared_ptr;
+
+static int NumProcessThreads(void) {
+  FILE *fp = fopen("/proc/self/status", "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Couldn't open /proc/self/status\n");
+    exit(-1);
+  }
+  char line[500];
+  int num_threads = -1;
+  while (fgets(line, sizeof(line), fp)) {
+    if (! strncmp(line, "Threads:", 8)) num_threads = atoi(line + 8);
+  }
+  fclose(fp);
+  return num_threads;
+}
+
+static void Check(bool ok, const char *what) {
+  if (! ok) {
+    fprintf(stderr, "FAILED: %s\n", what);
+    exit(-1);
+  }
+  fprintf(stderr, "OK: %s\n", what);
+}
+
+static std::atomic<int> g_running(0);
+static std::atomic<int> g_max_running(0);
+
+static void Work(void) {
+  int running = ++g_running;
+  int max_running = g_max_running.load();
+  while (running > max_running && ! g_max_running.compare_exchange_weak(max_running, running)) {
+  }
+  usleep(1000);
+  --g_running;
+}
+
+// Each outer task splits into inner tasks and waits for them, as VCFR does on the flop and
+// again on the turn.
+static void RunNested(WorkStealingPool *pool) {
+  TaskGroup outer;
+  for (int i = 0; i < 8; ++i) {
+    pool->Submit(&outer, [pool]() {
+      TaskGroup inner;
+      for (int j = 0; j < 8; ++j) pool->Submit(&inner, Work);
+      pool->Wait(&inner);
+    });
+  }
+  pool->Wait(&outer);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 1) {
+    fprintf(stderr, "USAGE: %s\n", argv[0]);
+    exit(-1);
+  }
+  int base_threads = NumProcessThreads();
+  {
+    shared_ptr<WorkStealingPool> small = WorkStealingPool::Shared(2);
+    shared_ptr<WorkStealingPool> big = WorkStealingPool::Shared(6);
+    Check(big == small, "a bigger request reuses the live pool");
+    Check(big->NumThreads() == 2, "the reused pool keeps its size");
+    Check(NumProcessThreads() == base_threads + 2, "only one pool's workers are running");
+    RunNested(big.get());
+    Check(g_max_running.load() <= 2, "no more tasks run at once than the pool has workers");
+  }
+  Check(NumProcessThreads() == base_threads, "the pool goes away with its last holder");
+  shared_ptr<WorkStealingPool> pool = WorkStealingPool::Shared(6);
+  Check(pool->NumThreads() == 6, "a new pool gets the requested size");
+  Check(NumProcessThreads() == base_threads + 6, "only the new pool's workers are running");
+  g_max_running = 0;
+  RunNested(pool.get());
+  Check(g_max_running.load() <= 6, "no more tasks run at once than the new pool has workers");
+  fprintf(stderr, "All tests passed\n");
+}
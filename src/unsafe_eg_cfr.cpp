@@ -40,11 +40,9 @@ void UnsafeEGCFR::SolveSubgame(BettingTrees *subtrees, int solve_bd, const Reach
 
   // Should honor sumprobs_streets_
 
-  sumprobs_.reset(new CFRValues(nullptr, subtree_streets.get(), solve_bd, subtree_st, buckets_,
-				subtrees->GetBettingTree()));
-  sumprobs_->AllocateAndClear(subtrees->GetBettingTree(), CFRValueType::CFR_DOUBLE, false, -1);
+  InitializeSumprobs(nullptr, subtree_streets.get(), solve_bd, subtree_st, subtrees);
 
-  for (it_ = 1; it_ <= num_its; ++it_) {
+  for (it_ = 1; it_ <= num_its && TimeForIteration(); ++it_) {
     // Go from high to low to mimic slumbot2017 code
     for (int p = (int)num_players - 1; p >= 0; --p) {
       HalfIteration(subtrees, p, reach_probs.Get(p^1), hand_tree, action_sequence);
@@ -0,0 +1,178 @@
+// The entropy coder is a byte-oriented rANS coder with a 32-bit state and 12-bit frequencies.
+// Encoding runs backwards over the block so that decoding runs forwards.  Decoding a symbol is
+// one table lookup, a multiply and an occasional byte read, which is much faster than reading the
+// uncompressed values from disk.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "io.h"
+#include "value_compression.h"
+
+static const int kScaleBits = 12;
+static const unsigned int kTotFreq = 1U << kScaleBits;
+// Lower bound of the normalized state interval
+static const unsigned int kRANSL = 1U << 23;
+
+// Scales the counts of the symbols present so that they sum to kTotFreq while keeping every
+// present symbol's frequency at least one.
+static void NormalizeFreqs(const unsigned int *counts, unsigned int total,
+			   unsigned int *freqs) {
+  unsigned int sum = 0;
+  for (int i = 0; i < 256; ++i) {
+    if (counts[i] == 0) {
+      freqs[i] = 0;
+      continue;
+    }
+    unsigned int f = ((unsigned long long int)counts[i] * kTotFreq) / total;
+    if (f == 0) f = 1;
+    freqs[i] = f;
+    sum += f;
+  }
+  while (sum != kTotFreq) {
+    // Adjust the most frequent symbol, which loses the least by the adjustment
+    int best = -1;
+    for (int i = 0; i < 256; ++i) {
+      if (freqs[i] > 1 && (best == -1 || freqs[i] > freqs[best])) best = i;
+    }
+    if (best == -1) {
+      // Only possible if every present symbol has frequency one and there are too few of them
+      for (int i = 0; i < 256; ++i) if (freqs[i] > 0) best = i;
+    }
+    if (sum > kTotFreq) {
+      unsigned int d = sum - kTotFreq;
+      if (d > freqs[best] - 1) d = freqs[best] - 1;
+      freqs[best] -= d;
+      sum -= d;
+    } else {
+      freqs[best] += kTotFreq - sum;
+      sum = kTotFreq;
+    }
+  }
+}
+
+ValueCompressor::ValueCompressor(Writer *writer) {
+  writer_ = writer;
+  raw_.reset(new unsigned char[kBlockSize]);
+  // Room for incompressible data; such blocks are stored raw anyway
+  encoded_.reset(new unsigned char[kBlockSize + kBlockSize / 8 + 16]);
+  raw_size_ = 0;
+}
+
+void ValueCompressor::FlushBlock(void) {
+  if (raw_size_ == 0) return;
+  unsigned int counts[256], freqs[256], starts[256];
+  for (int i = 0; i < 256; ++i) counts[i] = 0;
+  for (int i = 0; i < raw_size_; ++i) ++counts[raw_[i]];
+  NormalizeFreqs(counts, raw_size_, freqs);
+  unsigned int cum = 0;
+  for (int i = 0; i < 256; ++i) {
+    starts[i] = cum;
+    cum += freqs[i];
+  }
+
+  int capacity = kBlockSize + kBlockSize / 8 + 16;
+  unsigned char *end = encoded_.get() + capacity;
+  unsigned char *ptr = end;
+  // Stop early if the output would be no smaller than the input
+  unsigned char *limit = end - raw_size_;
+  unsigned int x = kRANSL;
+  bool stored = false;
+  for (int i = raw_size_ - 1; i >= 0; --i) {
+    unsigned char sym = raw_[i];
+    unsigned int freq = freqs[sym];
+    unsigned int x_max = ((kRANSL >> kScaleBits) << 8) * freq;
+    while (x >= x_max) {
+      *--ptr = x & 0xff;
+      x >>= 8;
+    }
+    x = ((x / freq) << kScaleBits) + (x % freq) + starts[sym];
+    if (ptr - 4 <= limit) {
+      stored = true;
+      break;
+    }
+  }
+  writer_->WriteUnsignedInt(raw_size_);
+  if (stored) {
+    writer_->WriteUnsignedInt(0);
+    writer_->WriteNBytes(raw_.get(), raw_size_);
+  } else {
+    ptr -= 4;
+    ptr[0] = x & 0xff;
+    ptr[1] = (x >> 8) & 0xff;
+    ptr[2] = (x >> 16) & 0xff;
+    ptr[3] = (x >> 24) & 0xff;
+    int encoded_size = end - ptr;
+    writer_->WriteUnsignedInt(encoded_size);
+    for (int i = 0; i < 256; ++i) writer_->WriteUnsignedShort(freqs[i]);
+    writer_->WriteNBytes(ptr, encoded_size);
+  }
+  raw_size_ = 0;
+}
+
+void ValueCompressor::Finish(void) {
+  FlushBlock();
+}
+
+ValueDecompressor::ValueDecompressor(Reader *reader) {
+  reader_ = reader;
+  raw_.reset(new unsigned char[ValueCompressor::kBlockSize]);
+  encoded_.reset(new unsigned char[ValueCompressor::kBlockSize]);
+  raw_size_ = 0;
+  raw_pos_ = 0;
+}
+
+void ValueDecompressor::ReadBlock(void) {
+  unsigned int raw_size, encoded_size;
+  if (! reader_->ReadUnsignedInt(&raw_size)) {
+    fprintf(stderr, "ValueDecompressor: premature end of %s\n", reader_->Filename().c_str());
+    exit(-1);
+  }
+  encoded_size = reader_->ReadUnsignedIntOrDie();
+  if (raw_size == 0 || raw_size > (unsigned int)ValueCompressor::kBlockSize ||
+      encoded_size >= raw_size) {
+    fprintf(stderr, "ValueDecompressor: corrupt block header in %s\n",
+	    reader_->Filename().c_str());
+    exit(-1);
+  }
+  raw_size_ = raw_size;
+  raw_pos_ = 0;
+  if (encoded_size == 0) {
+    reader_->ReadNBytesOrDie(raw_size, raw_.get());
+    return;
+  }
+  unsigned int freqs[256], starts[256];
+  unsigned char syms[kTotFreq];
+  unsigned int cum = 0;
+  for (int i = 0; i < 256; ++i) {
+    freqs[i] = reader_->ReadUnsignedShortOrDie();
+    starts[i] = cum;
+    if (cum + freqs[i] > kTotFreq) {
+      fprintf(stderr, "ValueDecompressor: bad frequencies in %s\n", reader_->Filename().c_str());
+      exit(-1);
+    }
+    for (unsigned int j = 0; j < freqs[i]; ++j) syms[cum + j] = i;
+    cum += freqs[i];
+  }
+  if (cum != kTotFreq) {
+    fprintf(stderr, "ValueDecompressor: bad frequencies in %s\n", reader_->Filename().c_str());
+    exit(-1);
+  }
+  reader_->ReadNBytesOrDie(encoded_size, encoded_.get());
+  const unsigned char *ptr = encoded_.get();
+  const unsigned char *end = ptr + encoded_size;
+  unsigned int x = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((unsigned int)ptr[3] << 24);
+  ptr += 4;
+  unsigned char *raw = raw_.get();
+  unsigned int mask = kTotFreq - 1;
+  for (unsigned int i = 0; i < raw_size; ++i) {
+    unsigned char sym = syms[x & mask];
+    raw[i] = sym;
+    x = freqs[sym] * (x >> kScaleBits) + (x & mask) - starts[sym];
+    while (x < kRANSL && ptr < end) x = (x << 8) | *ptr++;
+  }
+  if (ptr != end) {
+    fprintf(stderr, "ValueDecompressor: corrupt block in %s\n", reader_->Filename().c_str());
+    exit(-1);
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef _VALUE_COMPRESSION_H_
+#define _VALUE_COMPRESSION_H_
+
+// A block-compressed stream of integer CFR values (regrets or sumprobs).  Values are written a
+// node at a time as a holding-major array of per-holding successor vectors.  Each value is
+// predicted by the value for the same successor at the previous holding (neighboring buckets and
+// hands tend to have similar values, and zeros come in runs); the residual is zigzag coded so that
+// small negative and positive residuals both map to small numbers, and then written as a varint.
+// The varint bytes are gathered into blocks of up to kBlockSize bytes, and each block is entropy
+// coded with an order-0 rANS coder using a frequency table stored in the block header.  A block
+// that doesn't shrink is stored raw.
+//
+// Block format:
+//   raw size (unsigned int)
+//   encoded size (unsigned int); zero if the block is stored raw
+//   if encoded: 256 symbol frequencies (unsigned short each), then the encoded bytes
+//   else: the raw bytes
+//
+// Nodes don't need to line up with blocks, so a file is a single stream that is written and read
+// in one pass.  Only integer value types are supported.
+
+#include <memory>
+
+#include "io.h"
+
+class ValueCompressor {
+public:
+  ValueCompressor(Writer *writer);
+  ~ValueCompressor(void) {}
+  template <typename T> void Write(const T *vals, int num_holdings, int num_succs);
+  // Must be called after the last value is written and before the writer is closed.
+  void Finish(void);
+
+  static const int kBlockSize = 1 << 20;
+private:
+  void FlushBlock(void);
+  void PutByte(unsigned char b) {
+    if (raw_size_ == kBlockSize) FlushBlock();
+    raw_[raw_size_++] = b;
+  }
+  void PutVarint(unsigned long long int u) {
+    while (u >= 0x80) {
+      PutByte((u & 0x7f) | 0x80);
+      u >>= 7;
+    }
+    PutByte(u);
+  }
+
+  Writer *writer_;
+  std::unique_ptr<unsigned char []> raw_;
+  std::unique_ptr<unsigned char []> encoded_;
+  int raw_size_;
+};
+
+class ValueDecompressor {
+public:
+  ValueDecompressor(Reader *reader);
+  ~ValueDecompressor(void) {}
+  template <typename T> void Read(T *vals, int num_holdings, int num_succs);
+  bool AtEnd(void) const {return raw_pos_ == raw_size_ && reader_->AtEnd();}
+private:
+  void ReadBlock(void);
+  unsigned char GetByte(void) {
+    if (raw_pos_ == raw_size_) ReadBlock();
+    return raw_[raw_pos_++];
+  }
+  unsigned long long int GetVarint(void) {
+    unsigned long long int u = 0;
+    int shift = 0;
+    while (true) {
+      unsigned char b = GetByte();
+      u |= ((unsigned long long int)(b & 0x7f)) << shift;
+      if (b < 0x80) return u;
+      shift += 7;
+    }
+  }
+
+  Reader *reader_;
+  std::unique_ptr<unsigned char []> raw_;
+  std::unique_ptr<unsigned char []> encoded_;
+  int raw_size_;
+  int raw_pos_;
+};
+
+static inline unsigned long long int ZigZag(long long int v) {
+  return (((unsigned long long int)v) << 1) ^ (unsigned long long int)(v >> 63);
+}
+
+static inline long long int UnZigZag(unsigned long long int u) {
+  return (long long int)(u >> 1) ^ -(long long int)(u & 1);
+}
+
+template <typename T>
+void ValueCompressor::Write(const T *vals, int num_holdings, int num_succs) {
+  for (int s = 0; s < num_succs; ++s) PutVarint(ZigZag((long long int)vals[s]));
+  int num_actions = num_holdings * num_succs;
+  for (int a = num_succs; a < num_actions; ++a) {
+    PutVarint(ZigZag((long long int)vals[a] - (long long int)vals[a - num_succs]));
+  }
+}
+
+template <typename T>
+void ValueDecompressor::Read(T *vals, int num_holdings, int num_succs) {
+  for (int s = 0; s < num_succs; ++s) vals[s] = UnZigZag(GetVarint());
+  int num_actions = num_holdings * num_succs;
+  for (int a = num_succs; a < num_actions; ++a) {
+    vals[a] = (long long int)vals[a - num_succs] + UnZigZag(GetVarint());
+  }
+}
+
+#endif
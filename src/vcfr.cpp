@@ -1,8 +1,8 @@
 #include <math.h> // lrint()
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h> // usleep()
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -20,12 +20,17 @@
 #include "hand_tree.h"
 #include "vcfr_state.h"
 #include "vcfr.h"
+#include "work_stealing_pool.h"
 
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
 using std::vector;
 
+// Hands of a board are grouped by bucket only on streets whose buckets hold at least this many
+// hands on average
+static const long long int kMinHandsPerBucket = 4;
+
 template <>
 void VCFR::UpdateRegrets<int>(Node *node, double *vals, shared_ptr<double []> *succ_vals,
 			      int *regrets) {
@@ -211,7 +216,110 @@ void VCFR::UpdateRegretsBucketed(Node *node, int *street_buckets, double *vals,
   }
 }
 
-void VCFR::UpdateRegretsBucketed(Node *node, int *street_buckets, double *vals,
+// The regret deltas of all the hands in a bucket are summed before being applied, so the
+// rounding, flooring and overflow checks happen once per bucket rather than once per hand.
+void VCFR::UpdateRegretsGrouped(Node *node, const VCFRState &state, double *vals,
+				shared_ptr<double []> *succ_vals, int *regrets) {
+  int st = node->Street();
+  int num_succs = node->NumSuccs();
+  const int *street_buckets = state.StreetBuckets(st);
+  const int *bucket_order = state.StreetBucketOrder(st);
+  const int *run_begins = state.StreetBucketRunBegins(st);
+  int num_runs = state.NumStreetBucketRuns(st);
+  double *deltas = state.Scratch(num_succs);
+
+  int floor = regret_floors_[st];
+  int ceiling = regret_ceilings_[st];
+  double scaling = regret_scaling_[st];
+  for (int r = 0; r < num_runs; ++r) {
+    int begin = run_begins[r];
+    int end = run_begins[r + 1];
+    for (int s = 0; s < num_succs; ++s) deltas[s] = 0;
+    for (int j = begin; j < end; ++j) {
+      int i = bucket_order[j];
+      double v = vals[i];
+      for (int s = 0; s < num_succs; ++s) {
+	deltas[s] += succ_vals[s][i] - v;
+      }
+    }
+    int b = street_buckets[bucket_order[begin]];
+    int *my_regrets = regrets + b * num_succs;
+    if (nn_regrets_) {
+      for (int s = 0; s < num_succs; ++s) {
+	// Need different implementation for doubles
+	int di = lrint(deltas[s] * scaling);
+	int ri = my_regrets[s] + di;
+	if (ri < floor) {
+	  my_regrets[s] = floor;
+	} else if (ri > ceiling) {
+	  my_regrets[s] = ceiling;
+	} else {
+	  my_regrets[s] = ri;
+	}
+      }
+    } else {
+      bool overflow = false;
+      for (int s = 0; s < num_succs; ++s) {
+	my_regrets[s] += lrint(deltas[s] * scaling);
+	if (my_regrets[s] < -2000000000 || my_regrets[s] > 2000000000) {
+	  overflow = true;
+	}
+      }
+      if (overflow) {
+	for (int s = 0; s < num_succs; ++s) {
+	  my_regrets[s] /= 2;
+	}
+      }
+    }
+  }
+}
+
+// Doesn't round regrets to ints or scale them.
+void VCFR::UpdateRegretsGrouped(Node *node, const VCFRState &state, double *vals,
+				shared_ptr<double []> *succ_vals, double *regrets) {
+  int st = node->Street();
+  int num_succs = node->NumSuccs();
+  const int *street_buckets = state.StreetBuckets(st);
+  const int *bucket_order = state.StreetBucketOrder(st);
+  const int *run_begins = state.StreetBucketRunBegins(st);
+  int num_runs = state.NumStreetBucketRuns(st);
+  double *deltas = state.Scratch(num_succs);
+
+  double floor = regret_floors_[st];
+  double ceiling = regret_ceilings_[st];
+  for (int r = 0; r < num_runs; ++r) {
+    int begin = run_begins[r];
+    int end = run_begins[r + 1];
+    for (int s = 0; s < num_succs; ++s) deltas[s] = 0;
+    for (int j = begin; j < end; ++j) {
+      int i = bucket_order[j];
+      double v = vals[i];
+      for (int s = 0; s < num_succs; ++s) {
+	deltas[s] += succ_vals[s][i] - v;
+      }
+    }
+    int b = street_buckets[bucket_order[begin]];
+    double *my_regrets = regrets + b * num_succs;
+    if (nn_regrets_) {
+      for (int s = 0; s < num_succs; ++s) {
+	double newr = my_regrets[s] + deltas[s];
+	if (newr < floor) {
+	  my_regrets[s] = floor;
+	} else if (newr > ceiling) {
+	  my_regrets[s] = ceiling;
+	} else {
+	  my_regrets[s] = newr;
+	}
+      }
+    } else {
+      for (int s = 0; s < num_succs; ++s) {
+	my_regrets[s] += deltas[s];
+      }
+    }
+  }
+}
+
+void VCFR::UpdateRegretsBucketed(Node *node, const VCFRState &state, double *vals,
 				 shared_ptr<double []> *succ_vals) {
   int pa = node->PlayerActing();
   int st = node->Street();
@@ -222,11 +330,19 @@ void VCFR::UpdateRegretsBucketed(Node *node, int *street_buckets, double *vals,
   if ((d_street_values =
        dynamic_cast<CFRStreetValues<double> *>(street_values))) {
     double *d_regrets = d_street_values->AllValues(pa, nt);
-    UpdateRegretsBucketed(node, street_buckets, vals, succ_vals, d_regrets);
+    if (group_by_bucket_streets_[st]) {
+      UpdateRegretsGrouped(node, state, vals, succ_vals, d_regrets);
+    } else {
+      UpdateRegretsBucketed(node, state.StreetBuckets(st), vals, succ_vals, d_regrets);
+    }
   } else if ((i_street_values =
 	      dynamic_cast<CFRStreetValues<int> *>(street_values))) {
     int *i_regrets = i_street_values->AllValues(pa, nt);
-    UpdateRegretsBucketed(node, street_buckets, vals, succ_vals, i_regrets);
+    if (group_by_bucket_streets_[st]) {
+      UpdateRegretsGrouped(node, state, vals, succ_vals, i_regrets);
+    } else {
+      UpdateRegretsBucketed(node, state.StreetBuckets(st), vals, succ_vals, i_regrets);
+    }
   }
 }
 
@@ -275,12 +391,31 @@ shared_ptr<double []> VCFR::OurChoice(Node *p0_node, Node *p1_node, int gbd, VCF
 	CFRStreetValues<double> *street_values =
 	  dynamic_cast< CFRStreetValues<double> *>(
 			current_strategy_->StreetValues(st));
-	for (int i = 0; i < num_hole_card_pairs; ++i) {
-	  int b = street_buckets[i];
-	  double *current_probs =
-	    street_values->AllValues(pa, nt) + b * num_succs;
-	  for (int s = 0; s < num_succs; ++s) {
-	    vals[i] += succ_vals[s][i] * current_probs[s];
+	if (group_by_bucket_streets_[st]) {
+	  const int *bucket_order = state->StreetBucketOrder(st);
+	  const int *run_begins = state->StreetBucketRunBegins(st);
+	  int num_runs = state->NumStreetBucketRuns(st);
+	  for (int r = 0; r < num_runs; ++r) {
+	    int begin = run_begins[r];
+	    int end = run_begins[r + 1];
+	    int b = street_buckets[bucket_order[begin]];
+	    double *current_probs =
+	      street_values->AllValues(pa, nt) + b * num_succs;
+	    for (int j = begin; j < end; ++j) {
+	      int i = bucket_order[j];
+	      for (int s = 0; s < num_succs; ++s) {
+		vals[i] += succ_vals[s][i] * current_probs[s];
+	      }
+	    }
+	  }
+	} else {
+	  for (int i = 0; i < num_hole_card_pairs; ++i) {
+	    int b = street_buckets[i];
+	    double *current_probs =
+	      street_values->AllValues(pa, nt) + b * num_succs;
+	    for (int s = 0; s < num_succs; ++s) {
+	      vals[i] += succ_vals[s][i] * current_probs[s];
+	    }
 	  }
 	}
       } else {
@@ -290,10 +425,17 @@ shared_ptr<double []> VCFR::OurChoice(Node *p0_node, Node *p1_node, int gbd, VCF
 	} else {
 	  street_values = regrets_->StreetValues(st);
 	}
-	unique_ptr<double []> current_probs(new double[num_succs]);
-	if (bucketed) {
-	  street_values->ComputeOurValsBucketed(pa, nt, num_hole_card_pairs, num_succs, dsi,
-						succ_vals.get(), street_buckets, vals);
+	if (bucketed && group_by_bucket_streets_[st]) {
+	  street_values->ComputeOurValsBucketed(pa, nt, num_succs, dsi, succ_vals.get(),
+						street_buckets, state->StreetBucketOrder(st),
+						state->StreetBucketRunBegins(st),
+						state->NumStreetBucketRuns(st),
+						state->Scratch(num_succs), vals);
+	} else if (bucketed) {
+	  street_values->ComputeOurValsBucketed(pa, nt, num_succs, dsi, succ_vals.get(),
+						street_buckets, nullptr, nullptr,
+						num_hole_card_pairs, state->Scratch(num_succs),
+						vals);
 	} else {
 	  street_values->ComputeOurVals(pa, nt, num_hole_card_pairs, num_succs, dsi,
 					succ_vals.get(), lbd, vals);
@@ -310,7 +452,7 @@ shared_ptr<double []> VCFR::OurChoice(Node *p0_node, Node *p1_node, int gbd, VCF
       }
       if (! value_calculation_ && ! pre_phase_) {
 	if (bucketed) {
-	  UpdateRegretsBucketed(node, state->StreetBuckets(st), vals.get(), succ_vals.get());
+	  UpdateRegretsBucketed(node, *state, vals.get(), succ_vals.get());
 	} else {
 	  // Need values for current board if this is unabstracted system
 	  UpdateRegrets(node, lbd, vals.get(), succ_vals.get());
@@ -511,147 +653,63 @@ shared_ptr<double []> VCFR::OppChoice(Node *p0_node, Node *p1_node, int gbd, VCF
   return vals;
 }
 
-using std::queue;
-using std::shared_ptr;
-using std::unique_ptr;
-
-Request::Request(RequestType t, Node *p0_node, Node *p1_node, int gbd, const VCFRState *pred_state,
-		 int *prev_canons) : request_type_(t), p0_node_(p0_node), p1_node_(p1_node),
-				     gbd_(gbd), pred_state_(pred_state), prev_canons_(prev_canons) {
-}
-
-VCFRWorker::VCFRWorker(VCFR *vcfr) : vcfr_(vcfr) {
-}
-
-// Should be sure to call this while the worker is idle
-void VCFRWorker::Reset(int pst) {
-  int num_prev_hole_card_pairs = Game::NumHoleCardPairs(pst);
-  vals_.reset(new double[num_prev_hole_card_pairs]);
-  for (int i = 0; i < num_prev_hole_card_pairs; ++i) vals_[i] = 0;
-}
-
-void VCFRWorker::HandleRequest(const Request &request) {
-  Node *p0_node = request.P0Node();
-  Node *p1_node = request.P1Node();
-  int ngbd = request.GBD();
-  const VCFRState &pred_state = request.PredState();
-  int *prev_canons = request.PrevCanons();
-  int nst = p0_node->Street();
-  if (vals_.get() == nullptr) {
-    fprintf(stderr, "vals_ uninitialized\n");
-    exit(-1);
-  }
-  shared_ptr<double []> bd_vals = vcfr_->ProcessSubgame(p0_node, p1_node, ngbd, pred_state);
-  const CanonicalCards *hands = pred_state.Hands(nst, ngbd);
-  int board_variants = BoardTree::NumVariants(nst, ngbd);
-  int num_hands = hands->NumRaw();
-  int max_card1 = Game::MaxCard() + 1;
-  for (int nhcp = 0; nhcp < num_hands; ++nhcp) {
-    const Card *cards = hands->Cards(nhcp);
-    Card hi = cards[0];
-    Card lo = cards[1];
-    int enc = hi * max_card1 + lo;
-    int prev_canon = prev_canons[enc];
-    vals_[prev_canon] += board_variants * bd_vals[nhcp];
-  }
+void VCFR::SetSplitStreet(int st) {
+  int max_street = Game::MaxStreet();
+  for (int st1 = 0; st1 <= max_street; ++st1) split_streets_[st1] = false;
+  if (st >= 0 && st <= max_street) split_streets_[st] = true;
 }
 
-void VCFRWorker::MainLoop(void) {
-  queue<Request> *request_queue = vcfr_->GetRequestQueue();
-  pthread_mutex_t *queue_mutex = vcfr_->GetQueueMutex();
-  pthread_cond_t *queue_not_empty = vcfr_->GetQueueNotEmpty();
-  pthread_cond_t *queue_not_full = vcfr_->GetQueueNotFull();
-
-  while (true) {
-    pthread_mutex_lock(queue_mutex);
-
-    // Wait while the queue is empty.
-    while (request_queue->empty()) {
-      pthread_cond_wait(queue_not_empty, queue_mutex);
-    }
-
-    Request request = request_queue->front();
-    request_queue->pop();
-
-    pthread_cond_signal(queue_not_full);
-    pthread_mutex_unlock(queue_mutex);
-    if (request.GetRequestType() == RequestType::QUIT) {
-      vcfr_->IncrementNumDone();
-      break;
+void VCFR::SetSplitStreets(const vector<int> &streets) {
+  int max_street = Game::MaxStreet();
+  for (int st = 0; st <= max_street; ++st) split_streets_[st] = false;
+  for (int st : streets) {
+    if (st < 0 || st > max_street) {
+      fprintf(stderr, "Illegal split street %i\n", st);
+      exit(-1);
     }
-
-    HandleRequest(request);
-    vcfr_->IncrementNumDone();
-  }
-}
-
-static void *worker_thread_run(void *v_w) {
-  VCFRWorker *w = (VCFRWorker *)v_w;
-  w->MainLoop();
-  return NULL;
-}
-
-void VCFRWorker::Run(void) {
-  pthread_create(&pthread_id_, NULL, worker_thread_run, this);
-}
-
-void VCFRWorker::Join(void) {
-  pthread_join(pthread_id_, NULL);
-}
-
-void VCFR::SpawnWorkers(void) {
-  workers_.reset(new unique_ptr<VCFRWorker>[num_threads_]);
-  for (int i = 0; i < num_threads_; ++i) {
-    workers_[i].reset(new VCFRWorker(this));
-    workers_[i]->Run();
+    split_streets_[st] = true;
   }
 }
 
-void VCFR::IncrementNumDone(void) {
-  pthread_mutex_lock(&num_done_mutex_);
-  ++num_done_;
-  pthread_mutex_unlock(&num_done_mutex_);
-}
-
-void VCFR::Split(Node *p0_node, Node *p1_node, int pgbd, VCFRState *state, int *prev_canons,
-		 double *vals) {
+// Processes each of the successor boards as a separate task in the thread pool.  Each worker
+// thread accumulates the values of the boards it processed into its own vector; we sum those
+// vectors at the end.  If the task for a board splits again on a later street, the worker that
+// waits for the nested split runs other queued tasks in the meantime.
+void VCFR::Split(Node *p0_node, Node *p1_node, int ngbd_begin, int ngbd_end, VCFRState *state,
+		 int *prev_canons, double *vals) {
   int nst = p0_node->Street();
   int pst = nst - 1;
-
-  // Reset the workers; i.e., initialize all values to zero
-  // Can only do this while workers are idle
-  for (int t = 0; t < num_threads_; ++t) {
-    workers_[t]->Reset(pst);
-  }
-  
-  num_done_ = 0;
-  int ngbd_begin = BoardTree::SuccBoardBegin(pst, pgbd, nst);
-  int ngbd_end = BoardTree::SuccBoardEnd(pst, pgbd, nst);
+  int num_prev_hole_card_pairs = Game::NumHoleCardPairs(pst);
+  int num_pool_threads = pool_->NumThreads();
+  unique_ptr<unique_ptr<double []> []> thread_vals(new unique_ptr<double []>[num_pool_threads]);
+  const VCFRState *pred_state = state;
+  TaskGroup group;
   for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
-    // Push onto the queue under mutex protection
-    pthread_mutex_lock(&queue_mutex_);
-    // Wait until there’s room in the queue.
-    while (request_queue_.size() == kRequestQueueMaxSize) {
-      pthread_cond_wait(&queue_not_full_, &queue_mutex_);
-    }
-    Request request(RequestType::PROCESS, p0_node, p1_node, ngbd, state, prev_canons);
-    request_queue_.push(request);
-    // Inform waiting threads that queue has a request
-    pthread_cond_signal(&queue_not_empty_);
-    pthread_mutex_unlock(&queue_mutex_);
-  }
-
-  // There should be a better way to do this without a busy loop
-  int num_requests = ngbd_end - ngbd_begin;
-  while (true) {
-    // No mutex needed, right?
-    if (num_done_ == num_requests) break;
-    usleep(1);
+    pool_->Submit(&group, [this, p0_node, p1_node, ngbd, nst, pred_state, prev_canons,
+			   num_prev_hole_card_pairs, &thread_vals]() {
+      int t = pool_->CurrentWorker();
+      if (thread_vals[t].get() == nullptr) {
+	thread_vals[t].reset(new double[num_prev_hole_card_pairs]);
+	for (int i = 0; i < num_prev_hole_card_pairs; ++i) thread_vals[t][i] = 0;
+      }
+      double *t_vals = thread_vals[t].get();
+      shared_ptr<double []> bd_vals = ProcessSubgame(p0_node, p1_node, ngbd, *pred_state);
+      const CanonicalCards *hands = pred_state->Hands(nst, ngbd);
+      int board_variants = BoardTree::NumVariants(nst, ngbd);
+      int num_hands = hands->NumRaw();
+      int max_card1 = Game::MaxCard() + 1;
+      for (int nhcp = 0; nhcp < num_hands; ++nhcp) {
+	const Card *cards = hands->Cards(nhcp);
+	int enc = cards[0] * max_card1 + cards[1];
+	t_vals[prev_canons[enc]] += board_variants * bd_vals[nhcp];
+      }
+    });
   }
+  pool_->Wait(&group);
 
-  int num_prev_hole_card_pairs = Game::NumHoleCardPairs(pst);
-  for (int t = 0; t < num_threads_; ++t) {
-    double *t_vals = workers_[t]->Vals();
+  for (int t = 0; t < num_pool_threads; ++t) {
+    double *t_vals = thread_vals[t].get();
+    if (t_vals == nullptr) continue;
     for (int i = 0; i < num_prev_hole_card_pairs; ++i) {
       vals[i] += t_vals[i];
     }
@@ -685,6 +743,79 @@ void VCFR::SetStreetBuckets(int st, int gbd, VCFRState *state) {
     }
     street_buckets[i] = buckets_.Bucket(st, h);
   }
+
+  if (! group_by_bucket_streets_[st]) return;
+
+  // Order the hands by bucket, and by index within a bucket, and find where each bucket begins.
+  int *bucket_order = state->StreetBucketOrder(st);
+  int *run_begins = state->StreetBucketRunBegins(st);
+  unique_ptr<long long int []> keys(new long long int[num_hole_card_pairs]);
+  for (int i = 0; i < num_hole_card_pairs; ++i) {
+    keys[i] = (((long long int)street_buckets[i]) << 32) | i;
+  }
+  std::sort(keys.get(), keys.get() + num_hole_card_pairs);
+  int num_runs = 0;
+  for (int j = 0; j < num_hole_card_pairs; ++j) {
+    bucket_order[j] = keys[j] & 0xffffffff;
+    if (j == 0 || (keys[j] >> 32) != (keys[j - 1] >> 32)) run_begins[num_runs++] = j;
+  }
+  run_begins[num_runs] = num_hole_card_pairs;
+  state->SetNumStreetBucketRuns(st, num_runs);
+}
+
+// Maps the encoding of each previous-street hand to the index of its canonical hand.
+void VCFR::PrevCanons(const CanonicalCards *pred_hands, int *prev_canons) const {
+  int num_hands = pred_hands->NumRaw();
+  Card max_card = Game::MaxCard();
+  for (int ph = 0; ph < num_hands; ++ph) {
+    if (pred_hands->NumVariants(ph) > 0) {
+      const Card *prev_cards = pred_hands->Cards(ph);
+      int prev_encoding = prev_cards[0] * (max_card + 1) +
+	prev_cards[1];
+      prev_canons[prev_encoding] = ph;
+    }
+  }
+  for (int ph = 0; ph < num_hands; ++ph) {
+    if (pred_hands->NumVariants(ph) == 0) {
+      const Card *prev_cards = pred_hands->Cards(ph);
+      int prev_encoding = prev_cards[0] * (max_card + 1) +
+	prev_cards[1];
+      int pc = prev_canons[pred_hands->Canon(ph)];
+      prev_canons[prev_encoding] = pc;
+    }
+  }
+}
+
+// Processes the successor boards ngbd_begin...ngbd_end-1 of a street-initial node and adds their
+// (unnormalized) values into vals, which is indexed by previous-street hand.
+void VCFR::ProcessSuccBoards(Node *p0_node, Node *p1_node, int pgbd, int ngbd_begin,
+			     int ngbd_end, VCFRState *state, int *prev_canons, double *vals) {
+  int nst = p0_node->Street();
+  if (split_streets_[nst] && subgame_street_ == -1 && pool_.get() != nullptr) {
+    // By default, split on the flop.
+    Split(p0_node, p1_node, ngbd_begin, ngbd_end, state, prev_canons, vals);
+    return;
+  }
+  Card max_card = Game::MaxCard();
+  for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
+    const CanonicalCards *hands = state->Hands(nst, ngbd);
+    SetStreetBuckets(nst, ngbd, state);
+    // I can pass unset values for sum_opp_probs and total_card_probs.  I
+    // know I will come across an opp choice node before getting to a terminal
+    // node.
+    shared_ptr<double []> next_vals = Process(p0_node, p1_node, ngbd, state, nst);
+
+    int board_variants = BoardTree::NumVariants(nst, ngbd);
+    int num_next_hands = hands->NumRaw();
+    for (int nh = 0; nh < num_next_hands; ++nh) {
+      const Card *cards = hands->Cards(nh);
+      Card hi = cards[0];
+      Card lo = cards[1];
+      int enc = hi * (max_card + 1) + lo;
+      int prev_canon = prev_canons[enc];
+      vals[prev_canon] += board_variants * next_vals[nh];
+    }
+  }
 }
 
 shared_ptr<double []> VCFR::StreetInitial(Node *p0_node, Node *p1_node, int pgbd,
@@ -720,50 +851,12 @@ shared_ptr<double []> VCFR::StreetInitial(Node *p0_node, Node *p1_node, int pgbd
   unique_ptr<int []> prev_canons(new int[num_encodings]);
   shared_ptr<double []> vals(new double[prev_num_hole_card_pairs]);
   for (int i = 0; i < prev_num_hole_card_pairs; ++i) vals[i] = 0;
-  for (int ph = 0; ph < prev_num_hole_card_pairs; ++ph) {
-    if (pred_hands->NumVariants(ph) > 0) {
-      const Card *prev_cards = pred_hands->Cards(ph);
-      int prev_encoding = prev_cards[0] * (max_card + 1) +
-	prev_cards[1];
-      prev_canons[prev_encoding] = ph;
-    }
-  }
-  for (int ph = 0; ph < prev_num_hole_card_pairs; ++ph) {
-    if (pred_hands->NumVariants(ph) == 0) {
-      const Card *prev_cards = pred_hands->Cards(ph);
-      int prev_encoding = prev_cards[0] * (max_card + 1) +
-	prev_cards[1];
-      int pc = prev_canons[pred_hands->Canon(ph)];
-      prev_canons[prev_encoding] = pc;
-    }
-  }
+  PrevCanons(pred_hands, prev_canons.get());
 
-  if (nst == split_street_ && subgame_street_ == -1 && num_threads_ > 1) {
-    // By default, split on the flop.
-    Split(p0_node, p1_node, pgbd, state, prev_canons.get(), vals.get());
-  } else {
-    int ngbd_begin = BoardTree::SuccBoardBegin(pst, pgbd, nst);
-    int ngbd_end = BoardTree::SuccBoardEnd(pst, pgbd, nst);
-    for (int ngbd = ngbd_begin; ngbd < ngbd_end; ++ngbd) {
-      const CanonicalCards *hands = state->Hands(nst, ngbd);
-      SetStreetBuckets(nst, ngbd, state);
-      // I can pass unset values for sum_opp_probs and total_card_probs.  I
-      // know I will come across an opp choice node before getting to a terminal
-      // node.
-      shared_ptr<double []> next_vals = Process(p0_node, p1_node, ngbd, state, nst);
-
-      int board_variants = BoardTree::NumVariants(nst, ngbd);
-      int num_next_hands = hands->NumRaw();
-      for (int nh = 0; nh < num_next_hands; ++nh) {
-	const Card *cards = hands->Cards(nh);
-	Card hi = cards[0];
-	Card lo = cards[1];
-	int enc = hi * (max_card + 1) + lo;
-	int prev_canon = prev_canons[enc];
-	vals[prev_canon] += board_variants * next_vals[nh];
-      }
-    }
-  }
+  int ngbd_begin = BoardTree::SuccBoardBegin(pst, pgbd, nst);
+  int ngbd_end = BoardTree::SuccBoardEnd(pst, pgbd, nst);
+  ProcessSuccBoards(p0_node, p1_node, pgbd, ngbd_begin, ngbd_end, state, prev_canons.get(),
+		    vals.get());
   
   // Scale down the values of the previous-street canonical hands
   double scale_down = Game::StreetPermutations(nst);
@@ -904,7 +997,6 @@ VCFR::VCFR(const CardAbstraction &ca, const CFRConfig &cc, const Buckets &bucket
   card_abstraction_(ca), cfr_config_(cc), buckets_(buckets) {
   num_threads_ = num_threads;
   subgame_street_ = cfr_config_.SubgameStreet();
-  split_street_ = 1; // Default
   soft_warmup_ = cfr_config_.SoftWarmup();
   hard_warmup_ = cfr_config_.HardWarmup();
   nn_regrets_ = cfr_config_.NNR();
@@ -917,10 +1009,26 @@ VCFR::VCFR(const CardAbstraction &ca, const CFRConfig &cc, const Buckets &bucket
   pre_phase_ = false;
 
   int max_street = Game::MaxStreet();
+  split_streets_.reset(new bool[max_street + 1]);
+  if (cfr_config_.SplitStreets().size() > 0) {
+    SetSplitStreets(cfr_config_.SplitStreets());
+  } else {
+    SetSplitStreet(1); // Default
+  }
   best_response_streets_.reset(new bool[max_street + 1]);
   for (int st = 0; st <= max_street; ++st) {
     best_response_streets_[st] = false;
   }
+  // Grouping costs a sort per board, which only pays off when the average bucket holds several
+  // hands.  A null abstraction, for example, has about one hand per bucket.
+  BoardTree::Create();
+  group_by_bucket_streets_.reset(new bool[max_street + 1]);
+  for (int st = 0; st <= max_street; ++st) {
+    long long int num_hands =
+      BoardTree::NumBoards(st) * (long long int)Game::NumHoleCardPairs(st);
+    group_by_bucket_streets_[st] = ! buckets_.None(st) &&
+      buckets_.NumBuckets(st) * kMinHandsPerBucket <= num_hands;
+  }
   
   sumprob_streets_.reset(new bool[max_street + 1]);
   const vector<int> &ssv = cfr_config_.SumprobStreets();
@@ -1004,40 +1112,9 @@ VCFR::VCFR(const CardAbstraction &ca, const CFRConfig &cc, const Buckets &bucket
     }
   }
 
-  pthread_mutex_init(&queue_mutex_, NULL);
-  pthread_mutex_init(&num_done_mutex_, NULL);
-  pthread_cond_init(&queue_not_empty_, NULL);
-  pthread_cond_init(&queue_not_full_, NULL);
-  SpawnWorkers();
+  if (num_threads_ > 1) pool_ = WorkStealingPool::Shared(num_threads_);
 }
 
 VCFR::~VCFR(void) {
-  num_done_ = 0;
-  // Add num_threads_ quit requests to the queue
-  for (int t = 0; t < num_threads_; ++t) {
-    pthread_mutex_lock(&queue_mutex_);
-    // Wait until there’s room in the queue.
-    while (request_queue_.size() == kRequestQueueMaxSize) {
-      pthread_cond_wait(&queue_not_full_, &queue_mutex_);
-    }
-    Request request(RequestType::QUIT, nullptr, nullptr, -1, nullptr, nullptr);
-    request_queue_.push(request);
-    // Inform waiting threads that queue has a request
-    pthread_cond_signal(&queue_not_empty_);
-    pthread_mutex_unlock(&queue_mutex_);
-  }
-  // There should be a better way to do this without a busy loop
-  while (true) {
-    // No mutex needed, right?
-    if (num_done_ == num_threads_) break;
-    usleep(1);
-  }
-  for (int t = 0; t < num_threads_; ++t) {
-    workers_[t]->Join();
-  }
-  pthread_mutex_destroy(&queue_mutex_);
-  pthread_mutex_destroy(&num_done_mutex_);
-  pthread_cond_destroy(&queue_not_empty_);
-  pthread_cond_destroy(&queue_not_full_);
 }
 
@@ -3,7 +3,7 @@
 
 #include <memory>
 #include <string>
-#include <queue>
+#include <vector>
 
 #include "cfr_values.h"
 #include "prob_method.h"
@@ -11,36 +11,12 @@
 class BettingAbstraction;
 class BettingTrees;
 class Buckets;
+class CanonicalCards;
 class CardAbstraction;
 class CFRConfig;
 class HandTree;
 class VCFRState;
-class VCFRWorker;
-
-enum class RequestType {
-  PROCESS,
-  QUIT
-};
-
-class Request {
-public:
-  Request(RequestType t, Node *p0_node, Node *p1_node, int gbd, const VCFRState *pred_state,
-	  int *prev_canons);
-  ~Request(void) {}
-  RequestType GetRequestType(void) const {return request_type_;}
-  Node *P0Node(void) const {return p0_node_;}
-  Node *P1Node(void) const {return p1_node_;}
-  int GBD(void) const {return gbd_;}
-  const VCFRState &PredState(void) const {return *pred_state_;}
-  int *PrevCanons(void) const {return prev_canons_;}
-private:
-  RequestType request_type_;
-  Node *p0_node_;
-  Node *p1_node_;
-  int gbd_;
-  const VCFRState *pred_state_;
-  int *prev_canons_;
-};
+class WorkStealingPool;
 
 class VCFR {
  public:
@@ -61,18 +37,10 @@ class VCFR {
   virtual void SetStreetBuckets(int st, int gbd, VCFRState *state);
   virtual void SetValueCalculation(bool b) {value_calculation_ = b;}
   virtual void SetBestResponseStreet(int st, bool b) {best_response_streets_[st] = b;}
-  virtual void SetSplitStreet(int st) {split_street_ = st;}
+  virtual void SetSplitStreet(int st);
+  virtual void SetSplitStreets(const std::vector<int> &streets);
   int It(void) const {return it_;}
-  void SpawnWorkers(void);
-  void IncrementNumDone(void);
-  std::queue<Request> *GetRequestQueue(void) {return &request_queue_;}
-  pthread_mutex_t *GetQueueMutex(void) {return &queue_mutex_;}
-  pthread_mutex_t *GetNumDoneMutex(void) {return &num_done_mutex_;}
-  pthread_cond_t *GetQueueNotEmpty(void) {return &queue_not_empty_;}
-  pthread_cond_t *GetQueueNotFull(void) {return &queue_not_full_;}
  protected:
-  static const int kRequestQueueMaxSize = 100;
-  
   template <typename T>
     void UpdateRegrets(Node *node, double *vals, std::shared_ptr<double []> *succ_vals, T *regrets);
   virtual void UpdateRegrets(Node *node, int lbd, double *vals,
@@ -81,14 +49,22 @@ class VCFR {
 				     std::shared_ptr<double []> *succ_vals, int *regrets);
   virtual void UpdateRegretsBucketed(Node *node, int *street_buckets, double *vals,
 				     std::shared_ptr<double []> *succ_vals, double *regrets);
-  virtual void UpdateRegretsBucketed(Node *node, int *street_buckets, double *vals,
+  // For streets on which the hands are grouped by bucket
+  virtual void UpdateRegretsGrouped(Node *node, const VCFRState &state, double *vals,
+				    std::shared_ptr<double []> *succ_vals, int *regrets);
+  virtual void UpdateRegretsGrouped(Node *node, const VCFRState &state, double *vals,
+				    std::shared_ptr<double []> *succ_vals, double *regrets);
+  virtual void UpdateRegretsBucketed(Node *node, const VCFRState &state, double *vals,
 				     std::shared_ptr<double []> *succ_vals);
   virtual std::shared_ptr<double []> OurChoice(Node *p0_node, Node *p1_node, int gbd,
 					       VCFRState *state);
   virtual std::shared_ptr<double []> OppChoice(Node *p0_node, Node *p1_node, int gbd,
 					       VCFRState *state);
-  virtual void Split(Node *p0_node, Node *p1_node, int pgbd, VCFRState *state,
-		     int *prev_canons, double *vals);
+  virtual void Split(Node *p0_node, Node *p1_node, int ngbd_begin, int ngbd_end,
+		     VCFRState *state, int *prev_canons, double *vals);
+  virtual void ProcessSuccBoards(Node *p0_node, Node *p1_node, int pgbd, int ngbd_begin,
+				 int ngbd_end, VCFRState *state, int *prev_canons, double *vals);
+  void PrevCanons(const CanonicalCards *pred_hands, int *prev_canons) const;
   virtual std::shared_ptr<double []> StreetInitial(Node *p0_node, Node *p1_node, int pgbd,
 						   VCFRState *state);
   virtual void InitializeOppData(VCFRState *state, int st, int gbd);
@@ -106,12 +82,17 @@ class VCFR {
   // best_response_streets_ are set to true in run_rgbr, for example.
   // Whenever some streets are best-response streets, value_calculation_ is true.
   std::unique_ptr<bool []> best_response_streets_;
+  // Streets on which the hands of each board are grouped by bucket (see SetStreetBuckets()).
+  // Elsewhere each hand is treated as a group of its own.
+  std::unique_ptr<bool []> group_by_bucket_streets_;
   bool br_current_;
   ProbMethod prob_method_;
   // value_calculation_ is true in, e.g., run_rgbr
   bool value_calculation_;
   bool prune_;
-  int split_street_;
+  // Streets on which we farm out the successor boards to the thread pool.  Splitting on more than
+  // one street (e.g., flop and turn) produces nested splits.
+  std::unique_ptr<bool []> split_streets_;
   int subgame_street_;
   bool nn_regrets_;
   int soft_warmup_;
@@ -123,29 +104,8 @@ class VCFR {
   std::unique_ptr<double []> sumprob_scaling_;
   int it_;
   bool pre_phase_;
-  std::unique_ptr<std::unique_ptr<VCFRWorker> []> workers_;
-  std::queue<Request> request_queue_;
-  pthread_mutex_t queue_mutex_;
-  pthread_mutex_t num_done_mutex_;
-  pthread_cond_t queue_not_empty_;
-  pthread_cond_t queue_not_full_;
-  int num_done_;
-};
-
-class VCFRWorker {
-public:
-  VCFRWorker(VCFR *vcfr);
-  ~VCFRWorker(void) {}
-  void Reset(int pst);
-  void HandleRequest(const Request &request);
-  void MainLoop(void);
-  void Run(void);
-  void Join(void);
-  double *Vals(void) const {return vals_.get();}
-private:
-  VCFR *vcfr_;
-  std::unique_ptr<double []> vals_;
-  pthread_t pthread_id_;
+  // Shared by all VCFR objects in the process; null when num_threads_ is 1.
+  std::shared_ptr<WorkStealingPool> pool_;
 };
 
 #endif
@@ -15,6 +15,31 @@ class VCFRState;
 
 class VCFR2Worker;
 
+enum class RequestType {
+  PROCESS,
+  QUIT
+};
+
+class Request {
+public:
+  Request(RequestType t, Node *p0_node, Node *p1_node, int gbd, const VCFRState *pred_state,
+	  int *prev_canons);
+  ~Request(void) {}
+  RequestType GetRequestType(void) const {return request_type_;}
+  Node *P0Node(void) const {return p0_node_;}
+  Node *P1Node(void) const {return p1_node_;}
+  int GBD(void) const {return gbd_;}
+  const VCFRState &PredState(void) const {return *pred_state_;}
+  int *PrevCanons(void) const {return prev_canons_;}
+private:
+  RequestType request_type_;
+  Node *p0_node_;
+  Node *p1_node_;
+  int gbd_;
+  const VCFRState *pred_state_;
+  int *prev_canons_;
+};
+
 class VCFR2 : public VCFR {
 public:
   VCFR2(const CardAbstraction &ca, const BettingAbstraction &ba, const CFRConfig &cc,
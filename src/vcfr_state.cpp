@@ -10,6 +10,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "betting_tree.h"
 #include "cfr_utils.h" // CommonBetResponseCalcs()
@@ -19,6 +20,7 @@
 
 using std::shared_ptr;
 using std::string;
+using std::vector;
 
 static shared_ptr<int []> AllocateStreetBuckets(void) {
   int max_num_hole_card_pairs = Game::NumHoleCardPairs(0);
@@ -28,6 +30,17 @@ static shared_ptr<int []> AllocateStreetBuckets(void) {
   return street_buckets;
 }
 
+void VCFRState::AllocateBucketRuns(void) {
+  int max_num_hole_card_pairs = Game::NumHoleCardPairs(0);
+  int max_street = Game::MaxStreet();
+  bucket_runs_.reset(new BucketRuns);
+  bucket_runs_->order.reset(new int[(max_street + 1) * max_num_hole_card_pairs]);
+  // With one extra entry per street for the end of the last run
+  bucket_runs_->run_begins.reset(new int[(max_street + 1) * (max_num_hole_card_pairs + 1)]);
+  bucket_runs_->num_runs.reset(new int[max_street + 1]);
+  for (int st = 0; st <= max_street; ++st) bucket_runs_->num_runs[st] = 0;
+}
+
 static shared_ptr<double []> AllocateOppProbs(void) {
   int num_hole_cards = Game::NumCardsForStreet(0);
   int max_card1 = Game::MaxCard() + 1;
@@ -49,6 +62,7 @@ VCFRState::VCFRState(int p, const HandTree *hand_tree) {
   p_ = p;
   opp_probs_ = AllocateOppProbs();
   street_buckets_ = AllocateStreetBuckets();
+  AllocateBucketRuns();
   action_sequence_ = "x";
   hand_tree_ = hand_tree;
   total_card_probs_ = nullptr;
@@ -74,6 +88,7 @@ VCFRState::VCFRState(int p, const shared_ptr<double []> &opp_probs, const HandTr
   hand_tree_ = hand_tree;
   action_sequence_ = action_sequence;
   street_buckets_ = AllocateStreetBuckets();
+  AllocateBucketRuns();
 }
 
 // Create a new VCFRState corresponding to taking an action of ours.
@@ -83,6 +98,7 @@ VCFRState::VCFRState(const VCFRState &pred, Node *node, int s) {
   hand_tree_ = pred.GetHandTree();
   action_sequence_ = pred.ActionSequence() + node->ActionName(s);
   street_buckets_ = pred.AllStreetBuckets();
+  bucket_runs_ = pred.bucket_runs_;
   total_card_probs_ = pred.TotalCardProbs();
   sum_opp_probs_ = pred.SumOppProbs();
 }
@@ -95,6 +111,7 @@ VCFRState::VCFRState(const VCFRState &pred, Node *node, int s,
   hand_tree_ = pred.GetHandTree();
   action_sequence_ = pred.ActionSequence() + node->ActionName(s);
   street_buckets_ = pred.AllStreetBuckets();
+  bucket_runs_ = pred.bucket_runs_;
   // Signifies opp data is uninitialized
   sum_opp_probs_ = -1;
   total_card_probs_ = nullptr;
@@ -104,3 +121,19 @@ int *VCFRState::StreetBuckets(int st) const {
   int max_num_hole_card_pairs = Game::NumHoleCardPairs(0);
   return street_buckets_.get() + st * max_num_hole_card_pairs;
 }
+
+int *VCFRState::StreetBucketOrder(int st) const {
+  int max_num_hole_card_pairs = Game::NumHoleCardPairs(0);
+  return bucket_runs_->order.get() + st * max_num_hole_card_pairs;
+}
+
+int *VCFRState::StreetBucketRunBegins(int st) const {
+  int max_num_hole_card_pairs = Game::NumHoleCardPairs(0);
+  return bucket_runs_->run_begins.get() + st * (max_num_hole_card_pairs + 1);
+}
+
+double *VCFRState::Scratch(int n) const {
+  vector<double> &scratch = bucket_runs_->scratch;
+  if ((int)scratch.size() < n) scratch.resize(n);
+  return scratch.data();
+}
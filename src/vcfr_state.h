@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "hand_tree.h"
 
@@ -24,6 +25,16 @@ class VCFRState {
   std::shared_ptr<double []> TotalCardProbs(void) const {return total_card_probs_;}
   int *StreetBuckets(int st) const;
   const std::shared_ptr<int []> AllStreetBuckets(void) const {return street_buckets_;}
+  // The hands of the current board on the given street ordered by bucket, so that the hands in
+  // each bucket are adjacent.  Run r is StreetBucketOrder(st)[StreetBucketRunBegins(st)[r]]...
+  // StreetBucketOrder(st)[StreetBucketRunBegins(st)[r+1]-1].  Set by VCFR::SetStreetBuckets().
+  int *StreetBucketOrder(int st) const;
+  int *StreetBucketRunBegins(int st) const;
+  int NumStreetBucketRuns(int st) const {return bucket_runs_->num_runs[st];}
+  void SetNumStreetBucketRuns(int st, int n) {bucket_runs_->num_runs[st] = n;}
+  // Scratch space of at least n doubles.  Shared with the states created from this one, so only
+  // valid until the next call from any of them.
+  double *Scratch(int n) const;
   const std::string &ActionSequence(void) const {return action_sequence_;}
   const HandTree *GetHandTree(void) const {return hand_tree_;}
   int RootSt(void) const {return hand_tree_->RootSt();}
@@ -34,11 +45,21 @@ class VCFRState {
   }
   void SetOppProbs(const std::shared_ptr<double []> &opp_probs) {opp_probs_ = opp_probs;}
  protected:
+  void AllocateBucketRuns(void);
+
   int p_;
   std::shared_ptr<double []> opp_probs_;
   double sum_opp_probs_;
   std::shared_ptr<double []> total_card_probs_;
   std::shared_ptr<int []> street_buckets_;
+  // Like street_buckets_, shared with the states created from this one
+  struct BucketRuns {
+    std::unique_ptr<int []> order;
+    std::unique_ptr<int []> run_begins;
+    std::unique_ptr<int []> num_runs;
+    std::vector<double> scratch;
+  };
+  std::shared_ptr<BucketRuns> bucket_runs_;
   std::string action_sequence_;
   const HandTree *hand_tree_;
 };
@@ -0,0 +1,211 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include "work_stealing_pool.h"
+
+using std::function;
+using std::shared_ptr;
+using std::weak_ptr;
+
+// The pool (if any) that the current thread is a worker of, and the worker's index.
+static thread_local const WorkStealingPool *tl_pool = nullptr;
+static thread_local int tl_worker = -1;
+
+TaskGroup::TaskGroup(void) : num_pending_(0) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&done_, NULL);
+}
+
+TaskGroup::~TaskGroup(void) {
+  pthread_mutex_destroy(&mutex_);
+  pthread_cond_destroy(&done_);
+}
+
+struct WorkerArgs {
+  WorkStealingPool *pool;
+  int t;
+};
+
+static void *worker_thread_run(void *v_args) {
+  WorkerArgs *args = (WorkerArgs *)v_args;
+  WorkStealingPool *pool = args->pool;
+  int t = args->t;
+  delete args;
+  pool->MainLoop(t);
+  return NULL;
+}
+
+WorkStealingPool::WorkStealingPool(int num_threads) :
+  num_threads_(num_threads), num_queued_(0), num_sleeping_(0), next_deque_(0), quit_(false) {
+  if (num_threads_ < 1) {
+    fprintf(stderr, "WorkStealingPool: num_threads must be at least 1\n");
+    exit(-1);
+  }
+  deques_.reset(new std::deque<Task>[num_threads_]);
+  deque_mutexes_.reset(new pthread_mutex_t[num_threads_]);
+  for (int t = 0; t < num_threads_; ++t) pthread_mutex_init(&deque_mutexes_[t], NULL);
+  pthread_mutex_init(&sleep_mutex_, NULL);
+  pthread_cond_init(&work_available_, NULL);
+  pthread_ids_.reset(new pthread_t[num_threads_]);
+  for (int t = 0; t < num_threads_; ++t) {
+    WorkerArgs *args = new WorkerArgs;
+    args->pool = this;
+    args->t = t;
+    pthread_create(&pthread_ids_[t], NULL, worker_thread_run, args);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool(void) {
+  pthread_mutex_lock(&sleep_mutex_);
+  quit_.store(true);
+  pthread_cond_broadcast(&work_available_);
+  pthread_mutex_unlock(&sleep_mutex_);
+  for (int t = 0; t < num_threads_; ++t) {
+    pthread_join(pthread_ids_[t], NULL);
+  }
+  for (int t = 0; t < num_threads_; ++t) pthread_mutex_destroy(&deque_mutexes_[t]);
+  pthread_mutex_destroy(&sleep_mutex_);
+  pthread_cond_destroy(&work_available_);
+}
+
+shared_ptr<WorkStealingPool> WorkStealingPool::Shared(int num_threads) {
+  static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static weak_ptr<WorkStealingPool> shared_pool;
+  pthread_mutex_lock(&shared_mutex);
+  shared_ptr<WorkStealingPool> pool = shared_pool.lock();
+  if (pool.get() == nullptr) {
+    pool.reset(new WorkStealingPool(num_threads));
+    shared_pool = pool;
+  } else if (pool->NumThreads() < num_threads) {
+    // Creating a bigger pool would leave the existing one running alongside it for as long as
+    // its holders keep it, oversubscribing the machine.
+    fprintf(stderr, "WorkStealingPool::Shared(): using the existing pool of %i threads rather "
+	    "than %i\n", pool->NumThreads(), num_threads);
+  }
+  pthread_mutex_unlock(&shared_mutex);
+  return pool;
+}
+
+int WorkStealingPool::CurrentWorker(void) const {
+  return tl_pool == this ? tl_worker : -1;
+}
+
+// Workers push onto the back of their own deque.  Other threads distribute their tasks
+// round-robin over the workers' deques.
+void WorkStealingPool::Submit(TaskGroup *group, function<void (void)> fn) {
+  group->num_pending_.fetch_add(1);
+  int t = CurrentWorker();
+  if (t == -1) t = next_deque_.fetch_add(1) % num_threads_;
+  pthread_mutex_lock(&deque_mutexes_[t]);
+  deques_[t].push_back(Task{group, std::move(fn)});
+  pthread_mutex_unlock(&deque_mutexes_[t]);
+  num_queued_.fetch_add(1);
+  if (num_sleeping_.load() > 0) {
+    pthread_mutex_lock(&sleep_mutex_);
+    pthread_cond_signal(&work_available_);
+    pthread_mutex_unlock(&sleep_mutex_);
+  }
+}
+
+// Take from the back of our own deque first (most recently submitted, so most likely to be in
+// cache) and otherwise steal from the front of another deque (the oldest, largest tasks).
+bool WorkStealingPool::GetTask(int t, Task *task) {
+  if (num_queued_.load() <= 0) return false;
+  for (int i = 0; i < num_threads_; ++i) {
+    int v = (t + i) % num_threads_;
+    pthread_mutex_lock(&deque_mutexes_[v]);
+    std::deque<Task> &dq = deques_[v];
+    if (! dq.empty()) {
+      if (v == t) {
+	*task = std::move(dq.back());
+	dq.pop_back();
+      } else {
+	*task = std::move(dq.front());
+	dq.pop_front();
+      }
+      pthread_mutex_unlock(&deque_mutexes_[v]);
+      num_queued_.fetch_sub(1);
+      return true;
+    }
+    pthread_mutex_unlock(&deque_mutexes_[v]);
+  }
+  return false;
+}
+
+void WorkStealingPool::RunTask(Task *task) {
+  task->fn();
+  // Decrement under the group's mutex so that the group cannot be destroyed by a waiter while we
+  // are still signalling it.
+  TaskGroup *group = task->group;
+  pthread_mutex_lock(&group->mutex_);
+  if (group->num_pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    pthread_cond_broadcast(&group->done_);
+  }
+  pthread_mutex_unlock(&group->mutex_);
+}
+
+void WorkStealingPool::MainLoop(int t) {
+  tl_pool = this;
+  tl_worker = t;
+  Task task;
+  while (true) {
+    if (GetTask(t, &task)) {
+      RunTask(&task);
+      continue;
+    }
+    pthread_mutex_lock(&sleep_mutex_);
+    num_sleeping_.fetch_add(1);
+    // Check again after announcing that we are sleeping so that a concurrent Submit() either
+    // sees num_sleeping_ > 0 and signals, or its task is visible to us here.
+    while (num_queued_.load() <= 0 && ! quit_.load()) {
+      pthread_cond_wait(&work_available_, &sleep_mutex_);
+    }
+    num_sleeping_.fetch_sub(1);
+    pthread_mutex_unlock(&sleep_mutex_);
+    if (quit_.load()) break;
+  }
+}
+
+void WorkStealingPool::Wait(TaskGroup *group) {
+  int t = CurrentWorker();
+  if (t >= 0) {
+    // A worker waiting on a nested group helps out until the group is done.  When there is
+    // nothing to steal the remaining tasks are running on other workers; sleep briefly on the
+    // group rather than spin.
+    Task task;
+    while (! group->Done()) {
+      if (GetTask(t, &task)) {
+	RunTask(&task);
+	continue;
+      }
+      pthread_mutex_lock(&group->mutex_);
+      if (! group->Done()) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += 100000;
+	if (deadline.tv_nsec >= 1000000000) {
+	  deadline.tv_nsec -= 1000000000;
+	  ++deadline.tv_sec;
+	}
+	pthread_cond_timedwait(&group->done_, &group->mutex_, &deadline);
+      }
+      pthread_mutex_unlock(&group->mutex_);
+    }
+    // Make sure the thread that finished the last task has released the group's mutex
+    pthread_mutex_lock(&group->mutex_);
+    pthread_mutex_unlock(&group->mutex_);
+  } else {
+    pthread_mutex_lock(&group->mutex_);
+    while (! group->Done()) {
+      pthread_cond_wait(&group->done_, &group->mutex_);
+    }
+    pthread_mutex_unlock(&group->mutex_);
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef _WORK_STEALING_POOL_H_
+#define _WORK_STEALING_POOL_H_
+
+#include <pthread.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
+// Counts the outstanding tasks that were submitted to a WorkStealingPool as one batch.
+// WorkStealingPool::Wait() returns once every task in the group has finished.
+class TaskGroup {
+public:
+  TaskGroup(void);
+  ~TaskGroup(void);
+  bool Done(void) const {return num_pending_.load(std::memory_order_acquire) == 0;}
+private:
+  friend class WorkStealingPool;
+
+  std::atomic<int> num_pending_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t done_;
+};
+
+// A fixed set of worker threads, each with its own deque of tasks.  A worker pops tasks from the
+// back of its own deque and, when that is empty, steals from the front of another worker's deque.
+// There is no global task queue; each deque has its own lock.
+//
+// Tasks may themselves submit tasks and wait for them (e.g., splitting on the flop and then
+// again on the turn).  A worker that waits on a group keeps running queued tasks until the
+// group is done, so nested splits never create more threads than the pool has.  A thread that
+// is not a pool worker simply blocks in Wait().
+class WorkStealingPool {
+public:
+  WorkStealingPool(int num_threads);
+  ~WorkStealingPool(void);
+  // Returns the pool shared by everyone in this process, creating one with num_threads threads
+  // if there is none.  If a pool already exists it is returned even if it has fewer than
+  // num_threads threads, so that there is never more than one pool running; callers should size
+  // their work by NumThreads().
+  static std::shared_ptr<WorkStealingPool> Shared(int num_threads);
+  void Submit(TaskGroup *group, std::function<void (void)> fn);
+  void Wait(TaskGroup *group);
+  int NumThreads(void) const {return num_threads_;}
+  // Index (0...NumThreads()-1) of the calling thread if it is one of this pool's workers;
+  // otherwise -1.
+  int CurrentWorker(void) const;
+  void MainLoop(int t);
+private:
+  struct Task {
+    TaskGroup *group;
+    std::function<void (void)> fn;
+  };
+
+  bool GetTask(int t, Task *task);
+  void RunTask(Task *task);
+
+  int num_threads_;
+  std::unique_ptr<std::deque<Task> []> deques_;
+  std::unique_ptr<pthread_mutex_t []> deque_mutexes_;
+  std::unique_ptr<pthread_t []> pthread_ids_;
+  std::atomic<int> num_queued_;
+  std::atomic<int> num_sleeping_;
+  std::atomic<unsigned int> next_deque_;
+  std::atomic<bool> quit_;
+  pthread_mutex_t sleep_mutex_;
+  pthread_cond_t work_available_;
+};
+
+#endif